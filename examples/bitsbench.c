@@ -0,0 +1,419 @@
+/*****************************************************************************/
+/*  LibreDWG - free implementation of the DWG file format                    */
+/*                                                                           */
+/*  Copyright (C) 2018 Free Software Foundation, Inc.                        */
+/*                                                                           */
+/*  This library is free software, licensed under the terms of the GNU       */
+/*  General Public License as published by the Free Software Foundation,     */
+/*  either version 3 of the License, or (at your option) any later version.  */
+/*  You should have received a copy of the GNU General Public License        */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.    */
+/*****************************************************************************/
+
+/*
+ * bitsbench.c: time the bit primitives of src/bits.c in ns/op.
+ * Each primitive writes and reads back a generated stream of typical
+ * values, alone and in typical field mixes, starting at every bit offset.
+ * A value which does not read back is an error.
+ */
+
+#include "../src/config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dwg.h"
+#include "../src/bits.h"
+
+/* values per stream */
+static unsigned n = 100000;
+static unsigned rounds = 3;
+
+static double *bd;       /* 0.0, 1.0 or some coordinate */
+static double *dd;       /* a polyline, each coordinate near the previous */
+static BITCODE_MC *mc;
+static BITCODE_UMC *umc;
+static Dwg_Handle *h;
+static Dwg_Color *cmc;
+static BITCODE_BL *bl;
+
+static unsigned long long seed = 0x2545F4914F6CDD1DULL;
+
+/* xorshift64*, the same stream on every run */
+static unsigned long
+rnd(unsigned long max)
+{
+  seed ^= seed >> 12;
+  seed ^= seed << 25;
+  seed ^= seed >> 27;
+  return (unsigned long)((seed * 0x2545F4914F6CDD1DULL) >> 33) % max;
+}
+
+static double
+coord(void)
+{
+  return (double)rnd(20000000) / 1000.0 - 10000.0;
+}
+
+static int
+generate(void)
+{
+  static const unsigned codes[] = { 2, 3, 4, 5, 5, 5, 6, 8, 0xa, 0xc };
+  unsigned i;
+
+  bd = (double *) calloc(n, sizeof(double));
+  dd = (double *) calloc(n, sizeof(double));
+  mc = (BITCODE_MC *) calloc(n, sizeof(BITCODE_MC));
+  umc = (BITCODE_UMC *) calloc(n, sizeof(BITCODE_UMC));
+  h = (Dwg_Handle *) calloc(n, sizeof(Dwg_Handle));
+  cmc = (Dwg_Color *) calloc(n, sizeof(Dwg_Color));
+  bl = (BITCODE_BL *) calloc(n, sizeof(BITCODE_BL));
+  if (!bd || !dd || !mc || !umc || !h || !cmc || !bl)
+    return 1;
+  for (i = 0; i < n; i++)
+    {
+      unsigned long r = rnd(10);
+      bd[i] = r < 4 ? 0.0 : r < 6 ? 1.0 : coord();
+      // DD: same, low bytes, the 6 low bytes, or all changed
+      r = rnd(4);
+      if (!i || r == 3)
+        dd[i] = coord();
+      else if (r == 0)
+        dd[i] = dd[i - 1];
+      else
+        {
+          unsigned char *p = (unsigned char *) &dd[i];
+          dd[i] = dd[i - 1];
+          p[0] = (unsigned char) rnd(256);
+          if (r == 2)
+            p[5] = (unsigned char) rnd(256);
+        }
+      r = rnd(10);
+      mc[i] = (BITCODE_MC)(r < 6 ? rnd(128) : r < 9 ? rnd(16384)
+                           : rnd(1L << 26)) - (r & 1 ? 0 : 64);
+      umc[i] = (BITCODE_UMC)(r < 8 ? 20 + rnd(2000) : rnd(1L << 24));
+      h[i].code = codes[rnd(sizeof(codes) / sizeof(codes[0]))];
+      h[i].value = r < 1 ? 0 : r < 4 ? rnd(256) : r < 9 ? rnd(65536)
+                                                : rnd(1L << 24);
+      cmc[i].index = (BITCODE_BS)(r < 5 ? 256 : rnd(257));
+      cmc[i].rgb = r < 5 ? 0xc0000000 : 0xc2000000 | rnd(0x1000000);
+      bl[i] = (BITCODE_BL)(r < 3 ? 0 : r < 5 ? 256 : rnd(1L << 20));
+    }
+  return 0;
+}
+
+static double
+now(void)
+{
+#ifdef HAVE_CLOCK_GETTIME
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+  return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/* The write and read functions of one benchmark. read returns the number
+   of values which did not read back. */
+struct bench
+{
+  const char *name;
+  Dwg_Version_Type version;
+  unsigned step; /* values per record */
+  unsigned ops;  /* primitive calls per record */
+  void (*write)(Bit_Chain *dat);
+  unsigned (*read)(Bit_Chain *dat);
+};
+
+static void
+write_BD(Bit_Chain *dat)
+{
+  unsigned i;
+  for (i = 0; i < n; i++)
+    bit_write_BD(dat, bd[i]);
+}
+static unsigned
+read_BD(Bit_Chain *dat)
+{
+  unsigned i, e = 0;
+  for (i = 0; i < n; i++)
+    e += bit_read_BD(dat) != bd[i];
+  return e;
+}
+
+static void
+write_DD(Bit_Chain *dat)
+{
+  unsigned i;
+  bit_write_RD(dat, dd[0]);
+  for (i = 1; i < n; i++)
+    bit_write_DD(dat, dd[i], dd[i - 1]);
+}
+static unsigned
+read_DD(Bit_Chain *dat)
+{
+  unsigned i, e = 0;
+  double prev = bit_read_RD(dat);
+  e += prev != dd[0];
+  for (i = 1; i < n; i++)
+    {
+      const double d = bit_read_DD(dat, prev);
+      e += d != dd[i];
+      prev = d;
+    }
+  return e;
+}
+
+static void
+write_MC(Bit_Chain *dat)
+{
+  unsigned i;
+  for (i = 0; i < n; i++)
+    bit_write_MC(dat, mc[i]);
+}
+static unsigned
+read_MC(Bit_Chain *dat)
+{
+  unsigned i, e = 0;
+  for (i = 0; i < n; i++)
+    e += bit_read_MC(dat) != mc[i];
+  return e;
+}
+
+static void
+write_UMC(Bit_Chain *dat)
+{
+  unsigned i;
+  for (i = 0; i < n; i++)
+    bit_write_UMC(dat, umc[i]);
+}
+static unsigned
+read_UMC(Bit_Chain *dat)
+{
+  unsigned i, e = 0;
+  for (i = 0; i < n; i++)
+    e += bit_read_UMC(dat) != umc[i];
+  return e;
+}
+
+static void
+write_H(Bit_Chain *dat)
+{
+  unsigned i;
+  for (i = 0; i < n; i++)
+    bit_write_H(dat, &h[i]);
+}
+static unsigned
+read_H(Bit_Chain *dat)
+{
+  unsigned i, e = 0;
+  Dwg_Handle ref;
+  for (i = 0; i < n; i++)
+    {
+      e += bit_read_H(dat, &ref) != 0
+           || ref.code != h[i].code || ref.value != h[i].value;
+    }
+  return e;
+}
+
+static void
+write_CMC(Bit_Chain *dat)
+{
+  unsigned i;
+  for (i = 0; i < n; i++)
+    bit_write_CMC(dat, &cmc[i]);
+}
+static unsigned
+read_CMC(Bit_Chain *dat)
+{
+  unsigned i, e = 0;
+  Dwg_Color color;
+  for (i = 0; i < n; i++)
+    {
+      memset(&color, 0, sizeof(color));
+      bit_read_CMC(dat, &color);
+      e += color.index != cmc[i].index
+           || (dat->version >= R_2004 && color.rgb != cmc[i].rgb);
+    }
+  return e;
+}
+
+/* The fields of a LINE */
+static void
+write_line(Bit_Chain *dat)
+{
+  unsigned i;
+  for (i = 0; i + 1 < n; i += 2)
+    {
+      bit_write_B(dat, 1); // z_is_zero
+      bit_write_RD(dat, dd[i]);
+      bit_write_DD(dat, dd[i + 1], dd[i]);
+      bit_write_RD(dat, bd[i]);
+      bit_write_DD(dat, bd[i + 1], bd[i]);
+      bit_write_BT(dat, 0.0);
+      bit_write_BE(dat, 0.0, 0.0, 1.0);
+    }
+}
+static unsigned
+read_line(Bit_Chain *dat)
+{
+  unsigned i, e = 0;
+  for (i = 0; i + 1 < n; i += 2)
+    {
+      double x, y, z;
+      e += bit_read_B(dat) != 1;
+      x = bit_read_RD(dat);
+      e += x != dd[i] || bit_read_DD(dat, x) != dd[i + 1];
+      y = bit_read_RD(dat);
+      e += y != bd[i] || bit_read_DD(dat, y) != bd[i + 1];
+      e += bit_read_BT(dat) != 0.0;
+      bit_read_BE(dat, &x, &y, &z);
+      e += x != 0.0 || y != 0.0 || z != 1.0;
+    }
+  return e;
+}
+
+/* The common entity fields */
+static void
+write_common(Bit_Chain *dat)
+{
+  unsigned i;
+  for (i = 0; i < n; i++)
+    {
+      bit_write_BL(dat, bl[i]); // num_eed
+      bit_write_B(dat, 0);      // picture_exists
+      bit_write_BB(dat, 0);     // entmode
+      bit_write_BL(dat, 0);     // num_reactors
+      bit_write_CMC(dat, &cmc[i]);
+      bit_write_BD(dat, bd[i]); // linetype_scale
+      bit_write_BB(dat, 0);     // linetype_flags
+      bit_write_BB(dat, 0);     // plotstyle_flags
+      bit_write_BS(dat, 0);     // invisible
+      bit_write_RC(dat, 0x1d);  // lineweight
+      bit_write_H(dat, &h[i]);  // layer
+    }
+}
+static unsigned
+read_common(Bit_Chain *dat)
+{
+  unsigned i, e = 0;
+  Dwg_Color color;
+  Dwg_Handle ref;
+  for (i = 0; i < n; i++)
+    {
+      e += bit_read_BL(dat) != bl[i];
+      e += bit_read_B(dat) != 0;
+      e += bit_read_BB(dat) != 0;
+      e += bit_read_BL(dat) != 0;
+      bit_read_CMC(dat, &color);
+      e += color.index != cmc[i].index;
+      e += bit_read_BD(dat) != bd[i];
+      e += bit_read_BB(dat) != 0;
+      e += bit_read_BB(dat) != 0;
+      e += bit_read_BS(dat) != 0;
+      e += bit_read_RC(dat) != 0x1d;
+      e += bit_read_H(dat, &ref) != 0 || ref.value != h[i].value;
+    }
+  return e;
+}
+
+static const struct bench benches[] = {
+  { "BD", R_2000, 1, 1, write_BD, read_BD },
+  { "DD chain", R_2000, 1, 1, write_DD, read_DD },
+  { "MC", R_2000, 1, 1, write_MC, read_MC },
+  { "UMC", R_2000, 1, 1, write_UMC, read_UMC },
+  { "H", R_2000, 1, 1, write_H, read_H },
+  { "CMC", R_2000, 1, 1, write_CMC, read_CMC },
+  { "CMC r2004", R_2004, 1, 1, write_CMC, read_CMC },
+  { "LINE fields", R_2000, 2, 7, write_line, read_line },
+  { "entity fields", R_2000, 1, 11, write_common, read_common },
+};
+
+/* Returns the number of read errors */
+static unsigned
+run(const struct bench *b)
+{
+  Bit_Chain dat;
+  double twrite = 0.0, tread = 0.0;
+  unsigned long bits = 0;
+  unsigned errors = 0;
+  unsigned r, off;
+  const unsigned ops = n / b->step * b->ops;
+
+  memset(&dat, 0, sizeof(dat));
+  dat.version = dat.from_version = b->version;
+  bit_chain_alloc(&dat);
+  for (r = 0; r < rounds; r++)
+    for (off = 0; off < 8; off++)
+      {
+        double t;
+        unsigned long start;
+
+        dat.byte = 0;
+        dat.bit = 0;
+        bit_advance_position(&dat, off);
+        start = bit_position(&dat);
+        t = now();
+        b->write(&dat);
+        twrite += now() - t;
+        bits = bit_position(&dat) - start;
+
+        bit_set_position(&dat, start);
+        t = now();
+        errors += b->read(&dat);
+        tread += now() - t;
+      }
+  printf("%-14s %10.2f %10.2f %10.1f\n", b->name,
+         twrite * 1e9 / ops / rounds / 8, tread * 1e9 / ops / rounds / 8,
+         (double)bits / ops);
+  if (errors)
+    printf("%-14s %u values did not read back\n", b->name, errors);
+  free(dat.chain);
+  return errors;
+}
+
+static int usage(void) {
+  printf("\nUsage: bitsbench [-n COUNT] [-r ROUNDS]\n"
+         "Writes and reads COUNT typical values (default 100000) per bit\n"
+         "primitive and field mix, at each of the 8 start bit offsets,\n"
+         "ROUNDS times (default 3), and prints the mean ns per call.\n");
+  return 1;
+}
+
+int
+main(int argc, char *argv[])
+{
+  unsigned i, errors = 0;
+
+  for (i = 1; i < (unsigned)argc; i++)
+    {
+      if (i + 1 < (unsigned)argc && !strcmp(argv[i], "-n"))
+        n = (unsigned)atoi(argv[++i]);
+      else if (i + 1 < (unsigned)argc && !strcmp(argv[i], "-r"))
+        rounds = (unsigned)atoi(argv[++i]);
+      else
+        return usage();
+    }
+  if (n < 2 || !rounds)
+    return usage();
+  if (generate())
+    {
+      fprintf(stderr, "Out of memory\n");
+      return 1;
+    }
+
+  printf("%-14s %10s %10s %10s\n", "", "write ns", "read ns", "bits");
+  for (i = 0; i < sizeof(benches) / sizeof(benches[0]); i++)
+    errors += run(&benches[i]);
+
+  free(bd);
+  free(dd);
+  free(mc);
+  free(umc);
+  free(h);
+  free(cmc);
+  free(bl);
+  return errors ? 1 : 0;
+}
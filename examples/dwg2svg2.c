@@ -35,6 +35,7 @@ static int opts = 0;
 static dwg_data g_dwg;
 static double model_xmin, model_ymin;
 static double page_width, page_height, scale;
+static Dwg_Tessellation g_tess;
 
 static int usage(void) {
   printf("\nUsage: dwg2svg2 [-v[0-9]] DWGFILE\n");
@@ -89,6 +90,7 @@ test_SVG(char *filename)
   if (error < DWG_ERR_CRITICAL)
     output_SVG(&g_dwg);
 
+  dwg_free_tessellation(&g_tess);
   dwg_free(&g_dwg);
   /* This value is the return value for `main',
      so clamp it to either 0 or 1.  */
@@ -102,7 +104,7 @@ output_TEXT(dwg_object* obj)
   dwg_point_2d ins_pt;
   Dwg_Entity_TEXT* text;
   char * text_value;
-  double fontsize;
+  double fontsize, elevation, ocs[9];
 
   index = dwg_object_get_index(obj, &error);
   log_if_error("object_get_index");
@@ -116,6 +118,9 @@ output_TEXT(dwg_object* obj)
   log_if_error("text_get_insertion_point");
   fontsize = dwg_ent_text_get_height(text, &error);
   log_if_error("text_get_height");
+  elevation = text->elevation;
+  if (dwg_entity_ocs(obj, ocs))
+    dwg_ocs_to_wcs(ocs, 1, &ins_pt.x, &ins_pt.y, &elevation);
 
   /*TODO: Juca, fix it properly: */
   if (text_value[0] == '&') return;
@@ -149,6 +154,33 @@ output_LINE(dwg_object* obj)
       transform_Y(end.y));
 }
 
+/* the curves and faces via their tessellation */
+static void
+output_path(dwg_object* obj)
+{
+  int error, index;
+  BITCODE_BL i, j;
+
+  index = dwg_object_get_index(obj, &error);
+  log_if_error("object_get_index");
+  if (dwg_tessellate(obj, 0.0, &g_tess) || !g_tess.num_points)
+    return;
+  printf("\t<path id=\"dwg-object-%d\" d=\"", index);
+  for (i = 0; i < g_tess.num_parts; i++)
+    {
+      const BITCODE_BL to = i + 1 < g_tess.num_parts ? g_tess.parts[i + 1]
+                                                   : g_tess.num_points;
+      for (j = g_tess.parts[i]; j < to; j++)
+        printf("%s%f,%f", j == g_tess.parts[i] ? "M " : " L ",
+               transform_X(g_tess.x[j]), transform_Y(g_tess.y[j]));
+      if (g_tess.closed[i])
+        printf(" Z");
+      if (i + 1 < g_tess.num_parts)
+        printf(" ");
+    }
+  printf("\" fill=\"none\" stroke=\"blue\" stroke-width=\"%f\" />\n", 0.1);
+}
+
 static void
 output_CIRCLE(dwg_object* obj)
 {
@@ -156,7 +188,14 @@ output_CIRCLE(dwg_object* obj)
   int error, index;
   double radius;
   dwg_point_3d center;
-  
+  double ocs[9];
+
+  // in another OCS, maybe an ellipse in the projection
+  if (dwg_entity_ocs(obj, ocs))
+    {
+      output_path(obj);
+      return;
+    }
   index = dwg_object_get_index(obj, &error);
   log_if_error("object_get_index");
   circle = dwg_object_to_CIRCLE(obj);
@@ -172,43 +211,6 @@ output_CIRCLE(dwg_object* obj)
       index, transform_X(center.x), transform_Y(center.y), radius);
 }
 
-static void
-output_ARC(dwg_object* obj)
-{
-  Dwg_Entity_ARC* arc;
-  int error, index;
-  double radius, start_angle, end_angle;
-  dwg_point_3d center;
-  double x_start, y_start, x_end, y_end;
-  int large_arc;
-  
-  index = dwg_object_get_index(obj, &error);
-  log_if_error("object_get_index");
-  arc = dwg_object_to_ARC(obj);
-  if (!arc) {
-    error = 1; log_if_error("dwg_object_to_ARC");
-  }
-  radius = dwg_ent_arc_get_radius(arc, &error);
-  log_if_error("arc_get_radius");
-  start_angle = dwg_ent_arc_get_start_angle(arc, &error);
-  log_if_error("arc_get_start_angle");
-  end_angle = dwg_ent_arc_get_end_angle(arc, &error);
-  log_if_error("arc_get_end_angle");
-  dwg_ent_arc_get_center(arc, &center, &error);
-  log_if_error("arc_get_center");
-      
-  x_start = center.x + radius * cos(start_angle);
-  y_start = center.y + radius * sin(start_angle);
-  x_end = center.x + radius * cos(end_angle);
-  y_end = center.y + radius * sin(end_angle);
-  //Assuming clockwise arcs.
-  large_arc = (end_angle - start_angle < 3.1415) ? 0 : 1;
-  printf(
-      "\t<path id=\"dwg-object-%d\" d=\"M %f,%f A %f,%f 0 %d 0 %f,%f\" fill=\"none\" stroke=\"blue\" stroke-width=\"%f\" />\n",
-      index, transform_X(x_start), transform_Y(y_start), radius, radius,
-      large_arc, transform_X(x_end), transform_Y(y_end), 0.1);
-}
-
 static void
 output_INSERT(dwg_object* obj)
 {
@@ -218,6 +220,8 @@ output_INSERT(dwg_object* obj)
   dwg_ent_insert* insert;
   dwg_point_3d ins_pt, _scale;
   dwg_handle *obj_handle, *ins_handle;
+  double ocs[9];
+  char matrix[128] = "";
 
   insert = dwg_object_to_INSERT(obj);
   if (!insert) {
@@ -231,6 +235,13 @@ output_INSERT(dwg_object* obj)
   log_if_error("insert_get_ins_pt");
   dwg_ent_insert_get_scale(insert, &_scale, &error);
   log_if_error("insert_get_scale");
+  if (dwg_entity_ocs(obj, ocs))
+    {
+      // the OCS xy axes projected to the WCS xy plane
+      dwg_ocs_to_wcs(ocs, 1, &ins_pt.x, &ins_pt.y, &ins_pt.z);
+      snprintf(matrix, sizeof(matrix), "matrix(%f %f %f %f 0 0) ", ocs[0],
+               ocs[1], ocs[3], ocs[4]);
+    }
   obj_handle = dwg_object_get_handle(obj, &error);
   log_if_error("get_handle");
   ins_handle = &obj->handle;
@@ -241,9 +252,9 @@ output_INSERT(dwg_object* obj)
   if (insert->block_header->handleref.code == 5)
     {
       printf(
-          "\t<use id=\"dwg-object-%d\" transform=\"translate(%f %f) rotate(%f) scale(%f %f)\" xlink:href=\"#symbol-%lu\" /><!-- block_header->handleref: %d.%d.%lu -->\n",
+          "\t<use id=\"dwg-object-%d\" transform=\"translate(%f %f) %srotate(%f) scale(%f %f)\" xlink:href=\"#symbol-%lu\" /><!-- block_header->handleref: %d.%d.%lu -->\n",
           index,
-          transform_X(ins_pt.x), transform_Y(ins_pt.y),
+          transform_X(ins_pt.x), transform_Y(ins_pt.y), matrix,
           (180.0 / M_PI) * rotation, _scale.x, _scale.y, abs_ref,
           ins_handle->code, ins_handle->size, ins_handle->value);
     }
@@ -284,9 +295,21 @@ output_object(dwg_object* obj){
       output_TEXT(obj);
     }
 
-  if (dwg_object_get_type(obj)== DWG_TYPE_ARC)
+  switch (dwg_object_get_fixedtype(obj))
     {
-      output_ARC(obj);
+    case DWG_TYPE_ARC:
+    case DWG_TYPE_ELLIPSE:
+    case DWG_TYPE_SPLINE:
+    case DWG_TYPE_LWPOLYLINE:
+    case DWG_TYPE_POLYLINE_2D:
+    case DWG_TYPE_POLYLINE_3D:
+    case DWG_TYPE_SOLID:
+    case DWG_TYPE_TRACE:
+    case DWG_TYPE__3DFACE:
+      output_path(obj);
+      break;
+    default:
+      break;
     }
 }
 
@@ -0,0 +1,404 @@
+/*****************************************************************************/
+/*  LibreDWG - free implementation of the DWG file format                    */
+/*                                                                           */
+/*  Copyright (C) 2018 Free Software Foundation, Inc.                        */
+/*                                                                           */
+/*  This library is free software, licensed under the terms of the GNU       */
+/*  General Public License as published by the Free Software Foundation,     */
+/*  either version 3 of the License, or (at your option) any later version.  */
+/*  You should have received a copy of the GNU General Public License        */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.    */
+/*****************************************************************************/
+
+/*
+ * dwgbench.c: time decode, encode and the exports of the given DWG's, and
+ * count their allocations with a counting allocator.
+ * Appends one JSON line per file and one summary line per run to the
+ * output file, so runs of different builds can be compared.
+ * Used by make bench.
+ */
+
+#include "../src/config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef HAVE_SYS_RESOURCE_H
+# include <sys/resource.h>
+#endif
+#ifdef HAVE_FORK
+# include <unistd.h>
+# include <sys/wait.h>
+#endif
+
+#include "dwg.h"
+#include "bits.h"
+#ifndef DISABLE_DXF
+# include "out_dxf.h"
+# include "out_json.h"
+#endif
+
+#define TMPFILE "dwgbench.tmp.dwg"
+
+enum bench_stage { DECODE, ENCODE, DXF, JSON, GEOJSON, NUM_STAGES };
+static const char *const stage_names[NUM_STAGES] = {
+  "decode", "encode", "dxf", "json", "geojson" };
+
+struct bench_sum
+{
+  unsigned files;
+  unsigned errors;
+  unsigned long long bytes;
+  unsigned long long objects;
+  unsigned long long allocs;
+  double time[NUM_STAGES];
+};
+
+static int usage(void) {
+  printf("\nUsage: dwgbench [-n ITERATIONS] [-o OUTFILE] [-l LABEL] DWGFILE...\n"
+         "Times the decode, the R2000 encode and the DXF, JSON and GeoJSON\n"
+         "exports of each DWGFILE, the best of ITERATIONS (default 3),\n"
+         "counts the allocations of the decode and the exports,\n"
+         "and appends the results as JSON lines to OUTFILE (default bench.json).\n");
+  return 1;
+}
+
+static double
+now(void)
+{
+#ifdef HAVE_CLOCK_GETTIME
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+  return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/* in KB, or 0 if unknown */
+static long
+peak_rss(void)
+{
+#if defined(HAVE_SYS_RESOURCE_H) && defined(HAVE_GETRUSAGE)
+  struct rusage ru;
+  if (!getrusage(RUSAGE_SELF, &ru))
+# ifdef __APPLE__
+    return ru.ru_maxrss / 1024;
+# else
+    return ru.ru_maxrss;
+# endif
+#endif
+  return 0;
+}
+
+/* str as a quoted JSON string */
+static void
+json_string(FILE *out, const char *str)
+{
+  const unsigned char *p;
+  putc('"', out);
+  for (p = (const unsigned char *)str; *p; p++)
+    {
+      if (*p == '"' || *p == '\\')
+        fprintf(out, "\\%c", *p);
+      else if (*p < 0x20)
+        fprintf(out, "\\u%04x", *p);
+      else
+        putc(*p, out);
+    }
+  putc('"', out);
+}
+
+/* The allocator of the benchmarked dwg, counting the malloc, calloc and
+   realloc calls into ctx. The decoder calls it from all its threads. */
+static void *
+count_malloc(void *ctx, size_t size)
+{
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+  (*(unsigned long long *)ctx)++;
+  return malloc(size);
+}
+
+static void *
+count_calloc(void *ctx, size_t nmemb, size_t size)
+{
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+  (*(unsigned long long *)ctx)++;
+  return calloc(nmemb, size);
+}
+
+static void *
+count_realloc(void *ctx, void *ptr, size_t size)
+{
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+  (*(unsigned long long *)ctx)++;
+  return realloc(ptr, size);
+}
+
+static void
+count_free(void *ctx, void *ptr)
+{
+  (void)ctx;
+  free(ptr);
+}
+
+static double
+mb_per_s(unsigned long long bytes, double t)
+{
+  return t > 0.0 ? bytes / t / 1e6 : 0.0;
+}
+
+#ifndef DISABLE_DXF
+static int
+export(enum bench_stage stage, Dwg_Data *dwg, FILE *fh)
+{
+  Bit_Chain dat;
+  memset(&dat, 0, sizeof(Bit_Chain));
+  dat.fh = fh;
+  dat.version = dat.from_version = dwg->header.version;
+  rewind(fh);
+  if (stage == DXF)
+    return dwg_write_dxf(&dat, dwg);
+  else if (stage == JSON)
+    return dwg_write_json(&dat, dwg);
+  else
+    return dwg_write_geojson(&dat, dwg);
+}
+#endif
+
+#ifdef USE_WRITE
+/* Encode dwg as R2000 into a temporary file, and set its time. The encoder
+   still crashes on some newer DWG's, so with fork it runs in a child. */
+static int
+encode(Dwg_Data *dwg, double *t)
+{
+  int error;
+# ifdef HAVE_FORK
+  int fd[2], status;
+  pid_t pid;
+
+  if (pipe(fd))
+    return DWG_ERR_IOERROR;
+  pid = fork();
+  if (pid < 0)
+    {
+      close(fd[0]);
+      close(fd[1]);
+      return DWG_ERR_IOERROR;
+    }
+  if (pid > 0)
+    {
+      close(fd[1]);
+      if (read(fd[0], t, sizeof(double)) != sizeof(double)
+          || read(fd[0], &error, sizeof(int)) != sizeof(int))
+        {
+          *t = -1.0;
+          error = DWG_ERR_INTERNALERROR; // crashed
+        }
+      close(fd[0]);
+      waitpid(pid, &status, 0);
+      remove(TMPFILE);
+      return error;
+    }
+  close(fd[0]);
+# endif
+  remove(TMPFILE);
+  *t = now();
+  error = dwg_write_file(TMPFILE, dwg);
+  *t = now() - *t;
+# ifdef HAVE_FORK
+  if (write(fd[1], t, sizeof(double)) != sizeof(double)
+      || write(fd[1], &error, sizeof(int)) != sizeof(int))
+    _exit(1);
+  _exit(0);
+# else
+  remove(TMPFILE);
+  return error;
+# endif
+}
+#endif
+
+/* The best time of n runs per stage. Returns the decode error. */
+static int
+bench_file(const char *filename, int n, FILE *fh, FILE *out,
+           struct bench_sum *sum)
+{
+  Dwg_Data dwg;
+  double t[NUM_STAGES];
+  int error = 0, err[NUM_STAGES];
+  unsigned long long bytes, count, allocs[NUM_STAGES];
+  int i, s;
+  FILE *fp;
+
+  fp = fopen(filename, "rb");
+  if (!fp)
+    {
+      fprintf(stderr, "Could not open file: %s\n", filename);
+      sum->errors++;
+      return DWG_ERR_IOERROR;
+    }
+  fseek(fp, 0, SEEK_END);
+  bytes = (unsigned long long)ftell(fp);
+  fclose(fp);
+
+  for (s = 0; s < NUM_STAGES; s++)
+    {
+      t[s] = -1.0;
+      err[s] = 0;
+      allocs[s] = 0;
+    }
+  for (i = 0; i < n; i++)
+    {
+      double start;
+      memset(&dwg, 0, sizeof(Dwg_Data));
+      count = 0;
+      dwg_set_allocator(&dwg, count_malloc, count_calloc, count_realloc,
+                        count_free, &count);
+      start = now();
+      error = dwg_read_file(filename, &dwg);
+      start = now() - start;
+      allocs[DECODE] = count;
+      if (t[DECODE] < 0.0 || start < t[DECODE])
+        t[DECODE] = start;
+      err[DECODE] = error;
+      if (error >= DWG_ERR_CRITICAL)
+        {
+          dwg_free(&dwg);
+          break;
+        }
+#ifndef DISABLE_DXF
+      for (s = DXF; s <= GEOJSON; s++)
+        {
+          count = 0;
+          start = now();
+          err[s] = export((enum bench_stage)s, &dwg, fh);
+          start = now() - start;
+          allocs[s] = count;
+          if (t[s] < 0.0 || start < t[s])
+            t[s] = start;
+        }
+#endif
+#ifdef USE_WRITE
+      // last, as it changes the version of dwg
+      if (dwg.header.version >= R_13)
+        {
+          if (dwg.header.from_version != dwg.header.version)
+            dwg.header.from_version = dwg.header.version;
+          dwg.header.version = R_2000;
+          err[ENCODE] = encode(&dwg, &start);
+          dwg.header.version = dwg.header.from_version;
+          if (start >= 0.0 && (t[ENCODE] < 0.0 || start < t[ENCODE]))
+            t[ENCODE] = start;
+        }
+#endif
+      if (i == n - 1)
+        {
+          sum->objects += dwg.num_objects;
+          sum->allocs += allocs[DECODE];
+          fprintf(out, "{\"file\":");
+          json_string(out, filename);
+          fprintf(out, ",\"bytes\":%llu,\"objects\":%u,\"allocs\":%llu",
+                  bytes, (unsigned)dwg.num_objects, allocs[DECODE]);
+          if (t[DECODE] > 0.0)
+            fprintf(out, ",\"decode_MBps\":%.3f,\"objects_per_s\":%.0f",
+                    mb_per_s(bytes, t[DECODE]), dwg.num_objects / t[DECODE]);
+        }
+      dwg_free(&dwg);
+    }
+  if (error >= DWG_ERR_CRITICAL)
+    {
+      fprintf(out, "{\"file\":");
+      json_string(out, filename);
+      fprintf(out, ",\"bytes\":%llu", bytes);
+      sum->errors++;
+    }
+  for (s = 0; s < NUM_STAGES; s++)
+    {
+      if (t[s] >= 0.0)
+        {
+          fprintf(out, ",\"%s_s\":%.6f", stage_names[s], t[s]);
+          if (s >= DXF) // the decode ones are "allocs"
+            fprintf(out, ",\"%s_allocs\":%llu", stage_names[s], allocs[s]);
+          sum->time[s] += t[s];
+        }
+      if (err[s])
+        fprintf(out, ",\"%s_error\":%d", stage_names[s], err[s]);
+    }
+  fprintf(out, "}\n");
+  sum->files++;
+  sum->bytes += bytes;
+  return error;
+}
+
+int
+main(int argc, char *argv[])
+{
+  const char *outfile = "bench.json";
+  const char *label = "";
+  struct bench_sum sum;
+  FILE *out, *fh;
+  int n = 3;
+  int i, s;
+
+  for (i = 1; i < argc && argv[i][0] == '-'; i++)
+    {
+      if (!argv[i][1] || argv[i][2] || i + 1 >= argc)
+        return usage();
+      if (argv[i][1] == 'n')
+        n = atoi(argv[++i]);
+      else if (argv[i][1] == 'o')
+        outfile = argv[++i];
+      else if (argv[i][1] == 'l')
+        label = argv[++i];
+      else
+        return usage();
+    }
+  if (i == argc || n < 1)
+    return usage();
+
+  out = fopen(outfile, "a");
+  if (!out)
+    {
+      fprintf(stderr, "Could not open file: %s\n", outfile);
+      return 1;
+    }
+  fh = tmpfile();
+  if (!fh)
+    {
+      fprintf(stderr, "Could not create a temporary file\n");
+      fclose(out);
+      return 1;
+    }
+  memset(&sum, 0, sizeof(sum));
+  for (; i < argc; i++)
+    bench_file(argv[i], n, fh, out, &sum);
+  fclose(fh);
+
+  fprintf(out, "{\"label\":");
+  json_string(out, label);
+  fprintf(out, ",\"package_version\":\"%s\",\"date\":%lu,"
+          "\"files\":%u,\"errors\":%u,\"bytes\":%llu,\"objects\":%llu,"
+          "\"allocs\":%llu,\"peak_rss_kb\":%ld,"
+          "\"decode_MBps\":%.3f,\"objects_per_s\":%.0f",
+          PACKAGE_VERSION, (unsigned long)time(NULL), sum.files,
+          sum.errors, sum.bytes, sum.objects, sum.allocs, peak_rss(),
+          mb_per_s(sum.bytes, sum.time[DECODE]),
+          sum.time[DECODE] > 0.0 ? sum.objects / sum.time[DECODE] : 0.0);
+  for (s = 0; s < NUM_STAGES; s++)
+    fprintf(out, ",\"%s_s\":%.6f", stage_names[s], sum.time[s]);
+  fprintf(out, "}\n");
+  fclose(out);
+
+  printf("%-6s %3u files %8.3f MB/s %10.0f objects/s %8ld KB peak RSS "
+         "%10llu allocs\n", label, sum.files,
+         mb_per_s(sum.bytes, sum.time[DECODE]),
+         sum.time[DECODE] > 0.0 ? sum.objects / sum.time[DECODE] : 0.0,
+         peak_rss(), sum.allocs);
+  return sum.errors ? 1 : 0;
+}
@@ -25,6 +25,7 @@
 
 /* for uint64_t, but not in swig */
 #ifndef SWIGIMPORTED
+# include <stddef.h>
 /* with autotools you get better int types, esp. on 64bit */
 # ifdef HAVE_STDINT_H
 #  include <stdint.h>
@@ -458,8 +459,27 @@ typedef struct _dwg_object_ref
   struct _dwg_object* obj;
   Dwg_Handle handleref;
   long unsigned int absolute_ref;
+  BITCODE_BL generation; /*!< _dwg_struct::ref_generation when obj was resolved */
 } Dwg_Object_Ref;
 
+/**
+ Reverse reference: dwg->object[owner] holds a handle to some target
+ object. See dwg_referrers().
+
+ Used as \ref Dwg_Referrer
+ */
+typedef struct _dwg_referrer
+{
+  BITCODE_BL owner; /*!< index into dwg->object[], or DWG_REFERRER_HEADER */
+  unsigned int code; /*!< handleref.code: 2 soft owner, 3 hard owner,
+                        4 soft pointer, 5 hard pointer, >5 relative */
+} Dwg_Referrer;
+
+/* The owner of handles in the header variables, not an object */
+#define DWG_REFERRER_HEADER ((BITCODE_BL)-1)
+/* in dwg->opts: build the referrers while decoding */
+#define DWG_OPTS_REFERRERS 0x20
+
 /**
  CMC colors: color index or rgb value. layers are off when the index is negative.
  Used as \ref Dwg_Color
@@ -5022,6 +5042,26 @@ typedef struct _dwg_entity_eed
   char* raw; /* a copy of data */
 } Dwg_Eed;
 
+/**
+ An axis-aligned bounding box in WCS, see dwg_entity_extents()
+ */
+typedef struct _dwg_bbox
+{
+  BITCODE_3BD min;
+  BITCODE_3BD max;
+} Dwg_Bbox;
+
+/**
+ The state of the extents cached in Dwg_Object_Entity
+ */
+typedef enum DWG_EXTENTS_STATE
+{
+  DWG_EXTENTS_UNKNOWN = 0, /* not computed yet, or reset */
+  DWG_EXTENTS_VALID,       /* in Dwg_Object_Entity.extents */
+  DWG_EXTENTS_NONE,        /* no finite geometry */
+  DWG_EXTENTS_BUSY         /* a block, while computing its entities */
+} Dwg_Extents_State;
+
 /**
  Common entity attributes
  */
@@ -5155,6 +5195,10 @@ typedef struct _dwg_object_entity
   BITCODE_H full_visualstyle; /*!< r2010+ */
   BITCODE_H face_visualstyle;
   BITCODE_H edge_visualstyle;
+
+  /* Not in the file, cached by dwg_entity_extents() */
+  Dwg_Bbox extents;
+  BITCODE_RC extents_state; /* Dwg_Extents_State */
 } Dwg_Object_Entity;
 
 /**
@@ -5447,9 +5491,155 @@ typedef struct
   Dwg_Section **sections;
 } Dwg_Section_Info;
 
+/**
+ A run of the objects of one type in type_objects, owned by one block.
+ The objects of no block are last, with block (BITCODE_BL)-1.
+ */
+typedef struct _dwg_type_group
+{
+  BITCODE_BL block; /*!< object[] index of the owning BLOCK_HEADER */
+  BITCODE_BL first; /*!< into type_objects */
+} Dwg_Type_Group;
+
+/* all fixed types, and the UNKNOWN_ENT and UNKNOWN_OBJ objects */
+#define DWG_TYPE_INDEX_SIZE (DWG_TYPE_XREFPANELOBJECT + 3)
+
 /**
  Main DWG struct
  */
+/**
+ Log sink, called with one or more complete lines of log output.
+ msg is not NUL-terminated.
+ */
+typedef void (*Dwg_Log_Callback) (void *data, const char *msg, size_t len);
+
+/**
+ Memory allocator, see dwg_set_allocator(). ctx is passed to each call.
+ */
+typedef struct _dwg_allocator
+{
+  void *(*malloc_fn) (void *ctx, size_t size);
+  void *(*calloc_fn) (void *ctx, size_t nmemb, size_t size); /* optional */
+  void *(*realloc_fn) (void *ctx, void *ptr, size_t size);
+  void (*free_fn) (void *ctx, void *ptr);
+  void *ctx;
+} Dwg_Allocator;
+
+/**
+ Decode phases, for the wall times in Dwg_Stats.
+ R2007 only fills HEADER, HANDLES and TOTAL, its rest is in OTHER.
+ */
+typedef enum DWG_PHASE
+{
+  DWG_PHASE_OTHER,       /* not attributed to the others */
+  DWG_PHASE_HEADER,      /* file header and header variables */
+  DWG_PHASE_SECTION_MAP, /* R2004+: section page map and section info */
+  DWG_PHASE_CLASSES,
+  DWG_PHASE_DECOMPRESS,  /* R2004+: all read_2004_compressed_section */
+  DWG_PHASE_OBJECT_MAP,  /* the handles section with the object offsets */
+  DWG_PHASE_OBJECTS,     /* decoding the objects */
+  DWG_PHASE_HANDLES,     /* resolve_objectref_vector */
+  DWG_PHASE_TOTAL,       /* dwg_decode */
+  DWG_NUM_PHASES
+} Dwg_Phase;
+
+/** Number of decoded objects per type in Dwg_Stats */
+typedef struct _dwg_stats_type
+{
+  enum DWG_OBJECT_TYPE fixedtype;
+  const char *name;      /* the dxfname */
+  BITCODE_BL count;
+} Dwg_Stats_Type;
+
+/**
+ Decode costs per type, with opts 0x40. Unknown objects are counted per
+ class, with fixedtype DWG_TYPE_UNKNOWN_OBJ or _ENT.
+ */
+typedef struct _dwg_profile_type
+{
+  enum DWG_OBJECT_TYPE fixedtype;
+  const char *name;      /* the dxfname, or of the class */
+  BITCODE_BL count;
+  BITCODE_BL errors;     /* objects decoded with some error */
+  BITCODE_RLL bytes;     /* sum of obj->size */
+  BITCODE_RLL ticks;     /* TSC cycles, or nanoseconds without TSC */
+  BITCODE_RLL allocs;    /* malloc, calloc and realloc calls */
+} Dwg_Profile_Type;
+
+/**
+ Statistics of the last dwg_decode(), see dwg_stats().
+ */
+typedef struct _dwg_stats
+{
+  double time[DWG_NUM_PHASES];     /* wall time in seconds */
+  double section_time[SECTION_UNKNOWN + 1]; /* R2004+: per Dwg_Section_Type */
+  BITCODE_RLL bytes_decompressed;  /* R2004+ */
+  BITCODE_BL num_pages;            /* R2004+: compressed pages read */
+  BITCODE_BL num_refs;             /* handle refs created */
+  BITCODE_BL num_allocs;           /* malloc, calloc and realloc calls of
+                                      the decoder, on all threads */
+  BITCODE_BL num_unknown_objects;  /* objects not decoded, as UNKNOWN_* */
+  BITCODE_BL num_unhandled_classes; /* classes of these objects */
+  BITCODE_BL num_types;
+  Dwg_Stats_Type *types;           /* ordered by fixedtype */
+  BITCODE_BL num_profile;
+  Dwg_Profile_Type *profile;       /* with opts 0x40, most expensive first */
+} Dwg_Stats;
+
+/** Heap bytes of the objects of one type in Dwg_Memory_Report */
+typedef struct _dwg_memory_type
+{
+  enum DWG_OBJECT_TYPE fixedtype;
+  const char *name;      /* the dxfname */
+  BITCODE_BL count;
+  BITCODE_RLL bytes;     /* the structs, vectors and strings of the objects */
+  BITCODE_RLL strings;   /* of those the strings */
+} Dwg_Memory_Type;
+
+#define DWG_MEMORY_NUM_TYPES DWG_TYPE_INDEX_SIZE
+
+/**
+ Heap memory held by a Dwg_Data, see dwg_memory_usage(). These are the
+ requested sizes, without the overhead of the allocator.
+ */
+typedef struct _dwg_memory_report
+{
+  BITCODE_RLL total;       /* the sum of all below, without strings */
+  BITCODE_RLL objects;     /* the object[] array and types[].bytes */
+  BITCODE_RLL strings;     /* the strings of the objects and header variables */
+  BITCODE_RLL extents;     /* of the objects the extents cached in the entities */
+  BITCODE_RLL header;      /* the header variables */
+  BITCODE_RLL handles;     /* object_ref, its refs and owners */
+  BITCODE_RLL object_map;  /* the handle hash */
+  BITCODE_RLL indices;     /* the referrers, owned, layer and type indices */
+  BITCODE_RLL rtrees;      /* the R-trees of the blocks */
+  BITCODE_RLL sections;    /* section, section_info and the handlers */
+  BITCODE_RLL classes;     /* dwg_class and its names */
+  BITCODE_RLL picture;     /* the preview */
+  BITCODE_RLL stats;       /* the types and profile of Dwg_Stats */
+  BITCODE_BL num_types;
+  Dwg_Memory_Type types[DWG_MEMORY_NUM_TYPES]; /* the largest first */
+} Dwg_Memory_Report;
+
+/**
+ The points of a curve or face entity as polylines, see dwg_tessellate().
+ x, y and z are separate arrays, so that transforms run over them in
+ vectorized loops. A part with a single point is a POINT.
+ */
+typedef struct _dwg_tessellation
+{
+  BITCODE_BL num_points;
+  double *x;
+  double *y;
+  double *z;
+  BITCODE_BL num_parts;
+  BITCODE_BL *parts;      /* the index of the first point of each polyline */
+  BITCODE_B *closed;      /* per part: a ring, the last point repeats the first */
+  BITCODE_BL size_points; /* allocated */
+  BITCODE_BL size_parts;
+  const struct _dwg_struct *dwg; /* with the allocator of the arrays */
+} Dwg_Tessellation;
+
 typedef struct _dwg_struct
 {
   struct Dwg_Header
@@ -5559,7 +5749,22 @@ typedef struct _dwg_struct
   BITCODE_BL num_object_refs;    /*!< number of object_ref's (resolved handles) */
   Dwg_Object_Ref **object_ref;   /*!< array of all handles */
   struct _inthash *object_map;   /*!< map of all handles */
-  int dirty_refs; /* 1 if we added an entity, and invalidated all the internal ref->obj's */
+  BITCODE_BL ref_generation;     /*!< bumped when object[] moved, invalidating older ref->obj's */
+  BITCODE_BL *object_ref_owner;  /*!< object[] index holding object_ref[i] */
+  BITCODE_BL *referrers_start;   /*!< reverse index: num_objects+1 offsets into referrers */
+  Dwg_Referrer *referrers;       /*!< reverse index, grouped by target object */
+  BITCODE_BL *owned_start;       /*!< block index: num_objects+1 offsets into owned */
+  BITCODE_BL *owned;             /*!< object[] indices owned by each BLOCK_HEADER */
+  BITCODE_BL *layered_start;     /*!< layer index: num_objects+1 offsets into layered */
+  BITCODE_BL *layered;           /*!< entity object[] indices grouped by their LAYER */
+  BITCODE_BL *type_start;        /*!< type index: DWG_TYPE_INDEX_SIZE+1 offsets into type_objects */
+  BITCODE_BL *type_objects;      /*!< object[] indices by type, then by owning block */
+  BITCODE_BL *type_groups_start; /*!< DWG_TYPE_INDEX_SIZE+1 offsets into type_groups */
+  struct _dwg_type_group *type_groups; /*!< the runs of one block in type_objects */
+  void **type_tio;               /*!< the tio of each group, NULL terminated */
+  Dwg_Object_Entity **entities;  /*!< all entities, NULL terminated */
+  BITCODE_BL num_rtree;          /*!< size of rtree */
+  struct _dwg_rtree **rtree;     /*!< spatial index by BLOCK_HEADER object[] index */
 
   Dwg_Object * mspace_block;
   Dwg_Object * pspace_block;
@@ -5602,7 +5807,14 @@ typedef struct _dwg_struct
 
   long unsigned int measurement;
   unsigned int layout_number;
-  unsigned int opts; /* 0xf: loglevel, ... */
+  unsigned int opts; /* 0xf: loglevel, 0x10: minimal, 0x20: referrers,
+                        0x40: profile, 0x80: compact JSON, ... */
+  Dwg_Log_Callback log_callback; /* NULL: stderr */
+  void *log_data;
+  Dwg_Allocator allocator; /* zero: the C library */
+  double tolerance; /* chord tolerance of tessellated curves in drawing units,
+                       0: 0.1% of the radius */
+  Dwg_Stats stats;
 } Dwg_Data;
 
 /*--------------------------------------------------
@@ -5622,6 +5834,185 @@ dwg_write_file(const char *restrict filename, const Dwg_Data *restrict dwg);
 EXPORT unsigned char*
 dwg_bmp(const Dwg_Data *restrict, BITCODE_RL *restrict);
 
+/** Redirect the log output of all calls on dwg to callback, or back to
+    stderr with NULL. The log level is still taken from dwg->opts.
+    Each thread buffers its log lines, so concurrent calls on different
+    dwg's do not interleave.
+ */
+EXPORT void
+dwg_set_log_callback(Dwg_Data *dwg, Dwg_Log_Callback callback, void *data);
+
+/** Allocate and free all memory of dwg with these functions. Without
+    malloc_fn, realloc_fn or free_fn the C library is used. calloc_fn may
+    be NULL. Set it before reading into dwg, and keep it until
+    dwg_free(). Each call on dwg installs it only for the calling thread
+    and its worker threads, and restores the previous one on return.
+    Memory returned by the API getters, e.g. converted strings, is not
+    part of dwg: free it with dwg_free_mem().
+    When malloc_fn, calloc_fn or realloc_fn return NULL, e.g. when a
+    memory budget of ctx is exceeded, the decoder stops with
+    DWG_ERR_OUTOFMEM. The partially decoded dwg can still be freed.
+ */
+EXPORT void
+dwg_set_allocator(Dwg_Data *dwg,
+                  void *(*malloc_fn) (void *ctx, size_t size),
+                  void *(*calloc_fn) (void *ctx, size_t nmemb, size_t size),
+                  void *(*realloc_fn) (void *ctx, void *ptr, size_t size),
+                  void (*free_fn) (void *ctx, void *ptr),
+                  void *ctx);
+
+/** Free memory returned by the API, e.g. by dwg_ent_lwpline_get_points()
+    or the converted strings of dwg_ent_get_*() */
+EXPORT void
+dwg_free_mem(void *ptr);
+
+/** Phase timings and counters of the last decode of dwg */
+EXPORT const Dwg_Stats *
+dwg_stats(const Dwg_Data *dwg);
+
+/** Fill report with the heap memory held by dwg, per object type and
+    per table. The objects are walked by their spec fields, as dwg_free()
+    does. Returns 0, or DWG_ERR_INVALIDDWG without dwg or report.
+ */
+EXPORT int
+dwg_memory_usage(const Dwg_Data *dwg, Dwg_Memory_Report *report);
+
+/** Tessellate the entity obj into out: LINE, POINT, ARC, CIRCLE, ELLIPSE,
+    SPLINE, the polylines, SOLID, TRACE and 3DFACE. The curves deviate
+    at most tolerance drawing units from their chords, with 0 at most
+    0.1% of the radius, or of the extent of the spline control points.
+    A SPLINE with only fit points is the C2 cubic through them, with
+    its knots at their chord lengths.
+    The points are in the WCS, the planar entities are transformed from
+    their OCS by dwg_entity_ocs().
+    out must be zeroed before the first call, its arrays are reused by
+    the next calls. Free them with dwg_free_tessellation().
+    Returns 0, DWG_ERR_INVALIDTYPE for other objects, or DWG_ERR_OUTOFMEM.
+ */
+EXPORT int
+dwg_tessellate(const Dwg_Object *restrict obj, double tolerance,
+               Dwg_Tessellation *restrict out);
+EXPORT void
+dwg_free_tessellation(Dwg_Tessellation *tess);
+
+/** The OCS of the extrusion by the arbitrary axis algorithm into m,
+    the OCS x, y and z axes in WCS at m[0], m[3] and m[6].
+    The matrices of the last extrusions are cached per thread.
+    Returns 1, or 0 when the OCS is the WCS and m the identity.
+ */
+EXPORT int
+dwg_ocs_matrix(const BITCODE_3BD *restrict extrusion, double m[9]);
+/** Transform the n points in x, y, z in place by m from dwg_ocs_matrix(). */
+EXPORT void
+dwg_ocs_to_wcs(const double m[9], BITCODE_BL n, double *restrict x,
+               double *restrict y, double *restrict z);
+/** The extrusion of the entities with coordinates in their OCS:
+    CIRCLE, ARC, LWPOLYLINE, POLYLINE_2D, TEXT, ATTRIB, ATTDEF, INSERT,
+    MINSERT, SOLID, TRACE, SHAPE and HATCH. NULL for the others.
+ */
+EXPORT const BITCODE_3BD *
+dwg_entity_extrusion(const Dwg_Object *obj);
+/** dwg_ocs_matrix() of the extrusion of obj, 0 for the WCS */
+EXPORT int
+dwg_entity_ocs(const Dwg_Object *obj, double m[9]);
+
+/** The WCS bounding box of the geometric entity obj. Curves are bounded
+    exactly, splines and the old 2D polylines by their tessellation,
+    texts by their height and number of characters, INSERT's by the
+    transformed box of their block, which is cached in its BLOCK entity.
+    A HELIX is bounded by the cylinder around its axis, 3DSOLID, REGION
+    and BODY by their wireframe only, the ACIS data is not evaluated.
+    The result is cached in the entity, until dwg_reset_extents() or
+    dwg_compute_all_extents(). Call dwg_reset_extents() after editing it.
+    Returns 0, DWG_ERR_INVALIDTYPE for objects without finite geometry,
+    such as the unbounded XLINE and RAY or a solid without wires, or
+    DWG_ERR_OUTOFMEM.
+ */
+EXPORT int
+dwg_entity_extents(const Dwg_Object *restrict obj, Dwg_Bbox *restrict bbox);
+/** Compute the extents of all entities anew, in parallel, and the union
+    of the model space entities into model, when not NULL. model is
+    empty, with min > max, without any.
+    Returns 0, DWG_ERR_INVALIDDWG or DWG_ERR_OUTOFMEM.
+ */
+EXPORT int
+dwg_compute_all_extents(Dwg_Data *dwg, Dwg_Bbox *restrict model);
+/** Forget the cached extents of the edited entity obj, and those of all
+    INSERT's, DIMENSION's and BLOCK's, which may include it.
+ */
+EXPORT void
+dwg_reset_extents(Dwg_Object *obj);
+
+/**
+ Packed R-tree over the extents of the entities of one block, bulk
+ loaded by Sort-Tile-Recursive. boxes holds the leaves first, then
+ each level of nodes up to the root, which is last.
+
+ Used as \ref Dwg_RTree
+ */
+typedef struct _dwg_rtree
+{
+  BITCODE_BL block;         /*!< object[] index of the BLOCK_HEADER */
+  BITCODE_BL num_objects;   /*!< of the DWG, to check serialized trees */
+  BITCODE_BL num_items;     /*!< number of leaves, the entities */
+  BITCODE_BL num_boxes;     /*!< leaves and nodes */
+  BITCODE_BS node_size;     /*!< max. children per node */
+  BITCODE_BS num_levels;    /*!< including the leaves */
+  BITCODE_BL level_end[32]; /*!< end of each level in boxes */
+  Dwg_Bbox *boxes;
+  BITCODE_BL *indices;      /*!< leaves: object[] index, nodes: first child */
+} Dwg_RTree;
+
+/** Called for each entity found, return non-zero to stop the query. */
+typedef int (*Dwg_Query_Callback) (Dwg_Object *obj, void *data);
+
+/** The spatial index of the BLOCK_HEADER or LAYOUT block, NULL for the
+    model space. Built on the first use, and kept until dwg_free() or
+    dwg_free_rtrees(). Entities without extents are not in the index.
+    Returns NULL on errors.
+ */
+EXPORT const Dwg_RTree *
+dwg_rtree(Dwg_Data *dwg, const Dwg_Object *block);
+/** Compute all extents and build the spatial indices of all blocks,
+    in parallel. Needed before querying from several threads.
+    Returns 0, DWG_ERR_INVALIDDWG or DWG_ERR_OUTOFMEM.
+ */
+EXPORT int
+dwg_build_rtrees(Dwg_Data *dwg);
+/** Free all spatial indices, e.g. after changing entities. */
+EXPORT void
+dwg_free_rtrees(Dwg_Data *dwg);
+/** Call cb for each entity of block (NULL: model space) whose extents
+    intersect bbox, in no particular order. For 2D queries set the z
+    range of bbox to -HUGE_VAL..HUGE_VAL.
+    Returns 0, DWG_ERR_INVALIDTYPE, DWG_ERR_INVALIDDWG or DWG_ERR_OUTOFMEM.
+ */
+EXPORT int
+dwg_query_bbox(Dwg_Data *dwg, const Dwg_Object *block,
+               const Dwg_Bbox *restrict bbox, Dwg_Query_Callback cb,
+               void *data);
+/** The k entities of block (NULL: model space) nearest to pt in the
+    XY plane, by the distance to their extents, nearest first.
+    result and the optional dist hold k entries, num the found ones.
+    Returns 0, DWG_ERR_INVALIDTYPE, DWG_ERR_INVALIDDWG or DWG_ERR_OUTOFMEM.
+ */
+EXPORT int
+dwg_query_nearest(Dwg_Data *dwg, const Dwg_Object *block,
+                  const BITCODE_2RD *restrict pt, BITCODE_BL k,
+                  Dwg_Object **restrict result, double *restrict dist,
+                  BITCODE_BL *restrict num);
+/** Write tree into buf, in the native byte order, when size is large
+    enough. Returns the needed size.
+ */
+EXPORT size_t
+dwg_rtree_serialize(const Dwg_RTree *restrict tree, unsigned char *restrict buf,
+                    size_t size);
+/** Read a tree written by dwg_rtree_serialize() for the same DWG,
+    and use it for its block.
+    Returns 0, DWG_ERR_INVALIDDWG for a mismatch or DWG_ERR_OUTOFMEM.
+ */
+EXPORT int
+dwg_rtree_deserialize(Dwg_Data *dwg, const unsigned char *buf, size_t size);
 EXPORT double dwg_model_x_min(const Dwg_Data *);
 EXPORT double dwg_model_x_max(const Dwg_Data *);
 EXPORT double dwg_model_y_min(const Dwg_Data *);
@@ -5666,6 +6057,8 @@ dwg_obj_is_table(const Dwg_Object *obj);
 EXPORT BITCODE_BL
 dwg_get_num_entities(const Dwg_Data *);
 
+/** All entities, as NULL terminated view of the type index.
+    Builds the index if needed. Do not free it. */
 EXPORT Dwg_Object_Entity **
 dwg_get_entities(const Dwg_Data *);
 
@@ -5689,6 +6082,53 @@ get_first_owned_object(const Dwg_Object *restrict hdr);
 EXPORT Dwg_Object*
 get_next_owned_object(const Dwg_Object *restrict hdr,
                       const Dwg_Object *restrict current);
+
+/**
+ External iterator over the entities owned by a BLOCK_HEADER.
+ Keeps its own cursor, so several may walk the same block at once,
+ nested or from different threads.
+
+ Used as \ref Dwg_Owned_Iter
+ */
+typedef struct _dwg_owned_iter
+{
+  const Dwg_Object *hdr;
+  const BITCODE_BL *list; /*!< the precomputed dwg->owned slice, or NULL */
+  BITCODE_BL num;         /*!< number of owned positions, an upper bound
+                               for the R13-R2000 chain without list */
+  BITCODE_BL i;           /*!< next position */
+  struct _dwg_object *next; /*!< R13-R2000 without list: next object */
+  struct _dwg_object *last;
+  int chain;              /*!< follow next_entity, last is before first in object[] */
+  int mode;               /*!< the entity_mode of the block's entities */
+} Dwg_Owned_Iter;
+
+/** Initialize it for the BLOCK_HEADER hdr. Returns 0 or DWG_ERR_INVALIDTYPE.
+*/
+EXPORT int
+dwg_owned_iter_init(Dwg_Owned_Iter *restrict it,
+                    const Dwg_Object *restrict hdr);
+/** Returns the next owned object, or NULL at the end.
+*/
+EXPORT Dwg_Object*
+dwg_owned_iter_next(Dwg_Owned_Iter *it);
+
+/** Build the contiguous per-block arrays of owned entity indices,
+    from first_entity..last_entity (R13-R2000) or entities[] (R2004+).
+    Only the entities of the block itself, not the ATTRIB's, VERTEX's or
+    SEQEND's of its complex entities.
+    Done automatically while decoding. Invalidated by dwg_add_object().
+    Returns 0 or DWG_ERR_OUTOFMEM.
+*/
+EXPORT int
+dwg_build_owned_index(Dwg_Data *dwg);
+
+/** Returns the object[] indices owned by the BLOCK_HEADER hdr,
+    and its count in num. NULL if empty or the index was not built.
+*/
+EXPORT const BITCODE_BL *
+dwg_owned_objects(const Dwg_Object *restrict hdr, BITCODE_BL *restrict num);
+
 EXPORT Dwg_Object*
 get_first_owned_block(const Dwg_Object *hdr);
 EXPORT Dwg_Object*
@@ -5705,6 +6145,63 @@ dwg_resolve_handleref(Dwg_Object_Ref *restrict ref,
 EXPORT Dwg_Section_Type
 dwg_section_type(const DWGCHAR *wname);
 
+/** Build the reverse reference index from the object_ref vector.
+    Done automatically while decoding with opts & DWG_OPTS_REFERRERS.
+    Invalidated by dwg_add_object().
+    Returns 0 or DWG_ERR_OUTOFMEM.
+*/
+EXPORT int
+dwg_build_referrers(Dwg_Data *dwg);
+
+/** Returns the objects referencing the given handle, and its count in num.
+    NULL if there are none, or the index was not built.
+*/
+EXPORT const Dwg_Referrer *
+dwg_referrers(const Dwg_Data *restrict dwg, const BITCODE_BL handle,
+              BITCODE_BL *restrict num);
+
+/** Build the per-layer index of the entities, from their layer handles.
+    Done automatically while decoding. Invalidated by dwg_add_object(),
+    and then rebuilt by dwg_get_entities_on_layer() on its next call.
+    Returns 0 or DWG_ERR_OUTOFMEM.
+*/
+EXPORT int
+dwg_build_layer_index(Dwg_Data *dwg);
+
+/** Returns the object[] indices of all entities on the LAYER with the
+    given handle, also in blocks, in object order, and its count in num.
+    Builds the index if needed. NULL if there are none, or out of memory.
+*/
+EXPORT const BITCODE_BL *
+dwg_get_entities_on_layer(const Dwg_Data *restrict dwg,
+                          const BITCODE_BL handle, BITCODE_BL *restrict num);
+
+/** Build the type index of all objects, grouped by their owning block,
+    and the views of dwg_get_entities() and the dwg_get_<TYPE> getters.
+    Done automatically while decoding. Invalidated by dwg_add_object(),
+    and then rebuilt by these getters on their next call.
+    Returns 0 or DWG_ERR_OUTOFMEM.
+*/
+EXPORT int
+dwg_build_type_index(Dwg_Data *dwg);
+
+/** Returns the object[] indices of all objects of the given type,
+    in the order of their owning blocks, then the unowned ones, and its
+    count in num. Builds the index if needed. NULL if there are none, or
+    out of memory.
+*/
+EXPORT const BITCODE_BL *
+dwg_get_objects_by_type(const Dwg_Data *restrict dwg,
+                        const Dwg_Object_Type type, BITCODE_BL *restrict num);
+
+/** Returns the tio of the entities of the given type owned by the
+    BLOCK_HEADER hdr, as NULL terminated view. Builds the index if
+    needed. NULL if there are none. Do not free it.
+*/
+EXPORT void **
+dwg_get_block_entities_by_type(const Dwg_Object *restrict hdr,
+                               const Dwg_Object_Type type);
+
 /** Free the whole DWG. all tables, sections, objects, ...
 */
 EXPORT void
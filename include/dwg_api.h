@@ -57,34 +57,15 @@ typedef struct _dwg_LWPLINE_widths
 EXPORT \
 Dwg_Entity_##token **dwg_get_##token (Dwg_Object_Ref * hdr);
 
-/* Checks now also variable classes */
+/* A NULL terminated view into the type index. Do not free it. */
 #define GET_DWG_ENTITY(token) \
 EXPORT \
 Dwg_Entity_##token **dwg_get_##token (Dwg_Object_Ref * hdr) \
 { \
-  int x=0, counts=0; \
-  Dwg_Entity_##token ** ret_##token; \
-  Dwg_Object * obj = get_first_owned_object(hdr->obj); \
-  while (obj) \
-    { \
-      if (obj->type == DWG_TYPE_##token || obj->fixedtype == DWG_TYPE_##token) \
-        counts++; \
-      obj = get_next_owned_object(hdr->obj, obj); \
-    } \
-  if (!counts) \
+  if (!hdr) \
     return NULL; \
-  ret_##token = (Dwg_Entity_##token **)malloc (counts * sizeof(Dwg_Entity_##token *));\
-  obj = get_first_owned_object(hdr->obj); \
-  while (obj) \
-    { \
-      if (obj->type == DWG_TYPE_##token || obj->fixedtype == DWG_TYPE_##token) \
-        { \
-          ret_##token[x] = obj->tio.entity->tio.token; \
-          x++; \
-        } \
-        obj = get_next_owned_object(hdr->obj, obj); \
-    } \
-  return ret_##token; \
+  return (Dwg_Entity_##token **)dwg_get_block_entities_by_type ( \
+      hdr->obj, DWG_TYPE_##token); \
 }
 
 // Cast a Dwg_Object to Entity
@@ -39,6 +39,7 @@ static int opts = 0;
 Dwg_Data g_dwg;
 double model_xmin, model_ymin;
 double page_width, page_height, scale;
+static Dwg_Tessellation g_tess;
 
 static void output_SVG(Dwg_Data* dwg);
 
@@ -85,13 +86,17 @@ static void
 output_TEXT(Dwg_Object* obj)
 {
   Dwg_Entity_TEXT* text = obj->tio.entity->tio.TEXT;
+  double x = text->insertion_pt.x, y = text->insertion_pt.y;
+  double z = text->elevation, ocs[9];
 
   /*TODO: Juca, fix it properly: */
   if (text->text_value[0] == '&') return;
 
+  if (dwg_entity_ocs(obj, ocs))
+    dwg_ocs_to_wcs(ocs, 1, &x, &y, &z);
   printf(
       "\t<text id=\"dwg-object-%d\" x=\"%f\" y=\"%f\" font-family=\"Verdana\" font-size=\"%f\" fill=\"blue\">%s</text>\n",
-      obj->index, transform_X(text->insertion_pt.x), transform_Y(text->insertion_pt.y),
+      obj->index, transform_X(x), transform_Y(y),
       text->height /* fontsize */, text->text_value);
 }
 
@@ -104,30 +109,43 @@ output_LINE(Dwg_Object* obj)
       obj->index, transform_X(line->start.x), transform_Y(line->start.y), transform_X(line->end.x), transform_Y(line->end.y));
 }
 
+/* curves and faces as their tessellation, one subpath per part */
 static void
-output_CIRCLE(Dwg_Object* obj)
+output_path(Dwg_Object* obj)
 {
-  Dwg_Entity_CIRCLE* circle = obj->tio.entity->tio.CIRCLE;
-  printf(
-      "\t<circle id=\"dwg-object-%d\" cx=\"%f\" cy=\"%f\" r=\"%f\" fill=\"none\" stroke=\"blue\" stroke-width=\"0.1px\" />\n",
-      obj->index, transform_X(circle->center.x), transform_Y(circle->center.y), circle->radius);
+  BITCODE_BL i, j;
+  if (dwg_tessellate(obj, 0.0, &g_tess) || !g_tess.num_points)
+    return;
+  printf("\t<path id=\"dwg-object-%d\" d=\"", obj->index);
+  for (i = 0; i < g_tess.num_parts; i++)
+    {
+      const BITCODE_BL to = i + 1 < g_tess.num_parts ? g_tess.parts[i + 1]
+                                                     : g_tess.num_points;
+      for (j = g_tess.parts[i]; j < to; j++)
+        printf("%s%f,%f", j == g_tess.parts[i] ? "M " : " L ",
+               transform_X(g_tess.x[j]), transform_Y(g_tess.y[j]));
+      if (g_tess.closed[i])
+        printf(" Z");
+      if (i + 1 < g_tess.num_parts)
+        printf(" ");
+    }
+  printf("\" fill=\"none\" stroke=\"blue\" stroke-width=\"0.1px\" />\n");
 }
 
 static void
-output_ARC(Dwg_Object* obj)
+output_CIRCLE(Dwg_Object* obj)
 {
-  Dwg_Entity_ARC* arc = obj->tio.entity->tio.ARC;
-  double x_start = arc->center.x + arc->radius * cos(arc->start_angle);
-  double y_start = arc->center.y + arc->radius * sin(arc->start_angle);
-  double x_end = arc->center.x + arc->radius * cos(arc->end_angle);
-  double y_end = arc->center.y + arc->radius * sin(arc->end_angle);
-  //Assuming clockwise arcs.
-  int large_arc = (arc->end_angle - arc->start_angle < 3.1415) ? 0 : 1;
-
+  Dwg_Entity_CIRCLE* circle = obj->tio.entity->tio.CIRCLE;
+  double ocs[9];
+  // in another OCS, maybe an ellipse in the projection
+  if (dwg_entity_ocs(obj, ocs))
+    {
+      output_path(obj);
+      return;
+    }
   printf(
-      "\t<path id=\"dwg-object-%d\" d=\"M %f,%f A %f,%f 0 %d 0 %f,%f\" fill=\"none\" stroke=\"blue\" stroke-width=\"%f\" />\n",
-      obj->index, transform_X(x_start), transform_Y(y_start), arc->radius, arc->radius,
-      large_arc, transform_X(x_end), transform_Y(y_end), 0.1);
+      "\t<circle id=\"dwg-object-%d\" cx=\"%f\" cy=\"%f\" r=\"%f\" fill=\"none\" stroke=\"blue\" stroke-width=\"0.1px\" />\n",
+      obj->index, transform_X(circle->center.x), transform_Y(circle->center.y), circle->radius);
 }
 
 static void
@@ -136,11 +154,21 @@ output_INSERT(Dwg_Object* obj)
   Dwg_Entity_INSERT* insert = obj->tio.entity->tio.INSERT;
   if (insert->block_header && insert->block_header->handleref.value)
     {
+      double x = insert->ins_pt.x, y = insert->ins_pt.y;
+      double z = insert->ins_pt.z, ocs[9];
+      char matrix[128] = "";
+      if (dwg_entity_ocs(obj, ocs))
+        {
+          // the OCS xy axes projected to the WCS xy plane
+          dwg_ocs_to_wcs(ocs, 1, &x, &y, &z);
+          snprintf(matrix, sizeof(matrix), "matrix(%f %f %f %f 0 0) ",
+                   ocs[0], ocs[1], ocs[3], ocs[4]);
+        }
       printf("\t<use id=\"dwg-object-%d\" transform=\"translate(%f %f) "
-             "rotate(%f) scale(%f %f)\" xlink:href=\"#symbol-%lu\" />"
+             "%srotate(%f) scale(%f %f)\" xlink:href=\"#symbol-%lu\" />"
              "<!-- block_header->handleref: %d.%d.%lu -->\n",
              obj->index,
-             transform_X(insert->ins_pt.x), transform_Y(insert->ins_pt.y),
+             transform_X(x), transform_Y(y), matrix,
              (180.0 / M_PI) * insert->rotation, insert->scale.x, insert->scale.y,
              insert->block_header->absolute_ref,
              insert->block_header->handleref.code,
@@ -162,16 +190,34 @@ output_object(Dwg_Object* obj){
       return;
     }
 
-  if (obj->type == DWG_TYPE_INSERT)
-    output_INSERT(obj);
-  else if (obj->type == DWG_TYPE_LINE)
-    output_LINE(obj);
-  else if (obj->type == DWG_TYPE_CIRCLE)
-    output_CIRCLE(obj);
-  else if (obj->type == DWG_TYPE_TEXT)
-    output_TEXT(obj);
-  else if (obj->type == DWG_TYPE_ARC)
-    output_ARC(obj);
+  switch ((int)obj->fixedtype)
+    {
+    case DWG_TYPE_INSERT:
+      output_INSERT(obj);
+      break;
+    case DWG_TYPE_LINE:
+      output_LINE(obj);
+      break;
+    case DWG_TYPE_CIRCLE:
+      output_CIRCLE(obj);
+      break;
+    case DWG_TYPE_TEXT:
+      output_TEXT(obj);
+      break;
+    case DWG_TYPE_ARC:
+    case DWG_TYPE_ELLIPSE:
+    case DWG_TYPE_SPLINE:
+    case DWG_TYPE_LWPOLYLINE:
+    case DWG_TYPE_POLYLINE_2D:
+    case DWG_TYPE_POLYLINE_3D:
+    case DWG_TYPE_SOLID:
+    case DWG_TYPE_TRACE:
+    case DWG_TYPE__3DFACE:
+      output_path(obj);
+      break;
+    default:
+      break;
+    }
 }
 
 static
@@ -179,6 +225,7 @@ void output_BLOCK_HEADER(Dwg_Object_Ref* ref)
 {
   Dwg_Object* obj;
   Dwg_Object_BLOCK_HEADER* hdr;
+  Dwg_Owned_Iter it;
 
   if (!ref)
     {
@@ -208,11 +255,10 @@ void output_BLOCK_HEADER(Dwg_Object_Ref* ref)
   printf(
       "\t<g id=\"symbol-%lu\" >\n\t\t<!-- %s -->\n", ref->absolute_ref, hdr->entry_name);
 
-  obj = get_first_owned_object(ref->obj);
-  while (obj)
+  dwg_owned_iter_init(&it, ref->obj);
+  while ((obj = dwg_owned_iter_next(&it)))
     {
       output_object(obj);
-      obj = get_next_owned_object(ref->obj, obj);
     }
 
   printf("\t</g>\n");
@@ -224,13 +270,24 @@ output_SVG(Dwg_Data* dwg)
   BITCODE_BS i;
   Dwg_Object *obj;
   Dwg_Object_BLOCK_CONTROL* block_control;
+  Dwg_Bbox model;
   double dx, dy;
 
-  model_xmin = dwg_model_x_min(dwg);
-  model_ymin = dwg_model_y_min(dwg);
-
-  dx = (dwg_model_x_max(dwg) - dwg_model_x_min(dwg));
-  dy = (dwg_model_y_max(dwg) - dwg_model_y_min(dwg));
+  // the header EXTMIN/EXTMAX are often stale
+  if (!dwg_compute_all_extents(dwg, &model) && model.min.x <= model.max.x)
+    {
+      model_xmin = model.min.x;
+      model_ymin = model.min.y;
+      dx = model.max.x - model.min.x;
+      dy = model.max.y - model.min.y;
+    }
+  else
+    {
+      model_xmin = dwg_model_x_min(dwg);
+      model_ymin = dwg_model_y_min(dwg);
+      dx = (dwg_model_x_max(dwg) - dwg_model_x_min(dwg));
+      dy = (dwg_model_y_max(dwg) - dwg_model_y_min(dwg));
+    }
   //double scale_x = dx / (dwg_page_x_max(dwg) - dwg_page_x_min(dwg));
   //double scale_y = dy / (dwg_page_y_max(dwg) - dwg_page_y_min(dwg));
   //scale = 25.4 / 72; // pt:mm
@@ -360,6 +417,7 @@ main(int argc, char *argv[])
   if (error < DWG_ERR_CRITICAL)
     output_SVG(&g_dwg);
 
+  dwg_free_tessellation(&g_tess);
   dwg_free(&g_dwg);
   return error >= DWG_ERR_CRITICAL ? 1 : 0;
 }
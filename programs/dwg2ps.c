@@ -35,6 +35,7 @@
 #include "suffix.inc"
 
 static int opts = 0;
+static Dwg_Tessellation tess;
 
 static int usage(void) {
   printf("\nUsage: dwg2ps [-v[0-9]] DWGFILE [PSFILE]\n");
@@ -63,6 +64,26 @@ static int help(void) {
   return 0;
 }
 
+/* curves and faces as their tessellation, one subpath per part */
+static void
+ps_tessellation(PSDoc *ps, Dwg_Object *obj)
+{
+  BITCODE_BL i, j;
+  if (dwg_tessellate(obj, 0.0, &tess) || !tess.num_points)
+    return;
+  for (i = 0; i < tess.num_parts; i++)
+    {
+      const BITCODE_BL to = i + 1 < tess.num_parts ? tess.parts[i + 1]
+                                                   : tess.num_points;
+      PS_moveto(ps, (float)tess.x[tess.parts[i]], (float)tess.y[tess.parts[i]]);
+      for (j = tess.parts[i] + 1; j < to; j++)
+        PS_lineto(ps, (float)tess.x[j], (float)tess.y[j]);
+      if (tess.closed[i])
+        PS_closepath(ps);
+    }
+  PS_stroke(ps);
+}
+
 static void
 create_postscript(Dwg_Data *dwg, char *output)
 {
@@ -71,6 +92,7 @@ create_postscript(Dwg_Data *dwg, char *output)
   double scale_x;
   double scale_y;
   double scale;
+  double ocs[9];
   BITCODE_BL i;
   //FILE *fh;
   PSDoc *ps;
@@ -129,7 +151,7 @@ create_postscript(Dwg_Data *dwg, char *output)
         continue;
       //if (obj->tio.entity->entity_mode == 0) // belongs to block
       //  continue;
-      if (obj->type == DWG_TYPE_LINE)
+      if (obj->fixedtype == DWG_TYPE_LINE)
         {
           Dwg_Entity_LINE* line;
           line = obj->tio.entity->tio.LINE;
@@ -137,33 +159,15 @@ create_postscript(Dwg_Data *dwg, char *output)
           PS_lineto(ps, (float)line->end.x, (float)line->end.y);
           PS_stroke(ps);
         }
-      else if (obj->type == DWG_TYPE_POLYLINE_2D)
-        {
-          int error;
-          BITCODE_RL j, numpts = dwg_object_polyline_2d_get_numpoints(obj, &error);
-          dwg_point_2d *pts = dwg_object_polyline_2d_get_points(obj, &error);
-          if (numpts && !error)
-            {
-              PS_moveto(ps, (float)pts[0].x, (float)pts[0].y);
-              for (j=1; j<numpts; j++)
-                {
-                  PS_lineto(ps, (float)pts[j].x, (float)pts[j].y);
-                  PS_stroke(ps);
-                }
-            }
-        }
-      else if (obj->type == DWG_TYPE_ARC)
-        {
-          Dwg_Entity_ARC* arc = obj->tio.entity->tio.ARC;
-          PS_arc(ps, (float)arc->center.x, (float)arc->center.y, (float)arc->radius,
-                     (float)arc->start_angle, (float)arc->end_angle);
-        }
-      else if (obj->type == DWG_TYPE_CIRCLE)
+      else if (obj->fixedtype == DWG_TYPE_CIRCLE && !dwg_entity_ocs(obj, ocs))
         {
           Dwg_Entity_CIRCLE* cir = obj->tio.entity->tio.CIRCLE;
           PS_circle(ps, (float)cir->center.x, (float)cir->center.y, (float)cir->radius);
         }
+      else
+        ps_tessellation(ps, obj);
     }
+  dwg_free_tessellation(&tess);
 
   /* End Model Space */
   PS_end_page(ps);
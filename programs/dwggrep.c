@@ -147,7 +147,7 @@ static void print_match(const int is16, const char *restrict filename,
     text = bit_convert_TU((BITCODE_TU)text);
   printf("%s %s %d: %s\n", opt_filename ? filename : "", entity, dxfgroup, text);
   if (is16)
-    free(text);
+    dwg_free_mem(text);
 }
 
 static int
@@ -278,7 +278,7 @@ do_match (const int is16, const char *restrict filename,
       text = bit_convert_TU((BITCODE_TU)text); \
     found += do_match(obj->parent->header.version >= R_2007, filename, #ENTITY, dxfgroup, text); \
     if (obj->parent->header.version >= R_2007) \
-      free(text); \
+      dwg_free_mem(text); \
   }
 #endif
 
@@ -789,12 +789,60 @@ int match_ACDBNAVISWORKSMODELDEF(const char *restrict filename, const Dwg_Object
   return found;
 }
 
+// with --type, is obj one of them
+static
+int type_ok(const Dwg_Object *obj)
+{
+  if (!numtype)
+    return 1;
+  for (int i=0; i<numtype; i++) {
+    if (obj->dxfname && !strcmp(type[i], obj->dxfname))
+      return 1;
+  }
+  return 0;
+}
+
+#define ATTRIBS(ENTITY) \
+  { \
+    const Dwg_Entity_##ENTITY *_obj = obj->tio.entity->tio.ENTITY; \
+    if (!_obj->has_attribs) \
+      return 0; \
+    first = _obj->first_attrib; \
+    last = _obj->last_attrib; \
+  }
+
+// the ATTRIB's are owned by their INSERT, not by the block. Only
+// R13-R2000, where they used to be found in the chain of the block.
+static
+int match_attribs(const char *restrict filename, const Dwg_Object *restrict obj)
+{
+  const Dwg_Data *dwg = obj->parent;
+  Dwg_Object *o, *end;
+  BITCODE_H first;
+  BITCODE_H last;
+  int found = 0;
+
+  if (dwg->header.version < R_13 || dwg->header.version > R_2000)
+    return 0;
+  if (obj->fixedtype == DWG_TYPE_INSERT)
+    ATTRIBS (INSERT)
+  else
+    ATTRIBS (MINSERT)
+  o = first ? dwg_ref_object(dwg, first) : NULL;
+  end = last ? dwg_ref_object(dwg, last) : NULL;
+  for (; o && end && o->index <= end->index; o = dwg_next_object(o))
+    if (o->fixedtype == DWG_TYPE_ATTRIB && type_ok(o))
+      found += match_ATTRIB(filename, o);
+  return found;
+}
+
 static
 int match_BLOCK_HEADER(const char *restrict filename, Dwg_Object_Ref *restrict ref)
 {
   int found = 0;
   Dwg_Object *hdr;
   Dwg_Object *obj;
+  Dwg_Owned_Iter it;
   char *text;
 
   if (!ref)
@@ -809,22 +857,14 @@ int match_BLOCK_HEADER(const char *restrict filename, Dwg_Object_Ref *restrict r
   MATCH_OBJECT (BLOCK_HEADER, description, 4);
 
   //fprintf(stderr, "HDR: %d, HANDLE: %X\n", hdr->address, hdr->handle.value);
-  for (obj = get_first_owned_object(hdr);
-       obj;
-       obj = get_next_owned_object(hdr, obj))
+  dwg_owned_iter_init(&it, hdr);
+  while ((obj = dwg_owned_iter_next(&it)))
     {
-      if (numtype) //search for allowed --type and skip if not
-        {
-          int typeok = 0;
-          for (int i=0; i<numtype; i++) {
-            if (obj->dxfname && !strcmp(type[i], obj->dxfname)) {
-              typeok = 1;
-              break;
-            }
-          }
-          if (!typeok) //next obj
-            continue;
-        }
+      if (!opt_tables && (obj->fixedtype == DWG_TYPE_INSERT
+                          || obj->fixedtype == DWG_TYPE_MINSERT))
+        found += match_attribs(filename, obj);
+      if (!type_ok(obj)) //search for allowed --type and skip if not
+        continue;
       if (!opt_tables)
         { // opt_text:
           if (obj->type == DWG_TYPE_TEXT)
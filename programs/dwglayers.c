@@ -28,7 +28,7 @@
 #include "logging.h"
 
 static int usage(void) {
-  printf("\nUsage: dwglayers [-f|--flags] [--on] <input_file.dwg>\n");
+  printf("\nUsage: dwglayers [-f|--flags] [--on] [-v|--verbose] <input_file.dwg>\n");
   return 1;
 }
 static int opt_version(void) {
@@ -43,6 +43,7 @@ static int help(void) {
   printf("  -f, --flags               prints also flags:\n"
          "                3 chars for: f for frozen, + or - for ON or OFF, l for locked\n");
   printf("      --on                  prints only ON layers\n");
+  printf("  -v, --verbose             prints also the number of entities\n");
   printf("      --help                display this help and exit\n");
   printf("      --version             output version information and exit\n"
          "\n");
@@ -50,6 +51,7 @@ static int help(void) {
   printf("  -f            prints also flags:\n"
          "                3 chars for: f for frozen, + or - for ON or OFF, l for locked\n");
   printf("  -o            prints only ON layers\n");
+  printf("  -v            prints also the number of entities\n");
   printf("  -h            display this help and exit\n");
   printf("  -i            output version information and exit\n"
          "\n");
@@ -63,7 +65,7 @@ main (int argc, char *argv[])
 {
   int error;
   long i = 1;
-  int flags = 0, on = 0;
+  int flags = 0, on = 0, verbose = 0;
   char* filename_in;
   Dwg_Data dwg;
   Bit_Chain dat;
@@ -74,6 +76,7 @@ main (int argc, char *argv[])
   static struct option long_options[] = {
         {"flags",   0, 0, 'f'},
         {"on",      0, 0, 'o'},
+        {"verbose", 0, 0, 'v'},
         {"help",    0, 0, 0},
         {"version", 0, 0, 0},
         {NULL,      0, NULL, 0}
@@ -82,10 +85,10 @@ main (int argc, char *argv[])
 
   while
 #ifdef HAVE_GETOPT_LONG
-    ((c = getopt_long(argc, argv, "foh",
+    ((c = getopt_long(argc, argv, "fovh",
                       long_options, &option_index)) != -1)
 #else
-    ((c = getopt(argc, argv, "fohi")) != -1)
+    ((c = getopt(argc, argv, "fovhi")) != -1)
 #endif
     {
       if (c == -1) break;
@@ -107,6 +110,9 @@ main (int argc, char *argv[])
       case 'o':
         on = 1;
         break;
+      case 'v':
+        verbose = 1;
+        break;
       case 'h':
         return help();
       case '?':
@@ -141,11 +147,17 @@ main (int argc, char *argv[])
                layer->frozen ? "f" : " ",
                layer->on ?     "+" : "-",
                layer->locked ? "l" : " ");
+      if (verbose)
+        {
+          BITCODE_BL num;
+          (void)dwg_get_entities_on_layer(&dwg, obj->handle.value, &num);
+          printf("%u\t", (unsigned)num);
+        }
       // since r2007 unicode, converted to utf-8
       if (dwg.header.version >= R_2007) {
         char *utf8 = bit_convert_TU((BITCODE_TU)layer->entry_name);
         printf("%s\n", utf8);
-        free(utf8);
+        dwg_free_mem(utf8);
       }
       else
         printf("%s\n", layer->entry_name);
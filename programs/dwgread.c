@@ -37,9 +37,13 @@
 #include "out_dxf.h"
 
 static int opts = 1;
+static int stats = 0;
+static int profile = 0;
+static int compact = 0;
+static double tolerance = 0.0;
 
 static int usage(void) {
-  printf("\nUsage: dwgread [-v[0-9]] [-O FMT] [-o OUTFILE] [DWGFILE|-]\n");
+  printf("\nUsage: dwgread [-v[0-9]] [-O FMT] [-o OUTFILE] [--compact] [-t TOL] [--stats] [--profile] [DWGFILE|-]\n");
   return 1;
 }
 static int opt_version(void) {
@@ -56,6 +60,10 @@ static int help(void) {
   printf("  -O fmt,  --format fmt     fmt: DXF, DXFB, JSON, GeoJSON\n");
   printf("           Planned output formats:  YAML, XML/OGR, GPX, SVG, PS\n");
   printf("  -o outfile                also defines the output fmt. Default: stdout\n");
+  printf("           --compact        JSON without indentation and newlines\n");
+  printf("  -t tol,  --tolerance tol  GeoJSON chord tolerance of curves. Default: 0.1%% of the radius\n");
+  printf("           --stats          print the decode timings, counters and memory usage to stderr\n");
+  printf("           --profile        print the decode costs per type to stderr\n");
   printf("           --help           display this help and exit\n");
   printf("           --version        output version information and exit\n"
          "\n");
@@ -64,6 +72,10 @@ static int help(void) {
   printf("  -O fmt      fmt: DXF, DXFB, JSON, GeoJSON\n");
   printf("              Planned output formats:  YAML, XML/OGR, GPX, SVG, PS\n");
   printf("  -o outfile  also defines the output fmt. Default: stdout\n");
+  printf("  -c          JSON without indentation and newlines\n");
+  printf("  -t tol      GeoJSON chord tolerance of curves. Default: 0.1%% of the radius\n");
+  printf("  -s          print the decode timings, counters and memory usage to stderr\n");
+  printf("  -p          print the decode costs per type to stderr\n");
   printf("  -h          display this help and exit\n");
   printf("  -i          output version information and exit\n"
          "\n");
@@ -72,6 +84,86 @@ static int help(void) {
   return 0;
 }
 
+static void print_stats(const Dwg_Data *dwg) {
+  static const char *const phases[DWG_NUM_PHASES] = {
+    "other", "header", "section map", "classes", "decompress",
+    "object map", "objects", "handles", "total" };
+  static const char *const sections[SECTION_UNKNOWN + 1] = {
+    "", "Header", "AuxHeader", "Classes", "Handles", "Template",
+    "ObjFreeSpace", "AcDbObjects", "RevHistory", "SummaryInfo", "Preview",
+    "AppInfo", "AppInfoHistory", "FileDepList", "Security", "VBAProject",
+    "Signature", "AcDsPrototype_1b", "unknown" };
+  const Dwg_Stats *st = dwg_stats(dwg);
+  unsigned i;
+
+  fprintf(stderr, "\nDecode phases:\n");
+  for (i = 0; i < DWG_NUM_PHASES; i++)
+    fprintf(stderr, "  %-16s %10.6f s\n", phases[i], st->time[i]);
+  if (st->num_pages)
+    {
+      fprintf(stderr, "Sections:\n");
+      for (i = 0; i <= SECTION_UNKNOWN; i++)
+        if (st->section_time[i] > 0.0)
+          fprintf(stderr, "  %-16s %10.6f s\n", sections[i],
+                  st->section_time[i]);
+      fprintf(stderr, "  %lu bytes decompressed from %u pages\n",
+              (unsigned long)st->bytes_decompressed, (unsigned)st->num_pages);
+    }
+  fprintf(stderr, "Objects: %u, refs: %u, allocations: %u\n",
+          (unsigned)dwg->num_objects, (unsigned)st->num_refs,
+          (unsigned)st->num_allocs);
+  fprintf(stderr, "Unknown objects: %u, unhandled classes: %u\n",
+          (unsigned)st->num_unknown_objects,
+          (unsigned)st->num_unhandled_classes);
+  for (i = 0; i < st->num_types; i++)
+    fprintf(stderr, "  %-24s %8u\n", st->types[i].name ? st->types[i].name : "",
+            (unsigned)st->types[i].count);
+}
+
+static void print_memory(const Dwg_Data *dwg) {
+  Dwg_Memory_Report mem;
+  unsigned i;
+
+  if (dwg_memory_usage(dwg, &mem))
+    return;
+  fprintf(stderr, "\nMemory: %lu bytes\n", (unsigned long)mem.total);
+  fprintf(stderr, "  %-16s %10lu\n", "objects", (unsigned long)mem.objects);
+  fprintf(stderr, "  %-16s %10lu\n", "strings", (unsigned long)mem.strings);
+  fprintf(stderr, "  %-16s %10lu\n", "extents", (unsigned long)mem.extents);
+  fprintf(stderr, "  %-16s %10lu\n", "header", (unsigned long)mem.header);
+  fprintf(stderr, "  %-16s %10lu\n", "handles", (unsigned long)mem.handles);
+  fprintf(stderr, "  %-16s %10lu\n", "object map",
+          (unsigned long)mem.object_map);
+  fprintf(stderr, "  %-16s %10lu\n", "indices", (unsigned long)mem.indices);
+  fprintf(stderr, "  %-16s %10lu\n", "rtrees", (unsigned long)mem.rtrees);
+  fprintf(stderr, "  %-16s %10lu\n", "sections", (unsigned long)mem.sections);
+  fprintf(stderr, "  %-16s %10lu\n", "classes", (unsigned long)mem.classes);
+  fprintf(stderr, "  %-16s %10lu\n", "picture", (unsigned long)mem.picture);
+  fprintf(stderr, "  %-16s %10lu\n", "stats", (unsigned long)mem.stats);
+  for (i = 0; i < mem.num_types; i++)
+    fprintf(stderr, "  %-24s %8u %10lu %10lu\n",
+            mem.types[i].name ? mem.types[i].name : "",
+            (unsigned)mem.types[i].count, (unsigned long)mem.types[i].bytes,
+            (unsigned long)mem.types[i].strings);
+}
+
+static void print_profile(const Dwg_Data *dwg) {
+  const Dwg_Stats *st = dwg_stats(dwg);
+  unsigned i;
+
+  fprintf(stderr, "\nDecode profile:\n");
+  fprintf(stderr, "  %-24s %8s %10s %14s %8s %6s\n", "type", "count", "bytes",
+          "ticks", "allocs", "errors");
+  for (i = 0; i < st->num_profile; i++)
+    {
+      const Dwg_Profile_Type *p = &st->profile[i];
+      fprintf(stderr, "  %-24s %8u %10lu %14llu %8lu %6u\n",
+              p->name ? p->name : "", (unsigned)p->count,
+              (unsigned long)p->bytes, (unsigned long long)p->ticks,
+              (unsigned long)p->allocs, (unsigned)p->errors);
+    }
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -88,6 +180,10 @@ main(int argc, char *argv[])
         {"verbose", 1, &opts, 1}, //optional
         {"format",  1, 0, 'O'},
         {"file",    1, 0, 'o'},
+        {"compact", 0, &compact, 1},
+        {"tolerance", 1, 0, 't'},
+        {"stats",   0, &stats, 1},
+        {"profile", 0, &profile, 1},
         {"help",    0, 0, 0},
         {"version", 0, 0, 0},
         {NULL,      0, NULL, 0}
@@ -99,10 +195,10 @@ main(int argc, char *argv[])
 
   while
 #ifdef HAVE_GETOPT_LONG
-    ((c = getopt_long(argc, argv, ":v::O:o:h",
+    ((c = getopt_long(argc, argv, ":v::O:o:t:h",
                       long_options, &option_index)) != -1)
 #else
-    ((c = getopt(argc, argv, ":v::O:o:hi")) != -1)
+    ((c = getopt(argc, argv, ":v::O:o:t:csphi")) != -1)
 #endif
     {
       if (c == -1) break;
@@ -142,10 +238,24 @@ main(int argc, char *argv[])
 #else
       case 'i':
         return opt_version();
+      case 'c':
+        compact = 1;
+        break;
+      case 's':
+        stats = 1;
+        break;
+      case 'p':
+        profile = 1;
+        break;
 #endif
       case 'O':
         fmt = optarg;
         break;
+      case 't':
+        tolerance = strtod(optarg, NULL);
+        if (!(tolerance >= 0.0))
+          return usage();
+        break;
       case 'o':
         outfile = optarg;
         if (!fmt)
@@ -206,12 +316,24 @@ main(int argc, char *argv[])
   memset(&dwg, 0, sizeof(Dwg_Data));
   if (has_v || !fmt)
     dwg.opts = opts;
+  if (profile)
+    dwg.opts |= 0x40;
+  if (compact)
+    dwg.opts |= 0x80;
+  dwg.tolerance = tolerance;
 #if defined(USE_TRACING) && defined(HAVE_SETENV)
   if (!has_v)
     setenv("LIBREDWG_TRACE", "1", 0);
 #endif
 
   error = dwg_read_file(argv[i], &dwg);
+  if (stats)
+    {
+      print_stats(&dwg);
+      print_memory(&dwg);
+    }
+  if (profile)
+    print_profile(&dwg);
   if (!fmt)
     {
       if (error >= DWG_ERR_CRITICAL)
@@ -0,0 +1,157 @@
+/*****************************************************************************/
+/*  LibreDWG - free implementation of the DWG file format                    */
+/*                                                                           */
+/*  Copyright (C) 2018 Free Software Foundation, Inc.                        */
+/*                                                                           */
+/*  This library is free software, licensed under the terms of the GNU       */
+/*  General Public License as published by the Free Software Foundation,     */
+/*  either version 3 of the License, or (at your option) any later version.  */
+/*  You should have received a copy of the GNU General Public License        */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.    */
+/*****************************************************************************/
+
+/*
+ * alloc.c: the per-thread memory allocator.
+ *         The bit readers and the hash have no Dwg_Data at hand, so like
+ *         the log sink each entry point installs the allocator of its
+ *         Dwg_Data for the calling thread and restores the previous one
+ *         on return, see dwg_log_enter(). Outside of the API calls it is
+ *         the C library.
+ */
+
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "dwg.h"
+
+static void *
+libc_malloc(void *ctx, size_t size)
+{
+  (void)ctx;
+  return malloc(size);
+}
+
+static void *
+libc_calloc(void *ctx, size_t nmemb, size_t size)
+{
+  (void)ctx;
+  return calloc(nmemb, size);
+}
+
+static void *
+libc_realloc(void *ctx, void *ptr, size_t size)
+{
+  (void)ctx;
+  return realloc(ptr, size);
+}
+
+static void
+libc_free(void *ctx, void *ptr)
+{
+  (void)ctx;
+  free(ptr);
+}
+
+static const Dwg_Allocator libc_allocator = {
+  libc_malloc, libc_calloc, libc_realloc, libc_free, NULL
+};
+static THREAD_LOCAL Dwg_Allocator allocator = {
+  libc_malloc, libc_calloc, libc_realloc, libc_free, NULL
+};
+/* malloc, calloc and realloc calls of this thread, for Dwg_Stats */
+static THREAD_LOCAL unsigned long long num_allocs;
+
+void *
+dwg_malloc(size_t size)
+{
+  num_allocs++;
+  return allocator.malloc_fn(allocator.ctx, size);
+}
+
+void *
+dwg_calloc(size_t nmemb, size_t size)
+{
+  void *ptr;
+  num_allocs++;
+  if (allocator.calloc_fn)
+    return allocator.calloc_fn(allocator.ctx, nmemb, size);
+  if (size && nmemb > (size_t)-1 / size)
+    return NULL;
+  ptr = allocator.malloc_fn(allocator.ctx, nmemb * size);
+  if (ptr)
+    memset(ptr, 0, nmemb * size);
+  return ptr;
+}
+
+void *
+dwg_realloc(void *ptr, size_t size)
+{
+  num_allocs++;
+  return allocator.realloc_fn(allocator.ctx, ptr, size);
+}
+
+void
+dwg_dealloc(void *ptr)
+{
+  if (ptr)
+    allocator.free_fn(allocator.ctx, ptr);
+}
+
+unsigned long long
+dwg_alloc_count(void)
+{
+  return num_allocs;
+}
+
+/* Copied, as dwg may be gone before the next call on this thread */
+void
+dwg_alloc_init(const Dwg_Data *dwg)
+{
+  if (dwg->allocator.malloc_fn)
+    allocator = dwg->allocator;
+  else
+    allocator = libc_allocator;
+}
+
+/* Install the allocator of dwg, saving the one of the caller */
+void
+dwg_alloc_enter(const Dwg_Data *dwg, Dwg_Allocator *saved)
+{
+  *saved = allocator;
+  dwg_alloc_init(dwg);
+}
+
+void
+dwg_alloc_leave(const Dwg_Allocator *saved)
+{
+  allocator = *saved;
+}
+
+/* For the memory returned by the API, e.g. converted strings */
+void
+dwg_free_mem(void *ptr)
+{
+  dwg_dealloc(ptr);
+}
+
+void
+dwg_set_allocator(Dwg_Data *dwg,
+                  void *(*malloc_fn) (void *ctx, size_t size),
+                  void *(*calloc_fn) (void *ctx, size_t nmemb, size_t size),
+                  void *(*realloc_fn) (void *ctx, void *ptr, size_t size),
+                  void (*free_fn) (void *ctx, void *ptr),
+                  void *ctx)
+{
+  if (!malloc_fn || !realloc_fn || !free_fn)
+    {
+      memset(&dwg->allocator, 0, sizeof(Dwg_Allocator));
+      return;
+    }
+  dwg->allocator.malloc_fn = malloc_fn;
+  dwg->allocator.calloc_fn = calloc_fn;
+  dwg->allocator.realloc_fn = realloc_fn;
+  dwg->allocator.free_fn = free_fn;
+  dwg->allocator.ctx = ctx;
+}
@@ -1000,26 +1000,24 @@ bit_write_DD(Bit_Chain * dat, double value, double default_value)
       uchar_value = (unsigned char *) &value;
       uint_value = (unsigned int *) &value;
       uint_default = (unsigned int *) &default_value;
-      if (uint_value[0] == uint_default[0])
+      // the high bytes are taken from the default
+      if (uint_value[1] == uint_default[1])
         {
-          if (uint_value[1] != uint_default[1])
-            {
-              bit_write_BB(dat, 2);
-              bit_write_RC(dat, uchar_value[4]);
-              bit_write_RC(dat, uchar_value[5]);
-              bit_write_RC(dat, uchar_value[0]);
-              bit_write_RC(dat, uchar_value[1]);
-              bit_write_RC(dat, uchar_value[2]);
-              bit_write_RC(dat, uchar_value[3]);
-            }
-          else
-            {
-              bit_write_BB(dat, 1);
-              bit_write_RC(dat, uchar_value[0]);
-              bit_write_RC(dat, uchar_value[1]);
-              bit_write_RC(dat, uchar_value[2]);
-              bit_write_RC(dat, uchar_value[3]);
-            }
+          bit_write_BB(dat, 1);
+          bit_write_RC(dat, uchar_value[0]);
+          bit_write_RC(dat, uchar_value[1]);
+          bit_write_RC(dat, uchar_value[2]);
+          bit_write_RC(dat, uchar_value[3]);
+        }
+      else if ((uint_value[1] >> 16) == (uint_default[1] >> 16))
+        {
+          bit_write_BB(dat, 2);
+          bit_write_RC(dat, uchar_value[4]);
+          bit_write_RC(dat, uchar_value[5]);
+          bit_write_RC(dat, uchar_value[0]);
+          bit_write_RC(dat, uchar_value[1]);
+          bit_write_RC(dat, uchar_value[2]);
+          bit_write_RC(dat, uchar_value[3]);
         }
       else
         {
@@ -1196,8 +1194,13 @@ bit_write_CRC(Bit_Chain * dat, long unsigned int start_address,
 BITCODE_TF
 bit_read_TF(Bit_Chain *restrict dat, int length)
 {
-  char *chain = malloc(length+1);
+  char *chain = dwg_malloc(length+1);
 
+  if (!chain)
+    {
+      LOG_ERROR("Out of memory");
+      return NULL;
+    }
   bit_read_fixed(dat, chain, length);
   chain[length] = '\0';
 
@@ -1234,7 +1237,12 @@ bit_read_TV(Bit_Chain *restrict dat)
 
   length = bit_read_BS(dat);
   // if (length > AVAIL_BITS()) return DWG_ERR_VALUEOUTOFBOUNDS;
-  chain = (unsigned char *) malloc(length + 1);
+  chain = (unsigned char *) dwg_malloc(length + 1);
+  if (!chain)
+    {
+      LOG_ERROR("Out of memory");
+      return NULL;
+    }
   for (i = 0; i < length; i++)
     {
       chain[i] = bit_read_RC(dat);
@@ -1274,7 +1282,12 @@ bit_read_TU(Bit_Chain *restrict dat)
   BITCODE_TU chain;
 
   length = bit_read_BS(dat);
-  chain = (BITCODE_TU) malloc((length + 1) * 2);
+  chain = (BITCODE_TU) dwg_malloc((length + 1) * 2);
+  if (!chain)
+    {
+      LOG_ERROR("Out of memory");
+      return NULL;
+    }
   for (i = 0; i < length; i++)
     {
       chain[i] = bit_read_RS(dat); // probably without byte swapping
@@ -1323,7 +1336,7 @@ bit_convert_TU(BITCODE_TU restrict wstr)
   while (*tmp++) {
     len++;
   }
-  str = malloc(len+1);
+  str = dwg_malloc(len+1);
   i = 0;
   while ((c = *wstr++)) {
     if (c < 256) {
@@ -1331,7 +1344,7 @@ bit_convert_TU(BITCODE_TU restrict wstr)
     }
     else if (c < 0x800) {
       if (i+3 > len) {
-        str = realloc(str, i+3);
+        str = dwg_realloc(str, i+3);
         len = i+2;
       }
       str[i+1] = (c & 0x3f) | 0x80;
@@ -1340,7 +1353,7 @@ bit_convert_TU(BITCODE_TU restrict wstr)
     }
     else { /* windows ucs-2 has no D800-DC00 surrogate pairs. go straight up */
       if (i+3 > len) {
-        str = realloc(str, i+4);
+        str = dwg_realloc(str, i+4);
         len = i+3;
       }
       str[i+3] = (c & 0x3f) | 0x80;
@@ -1364,7 +1377,7 @@ bit_utf8_to_TU(char* restrict str)
   int len = strlen(str);
   unsigned char c;
 
-  wstr = malloc(2*(len+1));
+  wstr = dwg_malloc(2*(len+1));
   while ((c = *str++)) {
     if (c < 128) {
       wstr[i++] = c;
@@ -1584,14 +1597,14 @@ bit_chain_alloc(Bit_Chain * dat)
 {
   if (dat->size == 0)
     {
-      dat->chain = (unsigned char *)calloc(1, CHAIN_BLOCK);
+      dat->chain = (unsigned char *)dwg_calloc(1, CHAIN_BLOCK);
       dat->size = CHAIN_BLOCK;
       dat->byte = 0;
       dat->bit = 0;
     }
   else
     {
-      dat->chain = (unsigned char *)realloc(dat->chain, dat->size + CHAIN_BLOCK);
+      dat->chain = (unsigned char *)dwg_realloc(dat->chain, dat->size + CHAIN_BLOCK);
       dat->size += CHAIN_BLOCK;
     }
 }
@@ -22,6 +22,7 @@
 #define COMMON_H
 
 #include "config.h"
+#include <stddef.h>
 #include <stdint.h>
 #include <inttypes.h>
 
@@ -153,4 +154,21 @@ typedef enum DWG_SENTINEL
 unsigned char *
 dwg_sentinel(Dwg_Sentinel sentinel);
 
+/* All memory of a Dwg_Data goes through the allocator of the calling
+   thread, set by dwg_alloc_init(). See alloc.c */
+void *dwg_malloc (size_t size);
+void *dwg_calloc (size_t nmemb, size_t size);
+void *dwg_realloc (void *ptr, size_t size);
+void dwg_dealloc (void *ptr);
+struct _dwg_struct;
+struct _dwg_allocator;
+void dwg_alloc_init (const struct _dwg_struct *dwg);
+/* dwg_alloc_init() for an entry point, which restores the saved
+   allocator with dwg_alloc_leave() before it returns */
+void dwg_alloc_enter (const struct _dwg_struct *dwg,
+                      struct _dwg_allocator *saved);
+void dwg_alloc_leave (const struct _dwg_allocator *saved);
+/* The allocations of the calling thread so far, to count by difference */
+unsigned long long dwg_alloc_count (void);
+
 #endif
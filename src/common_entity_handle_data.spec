@@ -46,7 +46,7 @@
       }
     }
 
-  VERSION(R_2000)
+  SINCE(R_2000)
     {
       FIELD_HANDLE(layer, 5, 8);
 #ifdef IS_DXF
@@ -39,7 +39,7 @@
       LOG(level,"%02x", (unsigned char)((char*)var)[_i]); \
     } \
     LOG(level,"\n"); \
-    if (DWG_LOGLEVEL >= DWG_LOGLEVEL_INSANE) { \
+    if (LOG_ENABLED(INSANE)) { \
       for (_i=0; _i<(len); _i++) { \
         unsigned char c = ((unsigned char*)var)[_i]; \
         LOG_INSANE("%-2c", isprint(c) ? c : ' '); \
@@ -310,27 +310,27 @@
 #undef DEBUG_POS_OBJ
 #undef DEBUG_HERE_OBJ
 #define DEBUG_POS_OBJ\
-  if (DWG_LOGLEVEL >= DWG_LOGLEVEL_TRACE) { \
+  if (LOG_ENABLED(TRACE)) { \
     LOG_TRACE("DEBUG_POS @%u.%u (%lu) %lu\n", (unsigned int)dat->byte, dat->bit, \
               bit_position(dat), obj ? bit_position(dat) - obj->address*8 : 0); \
   }
 #define DEBUG_POS\
-  if (DWG_LOGLEVEL >= DWG_LOGLEVEL_TRACE) { \
+  if (LOG_ENABLED(TRACE)) { \
     LOG_TRACE("DEBUG_POS @%u.%u (%lu)\n", (unsigned int)dat->byte, dat->bit, \
               bit_position(dat)); \
   }
 #define _DEBUG_HERE\
-  if (DWG_LOGLEVEL >= DWG_LOGLEVEL_TRACE) { \
+  if (LOG_ENABLED(TRACE)) { \
     Bit_Chain here = *dat; \
     int oldloglevel = loglevel; \
     char *tmp; BITCODE_BB bb = 0; BITCODE_RS rs; BITCODE_RL rl; double bd; \
     Dwg_Handle hdl; \
     tmp = bit_read_TF(dat, 24);\
-    if (DWG_LOGLEVEL >= DWG_LOGLEVEL_INSANE) { \
+    if (LOG_ENABLED(INSANE)) { \
       bit_fprint_bits(stderr, (unsigned char*)tmp, 68); fprintf(stderr,"\n"); \
     } \
     LOG_TRACE_TF(tmp, 24);\
-    free(tmp); \
+    dwg_dealloc(tmp); \
     SINCE(R_13) {\
       *dat = here;\
       LOG_TRACE("  B  :"FORMAT_B"\t", bit_read_B(dat));\
@@ -401,6 +401,13 @@
   VECTOR_CHKCOUNT(name,HANDLE,size)
 
 
+// A failed allocation, e.g. over the budget of a custom allocator, stops
+// decoding. dwg_free skips the NULL vector.
+#define CHK_ALLOC(ptr, count) \
+  if ((count) && !(ptr)) { \
+    LOG_ERROR("Out of memory for " #ptr " x %ld", (long)(count)); \
+    return DWG_ERR_OUTOFMEM; }
+
 //FIELD_VECTOR_N(name, type, size):
 // reads data of the type indicated by 'type' 'size' times and stores
 // it all in the vector called 'name'.
@@ -408,7 +415,8 @@
   if (size > 0) \
     { \
       VECTOR_CHKCOUNT(name,type,size) \
-      _obj->name = (BITCODE_##type*) calloc(size, sizeof(BITCODE_##type)); \
+      _obj->name = (BITCODE_##type*) dwg_calloc(size, sizeof(BITCODE_##type)); \
+      CHK_ALLOC(_obj->name, size) \
       for (vcount=0; vcount<(BITCODE_BL)size; vcount++) \
         {\
           _obj->name[vcount] = bit_read_##type(dat); \
@@ -420,7 +428,8 @@
   if (_obj->size > 0) \
     { \
       _VECTOR_CHKCOUNT(name,_obj->size,dat->version>=R_2007 ? 18 : 2) \
-      _obj->name = calloc(_obj->size, sizeof(char*)); \
+      _obj->name = dwg_calloc(_obj->size, sizeof(char*)); \
+      CHK_ALLOC(_obj->name, _obj->size) \
       for (vcount=0; vcount<(BITCODE_BL)_obj->size; vcount++) \
         {\
           PRE (R_2007) { \
@@ -438,7 +447,8 @@
     { \
       int _dxf = dxf;\
       VECTOR_CHKCOUNT(name,type,size) \
-      _obj->name = (BITCODE_##type*) calloc(size, sizeof(BITCODE_##type)); \
+      _obj->name = (BITCODE_##type*) dwg_calloc(size, sizeof(BITCODE_##type)); \
+      CHK_ALLOC(_obj->name, size) \
       for (vcount=0; vcount<(BITCODE_BL)size; vcount++) \
         {\
           _obj->name[vcount] = bit_read_##type(dat); \
@@ -451,7 +461,8 @@
 
 #define FIELD_2RD_VECTOR(name, size, dxf) \
   VECTOR_CHKCOUNT(name,2RD,_obj->size) \
-  _obj->name = (BITCODE_2RD *) calloc(_obj->size, sizeof(BITCODE_2RD)); \
+  _obj->name = (BITCODE_2RD *) dwg_calloc(_obj->size, sizeof(BITCODE_2RD)); \
+  CHK_ALLOC(_obj->name, _obj->size) \
   for (vcount=0; vcount< (BITCODE_BL)_obj->size; vcount++)\
     {\
       FIELD_2RD(name[vcount], dxf); \
@@ -459,7 +470,8 @@
 
 #define FIELD_2DD_VECTOR(name, size, dxf) \
   VECTOR_CHKCOUNT(name,2DD,_obj->size) \
-    _obj->name = (BITCODE_2RD *) calloc(_obj->size, sizeof(BITCODE_2RD)); \
+    _obj->name = (BITCODE_2RD *) dwg_calloc(_obj->size, sizeof(BITCODE_2RD)); \
+  CHK_ALLOC(_obj->name, _obj->size) \
   FIELD_2RD(name[0], dxf); \
   for (vcount = 1; vcount < (BITCODE_BL)_obj->size; vcount++)\
     {\
@@ -471,7 +483,8 @@
 
 #define FIELD_3DPOINT_VECTOR(name, size, dxf) \
   VECTOR_CHKCOUNT(name,3BD,_obj->size) \
-  _obj->name = (BITCODE_3DPOINT *) calloc(_obj->size, sizeof(BITCODE_3DPOINT)); \
+  _obj->name = (BITCODE_3DPOINT *) dwg_calloc(_obj->size, sizeof(BITCODE_3DPOINT)); \
+  CHK_ALLOC(_obj->name, _obj->size) \
   for (vcount=0; vcount < (BITCODE_BL)_obj->size; vcount++) \
     {\
       FIELD_3DPOINT(name[vcount], dxf); \
@@ -480,7 +493,8 @@
 // shortest handle: 8 bit
 #define HANDLE_VECTOR_N(name, size, code, dxf) \
   VECTOR_CHKCOUNT(name,HANDLE,size) \
-    FIELD_VALUE(name) = (BITCODE_H*) calloc(size, sizeof(BITCODE_H)); \
+    FIELD_VALUE(name) = (BITCODE_H*) dwg_calloc(size, sizeof(BITCODE_H)); \
+  CHK_ALLOC(FIELD_VALUE(name), size) \
   for (vcount=0; vcount < (BITCODE_BL)size; vcount++) \
     {\
       FIELD_HANDLE_N(name[vcount], vcount, code, dxf);  \
@@ -502,14 +516,16 @@
   _obj->name = dwg_decode_xdata(dat, _obj, _obj->size)
 
 #define REACTORS(code)\
-  obj->tio.object->reactors = calloc(obj->tio.object->num_reactors, sizeof(BITCODE_H)); \
+  obj->tio.object->reactors = dwg_calloc(obj->tio.object->num_reactors, sizeof(BITCODE_H)); \
+  CHK_ALLOC(obj->tio.object->reactors, obj->tio.object->num_reactors) \
   for (vcount=0; vcount < obj->tio.object->num_reactors; vcount++) \
     {\
       VALUE_HANDLE_N(obj->tio.object->reactors[vcount], reactors, vcount, code, 330); \
     }
 
 #define ENT_REACTORS(code)\
-  _ent->reactors = calloc(_ent->num_reactors, sizeof(BITCODE_H)); \
+  _ent->reactors = dwg_calloc(_ent->num_reactors, sizeof(BITCODE_H)); \
+  CHK_ALLOC(_ent->reactors, _ent->num_reactors) \
   for (vcount=0; vcount < _ent->num_reactors; vcount++)\
     {\
       VALUE_HANDLE_N(_ent->reactors[vcount], reactors, vcount, code, 330); \
@@ -599,20 +615,24 @@
 
 // unchecked with a constant
 #define REPEAT_CN(times, name, type) \
-  if (times) _obj->name = (type *) calloc(times, sizeof(type)); \
+  if (times) _obj->name = (type *) dwg_calloc(times, sizeof(type)); \
+  CHK_ALLOC(_obj->name, times) \
   for (rcount1=0; rcount1<(BITCODE_BL)times; rcount1++)
 #define REPEAT_N(times, name, type) \
   REPEAT_CHKCOUNT(name,times,type) \
-  if (times) _obj->name = (type *) calloc(times, sizeof(type)); \
+  if (times) _obj->name = (type *) dwg_calloc(times, sizeof(type)); \
+  CHK_ALLOC(_obj->name, times) \
   for (rcount1=0; rcount1<(BITCODE_BL)times; rcount1++)
 
 #define _REPEAT(times, name, type, idx) \
   REPEAT_CHKCOUNT_LVAL(name,_obj->times,type) \
-  if (_obj->times) _obj->name = (type *) calloc(_obj->times, sizeof(type)); \
+  if (_obj->times) _obj->name = (type *) dwg_calloc(_obj->times, sizeof(type)); \
+  CHK_ALLOC(_obj->name, _obj->times) \
   for (rcount##idx=0; rcount##idx<(BITCODE_BL)_obj->times; rcount##idx++)
 #define _REPEAT_C(times, name, type, idx) \
   REPEAT_CHKCOUNT_LVAL(name,_obj->times,type) \
-  if (_obj->times) _obj->name = (type *) calloc(_obj->times, sizeof(type)); \
+  if (_obj->times) _obj->name = (type *) dwg_calloc(_obj->times, sizeof(type)); \
+  CHK_ALLOC(_obj->name, _obj->times) \
   for (rcount##idx=0; rcount##idx<(BITCODE_BL)_obj->times; rcount##idx++)
 #define _REPEAT_N(times, name, type, idx) \
   if (_obj->name) \
@@ -640,19 +660,31 @@
     Returns 0 or DWG_ERR_OUTOFMEM.
 */
 
+/* Objects may be decoded concurrently, see decode_objects() */
+#ifdef _OPENMP
+# define COUNT_ENTITY(dwg) \
+  _Pragma("omp atomic") \
+  (dwg)->num_entities++;
+#else
+# define COUNT_ENTITY(dwg) (dwg)->num_entities++;
+#endif
+
 #define DWG_ENTITY(token) \
 EXPORT int dwg_add_##token (Dwg_Object *obj) \
 { \
   Dwg_Object_Entity *_ent; \
   Dwg_Entity_##token *_obj; \
+  Dwg_Allocator saved; \
   LOG_INFO("Add entity " #token " ")\
-  obj->parent->num_entities++;\
+  COUNT_ENTITY(obj->parent) \
   obj->supertype = DWG_SUPERTYPE_ENTITY;\
   obj->fixedtype = DWG_TYPE_##token;\
-  _ent = obj->tio.entity = calloc(1, sizeof(Dwg_Object_Entity));\
-  if (!_ent) return DWG_ERR_OUTOFMEM; \
-  _ent->tio.token = calloc(1, sizeof (Dwg_Entity_##token));\
-  if (!_ent->tio.token) return DWG_ERR_OUTOFMEM; \
+  dwg_alloc_enter(obj->parent, &saved); \
+  _ent = obj->tio.entity = dwg_calloc(1, sizeof(Dwg_Object_Entity));\
+  if (_ent) \
+    _ent->tio.token = dwg_calloc(1, sizeof (Dwg_Entity_##token));\
+  dwg_alloc_leave(&saved); \
+  if (!_ent || !_ent->tio.token) return DWG_ERR_OUTOFMEM; \
   obj->dxfname = (char*)#token; \
   _ent->dwg = obj->parent; \
   _ent->objid = obj->index; /* obj ptr itself might move */ \
@@ -671,7 +703,7 @@ static int dwg_decode_##token (Bit_Chain *restrict dat, Dwg_Object *restrict obj
   int error = dwg_add_##token(obj); \
   if (error) return error; \
   if (dat->version >= R_2007) { \
-    str_dat = calloc(1, sizeof(Bit_Chain)); /* separate string buffer */ \
+    str_dat = dwg_calloc(1, sizeof(Bit_Chain)); /* separate string buffer */ \
     if (!str_dat) return DWG_ERR_OUTOFMEM; \
     *str_dat = *dat; \
   } else \
@@ -693,7 +725,7 @@ static int dwg_decode_##token (Bit_Chain *restrict dat, Dwg_Object *restrict obj
 // Does size include the CRC?
 #define DWG_ENTITY_END \
   if (dat->version >= R_2007) { \
-    free(str_dat); \
+    dwg_dealloc(str_dat); \
     vcount  = (obj->size+obj->address)*8 - bit_position(hdl_dat); \
   } else { \
     vcount  = (obj->size+obj->address)*8 - bit_position(dat); \
@@ -708,13 +740,16 @@ static int dwg_decode_##token (Bit_Chain *restrict dat, Dwg_Object *restrict obj
 #define DWG_OBJECT(token) \
 EXPORT int dwg_add_ ## token (Dwg_Object *obj) \
 { \
-  Dwg_Object_##token *_obj;\
+  Dwg_Object_##token *_obj = NULL;\
+  Dwg_Allocator saved; \
   LOG_INFO("Add object " #token " ")\
   obj->supertype = DWG_SUPERTYPE_OBJECT;\
   obj->fixedtype = DWG_TYPE_##token;\
-  obj->tio.object = calloc (1, sizeof(Dwg_Object_Object)); \
-  if (!obj->tio.object) return DWG_ERR_OUTOFMEM; \
-  _obj = obj->tio.object->tio.token = calloc (1, sizeof(Dwg_Object_##token)); \
+  dwg_alloc_enter(obj->parent, &saved); \
+  obj->tio.object = dwg_calloc (1, sizeof(Dwg_Object_Object)); \
+  if (obj->tio.object) \
+    _obj = obj->tio.object->tio.token = dwg_calloc (1, sizeof(Dwg_Object_##token)); \
+  dwg_alloc_leave(&saved); \
   if (!_obj) return DWG_ERR_OUTOFMEM; \
   obj->dxfname = (char*)#token; \
   _obj->parent = obj->tio.object; \
@@ -732,7 +767,7 @@ static int dwg_decode_ ## token (Bit_Chain *restrict dat, Dwg_Object *restrict o
   int error = dwg_add_##token(obj); \
   if (error) return error; \
   if (dat->version >= R_2007) { \
-    str_dat = calloc(1, sizeof(Bit_Chain)); /* separate string buffer */ \
+    str_dat = dwg_calloc(1, sizeof(Bit_Chain)); /* separate string buffer */ \
     if (!str_dat) return DWG_ERR_OUTOFMEM; \
   } else \
     str_dat = dat; \
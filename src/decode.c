@@ -25,9 +25,16 @@
 #include <string.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <time.h>
 #ifdef HAVE_WCHAR_H
 # include <wchar.h>
 #endif
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+#ifdef HAVE_X86INTRIN_H
+# include <x86intrin.h>
+#endif
 
 #include "common.h"
 #include "bits.h"
@@ -36,22 +43,55 @@
 #include "decode.h"
 #include "print.h"
 
-/* The logging level for the read (decode) path.  */
-static unsigned int loglevel;
+/* The logging level for the read (decode) path, per thread.  */
+static THREAD_LOCAL unsigned int loglevel;
 /* the current version per spec block */
 static int cur_ver = 0;
 
-#ifdef USE_TRACING
-/* This flag means we have checked the environment variable
-   LIBREDWG_TRACE and set `loglevel' appropriately.  */
-static bool env_var_checked_p;
-#endif  /* USE_TRACING */
+/* Per-thread object_ref buffer of the parallel object decoder,
+   merged into dwg->object_ref[] afterwards. NULL when decoding serially. */
+struct _decode_refs
+{
+  Dwg_Object_Ref **ref;
+  BITCODE_BL *owner;
+  BITCODE_BL num;
+  BITCODE_BL size;
+};
+static struct _decode_refs *thread_refs = NULL;
+#ifdef _OPENMP
+#pragma omp threadprivate(cur_ver, thread_refs)
+#endif
+
+/* The phase timer of dwg->stats, see stats_phase() */
+static THREAD_LOCAL Dwg_Phase cur_phase = DWG_PHASE_OTHER;
+static THREAD_LOCAL double phase_start;
+/* dwg_alloc_count() at the start of the decode */
+static THREAD_LOCAL unsigned long long alloc_start;
+
+/* The per-type profile with opts 0x40, see profile_object() */
+#ifdef HAVE_X86INTRIN_H
+# define PROFILE_TICKS() (BITCODE_RLL) __rdtsc()
+#else
+# define PROFILE_TICKS() (BITCODE_RLL)(stats_time() * 1e9)
+#endif
+#ifdef _OPENMP
+# define PROFILE_ADD(field, value) \
+  _Pragma("omp atomic") \
+  field += value;
+#else
+# define PROFILE_ADD(field, value) field += value;
+#endif
+#define PROFILE_MAX_TYPES (DWG_TYPE_XREFPANELOBJECT + 1)
+
 #define DWG_LOGLEVEL loglevel
 
 #include "logging.h"
 #include "dec_macros.h"
 
-#define REFS_PER_REALLOC 128
+/* Chunk size for the parallel handle resolution */
+#define REFS_PER_CHUNK 4096
+/* Chunk size for the parallel object decoder */
+#define OBJECTS_PER_CHUNK 256
 
 #define MAX(X,Y) ((X) > (Y) ? (X) : (Y))
 #define MIN(X,Y) ((X) < (Y) ? (X) : (Y))
@@ -63,6 +103,21 @@ static bool env_var_checked_p;
 static int
 resolve_objectref_vector(Bit_Chain* dat, Dwg_Data * dwg);
 
+static int
+decode_objects(Dwg_Data *restrict dwg, Bit_Chain *restrict dat,
+               const long unsigned int *restrict offsets, BITCODE_BL num);
+static int
+add_offset(long unsigned int **offsets, BITCODE_BL *num, BITCODE_BL *size,
+           const long unsigned int offset);
+static double
+stats_time(void);
+static Dwg_Phase
+stats_phase(Dwg_Data *restrict dwg, const Dwg_Phase phase);
+static int
+stats_finish(Dwg_Data *restrict dwg, const double start, const int error);
+static int
+profile_alloc(Dwg_Data *restrict dwg);
+
 static void
 decode_preR13_section_ptr(const char* name, Dwg_Section_Type_r11 id,
                           Bit_Chain* dat, Dwg_Data * dwg);
@@ -107,6 +162,9 @@ dwg_decode_entity(Bit_Chain* dat, Bit_Chain* hdl_dat, Bit_Chain* str_dat,
  * Public function definitions
  */
 
+static int
+decode_dwg(Bit_Chain *restrict dat, Dwg_Data *restrict dwg);
+
 /** dwg_decode
  * returns 0 on success.
  *
@@ -115,9 +173,22 @@ dwg_decode_entity(Bit_Chain* dat, Bit_Chain* hdl_dat, Bit_Chain* str_dat,
  */
 int
 dwg_decode(Bit_Chain * dat, Dwg_Data * dwg)
+{
+  Dwg_Thread_State state;
+  int error;
+
+  loglevel = dwg_log_enter(dwg, &state);
+  error = decode_dwg(dat, dwg);
+  dwg_log_leave(&state);
+  return error;
+}
+
+static int
+decode_dwg(Bit_Chain *restrict dat, Dwg_Data *restrict dwg)
 {
   int i;
   char version[7];
+  double start;
 
   dwg->num_object_refs = 0;
   //dwg->num_layers = 0; // see now dwg->layer_control->num_entries
@@ -131,7 +202,23 @@ dwg_decode(Bit_Chain * dat, Dwg_Data * dwg)
   dwg->measurement = 0;
   dwg->dwg_class = NULL;
   dwg->object_ref = NULL;
+  dwg->object_ref_owner = NULL;
+  dwg->referrers_start = NULL;
+  dwg->referrers = NULL;
+  dwg->owned_start = NULL;
+  dwg->owned = NULL;
+  dwg->layered_start = NULL;
+  dwg->layered = NULL;
+  dwg->type_start = NULL;
+  dwg->type_objects = NULL;
+  dwg->type_groups_start = NULL;
+  dwg->type_groups = NULL;
+  dwg->type_tio = NULL;
+  dwg->entities = NULL;
+  dwg->num_rtree = 0;
+  dwg->rtree = NULL;
   dwg->object = NULL;
+  alloc_start = dwg_alloc_count();
   dwg->object_map = hash_new(dat->size/1000);
   if (!dwg->object_map)
     {
@@ -148,18 +235,12 @@ dwg_decode(Bit_Chain * dat, Dwg_Data * dwg)
   memset(&dwg->auxheader.aux_intro[0], 0, sizeof(dwg->auxheader));
   memset(&dwg->second_header.size, 0, sizeof(dwg->second_header));
 
-  if (dwg->opts)
-    loglevel = dwg->opts & 0xf;
-#ifdef USE_TRACING
-  /* Before starting, set the logging level, but only do so once.  */
-  if (! env_var_checked_p)
-    {
-      char *probe = getenv ("LIBREDWG_TRACE");
-      if (probe)
-        loglevel = atoi (probe);
-      env_var_checked_p = true;
-    }
-#endif  /* USE_TRACING */
+  // decoded again without dwg_free()
+  dwg_dealloc(dwg->stats.types);
+  dwg_dealloc(dwg->stats.profile);
+  memset(&dwg->stats, 0, sizeof(Dwg_Stats));
+  cur_phase = DWG_PHASE_OTHER;
+  start = phase_start = stats_time();
 
   /* Version */
   dat->byte = 0;
@@ -201,26 +282,26 @@ dwg_decode(Bit_Chain * dat, Dwg_Data * dwg)
     {
       LOG_ERROR(WE_CAN "We don't decode many entities and no blocks yet.")
 #ifndef IS_RELEASE
-      return decode_preR13(dat, dwg);
+      return stats_finish(dwg, start, decode_preR13(dat, dwg));
 #endif
     }
 
   VERSIONS(R_13, R_2000)
     {
-      return decode_R13_R2000(dat, dwg);
+      return stats_finish(dwg, start, decode_R13_R2000(dat, dwg));
     }
   VERSION(R_2004)
     {
-      return decode_R2004(dat, dwg);
+      return stats_finish(dwg, start, decode_R2004(dat, dwg));
     }
   VERSION(R_2007)
     {
-      return decode_R2007(dat, dwg);
+      return stats_finish(dwg, start, decode_R2007(dat, dwg));
     }
   SINCE(R_2010)
     {
       read_r2007_init(dwg);
-      return decode_R2004(dat, dwg);
+      return stats_finish(dwg, start, decode_R2004(dat, dwg));
     }
 
   // This line should not be reached
@@ -284,13 +365,22 @@ decode_preR13_section(Dwg_Section_Type_r11 id, Bit_Chain* dat, Dwg_Data * dwg)
             (long)(tbl->address + tbl->number * tbl->size))
   dat->byte = tbl->address;
   if (dwg->num_objects % REFS_PER_REALLOC == 0)
-    dwg->object = realloc(dwg->object, old_size + size + REFS_PER_REALLOC);
+    {
+      Dwg_Object *object = dwg_realloc(dwg->object,
+                                       old_size + size + REFS_PER_REALLOC);
+      if (!object)
+        {
+          LOG_ERROR("Out of memory");
+          return DWG_ERR_OUTOFMEM;
+        }
+      dwg->object = object;
+    }
 
   // TODO: move to a spec dwg_r11.spec, and dwg_decode_r11_NAME
 #define PREP_TABLE(name)\
   Dwg_Object *obj = &dwg->object[num + i];                              \
-  Dwg_Object_##name *_obj = calloc (1, sizeof(Dwg_Object_##name));      \
-  obj->tio.object = calloc (1, sizeof(Dwg_Object_Object));              \
+  Dwg_Object_##name *_obj = dwg_calloc (1, sizeof(Dwg_Object_##name));      \
+  obj->tio.object = dwg_calloc (1, sizeof(Dwg_Object_Object));              \
   obj->tio.object->tio.name = _obj;                                     \
   obj->tio.object->objid = obj->index;                                  \
   obj->parent = dwg;                                                    \
@@ -602,7 +692,7 @@ decode_preR13(Bit_Chain* dat, Dwg_Data * dwg)
 
   // tables really
   dwg->header.num_sections = 12;
-  dwg->header.section = (Dwg_Section*) calloc(1, sizeof(Dwg_Section)
+  dwg->header.section = (Dwg_Section*) dwg_calloc(1, sizeof(Dwg_Section)
       * dwg->header.num_sections);
   if (!dwg->header.section)
     {
@@ -749,9 +839,12 @@ decode_R13_R2000(Bit_Chain* dat, Dwg_Data * dwg)
   long unsigned int object_begin;
   long unsigned int object_end;
   long unsigned int pvz;
+  long unsigned int *offsets = NULL;
+  BITCODE_BL num_offsets = 0, size_offsets = 0;
   BITCODE_BL j, k;
   int error = 0;
 
+  stats_phase(dwg, DWG_PHASE_HEADER);
   {
     int i;
     struct Dwg_Header *_obj = &dwg->header;
@@ -769,7 +862,7 @@ decode_R13_R2000(Bit_Chain* dat, Dwg_Data * dwg)
     dwg->header.num_sections = 6;
 
   // So far seen 3-6 sections. Most emit only 3-5 sections.
-  dwg->header.section = (Dwg_Section*) calloc(1, sizeof(Dwg_Section)
+  dwg->header.section = (Dwg_Section*) dwg_calloc(1, sizeof(Dwg_Section)
       * dwg->header.num_sections);
   if (!dwg->header.section)
     {
@@ -815,6 +908,7 @@ decode_R13_R2000(Bit_Chain* dat, Dwg_Data * dwg)
   if (bit_search_sentinel(dat, dwg_sentinel(DWG_SENTINEL_HEADER_END)))
     LOG_TRACE("\n=======> HEADER (end): %8X\n", (unsigned int) dat->byte)
 
+  stats_phase(dwg, DWG_PHASE_OTHER);
   /*-------------------------------------------------------------------------
    * Section 5 AuxHeader
    * R2000+, mostly redundant file header information
@@ -855,7 +949,7 @@ decode_R13_R2000(Bit_Chain* dat, Dwg_Data * dwg)
           LOG_TRACE("         PICTURE (end): %8X\n",
                 (unsigned int) dat->byte)
           dwg->picture.size = (dat->byte - 16) - start_address;
-          dwg->picture.chain = (unsigned char *) calloc(dwg->picture.size, 1);
+          dwg->picture.chain = (unsigned char *) dwg_calloc(dwg->picture.size, 1);
           if (!dwg->picture.chain)
             {
               LOG_ERROR("Out of memory");
@@ -869,6 +963,7 @@ decode_R13_R2000(Bit_Chain* dat, Dwg_Data * dwg)
   /*-------------------------------------------------------------------------
    * Header Variables, section 0
    */
+  stats_phase(dwg, DWG_PHASE_HEADER);
 
   LOG_INFO("\n=======> Header Variables: %8X\n",
           (unsigned int) dwg->header.section[SECTION_HEADER_R13].address)
@@ -909,6 +1004,7 @@ decode_R13_R2000(Bit_Chain* dat, Dwg_Data * dwg)
   /*-------------------------------------------------------------------------
    * Classes, section 1
    */
+  stats_phase(dwg, DWG_PHASE_CLASSES);
   LOG_INFO("\n"
            "=======> CLASS 1 (start): %8lX\n",
            (long)dwg->header.section[SECTION_CLASSES_R13].address)
@@ -934,9 +1030,9 @@ decode_R13_R2000(Bit_Chain* dat, Dwg_Data * dwg)
 
       i = dwg->num_classes;
       if (i == 0)
-        dwg->dwg_class = malloc(sizeof(Dwg_Class));
+        dwg->dwg_class = dwg_malloc(sizeof(Dwg_Class));
       else
-        dwg->dwg_class = realloc(dwg->dwg_class, (i + 1) * sizeof(Dwg_Class));
+        dwg->dwg_class = dwg_realloc(dwg->dwg_class, (i + 1) * sizeof(Dwg_Class));
       if (!dwg->dwg_class)
         {
           LOG_ERROR("Out of memory");
@@ -1013,6 +1109,7 @@ decode_R13_R2000(Bit_Chain* dat, Dwg_Data * dwg)
   /*-------------------------------------------------------------------------
    * Object-map, section 2
    */
+  stats_phase(dwg, DWG_PHASE_OBJECT_MAP);
 
   dat->byte = dwg->header.section[SECTION_OBJECTS_R13].address;
   dat->bit = 0;
@@ -1028,7 +1125,6 @@ decode_R13_R2000(Bit_Chain* dat, Dwg_Data * dwg)
       long unsigned int last_offset;
       //long unsigned int last_handle;
       long unsigned int oldpos = 0;
-      int added;
       startpos = dat->byte;
 
       section_size = bit_read_RS_LE(dat);
@@ -1036,7 +1132,9 @@ decode_R13_R2000(Bit_Chain* dat, Dwg_Data * dwg)
       if (section_size > 2035)
         {
           LOG_ERROR("Object-map section size greater than 2035!")
-          return DWG_ERR_VALUEOUTOFBOUNDS;
+          error |= decode_objects(dwg, dat, offsets, num_offsets);
+          dwg_dealloc(offsets);
+          return error | DWG_ERR_VALUEOUTOFBOUNDS;
         }
 
       //last_handle = 0;
@@ -1049,7 +1147,7 @@ decode_R13_R2000(Bit_Chain* dat, Dwg_Data * dwg)
           offset = bit_read_MC(dat);
           //last_handle += handle;
           last_offset += offset;
-          LOG_TRACE("\nNext object: %lu\t", (unsigned long)dwg->num_objects)
+          LOG_TRACE("\nNext object: %lu\t", (unsigned long)num_offsets)
           LOG_TRACE("Handle: %li\tOffset: %ld @%lu\n", handle, offset, last_offset)
 
           if (dat->byte == oldpos)
@@ -1060,15 +1158,11 @@ decode_R13_R2000(Bit_Chain* dat, Dwg_Data * dwg)
           if (object_begin > last_offset)
             object_begin = last_offset;
 
-          added = dwg_decode_add_object(dwg, dat, dat, last_offset);
-          if (added > 0)
-            error |= added; // else not added (skipped) or -1 for re-allocated
-#if 0
-          kobj = dwg->num_objects;
-          if (dwg->num_objects > kobj)
-            dwg->object[dwg->num_objects - 1].handle.value = last_handle;
-          //TODO: blame Juca
-#endif
+          if (add_offset(&offsets, &num_offsets, &size_offsets, last_offset))
+            {
+              dwg_dealloc(offsets);
+              return DWG_ERR_OUTOFMEM;
+            }
         }
       if (dat->byte == oldpos)
         break;
@@ -1098,6 +1192,10 @@ decode_R13_R2000(Bit_Chain* dat, Dwg_Data * dwg)
     }
   while (section_size > 2);
 
+  // the whole file is in memory, so decode all objects at once
+  error |= decode_objects(dwg, dat, offsets, num_offsets);
+  dwg_dealloc(offsets);
+
   LOG_INFO("Num objects: %lu\n", (unsigned long)dwg->num_objects)
   LOG_INFO("\n"
            "=======> Object Data 2 (start)  : %8lX\n",
@@ -1144,6 +1242,7 @@ decode_R13_R2000(Bit_Chain* dat, Dwg_Data * dwg)
    * Second header, section 3. R13-R2000 only.
    * But partially also since r2004.
    */
+  stats_phase(dwg, DWG_PHASE_OTHER);
 
   if (bit_search_sentinel(dat, dwg_sentinel(DWG_SENTINEL_SECOND_HEADER_BEGIN)))
     {
@@ -1197,7 +1296,7 @@ decode_R13_R2000(Bit_Chain* dat, Dwg_Data * dwg)
             FIELD_BL(section[i].address, 0);
             FIELD_BL(section[i].size, 0);
           }
-        if (DWG_LOGLEVEL >= DWG_LOGLEVEL_HANDLE)
+        if (LOG_ENABLED(HANDLE))
           {
             LOG_HANDLE("1st header was:\n");
             for (i = 0; i < (int)dwg->header.num_sections; i++)
@@ -1259,15 +1358,64 @@ decode_R13_R2000(Bit_Chain* dat, Dwg_Data * dwg)
   //step II of handles parsing: resolve pointers from handle value
   //XXX: move this somewhere else
   LOG_TRACE("\nResolving pointers from ObjectRef vector.\n")
+  stats_phase(dwg, DWG_PHASE_HANDLES);
   error |= resolve_objectref_vector(dat, dwg);
   return error;
 }
 
+/* Resolve object_ref[start..end) to their objects. The object_map is only
+   read here, so disjoint chunks may run concurrently. */
+static void
+resolve_objectref_chunk(Dwg_Data *restrict dwg, BITCODE_BL start,
+                        BITCODE_BL end)
+{
+  BITCODE_BL i;
+  for (i = start; i < end; i++)
+    {
+      Dwg_Object_Ref *ref = dwg->object_ref[i];
+      if (!ref)
+        continue;
+      ref->obj = dwg_resolve_handle(dwg, ref->absolute_ref);
+      ref->generation = dwg->ref_generation;
+    }
+}
+
+static void
+resolve_objectref_chunks(Dwg_Data *restrict dwg)
+{
+  long c;
+  const long num_chunks
+      = (long)((dwg->num_object_refs + REFS_PER_CHUNK - 1) / REFS_PER_CHUNK);
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) if (num_chunks > 1)
+#endif
+  for (c = 0; c < num_chunks; c++)
+    {
+      BITCODE_BL start = (BITCODE_BL)c * REFS_PER_CHUNK;
+      BITCODE_BL end = MIN(start + REFS_PER_CHUNK, dwg->num_object_refs);
+      resolve_objectref_chunk(dwg, start, end);
+    }
+}
+
 static int
 resolve_objectref_vector(Bit_Chain* dat, Dwg_Data * dwg)
 {
   BITCODE_BL i;
   Dwg_Object * obj;
+  int error = 0;
+
+  // the traced variant must stay sequential to keep the log in order
+  if (!LOG_ENABLED(TRACE))
+    {
+      resolve_objectref_chunks(dwg);
+      if (dwg->opts & DWG_OPTS_REFERRERS)
+        error = dwg_build_referrers(dwg);
+      error |= dwg_build_owned_index(dwg);
+      error |= dwg_build_layer_index(dwg);
+      error |= dwg_build_type_index(dwg);
+      return error | (dwg->num_object_refs ? 0 : DWG_ERR_VALUEOUTOFBOUNDS);
+    }
 
   for (i = 0; i < dwg->num_object_refs; i++)
     {
@@ -1288,8 +1436,9 @@ resolve_objectref_vector(Bit_Chain* dat, Dwg_Data * dwg)
         }
       //assign found pointer to objectref vector
       ref->obj = obj;
+      ref->generation = dwg->ref_generation;
 
-      if (DWG_LOGLEVEL >= DWG_LOGLEVEL_INSANE)
+      if (LOG_ENABLED(INSANE))
         {
           if (obj)
             dwg_print_object(dat, obj);
@@ -1297,26 +1446,24 @@ resolve_objectref_vector(Bit_Chain* dat, Dwg_Data * dwg)
             LOG_TRACE("Null object pointer: object_ref[%ld]\n", (long)i)
         }
     }
-  return dwg->num_object_refs ? 0 : DWG_ERR_VALUEOUTOFBOUNDS;
+  if (dwg->opts & DWG_OPTS_REFERRERS)
+    error = dwg_build_referrers(dwg);
+  error |= dwg_build_owned_index(dwg);
+  error |= dwg_build_layer_index(dwg);
+  error |= dwg_build_type_index(dwg);
+  return error | (dwg->num_object_refs ? 0 : DWG_ERR_VALUEOUTOFBOUNDS);
 }
 
+/* Re-resolve all refs in the object_ref vector, e.g. after an object[]
+   realloc. dwg_add_object() already bumped dwg->ref_generation, so refs
+   outside the vector are resolved lazily on their next dwg_ref_object(). */
 void
 dwg_resolve_objectrefs_silent(Dwg_Data *restrict dwg)
 {
-  BITCODE_BL i;
-  Dwg_Object *restrict obj;
   int oldloglevel = loglevel;
 
   loglevel = 0;
-  // Dwg_Object_Ref->obj are stored all over. dirty it to update dynamically.
-  dwg->dirty_refs = 1; // TODO: this is now forever. find a way to resolve all objs also.
-  for (i = 0; i < dwg->num_object_refs; i++)
-    {
-      //scan num_objects for the id (absolute_ref)
-      obj = dwg_resolve_handle(dwg, dwg->object_ref[i]->absolute_ref);
-      dwg->object_ref[i]->obj = obj;
-    }
-  //TODO: scan dwg->num_objects also to update it's handlerefs
+  resolve_objectref_chunks(dwg);
   loglevel = oldloglevel;
 }
 
@@ -1517,7 +1664,7 @@ read_R2004_section_map(Bit_Chain* dat, Dwg_Data * dwg)
   dwg->header.section = 0;
 
   // decompressed data
-  decomp = (char *)calloc(decomp_data_size+1024, sizeof(char));
+  decomp = (char *)dwg_calloc(decomp_data_size+1024, sizeof(char));
   if (!decomp)
     {
       LOG_ERROR("Out of memory");
@@ -1538,9 +1685,9 @@ read_R2004_section_map(Bit_Chain* dat, Dwg_Data * dwg)
   while (bytes_remaining)
     {
       if (dwg->header.num_sections == 0)
-        dwg->header.section = calloc(1, sizeof(Dwg_Section));
+        dwg->header.section = dwg_calloc(1, sizeof(Dwg_Section));
       else
-        dwg->header.section = realloc(dwg->header.section,
+        dwg->header.section = dwg_realloc(dwg->header.section,
                        sizeof(Dwg_Section) * (dwg->header.num_sections+1));
       if (!dwg->header.section)
         {
@@ -1577,7 +1724,7 @@ read_R2004_section_map(Bit_Chain* dat, Dwg_Data * dwg)
       dwg->header.num_sections++;
       i++;
     }
-  free(decomp);
+  dwg_dealloc(decomp);
   return 0;
 }
 
@@ -1610,7 +1757,7 @@ read_R2004_section_info(Bit_Chain* dat, Dwg_Data *dwg,
   uint64_t start_offset;
   int error;
 
-  decomp = (char *)calloc(decomp_data_size+1024, 1);
+  decomp = (char *)dwg_calloc(decomp_data_size+1024, 1);
   if (!decomp)
     {
       LOG_ERROR("Out of memory");
@@ -1623,7 +1770,7 @@ read_R2004_section_info(Bit_Chain* dat, Dwg_Data *dwg,
 
   dwg->header.num_infos = *(uint32_t*)decomp;
   dwg->header.section_info = (Dwg_Section_Info*)
-    calloc(dwg->header.num_infos, sizeof(Dwg_Section_Info));
+    dwg_calloc(dwg->header.num_infos, sizeof(Dwg_Section_Info));
   if (!dwg->header.section_info)
     {
       LOG_ERROR("Out of memory");
@@ -1678,7 +1825,7 @@ read_R2004_section_info(Bit_Chain* dat, Dwg_Data *dwg,
       if (info->num_sections < 100000)
 	{
 	  LOG_INFO("Section count %u in area %d\n", info->num_sections, i);
-          info->sections = calloc(info->num_sections, sizeof(Dwg_Section*));
+          info->sections = dwg_calloc(info->num_sections, sizeof(Dwg_Section*));
           if (!info->sections)
             {
               LOG_ERROR("Out of memory with %u sections", info->num_sections);
@@ -1732,7 +1879,7 @@ read_R2004_section_info(Bit_Chain* dat, Dwg_Data *dwg,
           LOG_TRACE("Section Number: %d\n", section_number)
           LOG_TRACE("Data size:      %d\n", data_size) //compressed
           LOG_TRACE("Start offset:   0x%" PRIx64 "\n", start_offset);
-          free (decomp);
+          dwg_dealloc (decomp);
           return error | DWG_ERR_VALUEOUTOFBOUNDS;
         }
       else
@@ -1740,11 +1887,11 @@ read_R2004_section_info(Bit_Chain* dat, Dwg_Data *dwg,
 	  LOG_ERROR("Section count %u in area %d too high! Skipping",
                     info->num_sections, i);
           info->num_sections = 0;
-          free (decomp);
+          dwg_dealloc (decomp);
           return error | DWG_ERR_VALUEOUTOFBOUNDS;
 	}
     }
-  free (decomp);
+  dwg_dealloc (decomp);
   return error;
 }
 
@@ -1768,8 +1915,8 @@ typedef union _encrypted_section_header
 } encrypted_section_header;
 
 static int
-read_2004_compressed_section(Bit_Chain* dat, Dwg_Data *dwg,
-                            Bit_Chain* sec_dat, BITCODE_RL section_type)
+read_2004_compressed_pages(Bit_Chain* dat, Dwg_Data *dwg,
+                           Bit_Chain* sec_dat, BITCODE_RL section_type)
 {
   uint32_t address, sec_mask;
   uint32_t max_decomp_size;
@@ -1799,7 +1946,7 @@ read_2004_compressed_section(Bit_Chain* dat, Dwg_Data *dwg,
     }
 
   max_decomp_size = info->num_sections * info->max_decomp_size;
-  decomp = (char *)calloc(max_decomp_size, sizeof(char));
+  decomp = (char *)dwg_calloc(max_decomp_size, sizeof(char));
   if (!decomp)
     {
       LOG_ERROR("Out of memory with %u sections", info->num_sections);
@@ -1846,6 +1993,8 @@ read_2004_compressed_section(Bit_Chain* dat, Dwg_Data *dwg,
          es.fields.data_size);
       if (error > DWG_ERR_CRITICAL)
         return error;
+      dwg->stats.num_pages++;
+      dwg->stats.bytes_decompressed += es.fields.data_size;
     }
 
   sec_dat->bit     = 0;
@@ -1858,6 +2007,21 @@ read_2004_compressed_section(Bit_Chain* dat, Dwg_Data *dwg,
   return 0;
 }
 
+// Read and decompress all pages of the section, and time it.
+static int
+read_2004_compressed_section(Bit_Chain* dat, Dwg_Data *dwg,
+                            Bit_Chain* sec_dat, BITCODE_RL section_type)
+{
+  const Dwg_Phase phase = stats_phase(dwg, DWG_PHASE_DECOMPRESS);
+  const double start = phase_start;
+  int error = read_2004_compressed_pages(dat, dwg, sec_dat, section_type);
+
+  stats_phase(dwg, phase);
+  if (section_type <= SECTION_UNKNOWN)
+    dwg->stats.section_time[section_type] += phase_start - start;
+  return error;
+}
+
 /* R2004, 2010+ Class Section
  */
 static int
@@ -1876,7 +2040,7 @@ read_2004_section_classes(Bit_Chain* dat, Dwg_Data *dwg)
     {
       LOG_ERROR("Failed to read compressed class section");
       if (sec_dat.chain)
-        free(sec_dat.chain);
+        dwg_dealloc(sec_dat.chain);
       return error;
     }
 
@@ -1919,12 +2083,12 @@ read_2004_section_classes(Bit_Chain* dat, Dwg_Data *dwg)
       if (dat->version >= R_2007)
         section_string_stream(&sec_dat, bitsize, &str_dat);
 
-      dwg->dwg_class = (Dwg_Class *) calloc(dwg->num_classes, sizeof(Dwg_Class));
+      dwg->dwg_class = (Dwg_Class *) dwg_calloc(dwg->num_classes, sizeof(Dwg_Class));
       if (!dwg->dwg_class)
         {
           LOG_ERROR("Out of memory");
           if (sec_dat.chain)
-            free(sec_dat.chain);
+            dwg_dealloc(sec_dat.chain);
           return DWG_ERR_OUTOFMEM;
         }
 
@@ -1980,7 +2144,7 @@ read_2004_section_classes(Bit_Chain* dat, Dwg_Data *dwg)
   else
     {
       LOG_ERROR("Failed to find class section sentinel");
-      free(sec_dat.chain);
+      dwg_dealloc(sec_dat.chain);
       return DWG_ERR_CLASSESNOTFOUND;
     }
 
@@ -1988,7 +2152,7 @@ read_2004_section_classes(Bit_Chain* dat, Dwg_Data *dwg)
   // dwg_sentinel(DWG_SENTINEL_CLASS_END)
   // SINCE(R_2004) 8 unknown bytes
   
-  free(sec_dat.chain);
+  dwg_dealloc(sec_dat.chain);
   return 0;
 }
 
@@ -2030,7 +2194,7 @@ read_2004_section_header(Bit_Chain* dat, Dwg_Data *dwg)
         error |= dwg_decode_header_variables(&sec_dat, &hdl_dat, &str_dat, dwg);
       }
     }
-  free(sec_dat.chain);
+  dwg_dealloc(sec_dat.chain);
   return error;
 }
 
@@ -2042,6 +2206,8 @@ read_2004_section_handles(Bit_Chain* dat, Dwg_Data *dwg)
   Bit_Chain obj_dat, hdl_dat;
   BITCODE_RS section_size = 0;
   long unsigned int endpos;
+  long unsigned int *offsets = NULL;
+  BITCODE_BL num_offsets = 0, size_offsets = 0;
   int error;
 
   error = read_2004_compressed_section(dat, dwg, &obj_dat, SECTION_OBJECTS);
@@ -2051,13 +2217,14 @@ read_2004_section_handles(Bit_Chain* dat, Dwg_Data *dwg)
   error = read_2004_compressed_section(dat, dwg, &hdl_dat, SECTION_HANDLES);
   if (error)
     {
-      free(obj_dat.chain);
+      dwg_dealloc(obj_dat.chain);
       return error;
     }
 
   endpos = hdl_dat.byte + hdl_dat.size;
   dwg->num_objects = 0;
 
+  // first collect all offsets, then decode them all at once
   do
     {
       long unsigned int last_offset;
@@ -2070,30 +2237,29 @@ read_2004_section_handles(Bit_Chain* dat, Dwg_Data *dwg)
       if (section_size > 2034)
         {
           LOG_ERROR("Object-map section size greater than 2034!");
-          free(obj_dat.chain);
-          return DWG_ERR_VALUEOUTOFBOUNDS;
+          error |= DWG_ERR_VALUEOUTOFBOUNDS;
+          break; // decode the objects so far
         }
 
       //last_handle = 0;
       last_offset = 0;
       while (hdl_dat.byte - startpos < section_size)
         {
-          int added;
           long handle, offset;
           oldpos = dat->byte;
           handle = bit_read_MC(&hdl_dat);
           offset = bit_read_MC(&hdl_dat);
           //last_handle += handle;
           last_offset += offset;
-          LOG_TRACE("\n< Next object: %lu\t", (unsigned long)dwg->num_objects)
           LOG_HANDLE("Handle: %lX\tOffset: %ld @%lu\n", handle, offset, last_offset)
 
-          added = dwg_decode_add_object(dwg, &obj_dat, &obj_dat, last_offset);
-          if (added > 0)
-            error |= added;
-          //else re-allocated
-          // we don't stop encoding on single errors, but we sum them all up
-          // as combined bitmask
+          if (add_offset(&offsets, &num_offsets, &size_offsets, last_offset))
+            {
+              dwg_dealloc(offsets);
+              dwg_dealloc(hdl_dat.chain);
+              dwg_dealloc(obj_dat.chain);
+              return DWG_ERR_OUTOFMEM;
+            }
         }
 
       if (hdl_dat.byte == oldpos)
@@ -2105,10 +2271,12 @@ read_2004_section_handles(Bit_Chain* dat, Dwg_Data *dwg)
     }
   while (section_size > 2);
 
+  error |= decode_objects(dwg, &obj_dat, offsets, num_offsets);
   LOG_TRACE("\nNum objects: %lu\n", (unsigned long)dwg->num_objects);
 
-  free(hdl_dat.chain);
-  free(obj_dat.chain);
+  dwg_dealloc(offsets);
+  dwg_dealloc(hdl_dat.chain);
+  dwg_dealloc(obj_dat.chain);
   return error;
 }
 
@@ -2119,6 +2287,7 @@ decode_R2004(Bit_Chain* dat, Dwg_Data * dwg)
   int j, error = 0;
   Dwg_Section *section;
 
+  stats_phase(dwg, DWG_PHASE_HEADER);
   {
     struct Dwg_Header* _obj = &dwg->header;
     Dwg_Object *obj = NULL;
@@ -2179,6 +2348,7 @@ decode_R2004(Bit_Chain* dat, Dwg_Data * dwg)
 
   }
 
+  stats_phase(dwg, DWG_PHASE_SECTION_MAP);
   error |= read_R2004_section_map(dat, dwg);
   if (!dwg->header.section || error >= DWG_ERR_CRITICAL)
     {
@@ -2216,9 +2386,13 @@ decode_R2004(Bit_Chain* dat, Dwg_Data * dwg)
   else
     error |= DWG_ERR_SECTIONNOTFOUND;
 
+  stats_phase(dwg, DWG_PHASE_CLASSES);
   error |= read_2004_section_classes(dat, dwg);
+  stats_phase(dwg, DWG_PHASE_HEADER);
   error |= read_2004_section_header(dat, dwg);
+  stats_phase(dwg, DWG_PHASE_OBJECT_MAP);
   error |= read_2004_section_handles(dat, dwg);
+  stats_phase(dwg, DWG_PHASE_OTHER);
 
   /* Clean up. XXX? Need this to write the sections, at least the name and type */
 #if 0
@@ -2227,13 +2401,14 @@ decode_R2004(Bit_Chain* dat, Dwg_Data * dwg)
       unsigned u;
       for (u = 0; u < dwg->header.num_infos; ++u)
         if (dwg->header.section_info[u].sections != 0)
-          free(dwg->header.section_info[u].sections);
+          dwg_dealloc(dwg->header.section_info[u].sections);
 
-      free(dwg->header.section_info);
+      dwg_dealloc(dwg->header.section_info);
       dwg->header.num_infos = 0;
     }
 #endif
 
+  stats_phase(dwg, DWG_PHASE_HANDLES);
   error |= resolve_objectref_vector(dat, dwg);
   return error;
 }
@@ -2245,6 +2420,7 @@ decode_R2007(Bit_Chain* dat, Dwg_Data * dwg)
   int error;
 
   hdl_dat = *dat;
+  stats_phase(dwg, DWG_PHASE_HEADER);
   {
     int i;
     struct Dwg_Header *_obj = &dwg->header;
@@ -2253,6 +2429,7 @@ decode_R2007(Bit_Chain* dat, Dwg_Data * dwg)
     dat->byte = 0x06;
     #include "header.spec"
   }
+  stats_phase(dwg, DWG_PHASE_OTHER);
 
   // this includes classes, header, handles + objects
   error = read_r2007_meta_data(dat, &hdl_dat, dwg);
@@ -2264,6 +2441,7 @@ decode_R2007(Bit_Chain* dat, Dwg_Data * dwg)
 
   LOG_INFO("Num objects: %lu\n", (unsigned long)dwg->num_objects)
   LOG_TRACE("  num object_refs: %lu\n", (unsigned long)dwg->num_object_refs)
+  stats_phase(dwg, DWG_PHASE_HANDLES);
   return error | resolve_objectref_vector(dat, dwg);
 }
 
@@ -2301,17 +2479,26 @@ dwg_decode_eed(Bit_Chain * dat, Dwg_Object_Object * obj)
         }
 
       if (idx) {
-        obj->eed = (Dwg_Eed*)realloc(obj->eed, (idx+1) * sizeof(Dwg_Eed));
+        Dwg_Eed *eed = (Dwg_Eed*)dwg_realloc(obj->eed, (idx+1) * sizeof(Dwg_Eed));
+        if (!eed) {
+          LOG_ERROR("Out of memory");
+          return DWG_ERR_OUTOFMEM;
+        }
+        obj->eed = eed;
         memset(&obj->eed[idx], 0, sizeof(Dwg_Eed));
       } else {
-        obj->eed = (Dwg_Eed*)calloc(1, sizeof(Dwg_Eed));
+        obj->eed = (Dwg_Eed*)dwg_calloc(1, sizeof(Dwg_Eed));
+        if (!obj->eed) {
+          LOG_ERROR("Out of memory");
+          return DWG_ERR_OUTOFMEM;
+        }
       }
       obj->eed[idx].size = size;
       error = bit_read_H(dat, &obj->eed[idx].handle);
       if (error) {
         LOG_ERROR("No EED[%d].handle", idx);
         obj->num_eed = 0;
-        free(obj->eed);
+        dwg_dealloc(obj->eed);
         obj->eed = NULL;
         return error;
       } else {
@@ -2355,7 +2542,12 @@ dwg_decode_eed(Bit_Chain * dat, Dwg_Object_Object * obj)
           int lenc;
           BITCODE_RS lens;
 
-          obj->eed[idx].data = (Dwg_Eed_Data*)calloc(size + 8, 1);
+          obj->eed[idx].data = (Dwg_Eed_Data*)dwg_calloc(size + 8, 1);
+          if (!obj->eed[idx].data)
+            {
+              LOG_ERROR("Out of memory");
+              return DWG_ERR_OUTOFMEM;
+            }
           obj->eed[idx].data->code = code = bit_read_RC(dat);
           LOG_TRACE("EED[%u] code: %d\n", idx, (int)code);
           switch (code)
@@ -2373,9 +2565,9 @@ dwg_decode_eed(Bit_Chain * dat, Dwg_Object_Object * obj)
 
                     obj->num_eed = 0;
                     if (obj->eed[idx].size)
-                      free(obj->eed[idx].raw);
-                    free(obj->eed[idx].data);
-                    free(obj->eed);
+                      dwg_dealloc(obj->eed[idx].raw);
+                    dwg_dealloc(obj->eed[idx].data);
+                    dwg_dealloc(obj->eed);
                     obj->eed = NULL;
                     dat->byte = end;
                     return DWG_ERR_VALUEOUTOFBOUNDS; /* may not continue */
@@ -2459,10 +2651,16 @@ dwg_decode_eed(Bit_Chain * dat, Dwg_Object_Object * obj)
           obj->num_eed++;
           if (dat->byte < end-1)
             {
+              Dwg_Eed *eed;
               size = (long)(end - dat->byte + 1);
               LOG_INSANE("EED[%u] size remaining: %ld\n", idx, (long)size);
 
-              obj->eed = (Dwg_Eed*)realloc(obj->eed, (idx+1) * sizeof(Dwg_Eed));
+              eed = (Dwg_Eed*)dwg_realloc(obj->eed, (idx+1) * sizeof(Dwg_Eed));
+              if (!eed) {
+                LOG_ERROR("Out of memory");
+                return DWG_ERR_OUTOFMEM;
+              }
+              obj->eed = eed;
               obj->eed[idx].handle = obj->eed[idx-1].handle;
               obj->eed[idx].size = 0;
               obj->eed[idx].raw = NULL;
@@ -2759,6 +2957,112 @@ dwg_decode_object(Bit_Chain* dat, Bit_Chain* hdl_dat, Bit_Chain* str_dat,
   return error;
 }
 
+/* Append ref to dwg->object_ref[], and its owning object index to
+   dwg->object_ref_owner[] for the reverse index (dwg_referrers).
+   Or to the thread's own buffer while decoding in parallel. */
+static int
+add_object_ref(Dwg_Data *restrict dwg, Dwg_Object_Ref *restrict ref,
+               const Dwg_Object *restrict obj)
+{
+  struct _decode_refs *refs = thread_refs;
+  if (refs)
+    {
+      if (refs->num == refs->size)
+        {
+          BITCODE_BL size = refs->size ? refs->size * 2 : REFS_PER_REALLOC;
+          Dwg_Object_Ref **r = dwg_realloc(refs->ref, size * sizeof(Dwg_Object_Ref*));
+          BITCODE_BL *o;
+          if (r)
+            refs->ref = r;
+          o = dwg_realloc(refs->owner, size * sizeof(BITCODE_BL));
+          if (o)
+            refs->owner = o;
+          if (!r || !o)
+            {
+              LOG_ERROR("Out of memory");
+              return DWG_ERR_OUTOFMEM;
+            }
+          refs->size = size;
+        }
+      refs->owner[refs->num] = obj ? obj->index : DWG_REFERRER_HEADER;
+      refs->ref[refs->num++] = ref;
+      return 0;
+    }
+  // Reserve memory space for object references
+  if (!dwg->num_object_refs)
+    {
+      dwg->object_ref = dwg_calloc(REFS_PER_REALLOC, sizeof(Dwg_Object_Ref*));
+      dwg->object_ref_owner = dwg_calloc(REFS_PER_REALLOC, sizeof(BITCODE_BL));
+    }
+  else if (dwg->num_object_refs % REFS_PER_REALLOC == 0)
+    {
+      // keep the old vectors on failure, to be freed
+      Dwg_Object_Ref **object_ref = dwg_realloc(dwg->object_ref,
+            (dwg->num_object_refs + REFS_PER_REALLOC) * sizeof(Dwg_Object_Ref*));
+      BITCODE_BL *owner;
+      if (object_ref)
+        dwg->object_ref = object_ref;
+      owner = dwg_realloc(dwg->object_ref_owner,
+            (dwg->num_object_refs + REFS_PER_REALLOC) * sizeof(BITCODE_BL));
+      if (owner)
+        dwg->object_ref_owner = owner;
+      if (!object_ref || !owner)
+        {
+          LOG_ERROR("Out of memory");
+          return DWG_ERR_OUTOFMEM;
+        }
+    }
+  if (!dwg->object_ref || !dwg->object_ref_owner)
+    {
+      LOG_ERROR("Out of memory");
+      return DWG_ERR_OUTOFMEM;
+    }
+  dwg->object_ref_owner[dwg->num_object_refs]
+      = obj ? obj->index : DWG_REFERRER_HEADER;
+  dwg->object_ref[dwg->num_object_refs++] = ref;
+  return 0;
+}
+
+/* Undo the last add_object_ref() */
+static void
+drop_last_object_ref(Dwg_Data *restrict dwg)
+{
+  struct _decode_refs *refs = thread_refs;
+  if (refs)
+    {
+      if (refs->num)
+        refs->ref[--refs->num] = NULL;
+    }
+  else if (dwg->num_object_refs)
+    dwg->object_ref[--dwg->num_object_refs] = NULL;
+}
+
+/* A new reference to the absolute handle absref, owned by obj, for the
+   importers. Stored in dwg->object_ref[] and resolved later. */
+Dwg_Object_Ref *
+dwg_add_handleref(Dwg_Data *restrict dwg, const unsigned int code,
+                  const unsigned long absref, const Dwg_Object *restrict obj)
+{
+  Dwg_Object_Ref *ref = (Dwg_Object_Ref *)dwg_calloc(1, sizeof(Dwg_Object_Ref));
+  unsigned long v;
+  if (!ref)
+    {
+      LOG_ERROR("Out of memory");
+      return NULL;
+    }
+  ref->handleref.code = code;
+  ref->handleref.value = absref;
+  for (v = absref; v; v >>= 8)
+    ref->handleref.size++;
+  ref->absolute_ref = absref;
+  if (add_object_ref(dwg, ref, obj))
+    {
+      dwg_dealloc(ref);
+      return NULL;
+    }
+  return ref;
+}
+
 /* Store an object reference in a separate dwg->object_ref array
    which is the id for handles, i.e. DXF 5, 330. */
 Dwg_Object_Ref *
@@ -2766,7 +3070,7 @@ dwg_decode_handleref(Bit_Chain *restrict dat, Dwg_Object *restrict obj,
                      Dwg_Data *restrict dwg)
 {
   // Welcome to the house of evil code
-  Dwg_Object_Ref* ref = (Dwg_Object_Ref *) calloc(1, sizeof(Dwg_Object_Ref));
+  Dwg_Object_Ref* ref = (Dwg_Object_Ref *) dwg_calloc(1, sizeof(Dwg_Object_Ref));
   if (!ref)
     {
       LOG_ERROR("Out of memory");
@@ -2777,7 +3081,7 @@ dwg_decode_handleref(Bit_Chain *restrict dat, Dwg_Object *restrict obj,
     {
       LOG_WARN("Invalid handleref: (%d.%d.%lX)",
                ref->handleref.code, ref->handleref.size, ref->handleref.value)
-      free(ref);
+      dwg_dealloc(ref);
       return NULL;
     }
 
@@ -2785,18 +3089,8 @@ dwg_decode_handleref(Bit_Chain *restrict dat, Dwg_Object *restrict obj,
   // It shouldn't be placed in the object ref vector.
   if (ref->handleref.size || (obj && ref->handleref.code > 5))
     {
-      // Reserve memory space for object references
-      if (!dwg->num_object_refs)
-        dwg->object_ref = calloc(REFS_PER_REALLOC, sizeof(Dwg_Object_Ref*));
-      else if (dwg->num_object_refs % REFS_PER_REALLOC == 0)
-        dwg->object_ref = realloc(dwg->object_ref,
-              (dwg->num_object_refs + REFS_PER_REALLOC) * sizeof(Dwg_Object_Ref*));
-      if (!dwg->object_ref)
-        {
-          LOG_ERROR("Out of memory");
-          return NULL;
-        }
-      dwg->object_ref[dwg->num_object_refs++] = ref;
+      if (add_object_ref(dwg, ref, obj))
+        return NULL;
     }
   else if (!ref->handleref.value)
     {
@@ -2842,8 +3136,7 @@ dwg_decode_handleref(Bit_Chain *restrict dat, Dwg_Object *restrict obj,
       ref->absolute_ref = ref->handleref.value;
       break;
     default:
-      dwg->object_ref[dwg->num_object_refs-1] = NULL;
-      dwg->num_object_refs--;
+      drop_last_object_ref(dwg);
       ref->absolute_ref = 0;
       ref->obj = NULL;
       LOG_WARN("Invalid handle pointer code %d", ref->handleref.code);
@@ -2870,7 +3163,7 @@ Dwg_Object_Ref *
 dwg_decode_handleref_with_code(Bit_Chain *restrict dat, Dwg_Object *restrict obj,
                                Dwg_Data *restrict dwg, unsigned int code)
 {
-  Dwg_Object_Ref* ref = (Dwg_Object_Ref *) calloc(1, sizeof(Dwg_Object_Ref));
+  Dwg_Object_Ref* ref = (Dwg_Object_Ref *) dwg_calloc(1, sizeof(Dwg_Object_Ref));
   if (!ref)
     {
       LOG_ERROR("Out of memory");
@@ -2881,7 +3174,7 @@ dwg_decode_handleref_with_code(Bit_Chain *restrict dat, Dwg_Object *restrict obj
     {
       LOG_WARN("Invalid handleref: wanted code %d, got (%d.%d.%lX)",
                code, ref->handleref.code, ref->handleref.size, ref->handleref.value)
-      free(ref);
+      dwg_dealloc(ref);
       return NULL;
     }
 
@@ -2889,18 +3182,8 @@ dwg_decode_handleref_with_code(Bit_Chain *restrict dat, Dwg_Object *restrict obj
   // It shouldn't be placed in the object ref vector.
   if (ref->handleref.size || (obj && ref->handleref.code > 5))
     {
-      // Reserve memory space for object references
-      if (!dwg->num_object_refs)
-        dwg->object_ref = calloc(REFS_PER_REALLOC, sizeof(Dwg_Object_Ref*));
-      else if (dwg->num_object_refs % REFS_PER_REALLOC == 0)
-        dwg->object_ref = realloc(dwg->object_ref,
-              (dwg->num_object_refs + REFS_PER_REALLOC) * sizeof(Dwg_Object_Ref*));
-      if (!dwg->object_ref)
-        {
-          LOG_ERROR("Out of memory");
-          return NULL;
-        }
-      dwg->object_ref[dwg->num_object_refs++] = ref;
+      if (add_object_ref(dwg, ref, obj))
+        return NULL;
     }
   else if (!ref->handleref.value)
     {
@@ -2946,8 +3229,7 @@ dwg_decode_handleref_with_code(Bit_Chain *restrict dat, Dwg_Object *restrict obj
       ref->absolute_ref = ref->handleref.value;
       break;
     default:
-      dwg->object_ref[dwg->num_object_refs-1] = NULL;
-      dwg->num_object_refs--;
+      drop_last_object_ref(dwg);
       ref->absolute_ref = 0;
       ref->obj = NULL;
       LOG_WARN("Invalid handle pointer code %d", ref->handleref.code);
@@ -3081,8 +3363,8 @@ dwg_free_xdata_resbuf(Dwg_Resbuf *rbuf)
       Dwg_Resbuf *next = rbuf->next;
       short type = get_base_value_type(rbuf->type);
       if (type == VT_STRING || type == VT_BINARY)
-        free (rbuf->value.str.u.data);
-      free (rbuf);
+        dwg_dealloc (rbuf->value.str.u.data);
+      dwg_dealloc (rbuf);
       rbuf = next;
     }
 }
@@ -3106,7 +3388,7 @@ dwg_decode_xdata(Bit_Chain *restrict dat, Dwg_Object_XRECORD *restrict obj, int
 
   while (dat->byte < end_address)
     {
-      rbuf = (Dwg_Resbuf *) calloc(1, sizeof(Dwg_Resbuf));
+      rbuf = (Dwg_Resbuf *) dwg_calloc(1, sizeof(Dwg_Resbuf));
       if (!rbuf)
         {
           LOG_ERROR("Out of memory");
@@ -3130,14 +3412,14 @@ dwg_decode_xdata(Bit_Chain *restrict dat, Dwg_Object_XRECORD *restrict obj, int
             length = rbuf->value.str.size = bit_read_RS(dat);
             if (length > 0)
               {
-                rbuf->value.str.u.wdata = calloc(length + 1, 2);
+                rbuf->value.str.u.wdata = dwg_calloc(length + 1, 2);
                 if (!rbuf->value.str.u.wdata)
                   {
                     LOG_ERROR("Out of memory");
                     if (root)
                       {
                         dwg_free_xdata_resbuf(root);
-                        if (rbuf) free(rbuf);
+                        if (rbuf) dwg_dealloc(rbuf);
                       }
                     else
                       dwg_free_xdata_resbuf(rbuf);
@@ -3233,10 +3515,18 @@ decode_preR13_entities(unsigned long start, unsigned long end,
       BITCODE_RS crc;
 
       if (!num)
-        dwg->object = (Dwg_Object *) malloc(REFS_PER_REALLOC * sizeof(Dwg_Object));
+        dwg->object = (Dwg_Object *) dwg_malloc(REFS_PER_REALLOC * sizeof(Dwg_Object));
       else if (num % REFS_PER_REALLOC == 0)
-        dwg->object = realloc(dwg->object,
-            (num + REFS_PER_REALLOC) * sizeof(Dwg_Object));
+        {
+          Dwg_Object *object = dwg_realloc(dwg->object,
+              (num + REFS_PER_REALLOC) * sizeof(Dwg_Object));
+          if (!object)
+            {
+              LOG_ERROR("Out of memory");
+              return DWG_ERR_OUTOFMEM;
+            }
+          dwg->object = object;
+        }
       if (!dwg->object)
         {
           LOG_ERROR("Out of memory");
@@ -3381,39 +3671,87 @@ EXPORT int dwg_add_object (Dwg_Data *dwg)
   Dwg_Object *obj;
   BITCODE_BL num = dwg->num_objects;
   int realloced = 0;
+  Dwg_Allocator saved;
+
+  dwg_alloc_enter(dwg, &saved);
   if (!num)
-    dwg->object = calloc(REFS_PER_REALLOC, sizeof(Dwg_Object));
+    dwg->object = dwg_calloc(REFS_PER_REALLOC, sizeof(Dwg_Object));
   else if (num % REFS_PER_REALLOC == 0) {
-    Dwg_Object *old = dwg->object;
-    dwg->object = realloc(dwg->object, (num + REFS_PER_REALLOC) * sizeof(Dwg_Object));
-    realloced = old != dwg->object;
+    Dwg_Object *object = dwg_realloc(dwg->object, (num + REFS_PER_REALLOC) * sizeof(Dwg_Object));
+    if (!object) { // keep the old objects to free
+      dwg_alloc_leave(&saved);
+      return DWG_ERR_OUTOFMEM;
+    }
+    realloced = object != dwg->object;
+    dwg->object = object;
+  }
+  if (!dwg->object) {
+    dwg_alloc_leave(&saved);
+    return DWG_ERR_OUTOFMEM;
   }
-  if (!dwg->object) return DWG_ERR_OUTOFMEM;
+
+  if (realloced)
+    dwg->ref_generation++; // all ref->obj pointers are stale now
+  if (dwg->referrers_start) // the reverse index misses the new object
+    {
+      dwg_dealloc(dwg->referrers_start);
+      dwg_dealloc(dwg->referrers);
+      dwg->referrers_start = NULL;
+      dwg->referrers = NULL;
+    }
+  if (dwg->owned_start) // and the owned index the new entity
+    {
+      dwg_dealloc(dwg->owned_start);
+      dwg_dealloc(dwg->owned);
+      dwg->owned_start = NULL;
+      dwg->owned = NULL;
+    }
+  if (dwg->layered_start) // and the layer index
+    {
+      dwg_dealloc(dwg->layered_start);
+      dwg_dealloc(dwg->layered);
+      dwg->layered_start = NULL;
+      dwg->layered = NULL;
+    }
+  if (dwg->type_start) // and the type index
+    {
+      dwg_dealloc(dwg->type_start);
+      dwg_dealloc(dwg->type_objects);
+      dwg_dealloc(dwg->type_groups_start);
+      dwg_dealloc(dwg->type_groups);
+      dwg_dealloc(dwg->type_tio);
+      dwg_dealloc(dwg->entities);
+      dwg->type_start = NULL;
+      dwg->type_objects = NULL;
+      dwg->type_groups_start = NULL;
+      dwg->type_groups = NULL;
+      dwg->type_tio = NULL;
+      dwg->entities = NULL;
+    }
+  dwg_free_rtrees(dwg); // and the spatial index its extents
 
   obj = &dwg->object[num];
   memset(obj, 0, sizeof(Dwg_Object));
   obj->index = num;
   dwg->num_objects++;
   obj->parent = dwg;
+  dwg_alloc_leave(&saved);
   return realloced ? -1 : 0;
 }
 
-/** Adds an object to the DWG (i.e. dwg->object[dwg->num_objects])
-    Returns 0 or some error codes on success.
-    Returns -1 if the dwg->object pool was re-alloced.
-    Returns some DWG_ERR_* otherwise.
+/* Decode the object at address into the already added obj.
+   Touches no other object, so it may run concurrently for distinct objects.
+   Returns 0 or some error codes on success, or some DWG_ERR_*.
  */
-int
-dwg_decode_add_object(Dwg_Data *restrict dwg, Bit_Chain* dat, Bit_Chain* hdl_dat,
-                      long unsigned int address)
+static int
+decode_one_object(Dwg_Data *restrict dwg, Bit_Chain* dat, Bit_Chain* hdl_dat,
+                  long unsigned int address, Dwg_Object *restrict obj)
 {
   long unsigned int oldpos;
   long unsigned int object_address, end_address;
   unsigned char previous_bit;
-  Dwg_Object *obj;
-  BITCODE_BL num = dwg->num_objects;
+  BITCODE_BL num = obj->index;
   int error = 0;
-  int realloced = 0;
 
   /* Keep the previous address
    */
@@ -3425,14 +3763,6 @@ dwg_decode_add_object(Dwg_Data *restrict dwg, Bit_Chain* dat, Bit_Chain* hdl_dat
   dat->byte = address;
   dat->bit = 0;
 
-  //DEBUG_HERE;
-  /*
-   * Reserve memory space for objects. A realloc violates all internal pointers.
-   */
-  realloced = dwg_add_object(dwg);
-  if (realloced > 0)
-    return realloced; // i.e. DWG_ERR_OUTOFMEM
-  obj = &dwg->object[num];  
   LOG_INFO("==========================================\n"
            "Object number: %lu/%lX", (unsigned long)num, (unsigned long)num)
 
@@ -3594,6 +3924,8 @@ dwg_decode_add_object(Dwg_Data *restrict dwg, Bit_Chain* dat, Bit_Chain* hdl_dat
       break;
     case DWG_TYPE_BLOCK_CONTROL:
       error = dwg_decode_BLOCK_CONTROL(dat, obj);
+      if (error >= DWG_ERR_CRITICAL) // out of memory
+        break;
       obj->tio.object->tio.BLOCK_CONTROL->objid = num;
       dwg->block_control = *obj->tio.object->tio.BLOCK_CONTROL;
       break;
@@ -3606,6 +3938,8 @@ dwg_decode_add_object(Dwg_Data *restrict dwg, Bit_Chain* dat, Bit_Chain* hdl_dat
       break;
     case DWG_TYPE_LAYER_CONTROL:
       error = dwg_decode_LAYER_CONTROL(dat, obj);
+      if (error >= DWG_ERR_CRITICAL) // out of memory
+        break;
       obj->tio.object->tio.LAYER_CONTROL->objid = num;
       dwg->layer_control = *obj->tio.object->tio.LAYER_CONTROL;
       break;
@@ -3614,6 +3948,8 @@ dwg_decode_add_object(Dwg_Data *restrict dwg, Bit_Chain* dat, Bit_Chain* hdl_dat
       break;
     case DWG_TYPE_STYLE_CONTROL:
       error = dwg_decode_STYLE_CONTROL(dat, obj);
+      if (error >= DWG_ERR_CRITICAL) // out of memory
+        break;
       obj->tio.object->tio.STYLE_CONTROL->objid = num;
       dwg->style_control = *obj->tio.object->tio.STYLE_CONTROL;
       break;
@@ -3622,6 +3958,8 @@ dwg_decode_add_object(Dwg_Data *restrict dwg, Bit_Chain* dat, Bit_Chain* hdl_dat
       break;
     case DWG_TYPE_LTYPE_CONTROL:
       error = dwg_decode_LTYPE_CONTROL(dat, obj);
+      if (error >= DWG_ERR_CRITICAL) // out of memory
+        break;
       obj->tio.object->tio.LTYPE_CONTROL->objid = num;
       dwg->ltype_control = *obj->tio.object->tio.LTYPE_CONTROL;
       break;
@@ -3630,6 +3968,8 @@ dwg_decode_add_object(Dwg_Data *restrict dwg, Bit_Chain* dat, Bit_Chain* hdl_dat
       break;
     case DWG_TYPE_VIEW_CONTROL:
       error = dwg_decode_VIEW_CONTROL(dat, obj);
+      if (error >= DWG_ERR_CRITICAL) // out of memory
+        break;
       obj->tio.object->tio.VIEW_CONTROL->objid = num;
       dwg->view_control = *obj->tio.object->tio.VIEW_CONTROL;
       break;
@@ -3638,6 +3978,8 @@ dwg_decode_add_object(Dwg_Data *restrict dwg, Bit_Chain* dat, Bit_Chain* hdl_dat
       break;
     case DWG_TYPE_UCS_CONTROL:
       error = dwg_decode_UCS_CONTROL(dat, obj);
+      if (error >= DWG_ERR_CRITICAL) // out of memory
+        break;
       obj->tio.object->tio.UCS_CONTROL->objid = num;
       dwg->ucs_control = *obj->tio.object->tio.UCS_CONTROL;
       break;
@@ -3646,6 +3988,8 @@ dwg_decode_add_object(Dwg_Data *restrict dwg, Bit_Chain* dat, Bit_Chain* hdl_dat
       break;
     case DWG_TYPE_VPORT_CONTROL:
       error = dwg_decode_VPORT_CONTROL(dat, obj);
+      if (error >= DWG_ERR_CRITICAL) // out of memory
+        break;
       obj->tio.object->tio.VPORT_CONTROL->objid = num;
       dwg->vport_control = *obj->tio.object->tio.VPORT_CONTROL;
       break;
@@ -3654,6 +3998,8 @@ dwg_decode_add_object(Dwg_Data *restrict dwg, Bit_Chain* dat, Bit_Chain* hdl_dat
       break;
     case DWG_TYPE_APPID_CONTROL:
       error = dwg_decode_APPID_CONTROL(dat, obj);
+      if (error >= DWG_ERR_CRITICAL) // out of memory
+        break;
       obj->tio.object->tio.APPID_CONTROL->objid = num;
       dwg->appid_control = *obj->tio.object->tio.APPID_CONTROL;
       break;
@@ -3662,6 +4008,8 @@ dwg_decode_add_object(Dwg_Data *restrict dwg, Bit_Chain* dat, Bit_Chain* hdl_dat
       break;
     case DWG_TYPE_DIMSTYLE_CONTROL:
       error = dwg_decode_DIMSTYLE_CONTROL(dat, obj);
+      if (error >= DWG_ERR_CRITICAL) // out of memory
+        break;
       obj->tio.object->tio.DIMSTYLE_CONTROL->objid = num;
       dwg->dimstyle_control = *obj->tio.object->tio.DIMSTYLE_CONTROL;
       break;
@@ -3670,6 +4018,8 @@ dwg_decode_add_object(Dwg_Data *restrict dwg, Bit_Chain* dat, Bit_Chain* hdl_dat
       break;
     case DWG_TYPE_VPORT_ENTITY_CONTROL:
       error = dwg_decode_VPORT_ENTITY_CONTROL(dat, obj);
+      if (error >= DWG_ERR_CRITICAL) // out of memory
+        break;
       obj->tio.object->tio.VPORT_ENTITY_CONTROL->objid = num;
       dwg->vport_entity_control = *obj->tio.object->tio.VPORT_ENTITY_CONTROL;
       break;
@@ -3773,7 +4123,7 @@ dwg_decode_add_object(Dwg_Data *restrict dwg, Bit_Chain* dat, Bit_Chain* hdl_dat
                 char *mleader = bit_read_TF(dat, obj->size);
                 LOG_INSANE_TF(mleader, (int)obj->size)
                 bit_set_position(dat, object_address);
-                free (mleader);
+                dwg_dealloc (mleader);
               }
 #endif
               error |= dwg_decode_UNKNOWN_ENT(dat, obj);
@@ -3803,6 +4153,9 @@ dwg_decode_add_object(Dwg_Data *restrict dwg, Bit_Chain* dat, Bit_Chain* hdl_dat
 
   if (obj->handle.value) { // empty only with UNKNOWN
     LOG_HANDLE("object_map{%lX} = %lu\n", obj->handle.value, (unsigned long)num);
+#ifdef _OPENMP
+#pragma omp critical (object_map)
+#endif
     hash_set(dwg->object_map, obj->handle.value, (uint32_t)num);
   }
 
@@ -3837,9 +4190,500 @@ dwg_decode_add_object(Dwg_Data *restrict dwg, Bit_Chain* dat, Bit_Chain* hdl_dat
    */
   dat->byte = oldpos;
   dat->bit = previous_bit;
+  return error;
+}
+
+/* Allocate the profile slots: the fixed types, the classes and the rest */
+static int
+profile_alloc(Dwg_Data *restrict dwg)
+{
+  Dwg_Stats *stats = &dwg->stats;
+  if (stats->profile)
+    return 0;
+  stats->num_profile = PROFILE_MAX_TYPES + dwg->num_classes + 1;
+  stats->profile = (Dwg_Profile_Type *) dwg_calloc(stats->num_profile,
+                                               sizeof(Dwg_Profile_Type));
+  if (!stats->profile)
+    {
+      stats->num_profile = 0;
+      return DWG_ERR_OUTOFMEM;
+    }
+  return 0;
+}
+
+/* Add the costs of obj to its type. The names are filled in by
+   stats_finish(). Concurrent threads add atomically. */
+static void
+profile_object(Dwg_Data *restrict dwg, const Dwg_Object *restrict obj,
+               const BITCODE_RLL ticks, const BITCODE_RLL allocs,
+               const int error)
+{
+  Dwg_Profile_Type *p;
+  BITCODE_BL i;
+
+  if (obj->supertype == DWG_SUPERTYPE_UNKNOWN)
+    {
+      i = obj->type - 500;
+      i = PROFILE_MAX_TYPES
+          + (obj->type >= 500 && i < dwg->num_classes ? i : dwg->num_classes);
+    }
+  else if ((BITCODE_BL)obj->fixedtype < PROFILE_MAX_TYPES)
+    i = obj->fixedtype;
+  else
+    i = PROFILE_MAX_TYPES + dwg->num_classes;
+  if (i >= dwg->stats.num_profile)
+    i = dwg->stats.num_profile - 1;
+  p = &dwg->stats.profile[i];
+  PROFILE_ADD(p->count, 1)
+  PROFILE_ADD(p->bytes, obj->size)
+  PROFILE_ADD(p->ticks, ticks)
+  PROFILE_ADD(p->allocs, allocs)
+  if (error)
+    {
+      PROFILE_ADD(p->errors, 1)
+    }
+}
+
+/* Decode the object at address into obj. With opts 0x40 add its decode
+   costs to dwg->stats.profile. */
+static int
+decode_object(Dwg_Data *restrict dwg, Bit_Chain* dat, Bit_Chain* hdl_dat,
+              long unsigned int address, Dwg_Object *restrict obj)
+{
+  BITCODE_RLL ticks, allocs;
+  int error;
+
+  if (!(dwg->opts & 0x40) || profile_alloc(dwg))
+    return decode_one_object(dwg, dat, hdl_dat, address, obj);
+
+  allocs = dwg_alloc_count();
+  ticks = PROFILE_TICKS();
+  error = decode_one_object(dwg, dat, hdl_dat, address, obj);
+  ticks = PROFILE_TICKS() - ticks;
+  allocs = dwg_alloc_count() - allocs;
+  profile_object(dwg, obj, ticks, allocs, error);
+  return error;
+}
+
+/** Adds an object to the DWG (i.e. dwg->object[dwg->num_objects])
+    Returns 0 or some error codes on success.
+    Returns -1 if the dwg->object pool was re-alloced.
+    Returns some DWG_ERR_* otherwise.
+ */
+int
+dwg_decode_add_object(Dwg_Data *restrict dwg, Bit_Chain* dat, Bit_Chain* hdl_dat,
+                      long unsigned int address)
+{
+  Dwg_Object *obj;
+  BITCODE_BL num = dwg->num_objects;
+  int error;
+  int realloced;
+
+  /*
+   * Reserve memory space for objects. A realloc violates all internal pointers.
+   */
+  realloced = dwg_add_object(dwg);
+  if (realloced > 0)
+    return realloced; // i.e. DWG_ERR_OUTOFMEM
+  obj = &dwg->object[num];
+  error = decode_object(dwg, dat, hdl_dat, address, obj);
   return realloced ? -1 : error; //re-alloced or not
 }
 
+#ifdef _OPENMP
+
+/* Reserve num more zero'd objects at once, keeping the REFS_PER_REALLOC
+   rounding of dwg_add_object() */
+static int
+add_objects(Dwg_Data *restrict dwg, const BITCODE_BL num)
+{
+  const BITCODE_BL start = dwg->num_objects;
+  const BITCODE_BL old_size = ((start + REFS_PER_REALLOC - 1) / REFS_PER_REALLOC)
+                              * REFS_PER_REALLOC;
+  const BITCODE_BL size = ((start + num + REFS_PER_REALLOC - 1)
+                           / REFS_PER_REALLOC) * REFS_PER_REALLOC;
+  BITCODE_BL i;
+
+  if (size > old_size)
+    {
+      Dwg_Object *old = dwg->object;
+      Dwg_Object *object = dwg_realloc(dwg->object, size * sizeof(Dwg_Object));
+      if (!object)
+        {
+          LOG_ERROR("Out of memory");
+          return DWG_ERR_OUTOFMEM;
+        }
+      dwg->object = object;
+      if (old && old != object)
+        dwg->ref_generation++;
+    }
+  memset(&dwg->object[start], 0, num * sizeof(Dwg_Object));
+  for (i = start; i < start + num; i++)
+    {
+      dwg->object[i].index = i;
+      dwg->object[i].parent = dwg;
+    }
+  dwg->num_objects += num;
+  return 0;
+}
+
+/* Reads the type of the object at address, without decoding it */
+static BITCODE_BS
+peek_object_type(const Bit_Chain *restrict dat, const long unsigned int address)
+{
+  Bit_Chain peek = *dat;
+  if (address >= dat->size)
+    return 0;
+  peek.byte = address;
+  peek.bit = 0;
+  bit_read_MS(&peek);
+  if (peek.version >= R_2010)
+    {
+      bit_read_UMC(&peek);
+      return bit_read_BOT(&peek);
+    }
+  return bit_read_BS(&peek);
+}
+
+/* Append the per-thread ref buffers to dwg->object_ref[], stable sorted
+   by owner, i.e. in the order of a serial decode. */
+static int
+merge_object_refs(Dwg_Data *restrict dwg, struct _decode_refs *restrict refs,
+                  const int num_threads)
+{
+  const BITCODE_BL num_objects = dwg->num_objects;
+  BITCODE_BL total = 0, base = dwg->num_object_refs, size, i;
+  BITCODE_BL *start;
+  int t;
+
+  for (t = 0; t < num_threads; t++)
+    total += refs[t].num;
+  if (!total)
+    return 0;
+  // the header refs are last, in bucket num_objects
+  start = (BITCODE_BL *) dwg_calloc(num_objects + 2, sizeof(BITCODE_BL));
+  if (!start)
+    {
+      LOG_ERROR("Out of memory");
+      return DWG_ERR_OUTOFMEM;
+    }
+  for (t = 0; t < num_threads; t++)
+    for (i = 0; i < refs[t].num; i++)
+      start[MIN(refs[t].owner[i], num_objects) + 1]++;
+  for (i = 1; i < num_objects + 2; i++)
+    start[i] += start[i - 1];
+
+  size = ((base + total + REFS_PER_REALLOC - 1) / REFS_PER_REALLOC)
+         * REFS_PER_REALLOC;
+  {
+    Dwg_Object_Ref **ref = dwg_realloc(dwg->object_ref, size * sizeof(Dwg_Object_Ref*));
+    BITCODE_BL *owner;
+    if (ref)
+      dwg->object_ref = ref;
+    owner = dwg_realloc(dwg->object_ref_owner, size * sizeof(BITCODE_BL));
+    if (owner)
+      dwg->object_ref_owner = owner;
+    if (!ref || !owner)
+      {
+        dwg_dealloc(start);
+        LOG_ERROR("Out of memory");
+        return DWG_ERR_OUTOFMEM;
+      }
+  }
+  for (t = 0; t < num_threads; t++)
+    for (i = 0; i < refs[t].num; i++)
+      {
+        BITCODE_BL owner = refs[t].owner[i];
+        BITCODE_BL j = base + start[MIN(owner, num_objects)]++;
+        dwg->object_ref[j] = refs[t].ref[i];
+        dwg->object_ref_owner[j] = owner;
+      }
+  dwg->num_object_refs = base + total;
+  dwg_dealloc(start);
+  return 0;
+}
+
+/* Decode all objects at offsets into a presized dwg->object[]
+   concurrently, each thread with its own Bit_Chain cursor over the
+   shared read-only buffer, and its own object_ref buffer. */
+static int
+decode_objects_parallel(Dwg_Data *restrict dwg, Bit_Chain *restrict dat,
+                        const long unsigned int *restrict offsets,
+                        const BITCODE_BL num)
+{
+  const BITCODE_BL start = dwg->num_objects;
+  const int num_threads = omp_get_max_threads();
+  const unsigned int level = loglevel;
+  struct _decode_refs *refs;
+  unsigned char *done;
+  long i;
+  int error;
+
+  error = add_objects(dwg, num);
+  if (error)
+    return error;
+  if (dwg->opts & 0x40) // not lazily by the threads
+    error = profile_alloc(dwg);
+  refs = (struct _decode_refs *) dwg_calloc(num_threads, sizeof(struct _decode_refs));
+  done = (unsigned char *) dwg_calloc(num, 1);
+  if (!refs || !done)
+    {
+      dwg_dealloc(refs);
+      dwg_dealloc(done);
+      LOG_ERROR("Out of memory");
+      return DWG_ERR_OUTOFMEM;
+    }
+
+  // The tables are copied into dwg, and later objects look them up,
+  // e.g. MLEADERSTYLE the APPID_CONTROL. Decode them first.
+  thread_refs = &refs[0];
+  for (i = 0; i < (long)num; i++)
+    {
+      Dwg_Object *obj = &dwg->object[start + i];
+      obj->type = peek_object_type(dat, offsets[i]);
+      if (dwg_obj_is_control(obj))
+        {
+          error |= decode_object(dwg, dat, dat, offsets[i], obj);
+          done[i] = 1;
+        }
+    }
+  thread_refs = NULL;
+
+#pragma omp parallel num_threads(num_threads) reduction(|:error)
+  {
+    Bit_Chain tdat = *dat;
+    Dwg_Thread_State state;
+    const unsigned long long allocs = dwg_alloc_count();
+    thread_refs = &refs[omp_get_thread_num()];
+    // log as the caller
+    dwg_log_enter(dwg, &state);
+    loglevel = level;
+    if (dat->from_version >= R_2007)
+      read_r2007_init(dwg); // its string streams log on their own
+#pragma omp for schedule(dynamic, OBJECTS_PER_CHUNK)
+    for (i = 0; i < (long)num; i++)
+      {
+        if (!done[i])
+          error |= decode_object(dwg, &tdat, &tdat, offsets[i],
+                                 &dwg->object[start + i]);
+      }
+    thread_refs = NULL;
+    dwg_log_leave(&state);
+    // the caller counts its own in stats_finish()
+    if (omp_get_thread_num())
+      {
+        PROFILE_ADD(dwg->stats.num_allocs,
+                    (BITCODE_BL)(dwg_alloc_count() - allocs))
+      }
+  }
+
+  error |= merge_object_refs(dwg, refs, num_threads);
+  for (i = 0; i < num_threads; i++)
+    {
+      dwg_dealloc(refs[i].ref);
+      dwg_dealloc(refs[i].owner);
+    }
+  dwg_dealloc(refs);
+  dwg_dealloc(done);
+  return error;
+}
+#endif
+
+/* Append offset to the growing offsets array of the object map */
+static int
+add_offset(long unsigned int **offsets, BITCODE_BL *num, BITCODE_BL *size,
+           const long unsigned int offset)
+{
+  if (*num == *size)
+    {
+      long unsigned int *o;
+      BITCODE_BL newsize = *size ? *size * 2 : REFS_PER_REALLOC;
+      o = (long unsigned int *) dwg_realloc(*offsets,
+                                        newsize * sizeof(long unsigned int));
+      if (!o)
+        {
+          LOG_ERROR("Out of memory");
+          return DWG_ERR_OUTOFMEM;
+        }
+      *offsets = o;
+      *size = newsize;
+    }
+  (*offsets)[(*num)++] = offset;
+  return 0;
+}
+
+/* Wall time in seconds */
+static double
+stats_time(void)
+{
+#ifdef HAVE_CLOCK_GETTIME
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#else
+  return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/* Charge the time since the last switch to the current phase, and
+   continue with phase. Returns the previous phase, to switch back. */
+static Dwg_Phase
+stats_phase(Dwg_Data *restrict dwg, const Dwg_Phase phase)
+{
+  const double now = stats_time();
+  const Dwg_Phase prev = cur_phase;
+
+  dwg->stats.time[prev] += now - phase_start;
+  phase_start = now;
+  cur_phase = phase;
+  return prev;
+}
+
+/* Most expensive first */
+static int
+profile_cmp(const void *a, const void *b)
+{
+  const BITCODE_RLL ta = ((const Dwg_Profile_Type *)a)->ticks;
+  const BITCODE_RLL tb = ((const Dwg_Profile_Type *)b)->ticks;
+  return ta < tb ? 1 : ta > tb ? -1 : 0;
+}
+
+/* Stop the timer, and count the objects per type, the refs and the
+   allocations. Returns the error of the decoder. */
+static int
+stats_finish(Dwg_Data *restrict dwg, const double start, const int error)
+{
+  Dwg_Stats *stats = &dwg->stats;
+  const BITCODE_BL max_types = PROFILE_MAX_TYPES;
+  Dwg_Stats_Type *types;
+  unsigned char *unhandled;
+  BITCODE_BL i, j;
+
+  stats_phase(dwg, DWG_PHASE_OTHER);
+  stats->time[DWG_PHASE_TOTAL] = phase_start - start;
+  stats->num_refs = dwg->num_object_refs;
+  stats->num_allocs += (BITCODE_BL)(dwg_alloc_count() - alloc_start);
+
+  types = (Dwg_Stats_Type *) dwg_calloc(max_types, sizeof(Dwg_Stats_Type));
+  unhandled = (unsigned char *) dwg_calloc(dwg->num_classes + 1, 1);
+  if (!types || !unhandled)
+    {
+      dwg_dealloc(types);
+      dwg_dealloc(unhandled);
+      return error;
+    }
+  for (i = 0; i < dwg->num_objects; i++)
+    {
+      const Dwg_Object *obj = &dwg->object[i];
+      if (obj->supertype == DWG_SUPERTYPE_UNKNOWN)
+        {
+          const BITCODE_BL c = obj->type - 500;
+          stats->num_unknown_objects++;
+          if (obj->type >= 500 && c < dwg->num_classes && !unhandled[c])
+            {
+              unhandled[c] = 1;
+              stats->num_unhandled_classes++;
+            }
+        }
+      else if ((BITCODE_BL)obj->fixedtype < max_types)
+        {
+          Dwg_Stats_Type *t = &types[obj->fixedtype];
+          if (!t->count++)
+            {
+              t->fixedtype = obj->fixedtype;
+              t->name = obj->dxfname;
+            }
+        }
+    }
+  dwg_dealloc(unhandled);
+
+  if (stats->profile)
+    {
+      for (i = j = 0; i < stats->num_profile; i++)
+        {
+          Dwg_Profile_Type *p = &stats->profile[i];
+          const BITCODE_BL c = i - max_types;
+          if (!p->count)
+            continue;
+          if (i < max_types)
+            {
+              p->fixedtype = (Dwg_Object_Type)i;
+              p->name = types[i].name ? types[i].name : "UNKNOWN_OBJ";
+            }
+          else if (c < dwg->num_classes)
+            {
+              p->fixedtype = dwg->dwg_class[c].item_class_id == 0x1f2
+                ? DWG_TYPE_UNKNOWN_ENT : DWG_TYPE_UNKNOWN_OBJ;
+              p->name = dwg->dwg_class[c].dxfname;
+            }
+          else
+            {
+              p->fixedtype = DWG_TYPE_UNKNOWN_OBJ;
+              p->name = "UNKNOWN_OBJ";
+            }
+          stats->profile[j++] = *p;
+        }
+      stats->num_profile = j;
+      qsort(stats->profile, j, sizeof(Dwg_Profile_Type), profile_cmp);
+    }
+
+  for (i = j = 0; i < max_types; i++)
+    {
+      if (types[i].count)
+        types[j++] = types[i];
+    }
+  stats->num_types = j;
+  if (j)
+    stats->types = (Dwg_Stats_Type *) dwg_realloc(types, j * sizeof(Dwg_Stats_Type));
+  if (!stats->types)
+    {
+      dwg_dealloc(types);
+      stats->num_types = 0;
+    }
+  return error;
+}
+
+const Dwg_Stats *
+dwg_stats(const Dwg_Data *dwg)
+{
+  return &dwg->stats;
+}
+
+/* Decode and add the objects at the offsets in obj_dat, in this order.
+   With OpenMP and without object logging concurrently. */
+static int
+decode_objects(Dwg_Data *restrict dwg, Bit_Chain *restrict dat,
+               const long unsigned int *restrict offsets, const BITCODE_BL num)
+{
+  const Dwg_Phase phase = stats_phase(dwg, DWG_PHASE_OBJECTS);
+  BITCODE_BL i;
+  int error = 0;
+
+#ifdef _OPENMP
+  // the object log must stay in order
+  if (num > OBJECTS_PER_CHUNK && !LOG_ENABLED(INFO))
+    {
+      error = decode_objects_parallel(dwg, dat, offsets, num);
+      stats_phase(dwg, phase);
+      return error;
+    }
+#endif
+  for (i = 0; i < num; i++)
+    {
+      int added;
+      LOG_TRACE("\n< Next object: %lu\t", (unsigned long)dwg->num_objects)
+      LOG_HANDLE("Offset: @%lu\n", offsets[i])
+      added = dwg_decode_add_object(dwg, dat, dat, offsets[i]);
+      if (added > 0)
+        error |= added;
+      //else re-allocated
+      // we don't stop encoding on single errors, but we sum them all up
+      // as combined bitmask
+    }
+  stats_phase(dwg, phase);
+  return error;
+}
+
 /** dwg_decode_unknown
    Container to hold a unknown class entity, see classes.inc
    Every DEBUGGING class holds a bits array, a bitsize, and the handle
@@ -24,6 +24,9 @@
 #include "bits.h"
 #include "dwg.h"
 
+/* the object and object_ref arrays grow by this */
+#define REFS_PER_REALLOC 128
+
 enum RES_BUF_VALUE_TYPE
 {
   VT_INVALID = 0,
@@ -57,6 +60,10 @@ dwg_decode_handleref(Bit_Chain *restrict hdl_dat, Dwg_Object *restrict obj,
 Dwg_Object_Ref *
 dwg_decode_handleref_with_code(Bit_Chain *restrict hdl_dat, Dwg_Object *restrict obj,
                                Dwg_Data *restrict dwg, unsigned int code);
+/* for the importers */
+Dwg_Object_Ref *
+dwg_add_handleref(Dwg_Data *restrict dwg, const unsigned int code,
+                  const unsigned long absref, const Dwg_Object *restrict obj);
 int
 dwg_decode_header_variables(Bit_Chain* dat, Bit_Chain* hdl_dat,
                             Bit_Chain* str_dat, Dwg_Data *restrict dwg);
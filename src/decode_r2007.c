@@ -27,9 +27,9 @@
 #include "decode.h"
 
 /* The logging level for the read (decode) path.  */
-static unsigned int loglevel;
+static THREAD_LOCAL unsigned int loglevel;
 /* the current version per spec block */
-static unsigned int cur_ver = 0;
+static THREAD_LOCAL unsigned int cur_ver = 0;
 
 #define DWG_LOGLEVEL loglevel
 #include "logging.h"
@@ -554,7 +554,7 @@ decode_rs(const char *src, int block_count, int data_size)
   char *dst_base, *dst;
   //TODO: round up data_size from 239 to 255
 
-  dst_base = dst = (char*)calloc(block_count, data_size);
+  dst_base = dst = (char*)dwg_calloc(block_count, data_size);
   if (!dst)
     {
       LOG_ERROR("Out of memory")
@@ -609,7 +609,7 @@ read_system_page(Bit_Chain* dat, int64_t size_comp, int64_t size_uncomp,
                 (long)page_size, dat->size - dat->byte);
       return NULL;
     }
-  data = (char*)calloc(size_uncomp, page_size);
+  data = (char*)dwg_calloc(size_uncomp, page_size);
   if (!data) {
     LOG_ERROR("Out of memory")
     return NULL;
@@ -623,7 +623,7 @@ read_system_page(Bit_Chain* dat, int64_t size_comp, int64_t size_uncomp,
     (void)decompress_r2007(data, size_uncomp, pedata, size_comp);
   else
     memcpy(data, pedata, size_uncomp);
-  free(pedata);
+  dwg_dealloc(pedata);
 
   return data;
 }
@@ -645,7 +645,7 @@ read_data_page(Bit_Chain* dat, unsigned char *decomp, int64_t page_size,
   pesize = ((size_comp + 7) & ~7);
   block_count = (pesize + 0xFB - 1) / 0xFB;
 
-  rsdata = (char*)calloc(1, page_size);
+  rsdata = (char*)dwg_calloc(1, page_size);
   if (rsdata == NULL) {
     LOG_ERROR("Out of memory")
     return DWG_ERR_OUTOFMEM;
@@ -658,7 +658,7 @@ read_data_page(Bit_Chain* dat, unsigned char *decomp, int64_t page_size,
   else
     memcpy(decomp, pedata, size_uncomp);
 
-  free(pedata);
+  dwg_dealloc(pedata);
 
   return error;
 }
@@ -673,6 +673,7 @@ read_data_section(Bit_Chain *sec_dat, Bit_Chain *dat, r2007_section *sections_ma
   unsigned char *decomp;
   int error, i;
 
+  sec_dat->chain = NULL; // the callers free it on errors
   section = get_section(sections_map, sec_type);
   if (section == NULL) {
     LOG_ERROR("Failed to find section %d", (int)sec_type)
@@ -680,7 +681,7 @@ read_data_section(Bit_Chain *sec_dat, Bit_Chain *dat, r2007_section *sections_ma
   }
 
   max_decomp_size = section->data_size;
-  decomp = calloc(max_decomp_size, 1);
+  decomp = dwg_calloc(max_decomp_size, 1);
   if (decomp == NULL) {
     LOG_ERROR("Out of memory")
     return DWG_ERR_OUTOFMEM;
@@ -692,13 +693,13 @@ read_data_section(Bit_Chain *sec_dat, Bit_Chain *dat, r2007_section *sections_ma
       page = get_page(pages_map, section_page->id);
       if (page == NULL)
         {
-          free(decomp);
+          dwg_dealloc(decomp);
           LOG_ERROR("Failed to find page %d", (int)section_page->id)
           return DWG_ERR_PAGENOTFOUND;
         }
       if (section_page->offset > max_decomp_size)
         {
-          free(decomp);
+          dwg_dealloc(decomp);
           LOG_ERROR("Invalid section_page->offset %ld > %ld",
                     (long)section_page->offset, (long)max_decomp_size)
           return DWG_ERR_VALUEOUTOFBOUNDS;
@@ -709,7 +710,7 @@ read_data_section(Bit_Chain *sec_dat, Bit_Chain *dat, r2007_section *sections_ma
                              section_page->comp_size, section_page->uncomp_size);
       if (error)
         {
-          free(decomp);
+          dwg_dealloc(decomp);
           LOG_ERROR("Failed to read page")
           return error;
         }
@@ -750,7 +751,7 @@ bfr_read_string(char **src)
 
   wsize = length * sizeof(DWGCHAR) + sizeof(DWGCHAR);
 
-  str = str_base = (DWGCHAR*) malloc(wsize);
+  str = str_base = (DWGCHAR*) dwg_malloc(wsize);
   if (!str)
     {
       LOG_ERROR("Out of memory");
@@ -790,7 +791,7 @@ read_sections_map(Bit_Chain* dat, int64_t size_comp,
 
   while (ptr < ptr_end)
     {
-      section = (r2007_section*) malloc(sizeof(r2007_section));
+      section = (r2007_section*) dwg_malloc(sizeof(r2007_section));
       if (!section)
         {
           LOG_ERROR("Out of memory");
@@ -848,7 +849,7 @@ read_sections_map(Bit_Chain* dat, int64_t size_comp,
 #endif
       section->type = dwg_section_type(section->name);
 
-      section->pages = (r2007_section_page**) malloc(
+      section->pages = (r2007_section_page**) dwg_malloc(
         (size_t)section->num_pages * sizeof(r2007_section_page*));
       if (!section->pages)
         {
@@ -862,7 +863,7 @@ read_sections_map(Bit_Chain* dat, int64_t size_comp,
 
       for (i = 0; i < section->num_pages; i++)
         {
-          section->pages[i] = (r2007_section_page*) malloc(
+          section->pages[i] = (r2007_section_page*) dwg_malloc(
                                   sizeof(r2007_section_page));
           if (!section->pages[i])
             {
@@ -894,7 +895,7 @@ read_sections_map(Bit_Chain* dat, int64_t size_comp,
         }
     }
 
-  free(data);
+  dwg_dealloc(data);
 
   return sections;
 }
@@ -921,11 +922,11 @@ read_pages_map(Bit_Chain* dat, int64_t size_comp,
 
   while (ptr < ptr_end)
     {
-      page = (r2007_page*) malloc(sizeof(r2007_page));
+      page = (r2007_page*) dwg_malloc(sizeof(r2007_page));
       if (page == NULL)
         {
           LOG_ERROR("Out of memory")
-          free(data);
+          dwg_dealloc(data);
           pages_destroy(pages);
           return NULL;
         }
@@ -953,7 +954,7 @@ read_pages_map(Bit_Chain* dat, int64_t size_comp,
         }
     }
 
-  free(data);
+  dwg_dealloc(data);
 
   return pages;
 }
@@ -983,7 +984,7 @@ pages_destroy(r2007_page *page)
   while (page != 0)
     {
       next = page->next;
-      free(page);
+      dwg_dealloc(page);
       page = next;
     }
 }
@@ -1018,12 +1019,12 @@ sections_destroy(r2007_section *section)
         {
           while (section->num_pages-- > 0)
             {
-              free(section->pages[section->num_pages]);
+              dwg_dealloc(section->pages[section->num_pages]);
             }
-          free(section->pages);
+          dwg_dealloc(section->pages);
         }
 
-      free(section);
+      dwg_dealloc(section);
       section = next;
     }
 }
@@ -1095,7 +1096,7 @@ read_file_header(Bit_Chain *restrict dat, r2007_file_header *restrict file_heade
     VALID_COUNT(file_header->sections_amount);
   }
 
-  free(pedata);
+  dwg_dealloc(pedata);
   return error;
 }
 
@@ -1210,7 +1211,7 @@ read_2007_section_classes(Bit_Chain*restrict dat, Dwg_Data *restrict dwg,
     {
       LOG_ERROR("Failed to read class section");
       if (sec_dat.chain)
-        free(sec_dat.chain);
+        dwg_dealloc(sec_dat.chain);
       return error;
     }
 
@@ -1253,12 +1254,12 @@ read_2007_section_classes(Bit_Chain*restrict dat, Dwg_Data *restrict dwg,
 
       section_string_stream(&sec_dat, bitsize, &str);
 
-      dwg->dwg_class = (Dwg_Class *) calloc(dwg->num_classes, sizeof(Dwg_Class));
+      dwg->dwg_class = (Dwg_Class *) dwg_calloc(dwg->num_classes, sizeof(Dwg_Class));
       if (!dwg->dwg_class)
         {
           LOG_ERROR("Out of memory");
           if (sec_dat.chain)
-            free(sec_dat.chain);
+            dwg_dealloc(sec_dat.chain);
           return DWG_ERR_OUTOFMEM;
         }
 
@@ -1303,10 +1304,10 @@ read_2007_section_classes(Bit_Chain*restrict dat, Dwg_Data *restrict dwg,
   else
     {
       LOG_ERROR("Failed to find class section sentinel");
-      free(sec_dat.chain);
+      dwg_dealloc(sec_dat.chain);
       return DWG_ERR_CLASSESNOTFOUND;
     }
-  free(sec_dat.chain);
+  dwg_dealloc(sec_dat.chain);
   return 0;
 }
 
@@ -1325,7 +1326,7 @@ read_2007_section_header(Bit_Chain*restrict dat, Bit_Chain*restrict hdl_dat,
     {
       LOG_ERROR("Failed to read header section");
       if (sec_dat.chain)
-        free(sec_dat.chain);
+        dwg_dealloc(sec_dat.chain);
       return error;
     }
   if (bit_search_sentinel(&sec_dat, dwg_sentinel(DWG_SENTINEL_VARIABLE_BEGIN)))
@@ -1378,7 +1379,7 @@ read_2007_section_handles(Bit_Chain* dat, Bit_Chain* hdl,
     {
       LOG_ERROR("Failed to read objects section");
       if (obj_dat.chain)
-        free(obj_dat.chain);
+        dwg_dealloc(obj_dat.chain);
       return error;
     }
 
@@ -1389,7 +1390,7 @@ read_2007_section_handles(Bit_Chain* dat, Bit_Chain* hdl,
     {
       LOG_ERROR("Failed to read handles section");
       if (hdl_dat.chain)
-        free(hdl_dat.chain);
+        dwg_dealloc(hdl_dat.chain);
       return error;
     }
 
@@ -1442,8 +1443,8 @@ read_2007_section_handles(Bit_Chain* dat, Bit_Chain* hdl,
 
   LOG_INFO("\nNum objects: %lu\n", (unsigned long)dwg->num_objects);
 
-  free(hdl_dat.chain);
-  free(obj_dat.chain);
+  dwg_dealloc(hdl_dat.chain);
+  dwg_dealloc(obj_dat.chain);
 
   return error;
 }
@@ -1452,8 +1453,7 @@ read_2007_section_handles(Bit_Chain* dat, Bit_Chain* hdl,
 void
 read_r2007_init(Dwg_Data *dwg)
 {
-  if (dwg->opts)
-    loglevel = dwg->opts & 0xf;
+  loglevel = dwg_log_init(dwg);
 }
 
 int
@@ -1464,16 +1464,8 @@ read_r2007_meta_data(Bit_Chain *dat, Bit_Chain *hdl_dat,
   r2007_page *restrict pages_map, *restrict page;
   r2007_section *restrict sections_map;
   int error;
-#ifdef USE_TRACING
-  char *probe;
-#endif
 
   read_r2007_init(dwg);
-#ifdef USE_TRACING
-  probe = getenv ("LIBREDWG_TRACE");
-  if (probe)
-    loglevel = atoi (probe);
-#endif
   // @ 0x62
   error = read_file_header(dat, &file_header);
   if (error >= DWG_ERR_VALUEOUTOFBOUNDS)
@@ -36,16 +36,29 @@
 #include "in_dxf.h"
 #include "free.h"
 
-/* The logging level per .o */
-static unsigned int loglevel;
-#ifdef USE_TRACING
-/* This flag means we have checked the environment variable
-   LIBREDWG_TRACE and set `loglevel' appropriately.  */
-static bool env_var_checked_p;
-#endif  /* USE_TRACING */
+/* The logging level per .o and thread */
+static THREAD_LOCAL unsigned int loglevel;
 #define DWG_LOGLEVEL loglevel
 #include "logging.h"
 
+#define FREE_IF(ptr) { if (ptr) dwg_dealloc(ptr); ptr = NULL; }
+
+/* The readers and writers proper, logging to the sink set up by their
+   public wrappers */
+static int read_dwg_file (const char *restrict filename,
+                          Dwg_Data *restrict dwg);
+static int read_dxf_file (const char *restrict filename,
+                          Dwg_Data *restrict dwg);
+#if defined(USE_WRITE) && !defined(DISABLE_DXF)
+static int write_dwg_file (const char *restrict filename,
+                           const Dwg_Data *restrict dwg);
+#endif
+/* The indexes, built by their getters if missing */
+static int lazy_index (const Dwg_Data *dwg, BITCODE_BL *const *start,
+                       int (*build)(Dwg_Data *));
+static int build_layer_index (Dwg_Data *dwg);
+static int build_type_index (Dwg_Data *dwg);
+
 /*------------------------------------------------------------------------------
  * Public functions
  */
@@ -54,7 +67,7 @@ static int dat_read_file (Bit_Chain *restrict dat, FILE *restrict fp,
                           const char *restrict filename)
 {
   size_t size;
-  dat->chain = (unsigned char *) calloc(1, dat->size);
+  dat->chain = (unsigned char *) dwg_calloc(1, dat->size);
   if (!dat->chain)
     {
       LOG_ERROR("Not enough memory.\n")
@@ -68,7 +81,7 @@ static int dat_read_file (Bit_Chain *restrict dat, FILE *restrict fp,
       LOG_ERROR("Could not read file (%lu out of %lu): %s\n",
                 (long unsigned int) size, dat->size, filename)
         fclose(fp);
-      free(dat->chain);
+      dwg_dealloc(dat->chain);
       dat->chain = NULL;
       dat->size = 0;
       return DWG_ERR_IOERROR;
@@ -82,9 +95,9 @@ static int dat_read_stream (Bit_Chain *restrict dat, FILE *restrict fp)
 
   do {
     if (dat->chain)
-      dat->chain = (unsigned char *) realloc(dat->chain, dat->size + 4096);
+      dat->chain = (unsigned char *) dwg_realloc(dat->chain, dat->size + 4096);
     else {
-      dat->chain = (unsigned char *) calloc(1, 4096);
+      dat->chain = (unsigned char *) dwg_calloc(1, 4096);
       dat->size = 0;
     }
     if (!dat->chain)
@@ -102,7 +115,7 @@ static int dat_read_stream (Bit_Chain *restrict dat, FILE *restrict fp)
       LOG_ERROR("Could not read from stream (%lu out of %lu)\n",
                 (long unsigned int)size, dat->size);
       fclose(fp);
-      free(dat->chain);
+      dwg_dealloc(dat->chain);
       dat->chain = NULL;
       return DWG_ERR_IOERROR;
     }
@@ -112,11 +125,30 @@ static int dat_read_stream (Bit_Chain *restrict dat, FILE *restrict fp)
   if (size)
     {
       memset(&dat->chain[dat->size], 0, 0xfff - size);
-      dat->chain = (unsigned char *) realloc(dat->chain, dat->size);
+      dat->chain = (unsigned char *) dwg_realloc(dat->chain, dat->size);
     }
   return 0;
 }
 
+/* Clears dwg for a new read, but keeps the options, the log sink, the
+   allocator and the tolerance set by the caller */
+static void
+dwg_clear(Dwg_Data *restrict dwg)
+{
+  const unsigned int opts = dwg->opts;
+  const Dwg_Log_Callback log_callback = dwg->log_callback;
+  void *log_data = dwg->log_data;
+  const Dwg_Allocator allocator = dwg->allocator;
+  const double tolerance = dwg->tolerance;
+
+  memset(dwg, 0, sizeof(Dwg_Data));
+  dwg->opts = opts;
+  dwg->log_callback = log_callback;
+  dwg->log_data = log_data;
+  dwg->allocator = allocator;
+  dwg->tolerance = tolerance;
+}
+
 /** dwg_read_file
  * returns 0 on success.
  *
@@ -125,6 +157,18 @@ static int dat_read_stream (Bit_Chain *restrict dat, FILE *restrict fp)
  */
 int
 dwg_read_file(const char *restrict filename, Dwg_Data *restrict dwg)
+{
+  Dwg_Thread_State state;
+  int error;
+
+  loglevel = dwg_log_enter(dwg, &state);
+  error = read_dwg_file(filename, dwg);
+  dwg_log_leave(&state);
+  return error;
+}
+
+static int
+read_dwg_file(const char *restrict filename, Dwg_Data *restrict dwg)
 {
   FILE *fp;
   struct stat attrib;
@@ -132,9 +176,7 @@ dwg_read_file(const char *restrict filename, Dwg_Data *restrict dwg)
   Bit_Chain bit_chain;
   int error;
 
-  loglevel = dwg->opts;
-  memset(dwg, 0, sizeof(Dwg_Data));
-  dwg->opts = loglevel;
+  dwg_clear(dwg);
 
   if (!strcmp(filename, "-"))
     {
@@ -187,14 +229,14 @@ dwg_read_file(const char *restrict filename, Dwg_Data *restrict dwg)
   if (error >= DWG_ERR_CRITICAL)
     {
       LOG_ERROR("Failed to decode file: %s 0x%x\n", filename, error)
-      free(bit_chain.chain);
+      dwg_dealloc(bit_chain.chain);
       bit_chain.chain = NULL;
       bit_chain.size = 0;
       return error;
     }
 
   //TODO: does dwg hold any char* pointers to the bit_chain or are they all copied?
-  free(bit_chain.chain);
+  dwg_dealloc(bit_chain.chain);
   bit_chain.chain = NULL;
   bit_chain.size = 0;
 
@@ -213,6 +255,18 @@ dwg_read_file(const char *restrict filename, Dwg_Data *restrict dwg)
  */
 int
 dxf_read_file(const char *restrict filename, Dwg_Data *restrict dwg)
+{
+  Dwg_Thread_State state;
+  int error;
+
+  loglevel = dwg_log_enter(dwg, &state);
+  error = read_dxf_file(filename, dwg);
+  dwg_log_leave(&state);
+  return error;
+}
+
+static int
+read_dxf_file(const char *restrict filename, Dwg_Data *restrict dwg)
 {
   int error;
   FILE *fp;
@@ -243,12 +297,10 @@ dxf_read_file(const char *restrict filename, Dwg_Data *restrict dwg)
 
   /* Load whole file into memory
    */
-  loglevel = dwg->opts;
-  memset(dwg, 0, sizeof(Dwg_Data));
-  dwg->opts = loglevel;
+  dwg_clear(dwg);
   memset(&dat, 0, sizeof(Bit_Chain));
   dat.size = attrib.st_size;
-  dat.chain = (unsigned char *) calloc(1, dat.size);
+  dat.chain = (unsigned char *) dwg_calloc(1, dat.size);
   if (!dat.chain)
     {
       LOG_ERROR("Not enough memory.\n")
@@ -266,7 +318,7 @@ dxf_read_file(const char *restrict filename, Dwg_Data *restrict dwg)
       LOG_ERROR("Could not read the entire file (%lu out of %lu): %s\n",
           (long unsigned int) size, dat.size, filename)
       fclose(fp);
-      free(dat.chain);
+      dwg_dealloc(dat.chain);
       dat.chain = NULL;
       dat.size = 0;
       return DWG_ERR_IOERROR;
@@ -277,7 +329,7 @@ dxf_read_file(const char *restrict filename, Dwg_Data *restrict dwg)
   if (!memcmp(dat.chain, "AC10", 4))
     {
       LOG_ERROR("This is a DWG, not a DXF file: %s\n", filename)
-      free(dat.chain);
+      dwg_dealloc(dat.chain);
       dat.chain = NULL;
       dat.size = 0;
       return DWG_ERR_INVALIDDWG;
@@ -291,14 +343,14 @@ dxf_read_file(const char *restrict filename, Dwg_Data *restrict dwg)
   if (error >= DWG_ERR_CRITICAL)
     {
       LOG_ERROR("Failed to decode DXF file: %s\n", filename)
-      free(dat.chain);
+      dwg_dealloc(dat.chain);
       dat.chain = NULL;
       dat.size = 0;
       return error;
     }
 
   //TODO: does dwg hold any char* pointers to the dat or are they all copied?
-  free(dat.chain);
+  dwg_dealloc(dat.chain);
   dat.chain = NULL;
   dat.size = 0;
 
@@ -307,6 +359,18 @@ dxf_read_file(const char *restrict filename, Dwg_Data *restrict dwg)
 
 int
 dwg_write_file(const char *restrict filename, const Dwg_Data *restrict dwg)
+{
+  Dwg_Thread_State state;
+  int error;
+
+  loglevel = dwg_log_enter(dwg, &state);
+  error = write_dwg_file(filename, dwg);
+  dwg_log_leave(&state);
+  return error;
+}
+
+static int
+write_dwg_file(const char *restrict filename, const Dwg_Data *restrict dwg)
 {
   FILE *fh;
   struct stat attrib;
@@ -325,7 +389,7 @@ dwg_write_file(const char *restrict filename, const Dwg_Data *restrict dwg)
     {
       LOG_ERROR("Failed to encode datastructure.\n")
       if (dat.size > 0) {
-        free (dat.chain);
+        dwg_dealloc (dat.chain);
         dat.chain = NULL;
         dat.size = 0;
       }
@@ -350,7 +414,7 @@ dwg_write_file(const char *restrict filename, const Dwg_Data *restrict dwg)
     {
       LOG_ERROR("Failed to write data into the file: %s\n", filename)
       fclose (fh);
-      free (dat.chain);
+      dwg_dealloc (dat.chain);
       dat.chain = NULL;
       dat.size = 0;
       return error | DWG_ERR_IOERROR;
@@ -358,7 +422,7 @@ dwg_write_file(const char *restrict filename, const Dwg_Data *restrict dwg)
   fclose (fh);
 
   if (dat.size > 0) {
-    free (dat.chain);
+    dwg_dealloc (dat.chain);
     dat.chain = NULL;
     dat.size = 0;
   }
@@ -375,29 +439,21 @@ dwg_bmp(const Dwg_Data *restrict dwg, BITCODE_RL *restrict size)
   int plene;
   BITCODE_RL header_size, address, osize;
   Bit_Chain *dat;
+  Dwg_Thread_State state;
 
   *size = 0;
   assert(dwg);
   dat = (Bit_Chain*) &dwg->picture;
+  loglevel = dwg_log_enter(dwg, &state);
   if (!dat || !dat->size)
     {
       LOG_INFO("no THUMBNAIL Image Data\n")
+      dwg_log_leave(&state);
       return NULL;
     }
   dat->bit = 0;
   dat->byte = 0;
 
-#ifdef USE_TRACING
-  /* Before starting, set the logging level, but only do so once.  */
-  if (! env_var_checked_p)
-    {
-      char *probe = getenv ("LIBREDWG_TRACE");
-      if (probe)
-        loglevel = atoi (probe);
-      env_var_checked_p = true;
-    }
-#endif  /* USE_TRACING */
-  
   osize = bit_read_RL(dat); /* overall size of all images */
   LOG_TRACE("overall size: " FORMAT_RL "\n", osize)
   num_pictures = bit_read_RC(dat);
@@ -435,6 +491,7 @@ dwg_bmp(const Dwg_Data *restrict dwg, BITCODE_RL *restrict size)
     }
   dat->byte += header_size;
   LOG_TRACE("Current address: 0x%lx\n", dat->byte)
+  dwg_log_leave(&state);
 
   if (*size > 0)
     return (dat->chain + dat->byte);
@@ -527,7 +584,7 @@ dwg_get_layers(const Dwg_Data *dwg)
   Dwg_Object_LAYER ** layers;
 
   assert(dwg);
-  layers = (Dwg_Object_LAYER **) calloc(num_layers,
+  layers = (Dwg_Object_LAYER **) dwg_calloc(num_layers,
                                         sizeof (Dwg_Object_LAYER*));
   for (i=0; i < num_layers; i++)
     layers[i] = dwg->layer_control.layers[i]->obj->tio.object->tio.LAYER;
@@ -555,26 +612,14 @@ dwg_get_num_entities(const Dwg_Data *dwg)
   return dwg->num_entities;
 }
 
-/** Returns a copy of all entities */
+/** Returns all entities, a view into the type index */
 Dwg_Object_Entity **
 dwg_get_entities(const Dwg_Data *dwg)
 {
-  BITCODE_BL i, ent_count = 0;
-  Dwg_Object_Entity ** entities;
-
   assert(dwg);
-  entities = (Dwg_Object_Entity **) calloc(dwg_get_num_entities(dwg),
-                                           sizeof (Dwg_Object_Entity*));
-  for (i=0; i < dwg->num_objects; i++)
-    {
-      if (dwg->object[i].supertype == DWG_SUPERTYPE_ENTITY)
-        {
-          entities[ent_count] = dwg->object[i].tio.entity;
-          ent_count++;
-          assert(ent_count < dwg->num_objects);
-        }
-    }
-  return entities;
+  if (lazy_index(dwg, &dwg->type_start, build_type_index))
+    return NULL;
+  return dwg->entities;
 }
 
 Dwg_Object_LAYER *
@@ -596,6 +641,21 @@ dwg_next_object(const Dwg_Object* obj)
   return &dwg->object[obj->index+1];
 }
 
+/* The resolved target of a object_ref vector entry, without logging */
+static Dwg_Object *
+referrer_target(const Dwg_Data *restrict dwg, Dwg_Object_Ref *restrict ref)
+{
+  uint32_t i;
+  if (!ref)
+    return NULL;
+  if (ref->obj && ref->generation == dwg->ref_generation)
+    return ref->obj;
+  i = hash_get(dwg->object_map, (uint32_t)ref->absolute_ref);
+  if (i == HASH_NOT_FOUND || (BITCODE_BL)i >= dwg->num_objects)
+    return NULL;
+  return &dwg->object[i];
+}
+
 /**
  * Find an object given its handle
  */
@@ -604,13 +664,14 @@ dwg_ref_object(const Dwg_Data *restrict dwg, Dwg_Object_Ref *restrict ref)
 {
   if (!ref)
     return NULL;
-  if (ref->obj && !dwg->dirty_refs)
+  if (ref->obj && ref->generation == dwg->ref_generation)
     return ref->obj;
   // Without obj we don't get an absolute_ref from relative OFFSETOBJHANDLE handle types.
   if (ref->handleref.code < 6 &&
       dwg_resolve_handleref((Dwg_Object_Ref*)ref, NULL))
     {
       ref->obj = dwg_resolve_handle(dwg, ref->absolute_ref);
+      ref->generation = dwg->ref_generation;
       return ref->obj;
     }
   else
@@ -626,11 +687,12 @@ dwg_ref_object_relative(const Dwg_Data *restrict dwg,
                             Dwg_Object_Ref *restrict ref,
                             const Dwg_Object *restrict obj)
 {
-  if (ref->obj && !dwg->dirty_refs)
+  if (ref->obj && ref->generation == dwg->ref_generation)
     return ref->obj;
   if (dwg_resolve_handleref((Dwg_Object_Ref*)ref, obj))
     {
       ref->obj = dwg_resolve_handle(dwg, ref->absolute_ref);
+      ref->generation = dwg->ref_generation;
       return ref->obj;
     }
   else
@@ -700,6 +762,458 @@ dwg_resolve_handleref(Dwg_Object_Ref *restrict ref, const Dwg_Object *restrict o
   return 1;
 }
 
+/* Run an index builder with the sink and the allocator of dwg */
+static int
+build_index(Dwg_Data *dwg, int (*build)(Dwg_Data *))
+{
+  Dwg_Thread_State state;
+  int error;
+
+  loglevel = dwg_log_enter(dwg, &state);
+  error = build(dwg);
+  dwg_log_leave(&state);
+  return error;
+}
+
+/* The indexes are caches of dwg, so the getters build a missing one on
+   first use, e.g. after dwg_add_object() dropped it. Readers may share
+   dwg between threads, so with OpenMP the check and the build are
+   serialized. Without, build the indexes before sharing dwg.
+   Returns 0 or DWG_ERR_OUTOFMEM. */
+static int
+lazy_index(const Dwg_Data *dwg, BITCODE_BL *const *start,
+           int (*build)(Dwg_Data *))
+{
+  int error = 0;
+#ifdef _OPENMP
+#pragma omp critical(dwg_lazy_index)
+#endif
+  {
+    if (!*start)
+      error = build_index((Dwg_Data *)dwg, build);
+  }
+  return error;
+}
+
+/** Build the reverse reference index in CSR layout: the referrers of
+    object[i] are referrers[referrers_start[i] .. referrers_start[i+1]).
+    One counting pass over the object_ref vector, and one filling pass.
+ */
+static int
+build_referrers(Dwg_Data *dwg)
+{
+  BITCODE_BL i, num = 0;
+  const BITCODE_BL num_objects = dwg->num_objects;
+  BITCODE_BL *start;
+
+  FREE_IF(dwg->referrers_start);
+  FREE_IF(dwg->referrers);
+  // start[t+2] counts the refs to object[t], so that after the prefix sum
+  // start[t+1] is the fill cursor for t, ending at start[t] = begin of t.
+  start = (BITCODE_BL *) dwg_calloc(num_objects + 2, sizeof(BITCODE_BL));
+  if (!start)
+    {
+      LOG_ERROR("Out of memory");
+      return DWG_ERR_OUTOFMEM;
+    }
+  for (i = 0; i < dwg->num_object_refs; i++)
+    {
+      Dwg_Object *obj = referrer_target(dwg, dwg->object_ref[i]);
+      if (obj)
+        {
+          start[obj->index + 2]++;
+          num++;
+        }
+    }
+  for (i = 2; i < num_objects + 2; i++)
+    start[i] += start[i - 1];
+
+  dwg->referrers = (Dwg_Referrer *) dwg_calloc(num ? num : 1,
+                                           sizeof(Dwg_Referrer));
+  if (!dwg->referrers)
+    {
+      dwg_dealloc(start);
+      LOG_ERROR("Out of memory");
+      return DWG_ERR_OUTOFMEM;
+    }
+  for (i = 0; i < dwg->num_object_refs; i++)
+    {
+      Dwg_Object_Ref *ref = dwg->object_ref[i];
+      Dwg_Object *obj = referrer_target(dwg, ref);
+      if (obj)
+        {
+          Dwg_Referrer *r = &dwg->referrers[start[obj->index + 1]++];
+          r->owner = dwg->object_ref_owner[i];
+          r->code = ref->handleref.code;
+        }
+    }
+  dwg->referrers_start = start;
+  LOG_TRACE("referrers: %u refs to %u objects\n", (unsigned)num,
+            (unsigned)num_objects);
+  return 0;
+}
+
+int
+dwg_build_referrers(Dwg_Data *dwg)
+{
+  return build_index(dwg, build_referrers);
+}
+
+/** Returns the objects referencing the given handle, and its count in num.
+    With the CSR index this is O(num).
+ */
+const Dwg_Referrer *
+dwg_referrers(const Dwg_Data *restrict dwg, const BITCODE_BL handle,
+              BITCODE_BL *restrict num)
+{
+  uint32_t i;
+
+  *num = 0;
+  if (!dwg->referrers_start)
+    return NULL;
+  i = hash_get(dwg->object_map, (uint32_t)handle);
+  if (i == HASH_NOT_FOUND || (BITCODE_BL)i >= dwg->num_objects)
+    return NULL;
+  *num = dwg->referrers_start[i + 1] - dwg->referrers_start[i];
+  return *num ? &dwg->referrers[dwg->referrers_start[i]] : NULL;
+}
+
+/** Build the per-layer entity index in CSR layout: the entities on the
+    LAYER object[i] are layered[layered_start[i] .. layered_start[i+1]).
+ */
+static int
+build_layer_index(Dwg_Data *dwg)
+{
+  BITCODE_BL i, num = 0;
+  const BITCODE_BL num_objects = dwg->num_objects;
+  BITCODE_BL *start;
+
+  FREE_IF(dwg->layered_start);
+  FREE_IF(dwg->layered);
+  if (dwg->header.version < R_13)
+    return 0;
+  // the same counting as in dwg_build_referrers
+  start = (BITCODE_BL *) dwg_calloc(num_objects + 2, sizeof(BITCODE_BL));
+  if (!start)
+    {
+      LOG_ERROR("Out of memory");
+      return DWG_ERR_OUTOFMEM;
+    }
+  for (i = 0; i < num_objects; i++)
+    {
+      const Dwg_Object *obj = &dwg->object[i];
+      const Dwg_Object *layer;
+      if (obj->supertype != DWG_SUPERTYPE_ENTITY || !obj->tio.entity)
+        continue;
+      layer = referrer_target(dwg, obj->tio.entity->layer);
+      if (layer && layer->fixedtype == DWG_TYPE_LAYER)
+        {
+          start[layer->index + 2]++;
+          num++;
+        }
+    }
+  for (i = 2; i < num_objects + 2; i++)
+    start[i] += start[i - 1];
+
+  dwg->layered = (BITCODE_BL *) dwg_calloc(num ? num : 1, sizeof(BITCODE_BL));
+  if (!dwg->layered)
+    {
+      dwg_dealloc(start);
+      LOG_ERROR("Out of memory");
+      return DWG_ERR_OUTOFMEM;
+    }
+  for (i = 0; i < num_objects; i++)
+    {
+      const Dwg_Object *obj = &dwg->object[i];
+      const Dwg_Object *layer;
+      if (obj->supertype != DWG_SUPERTYPE_ENTITY || !obj->tio.entity)
+        continue;
+      layer = referrer_target(dwg, obj->tio.entity->layer);
+      if (layer && layer->fixedtype == DWG_TYPE_LAYER)
+        dwg->layered[start[layer->index + 1]++] = i;
+    }
+  dwg->layered_start = start;
+  LOG_TRACE("layered: %u entities on layers\n", (unsigned)num);
+  return 0;
+}
+
+int
+dwg_build_layer_index(Dwg_Data *dwg)
+{
+  return build_index(dwg, build_layer_index);
+}
+
+/** Returns the entities on the LAYER with the given handle, and its
+    count in num.
+ */
+const BITCODE_BL *
+dwg_get_entities_on_layer(const Dwg_Data *restrict dwg,
+                          const BITCODE_BL handle, BITCODE_BL *restrict num)
+{
+  uint32_t i;
+
+  *num = 0;
+  if (lazy_index(dwg, &dwg->layered_start, build_layer_index)
+      || !dwg->layered_start)
+    return NULL;
+  i = hash_get(dwg->object_map, (uint32_t)handle);
+  if (i == HASH_NOT_FOUND || (BITCODE_BL)i >= dwg->num_objects)
+    return NULL;
+  *num = dwg->layered_start[i + 1] - dwg->layered_start[i];
+  return *num ? &dwg->layered[dwg->layered_start[i]] : NULL;
+}
+
+/* The slot of a type in the type index, as in memsize_type_index() */
+static BITCODE_BL
+type_slot(const Dwg_Object *obj)
+{
+  if (obj->supertype == DWG_SUPERTYPE_UNKNOWN
+      || obj->fixedtype > DWG_TYPE_XREFPANELOBJECT)
+    return obj->fixedtype == DWG_TYPE_UNKNOWN_ENT
+      || obj->supertype == DWG_SUPERTYPE_ENTITY
+      ? DWG_TYPE_INDEX_SIZE - 2 : DWG_TYPE_INDEX_SIZE - 1;
+  return obj->fixedtype;
+}
+
+static BITCODE_BL
+type_slot_of(const Dwg_Object_Type type)
+{
+  if (type == DWG_TYPE_UNKNOWN_ENT)
+    return DWG_TYPE_INDEX_SIZE - 2;
+  if (type == DWG_TYPE_UNKNOWN_OBJ)
+    return DWG_TYPE_INDEX_SIZE - 1;
+  return (BITCODE_BL)type <= DWG_TYPE_XREFPANELOBJECT
+    ? (BITCODE_BL)type : DWG_TYPE_INDEX_SIZE;
+}
+
+#define NO_BLOCK (BITCODE_BL)-1
+
+/* The BLOCK_HEADER owning the entity obj, by its entity mode */
+static BITCODE_BL
+type_owner(const Dwg_Data *restrict dwg, const Dwg_Object *restrict obj,
+           const BITCODE_BL mspace, const BITCODE_BL pspace)
+{
+  const Dwg_Object *owner;
+
+  if (obj->supertype != DWG_SUPERTYPE_ENTITY || !obj->tio.entity)
+    return NO_BLOCK;
+  switch (obj->tio.entity->entity_mode)
+    {
+    case 2:
+      return mspace;
+    case 1:
+      return pspace;
+    default:
+      // ATTRIB's and VERTEX's are owned by their entity
+      owner = referrer_target(dwg, obj->tio.entity->subentity);
+      return owner && owner->fixedtype == DWG_TYPE_BLOCK_HEADER
+        ? owner->index : NO_BLOCK;
+    }
+}
+
+static BITCODE_BL
+type_block_index(const Dwg_Data *restrict dwg, Dwg_Object_Ref *restrict ref,
+                 Dwg_Object_Ref *restrict fallback)
+{
+  const Dwg_Object *obj = referrer_target(dwg, ref);
+  if (!obj)
+    obj = referrer_target(dwg, fallback);
+  return obj && obj->fixedtype == DWG_TYPE_BLOCK_HEADER ? obj->index : NO_BLOCK;
+}
+
+static void
+free_type_index(Dwg_Data *dwg)
+{
+  FREE_IF(dwg->type_start);
+  FREE_IF(dwg->type_objects);
+  FREE_IF(dwg->type_groups_start);
+  FREE_IF(dwg->type_groups);
+  FREE_IF(dwg->type_tio);
+  FREE_IF(dwg->entities);
+}
+
+/** Build the type index in CSR layout: the objects of the type slot t
+    are type_objects[type_start[t] .. type_start[t+1]), sorted by their
+    owning block by two stable counting sorts, first by the block, then
+    by the type. The runs of one block are described in type_groups,
+    and their tio's in type_tio, each run NULL terminated. preR13 has no
+    blocks, so all its objects are in one run per type.
+ */
+static int
+build_type_index(Dwg_Data *dwg)
+{
+  const BITCODE_BL num_objects = dwg->num_objects;
+  BITCODE_BL *owner, *by_owner, *cursor, *start, *gstart;
+  BITCODE_BL i, g, num_groups = 0, num_entities = 0, mspace, pspace;
+
+  free_type_index(dwg);
+  if (dwg->header.version < R_13)
+    mspace = pspace = NO_BLOCK;
+  else
+    {
+      mspace = type_block_index(dwg, dwg->header_vars.BLOCK_RECORD_MSPACE,
+                                dwg->block_control.model_space);
+      pspace = type_block_index(dwg, dwg->header_vars.BLOCK_RECORD_PSPACE,
+                                dwg->block_control.paper_space);
+    }
+  owner = (BITCODE_BL *) dwg_malloc((num_objects + 1) * sizeof(BITCODE_BL));
+  by_owner = (BITCODE_BL *) dwg_malloc((num_objects + 1) * sizeof(BITCODE_BL));
+  // the counts per block, the objects without one in the last
+  cursor = (BITCODE_BL *) dwg_calloc(num_objects + 2, sizeof(BITCODE_BL));
+  start = (BITCODE_BL *) dwg_calloc(DWG_TYPE_INDEX_SIZE + 2, sizeof(BITCODE_BL));
+  gstart = (BITCODE_BL *) dwg_calloc(DWG_TYPE_INDEX_SIZE + 1, sizeof(BITCODE_BL));
+  if (!owner || !by_owner || !cursor || !start || !gstart)
+    goto oom;
+
+  for (i = 0; i < num_objects; i++)
+    {
+      const Dwg_Object *obj = &dwg->object[i];
+      owner[i] = type_owner(dwg, obj, mspace, pspace);
+      cursor[(owner[i] == NO_BLOCK ? num_objects : owner[i]) + 1]++;
+      start[type_slot(obj) + 2]++;
+      if (obj->supertype == DWG_SUPERTYPE_ENTITY)
+        num_entities++;
+    }
+  for (i = 1; i <= num_objects + 1; i++)
+    cursor[i] += cursor[i - 1];
+  for (i = 0; i < num_objects; i++)
+    by_owner[cursor[owner[i] == NO_BLOCK ? num_objects : owner[i]]++] = i;
+  for (i = 2; i < DWG_TYPE_INDEX_SIZE + 2; i++)
+    start[i] += start[i - 1];
+  dwg->type_objects = (BITCODE_BL *) dwg_malloc((num_objects ? num_objects : 1)
+                                                * sizeof(BITCODE_BL));
+  if (!dwg->type_objects)
+    goto oom;
+  for (i = 0; i < num_objects; i++)
+    {
+      const BITCODE_BL j = by_owner[i];
+      dwg->type_objects[start[type_slot(&dwg->object[j]) + 1]++] = j;
+    }
+
+  // the runs of one block per type
+  for (i = 0; i < DWG_TYPE_INDEX_SIZE; i++)
+    {
+      BITCODE_BL j;
+      gstart[i] = num_groups;
+      for (j = start[i]; j < start[i + 1]; j++)
+        if (j == start[i] || owner[dwg->type_objects[j]]
+                             != owner[dwg->type_objects[j - 1]])
+          num_groups++;
+    }
+  gstart[DWG_TYPE_INDEX_SIZE] = num_groups;
+  dwg->type_groups = (Dwg_Type_Group *) dwg_malloc(
+      (num_groups ? num_groups : 1) * sizeof(Dwg_Type_Group));
+  dwg->type_tio = (void **) dwg_malloc((num_objects + num_groups + 1)
+                                       * sizeof(void *));
+  dwg->entities = (Dwg_Object_Entity **) dwg_malloc((num_entities + 1)
+                                                   * sizeof(Dwg_Object_Entity *));
+  if (!dwg->type_groups || !dwg->type_tio || !dwg->entities)
+    goto oom;
+  for (i = g = 0; i < DWG_TYPE_INDEX_SIZE; i++)
+    {
+      BITCODE_BL j;
+      for (j = start[i]; j < start[i + 1]; j++)
+        {
+          const Dwg_Object *obj = &dwg->object[dwg->type_objects[j]];
+          if (j == start[i] || owner[obj->index]
+                               != owner[dwg->type_objects[j - 1]])
+            {
+              if (j != start[i])
+                dwg->type_tio[j + g - 1] = NULL;
+              dwg->type_groups[g].block = owner[obj->index];
+              dwg->type_groups[g].first = j;
+              g++;
+            }
+          dwg->type_tio[j + g - 1] = obj->supertype == DWG_SUPERTYPE_ENTITY
+            ? (obj->tio.entity ? (void *)obj->tio.entity->tio.UNUSED : NULL)
+            : (obj->tio.object ? (void *)obj->tio.object->tio.BLOCK_CONTROL
+                               : NULL);
+        }
+      if (start[i + 1] > start[i])
+        dwg->type_tio[start[i + 1] + g - 1] = NULL;
+    }
+  for (i = g = 0; i < num_objects; i++)
+    if (dwg->object[i].supertype == DWG_SUPERTYPE_ENTITY)
+      dwg->entities[g++] = dwg->object[i].tio.entity;
+  dwg->entities[g] = NULL;
+
+  dwg_dealloc(owner);
+  dwg_dealloc(by_owner);
+  dwg_dealloc(cursor);
+  dwg->type_start = start;
+  dwg->type_groups_start = gstart;
+  LOG_TRACE("types: %u objects in %u groups\n", (unsigned)num_objects,
+            (unsigned)num_groups);
+  return 0;
+
+ oom:
+  FREE_IF(owner);
+  FREE_IF(by_owner);
+  FREE_IF(cursor);
+  FREE_IF(start);
+  FREE_IF(gstart);
+  free_type_index(dwg);
+  LOG_ERROR("Out of memory");
+  return DWG_ERR_OUTOFMEM;
+}
+
+int
+dwg_build_type_index(Dwg_Data *dwg)
+{
+  return build_index(dwg, build_type_index);
+}
+
+/** Returns the objects of the given type, and its count in num.
+ */
+const BITCODE_BL *
+dwg_get_objects_by_type(const Dwg_Data *restrict dwg,
+                        const Dwg_Object_Type type, BITCODE_BL *restrict num)
+{
+  const BITCODE_BL t = type_slot_of(type);
+
+  *num = 0;
+  if (t >= DWG_TYPE_INDEX_SIZE
+      || lazy_index(dwg, &dwg->type_start, build_type_index)
+      || !dwg->type_start)
+    return NULL;
+  *num = dwg->type_start[t + 1] - dwg->type_start[t];
+  return *num ? &dwg->type_objects[dwg->type_start[t]] : NULL;
+}
+
+/** Returns the entities of the given type owned by hdr, by a binary
+    search in the runs of the type.
+ */
+void **
+dwg_get_block_entities_by_type(const Dwg_Object *restrict hdr,
+                               const Dwg_Object_Type type)
+{
+  Dwg_Data *dwg;
+  const BITCODE_BL t = type_slot_of(type);
+  BITCODE_BL lo, hi;
+
+  if (!hdr || hdr->fixedtype != DWG_TYPE_BLOCK_HEADER
+      || t >= DWG_TYPE_INDEX_SIZE)
+    return NULL;
+  dwg = hdr->parent;
+  if (lazy_index(dwg, &dwg->type_start, build_type_index)
+      || !dwg->type_start)
+    return NULL;
+  lo = dwg->type_groups_start[t];
+  hi = dwg->type_groups_start[t + 1];
+  while (lo < hi)
+    {
+      const BITCODE_BL mid = lo + (hi - lo) / 2;
+      const Dwg_Type_Group *grp = &dwg->type_groups[mid];
+      if (grp->block == hdr->index)
+        return &dwg->type_tio[grp->first + mid];
+      if (grp->block < hdr->index)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return NULL;
+}
+
 /** Returns the block_control for the DWG,
     containing the list of all blocks headers.
 */
@@ -730,36 +1244,240 @@ dwg_paper_space_ref(Dwg_Data *dwg)
   return dwg->block_control.paper_space->obj ? dwg->block_control.paper_space : NULL;
 }
 
-Dwg_Object*
-get_first_owned_object(const Dwg_Object *hdr)
+/* The next object in the chain of a R13-R2000 block. Usually the objects
+   from first_entity to last_entity in object[], with the objects, the
+   entities of other blocks and the ATTRIB's, VERTEX's and SEQEND's of
+   complex entities in between. When the block was appended to out of
+   order, follow the next_entity links instead. */
+static Dwg_Object *
+owned_chain_next(Dwg_Data *restrict dwg, const Dwg_Object *restrict obj,
+                 const int chain)
 {
-  unsigned int version = hdr->parent->header.version;
-  Dwg_Object_BLOCK_HEADER *_hdr = hdr->tio.object->tio.BLOCK_HEADER;
-  if (hdr->type != DWG_TYPE_BLOCK_HEADER)
+  if (chain && obj->supertype == DWG_SUPERTYPE_ENTITY)
     {
-      LOG_ERROR("Invalid BLOCK_HEADER type %d", hdr->type);
-      return NULL;
+      Dwg_Object_Entity *ent = obj->tio.entity;
+      if (!ent->nolinks && ent->next_entity && ent->next_entity->absolute_ref)
+        return dwg_ref_object(dwg, ent->next_entity);
     }
+  return dwg_next_object(obj);
+}
 
-  if (R_13 <= version && version <= R_2000)
+/* The entity_mode of the entities of the block hdr: 2 in the model space,
+   1 in the paper space, else 0 with hdr as their owner */
+static int
+owned_mode(const Dwg_Data *restrict dwg, const Dwg_Object *restrict hdr)
+{
+  Dwg_Object *obj = referrer_target(dwg, dwg->header_vars.BLOCK_RECORD_MSPACE);
+  if (!obj)
+    obj = referrer_target(dwg, dwg->block_control.model_space);
+  if (obj == hdr)
+    return 2;
+  obj = referrer_target(dwg, dwg->header_vars.BLOCK_RECORD_PSPACE);
+  if (!obj)
+    obj = referrer_target(dwg, dwg->block_control.paper_space);
+  return obj == hdr ? 1 : 0;
+}
+
+/* Whether obj of the R13-R2000 chain is an entity of the block hdr */
+static int
+owned_by(const Dwg_Object *restrict obj, const Dwg_Object *restrict hdr,
+         const int mode)
+{
+  const Dwg_Object_Entity *ent = obj->tio.entity;
+  if (obj->supertype != DWG_SUPERTYPE_ENTITY || !ent)
+    return 0;
+  if (ent->entity_mode)
+    return ent->entity_mode == mode;
+  return ent->subentity && ent->subentity->absolute_ref == hdr->handle.value;
+}
+
+/** Initialize the external iterator over the entities owned by hdr.
+    Uses the precomputed dwg->owned slice if there is one, else walks
+    the first_entity..last_entity chain (R13-R2000), skipping what is not
+    owned by hdr, or entities[] (R2004+).
+ */
+int
+dwg_owned_iter_init(Dwg_Owned_Iter *restrict it, const Dwg_Object *restrict hdr)
+{
+  Dwg_Data *dwg;
+  Dwg_Object_BLOCK_HEADER *_hdr;
+  unsigned int version;
+
+  memset(it, 0, sizeof(Dwg_Owned_Iter));
+  if (!hdr || hdr->type != DWG_TYPE_BLOCK_HEADER)
     {
-      return _hdr->first_entity->obj;
+      LOG_ERROR("Invalid BLOCK_HEADER type %d", hdr ? (int)hdr->type : -1);
+      return DWG_ERR_INVALIDTYPE;
+    }
+  it->hdr = hdr;
+  dwg = hdr->parent;
+  if (dwg->owned_start)
+    {
+      it->list = dwg_owned_objects(hdr, &it->num);
+      return 0;
     }
 
-  if (version >= R_2004)
+  version = dwg->header.version;
+  if (!hdr->tio.object || !hdr->tio.object->tio.BLOCK_HEADER)
+    return DWG_ERR_INVALIDTYPE; // out of memory when it was decoded
+  _hdr = hdr->tio.object->tio.BLOCK_HEADER;
+  if (R_13 <= version && version <= R_2000)
     {
-      _hdr->__iterator = 0;
-      if (_hdr->entities && _hdr->num_owned && _hdr->entities[0])
-        return _hdr->entities[0]->obj;
+      it->next = _hdr->first_entity
+        ? dwg_ref_object(dwg, _hdr->first_entity) : NULL;
+      it->last = _hdr->last_entity
+        ? dwg_ref_object(dwg, _hdr->last_entity) : NULL;
+      if (!it->next || !it->last)
+        it->next = NULL;
+      else if (it->next->index <= it->last->index)
+        it->num = it->last->index - it->next->index + 1;
       else
-        return NULL;
+        {
+          it->chain = 1;
+          it->num = dwg->num_objects; // guards against cycles
+        }
+      it->mode = owned_mode(dwg, hdr);
+      return 0;
+    }
+  if (version >= R_2004)
+    {
+      if (_hdr->entities)
+        it->num = _hdr->num_owned;
+      return 0;
     }
 
   //TODO: preR13 block table
   LOG_ERROR("Unsupported version: %d\n", version);
+  return DWG_ERR_INVALIDTYPE;
+}
+
+Dwg_Object*
+dwg_owned_iter_next(Dwg_Owned_Iter *it)
+{
+  Dwg_Data *dwg;
+  Dwg_Object_BLOCK_HEADER *_hdr;
+
+  if (!it->hdr)
+    return NULL;
+  dwg = it->hdr->parent;
+  if (it->list)
+    return it->i < it->num ? &dwg->object[it->list[it->i++]] : NULL;
+  if (dwg->header.version <= R_2000)
+    {
+      Dwg_Object *obj;
+      while ((obj = it->next) && it->i < it->num)
+        {
+          it->i++;
+          it->next = obj == it->last ? NULL
+                                     : owned_chain_next(dwg, obj, it->chain);
+          if (owned_by(obj, it->hdr, it->mode))
+            return obj;
+        }
+      return NULL;
+    }
+
+  _hdr = it->hdr->tio.object->tio.BLOCK_HEADER;
+  while (it->i < it->num)
+    {
+      Dwg_Object_Ref *ref = _hdr->entities[it->i++];
+      Dwg_Object *obj = ref ? dwg_ref_object(dwg, ref) : NULL;
+      if (obj)
+        return obj;
+    }
   return NULL;
 }
 
+/** Build the contiguous per-block arrays of owned entity indices in CSR
+    layout: the entities owned by the BLOCK_HEADER object[i] are
+    owned[owned_start[i] .. owned_start[i+1]).
+ */
+static int
+build_owned_index(Dwg_Data *dwg)
+{
+  BITCODE_BL i, num = 0;
+  const BITCODE_BL num_objects = dwg->num_objects;
+  BITCODE_BL *start;
+  Dwg_Owned_Iter it;
+  Dwg_Object *obj;
+
+  FREE_IF(dwg->owned_start);
+  FREE_IF(dwg->owned);
+  if (dwg->header.version < R_13)
+    return 0;
+  start = (BITCODE_BL *) dwg_calloc(num_objects + 1, sizeof(BITCODE_BL));
+  if (!start)
+    {
+      LOG_ERROR("Out of memory");
+      return DWG_ERR_OUTOFMEM;
+    }
+  // the iterators walk the blocks directly until owned_start is set
+  for (i = 0; i < num_objects; i++)
+    {
+      start[i] = num;
+      if (dwg->object[i].type != DWG_TYPE_BLOCK_HEADER
+          || dwg_owned_iter_init(&it, &dwg->object[i]))
+        continue;
+      while (dwg_owned_iter_next(&it))
+        num++;
+    }
+  start[num_objects] = num;
+
+  dwg->owned = (BITCODE_BL *) dwg_calloc(num ? num : 1, sizeof(BITCODE_BL));
+  if (!dwg->owned)
+    {
+      dwg_dealloc(start);
+      LOG_ERROR("Out of memory");
+      return DWG_ERR_OUTOFMEM;
+    }
+  for (i = 0; i < num_objects; i++)
+    {
+      BITCODE_BL j = start[i];
+      if (start[i + 1] == j)
+        continue;
+      dwg_owned_iter_init(&it, &dwg->object[i]);
+      while ((obj = dwg_owned_iter_next(&it)) && j < start[i + 1])
+        dwg->owned[j++] = obj->index;
+    }
+  dwg->owned_start = start;
+  LOG_TRACE("owned: %u entities in blocks\n", (unsigned)num);
+  return 0;
+}
+
+int
+dwg_build_owned_index(Dwg_Data *dwg)
+{
+  return build_index(dwg, build_owned_index);
+}
+
+/** Returns the object[] indices owned by the BLOCK_HEADER hdr,
+    and its count in num.
+ */
+const BITCODE_BL *
+dwg_owned_objects(const Dwg_Object *restrict hdr, BITCODE_BL *restrict num)
+{
+  const Dwg_Data *dwg = hdr->parent;
+
+  *num = 0;
+  if (!dwg->owned_start || hdr->index >= dwg->num_objects)
+    return NULL;
+  *num = dwg->owned_start[hdr->index + 1] - dwg->owned_start[hdr->index];
+  return *num ? &dwg->owned[dwg->owned_start[hdr->index]] : NULL;
+}
+
+/* Prefer the Dwg_Owned_Iter, the cursor here is kept in the block. */
+Dwg_Object*
+get_first_owned_object(const Dwg_Object *hdr)
+{
+  Dwg_Owned_Iter it;
+  Dwg_Object_BLOCK_HEADER *_hdr;
+
+  if (dwg_owned_iter_init(&it, hdr))
+    return NULL;
+  _hdr = hdr->tio.object->tio.BLOCK_HEADER;
+  _hdr->__iterator = 0;
+  return dwg_owned_iter_next(&it);
+}
+
 Dwg_Object*
 get_next_owned_object(const Dwg_Object *restrict hdr,
                       const Dwg_Object *restrict current)
@@ -774,17 +1492,40 @@ get_next_owned_object(const Dwg_Object *restrict hdr,
 
   if (R_13 <= version && version <= R_2000)
     {
-      if (current == _hdr->last_entity->obj)
+      // skipping what hdr does not own, as dwg_owned_iter_next()
+      Dwg_Data *dwg = hdr->parent;
+      const Dwg_Object *obj = current;
+      BITCODE_BL n = dwg->num_objects; // guards against cycles
+      int chain, mode;
+      if (!_hdr->first_entity || !_hdr->first_entity->obj
+          || !_hdr->last_entity || !_hdr->last_entity->obj)
         return NULL;
-      return dwg_next_object(current);
+      chain = _hdr->first_entity->obj->index > _hdr->last_entity->obj->index;
+      mode = owned_mode(dwg, hdr);
+      while (obj && obj != _hdr->last_entity->obj && n--)
+        {
+          obj = owned_chain_next(dwg, obj, chain);
+          if (obj && owned_by(obj, hdr, mode))
+            return (Dwg_Object *)obj;
+        }
+      return NULL;
     }
 
   if (version >= R_2004)
     {
-      _hdr->__iterator++;
-      if (_hdr->__iterator == _hdr->num_owned)
+      BITCODE_BL i = _hdr->__iterator;
+      // only a hint, a nested walk over the same block may have moved it
+      if (i >= _hdr->num_owned || !_hdr->entities[i]
+          || _hdr->entities[i]->obj != current)
+        {
+          for (i = 0; i < _hdr->num_owned; i++)
+            if (_hdr->entities[i] && _hdr->entities[i]->obj == current)
+              break;
+        }
+      if (i + 1 >= _hdr->num_owned)
         return NULL;
-      return _hdr->entities[_hdr->__iterator]->obj;
+      _hdr->__iterator = ++i;
+      return _hdr->entities[i] ? _hdr->entities[i]->obj : NULL;
     }
 
   LOG_ERROR("Unsupported version: %d\n", version);
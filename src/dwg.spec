@@ -1563,19 +1563,34 @@ static int decode_3dsolid(Bit_Chain* dat, Bit_Chain* hdl_dat,
         {
           do
             {
-              FIELD_VALUE(encr_sat_data) = (BITCODE_RC**)
-                realloc(FIELD_VALUE(encr_sat_data), (i+1) * sizeof (BITCODE_RC*));
-              FIELD_VALUE(block_size) = (BITCODE_BL*)
-                realloc(FIELD_VALUE(block_size), (i+1) * sizeof (BITCODE_BL));
+              BITCODE_RC **sat_data = (BITCODE_RC**)
+                dwg_realloc(FIELD_VALUE(encr_sat_data), (i+1) * sizeof (BITCODE_RC*));
+              BITCODE_BL *sizes = sat_data ? (BITCODE_BL*)
+                dwg_realloc(FIELD_VALUE(block_size), (i+1) * sizeof (BITCODE_BL))
+                : NULL;
+              if (sat_data)
+                FIELD_VALUE(encr_sat_data) = sat_data;
+              if (!sizes)
+                {
+                  LOG_ERROR("Out of memory");
+                  FIELD_VALUE(num_blocks) = i;
+                  return DWG_ERR_OUTOFMEM;
+                }
+              FIELD_VALUE(block_size) = sizes;
               FIELD_BL (block_size[i], 0);
               FIELD_TF (encr_sat_data[i], FIELD_VALUE(block_size[i]), 1);
               total_size += FIELD_VALUE (block_size[i]);
             } while(FIELD_VALUE (block_size[i++]));
 
           // de-obfuscate SAT data
-          FIELD_VALUE(acis_data) = malloc (total_size+1);
+          FIELD_VALUE(acis_data) = dwg_malloc (total_size+1);
           num_blocks = i-1;
           FIELD_VALUE(num_blocks) = num_blocks;
+          if (!FIELD_VALUE(acis_data))
+            {
+              LOG_ERROR("Out of memory");
+              return DWG_ERR_OUTOFMEM;
+            }
           index = 0;
           for (i=0; i<num_blocks; i++)
             {
@@ -1611,8 +1626,13 @@ static int decode_3dsolid(Bit_Chain* dat, Bit_Chain* hdl_dat,
         {
           //TODO string in strhdl, even <r2007
           FIELD_VALUE(num_blocks) = 2;
-          FIELD_VALUE(block_size) = malloc(2 * sizeof (BITCODE_RL));
-          FIELD_VALUE(encr_sat_data) = malloc(2 * sizeof (BITCODE_RC*));
+          FIELD_VALUE(block_size) = dwg_malloc(2 * sizeof (BITCODE_RL));
+          FIELD_VALUE(encr_sat_data) = dwg_calloc(2, sizeof (BITCODE_RC*));
+          if (!FIELD_VALUE(block_size) || !FIELD_VALUE(encr_sat_data))
+            {
+              LOG_ERROR("Out of memory");
+              return DWG_ERR_OUTOFMEM;
+            }
           FIELD_TF (encr_sat_data[0], 15, 1); // "ACIS BinaryFile"
           FIELD_VALUE(block_size[0]) = 15;
           FIELD_RL (block_size[1], 0);
@@ -1723,9 +1743,9 @@ static void free_3dsolid(Dwg_Object* obj, Dwg_Entity_3DSOLID* _obj)
         {
           FIELD_TF (encr_sat_data[i], block_size[i], 0);
         }
-      free(_obj->encr_sat_data);
-      free(_obj->block_size);
-      free(_obj->acis_data);
+      dwg_dealloc(_obj->encr_sat_data);
+      dwg_dealloc(_obj->block_size);
+      dwg_dealloc(_obj->acis_data);
     }
 }
 #undef FREE_3DSOLID
@@ -4972,10 +4992,15 @@ DWG_OBJECT(XRECORD)
            hdl_dat->byte < obj->tio.object->datpos + (obj->bitsize/8);
            vcount++)
         {
-          FIELD_VALUE(objid_handles) = vcount
-            ? realloc(FIELD_VALUE(objid_handles),
-                                   (vcount+1) * sizeof(Dwg_Object_Ref))
-            : malloc(sizeof(Dwg_Object_Ref));
+          BITCODE_H *handles = (BITCODE_H *)dwg_realloc(
+              FIELD_VALUE(objid_handles), (vcount+1) * sizeof(Dwg_Object_Ref));
+          if (!handles)
+            {
+              LOG_ERROR("Out of memory");
+              FIELD_VALUE(num_objid_handles) = vcount;
+              return DWG_ERR_OUTOFMEM;
+            }
+          FIELD_VALUE(objid_handles) = handles;
           FIELD_HANDLE_N (objid_handles[vcount], vcount, ANYCODE, 0);
           if (!FIELD_VALUE(objid_handles[vcount]))
             break;
@@ -5794,7 +5819,7 @@ DWG_OBJECT(DBCOLOR)
   FIELD_RC (unknown2, 0); //8
 #endif
   DXF {
-    char *s = malloc(strlen(_obj->name) + strlen(_obj->catalog) + 2);
+    char *s = dwg_malloc(strlen(_obj->name) + strlen(_obj->catalog) + 2);
     strcpy(s, _obj->catalog);
     strcat(s, "$");
     strcat(s, _obj->name);
@@ -9519,7 +9519,7 @@ double *
 dwg_ent_lwpline_get_bulges(const dwg_ent_lwpline *restrict lwpline,
                           int *restrict error)
 {
-  BITCODE_BD *ptx = (BITCODE_BD*) malloc(sizeof(BITCODE_BD)* lwpline->num_bulges);
+  BITCODE_BD *ptx = (BITCODE_BD*) dwg_malloc(sizeof(BITCODE_BD)* lwpline->num_bulges);
   if (ptx)
     {
       BITCODE_BL i;
@@ -9544,7 +9544,7 @@ dwg_point_2d *
 dwg_ent_lwpline_get_points(const dwg_ent_lwpline *restrict lwpline,
                           int *restrict error)
 {
-  dwg_point_2d *ptx = (dwg_point_2d*) malloc(sizeof(dwg_point_2d)* lwpline->num_points);
+  dwg_point_2d *ptx = (dwg_point_2d*) dwg_malloc(sizeof(dwg_point_2d)* lwpline->num_points);
   if (ptx)
     {
       BITCODE_BL i;
@@ -9571,7 +9571,7 @@ dwg_ent_lwpline_get_widths(const dwg_ent_lwpline *restrict lwpline,
                           int *restrict error)
 {
   dwg_lwpline_widths *ptx = (dwg_lwpline_widths*)
-    malloc(sizeof(dwg_lwpline_widths)* lwpline->num_widths);
+    dwg_malloc(sizeof(dwg_lwpline_widths)* lwpline->num_widths);
   if (ptx)
     {
       BITCODE_BL i;
@@ -10570,7 +10570,7 @@ dwg_spline_point *
 dwg_ent_spline_get_fit_pts(const dwg_ent_spline *restrict spline,
                           int *restrict error)
 {
-  dwg_spline_point *ptx = calloc(spline->num_fit_pts, sizeof(dwg_spline_point));
+  dwg_spline_point *ptx = dwg_calloc(spline->num_fit_pts, sizeof(dwg_spline_point));
   if (ptx)
     {
       BITCODE_BS i;
@@ -10595,7 +10595,7 @@ dwg_spline_control_point *
 dwg_ent_spline_get_ctrl_pts(const dwg_ent_spline *restrict spline,
                           int *restrict error)
 {
-  dwg_spline_control_point *ptx = calloc(spline->num_ctrl_pts,
+  dwg_spline_control_point *ptx = dwg_calloc(spline->num_ctrl_pts,
                                          sizeof(dwg_spline_control_point));
   if (ptx)
     {
@@ -10621,7 +10621,7 @@ double *
 dwg_ent_spline_get_knots(const dwg_ent_spline *restrict spline,
                           int *restrict error)
 {
-  double *ptx = (double*) malloc(sizeof(double)* spline->num_knots);
+  double *ptx = (double*) dwg_malloc(sizeof(double)* spline->num_knots);
   if (ptx)
     {
       BITCODE_BL i;
@@ -12562,7 +12562,7 @@ dwg_object_polyline_2d_get_points(const dwg_object *restrict obj,
 
       if (!num_points || *error)
         return NULL;
-      ptx = calloc(num_points, sizeof(dwg_point_2d));
+      ptx = dwg_calloc(num_points, sizeof(dwg_point_2d));
       if (!ptx)
         {
           LOG_ERROR("%s: Out of memory", __FUNCTION__);
@@ -12794,7 +12794,7 @@ dwg_object_polyline_3d_get_points(const dwg_object *restrict obj,
 
       if (!num_points || *error)
         return NULL;
-      ptx = calloc(num_points, sizeof(dwg_point_3d));
+      ptx = dwg_calloc(num_points, sizeof(dwg_point_3d));
       if (!ptx)
         {
           LOG_ERROR("%s: Out of memory", __FUNCTION__);
@@ -13695,7 +13695,7 @@ BITCODE_2RD *
 dwg_ent_image_get_clip_verts(const dwg_ent_image *restrict image,
                           int *restrict error)
 {
-  BITCODE_2RD *ptx = calloc(image->num_clip_verts, sizeof(BITCODE_2RD));
+  BITCODE_2RD *ptx = dwg_calloc(image->num_clip_verts, sizeof(BITCODE_2RD));
   if (ptx)
     {
       BITCODE_BL i;
@@ -13941,7 +13941,7 @@ dwg_mline_line *
 dwg_mline_vertex_get_lines(const dwg_mline_vertex *restrict vertex,
                            int *restrict error)
 {
-  dwg_mline_line *ptx = calloc(vertex->num_lines, sizeof(dwg_mline_line));
+  dwg_mline_line *ptx = dwg_calloc(vertex->num_lines, sizeof(dwg_mline_line));
   if (ptx)
     {
       BITCODE_BS i;
@@ -13985,7 +13985,7 @@ dwg_mline_vertex *
 dwg_ent_mline_get_verts(const dwg_ent_mline *restrict mline,
                         int *restrict error)
 {
-  dwg_mline_vertex *ptx = calloc(mline->num_verts, sizeof(dwg_mline_vertex));
+  dwg_mline_vertex *ptx = dwg_calloc(mline->num_verts, sizeof(dwg_mline_vertex));
   if (ptx)
     {
       BITCODE_BS i;
@@ -14367,7 +14367,7 @@ dwg_3dsolid_wire *
 dwg_ent_3dsolid_get_wires(const dwg_ent_3dsolid *restrict _3dsolid,
                           int *restrict error)
 {
-  dwg_3dsolid_wire *wire = calloc(_3dsolid->num_wires, sizeof(dwg_3dsolid_wire));
+  dwg_3dsolid_wire *wire = dwg_calloc(_3dsolid->num_wires, sizeof(dwg_3dsolid_wire));
   if (wire)
     {
       BITCODE_BL i;
@@ -14413,7 +14413,7 @@ dwg_3dsolid_silhouette *
 dwg_ent_3dsolid_get_silhouettes(const dwg_ent_3dsolid *restrict _3dsolid,
                                 int *restrict error)
 {
-  dwg_3dsolid_silhouette *sh = calloc(_3dsolid->num_silhouettes,
+  dwg_3dsolid_silhouette *sh = dwg_calloc(_3dsolid->num_silhouettes,
                                       sizeof(dwg_3dsolid_silhouette));
   if (sh)
     {
@@ -17876,7 +17876,7 @@ dwg_obj_block_control_get_block_headers(const dwg_obj_block_control *restrict ct
                                         int *restrict error)
 {
   dwg_object_ref **ptx = (dwg_object_ref**)
-    malloc(ctrl->num_entries * sizeof(Dwg_Object_Ref *));
+    dwg_malloc(ctrl->num_entries * sizeof(Dwg_Object_Ref *));
   if (ctrl->num_entries && !ctrl->block_headers)
     {
       *error = 1;
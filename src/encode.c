@@ -27,9 +27,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
-#ifdef __STDC_ALLOC_LIB__
-#define __STDC_WANT_LIB_EXT2__ 1 /* for strdup */
-#endif
 #include <string.h>
 #include <assert.h>
 
@@ -39,16 +36,11 @@
 #include "encode.h"
 #include "decode.h"
 
-/* The logging level for the write (encode) path.  */
-static unsigned int loglevel;
+/* The logging level for the write (encode) path, per thread.  */
+static THREAD_LOCAL unsigned int loglevel;
 /* the current version per spec block */
 static unsigned int cur_ver = 0;
 
-#ifdef USE_TRACING
-/* This flag means we have checked the environment variable
-   LIBREDWG_TRACE and set `loglevel' appropriately.  */
-static bool env_var_checked_p;
-#endif  /* USE_TRACING */
 #define DWG_LOGLEVEL loglevel
 
 #include "logging.h"
@@ -61,7 +53,6 @@ static bool env_var_checked_p;
 #define IS_ENCODER
 
 #define ANYCODE -1
-#define REFS_PER_REALLOC 100
 
 #define VALUE(value,type,dxf) \
   { bit_write_##type(dat, value); \
@@ -102,7 +93,7 @@ static bool env_var_checked_p;
 #define FIELD_MC(name,dxf) FIELDG(name, MC, dxf)
 #define FIELD_MS(name,dxf) FIELDG(name, MS, dxf)
 #define FIELD_TV(name,dxf) \
-  { IF_ENCODE_FROM_EARLIER { _obj->name = strdup(""); } FIELDG(name, TV, dxf); }
+  { IF_ENCODE_FROM_EARLIER { _obj->name = (char*)dwg_calloc(1, 1); } FIELDG(name, TV, dxf); }
 #define FIELD_T(name,dxf) \
   { if (dat->version < R_2007) { \
       FIELD_TV(name,dxf) \
@@ -357,16 +348,18 @@ static bool env_var_checked_p;
 #if 0
 /** See dec_macro.h instead. 
    Returns -1 if not added, else returns the new objid.
-   Does a complete handleref rescan to invalidate and resolve
-   all internal obj pointers after a object[] realloc.
+   An object[] realloc bumps dwg->ref_generation, the stale obj pointers
+   of the refs are resolved lazily on their next dwg_ref_object().
 */
 EXPORT long dwg_add_##token (Dwg_Data * dwg)    \
 {                                               \
   Bit_Chain dat;                                \
   BITCODE_BL num_objs  = dwg->num_objects;      \
   int error = 0;                                \
+  Dwg_Allocator saved;                          \
   dat.size = sizeof(Dwg_Entity_##token) + 40;   \
-  dat.chain = calloc(dat.size, 1);              \
+  dwg_alloc_enter(dwg, &saved);                 \
+  dat.chain = dwg_calloc(dat.size, 1);          \
   dat.version = dwg->header.version;            \
   dat.from_version = dwg->header.from_version;  \
   bit_write_MS(&dat, dat.size);                 \
@@ -378,8 +371,8 @@ EXPORT long dwg_add_##token (Dwg_Data * dwg)    \
   }                                             \
   bit_set_position(&dat, 0);                    \
   error = dwg_decode_add_object(dwg, &dat, &dat, 0);\
-  if (-1 == error) \
-    dwg_resolve_objectrefs_silent(dwg);         \
+  dwg_dealloc(dat.chain);                       \
+  dwg_alloc_leave(&saved);                      \
   if (num_objs == dwg->num_objects)             \
     return -1;                                  \
   else                                          \
@@ -391,8 +384,10 @@ EXPORT long dwg_add_##token (Dwg_Data * dwg)     \
   Bit_Chain dat;                                 \
   int error = 0; \
   BITCODE_BL num_objs  = dwg->num_objects;       \
+  Dwg_Allocator saved;                           \
   dat.size = sizeof(Dwg_Object_##token) + 40;    \
-  dat.chain = calloc(dat.size, 1);               \
+  dwg_alloc_enter(dwg, &saved);                  \
+  dat.chain = dwg_calloc(dat.size, 1);           \
   dat.version = dwg->header.version;             \
   dat.from_version = dwg->header.from_version;   \
   bit_write_MS(&dat, dat.size);                  \
@@ -404,8 +399,8 @@ EXPORT long dwg_add_##token (Dwg_Data * dwg)     \
   }                                              \
   bit_set_position(&dat, 0);                     \
   error = dwg_decode_add_object(dwg, &dat, &dat, 0);\
-  if (-1 ==  error) \
-    dwg_resolve_objectrefs_silent(dwg);          \
+  dwg_dealloc(dat.chain);                        \
+  dwg_alloc_leave(&saved);                       \
   if (num_objs == dwg->num_objects)              \
     return -1;                                   \
   else                                           \
@@ -442,8 +437,8 @@ static int dwg_encode_##token (Bit_Chain *restrict dat, Dwg_Object *restrict obj
 }
 
 /** Returns -1 if not added, else returns the new objid.
-   Does a complete handleref rescan to invalidate and resolve
-   all internal obj pointers after a object[] realloc.
+   An object[] realloc bumps dwg->ref_generation, the stale obj pointers
+   of the refs are resolved lazily on their next dwg_ref_object().
 */
 #define DWG_OBJECT(token) \
 static int dwg_encode_##token (Bit_Chain *restrict dat, Dwg_Object *restrict obj) \
@@ -486,7 +481,7 @@ static int dwg_encode_##token (Bit_Chain *restrict dat, Dwg_Object *restrict obj
 
 #undef DEBUG_POS
 #define DEBUG_POS\
-  if (DWG_LOGLEVEL >= DWG_LOGLEVEL_TRACE) { \
+  if (LOG_ENABLED(TRACE)) { \
     LOG_TRACE("DEBUG_POS @%u.%u / 0x%x (%lu)\n", (unsigned int)dat->byte, dat->bit, \
               (unsigned int)dat->byte, bit_position(dat)); \
   }
@@ -535,6 +530,9 @@ dwg_encode_xdata(Bit_Chain *restrict dat, Dwg_Object_XRECORD *restrict obj, int
  * Public functions
  */
 
+static int
+encode_dwg(Dwg_Data *restrict dwg, Bit_Chain *restrict dat);
+
 /**
  * dwg_encode(): the current generic encoder entry point.
  *
@@ -544,6 +542,18 @@ dwg_encode_xdata(Bit_Chain *restrict dat, Dwg_Object_XRECORD *restrict obj, int
  */
 int
 dwg_encode(Dwg_Data *restrict dwg, Bit_Chain *restrict dat)
+{
+  Dwg_Thread_State state;
+  int error;
+
+  loglevel = dwg_log_enter(dwg, &state);
+  error = encode_dwg(dwg, dat);
+  dwg_log_leave(&state);
+  return error;
+}
+
+static int
+encode_dwg(Dwg_Data *restrict dwg, Bit_Chain *restrict dat)
 {
   int ckr_missing = 1;
   int i, error = 0;
@@ -560,19 +570,6 @@ dwg_encode(Dwg_Data *restrict dwg, Bit_Chain *restrict dat)
   Object_Map pvzmap;
   Bit_Chain *hdl_dat;
 
-  if (dwg->opts)
-    loglevel = dwg->opts & 0xf;
-#ifdef USE_TRACING
-  /* Before starting, set the logging level, but only do so once.  */
-  if (! env_var_checked_p)
-    {
-      char *probe = getenv ("LIBREDWG_TRACE");
-      if (probe)
-        loglevel = atoi (probe);
-      env_var_checked_p = true;
-    }
-#endif  /* USE_TRACING */
-
   bit_chain_alloc(dat);
   hdl_dat = dat;
 
@@ -608,7 +605,7 @@ dwg_encode(Dwg_Data *restrict dwg, Bit_Chain *restrict dat)
       dwg->header.num_sections = 6;
     bit_write_RL(dat, dwg->header.num_sections);
     if (!dwg->header.section)
-      dwg->header.section = calloc(dwg->header.num_sections, sizeof(Dwg_Section));
+      dwg->header.section = dwg_calloc(dwg->header.num_sections, sizeof(Dwg_Section));
     section_address = dat->byte; // Jump to section address
     dat->byte += (dwg->header.num_sections * 9);
     bit_write_CRC(dat, 0, 0xC0C1);
@@ -666,7 +663,7 @@ dwg_encode(Dwg_Data *restrict dwg, Bit_Chain *restrict dat)
     LOG_ERROR(WE_CAN "We don't encode the R2004_section_map yet")
 
     if (dwg->header.num_infos && !dwg->header.section_info)
-      dwg->header.section_info = calloc(dwg->header.num_infos, sizeof(Dwg_Section_Info));
+      dwg->header.section_info = dwg_calloc(dwg->header.num_infos, sizeof(Dwg_Section_Info));
 
     dat->byte = 0x80;
     for (i = 0; i < size; i++)
@@ -827,7 +824,7 @@ dwg_encode(Dwg_Data *restrict dwg, Bit_Chain *restrict dat)
 
   /* Define object-map
    */
-  omap = (Object_Map *) malloc(dwg->num_objects * sizeof(Object_Map));
+  omap = (Object_Map *) dwg_malloc(dwg->num_objects * sizeof(Object_Map));
   if (!omap) {
     LOG_ERROR("Out of memory");
     return DWG_ERR_OUTOFMEM;
@@ -956,7 +953,7 @@ dwg_encode(Dwg_Data *restrict dwg, Bit_Chain *restrict dat)
   /* Calculate and write the size of the object map
    */
   dwg->header.section[2].size = dat->byte - dwg->header.section[2].address;
-  free(omap);
+  dwg_dealloc(omap);
 
   /*------------------------------------------------------------
    * Second header, section 3. R13-R2000 only.
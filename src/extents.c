@@ -0,0 +1,1056 @@
+/*****************************************************************************/
+/*  LibreDWG - free implementation of the DWG file format                    */
+/*                                                                           */
+/*  Copyright (C) 2018 Free Software Foundation, Inc.                        */
+/*                                                                           */
+/*  This library is free software, licensed under the terms of the GNU       */
+/*  General Public License as published by the Free Software Foundation,     */
+/*  either version 3 of the License, or (at your option) any later version.  */
+/*  You should have received a copy of the GNU General Public License        */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.    */
+/*****************************************************************************/
+
+/*
+ * extents.c: the WCS bounding boxes of the entities, cached in the
+ *            entity. Arcs and ellipses are bounded by their axis
+ *            extrema, INSERT's by the transformed box of their block,
+ *            cached in the BLOCK entity of the block. XLINE's and RAY's
+ *            are unbounded, they never get extents.
+ */
+
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+
+#include "common.h"
+#include "dwg.h"
+
+static THREAD_LOCAL unsigned int loglevel;
+#define DWG_LOGLEVEL loglevel
+#include "logging.h"
+
+#ifndef M_PI
+# define M_PI 3.14159265358979323846
+#endif
+
+#define EXTENTS_MAX_NESTING 16
+/* Objects per parallel chunk */
+#define EXTENTS_CHUNK 256
+
+static int entity_extents (const Dwg_Object *restrict obj,
+                           Dwg_Bbox *restrict bb, Dwg_Tessellation *tess,
+                           int depth);
+
+static void
+bbox_empty (Dwg_Bbox *bb)
+{
+  bb->min.x = bb->min.y = bb->min.z = HUGE_VAL;
+  bb->max.x = bb->max.y = bb->max.z = -HUGE_VAL;
+}
+
+static int
+bbox_is_empty (const Dwg_Bbox *bb)
+{
+  return !(bb->min.x <= bb->max.x);
+}
+
+/* not from garbage */
+static int
+bbox_is_finite (const Dwg_Bbox *bb)
+{
+  return isfinite(bb->min.x) && isfinite(bb->min.y) && isfinite(bb->min.z)
+         && isfinite(bb->max.x) && isfinite(bb->max.y)
+         && isfinite(bb->max.z);
+}
+
+static void
+bbox_add (Dwg_Bbox *bb, double x, double y, double z)
+{
+  if (x < bb->min.x) bb->min.x = x;
+  if (x > bb->max.x) bb->max.x = x;
+  if (y < bb->min.y) bb->min.y = y;
+  if (y > bb->max.y) bb->max.y = y;
+  if (z < bb->min.z) bb->min.z = z;
+  if (z > bb->max.z) bb->max.z = z;
+}
+
+static void
+bbox_union (Dwg_Bbox *restrict bb, const Dwg_Bbox *restrict b)
+{
+  if (bbox_is_empty(b))
+    return;
+  bbox_add(bb, b->min.x, b->min.y, b->min.z);
+  bbox_add(bb, b->max.x, b->max.y, b->max.z);
+}
+
+/* min/max reductions over the separate arrays */
+static void
+bbox_add_points (Dwg_Bbox *restrict bb, BITCODE_BL n, const double *restrict x,
+                 const double *restrict y, const double *restrict z)
+{
+  double x0 = bb->min.x, x1 = bb->max.x;
+  double y0 = bb->min.y, y1 = bb->max.y;
+  double z0 = bb->min.z, z1 = bb->max.z;
+  BITCODE_BL i;
+
+  for (i = 0; i < n; i++)
+    {
+      x0 = x[i] < x0 ? x[i] : x0;
+      x1 = x[i] > x1 ? x[i] : x1;
+      y0 = y[i] < y0 ? y[i] : y0;
+      y1 = y[i] > y1 ? y[i] : y1;
+      z0 = z[i] < z0 ? z[i] : z0;
+      z1 = z[i] > z1 ? z[i] : z1;
+    }
+  bb->min.x = x0; bb->max.x = x1;
+  bb->min.y = y0; bb->max.y = y1;
+  bb->min.z = z0; bb->max.z = z1;
+}
+
+/* the OCS point x, y, z in WCS into p */
+static void
+ocs_point (const double m[9], double x, double y, double z, double p[3])
+{
+  p[0] = m[0] * x + m[3] * y + m[6] * z;
+  p[1] = m[1] * x + m[4] * y + m[7] * z;
+  p[2] = m[2] * x + m[5] * y + m[8] * z;
+}
+
+static void
+bbox_add_ocs (Dwg_Bbox *bb, const double m[9], double x, double y, double z)
+{
+  double p[3];
+  ocs_point(m, x, y, z, p);
+  bbox_add(bb, p[0], p[1], p[2]);
+}
+
+/* The points c + u cos(a) + v sin(a), a in [a0, a0 + sweep]: the ends,
+   and per axis the extrema -u sin(a) + v cos(a) = 0 inside the sweep */
+static void
+bbox_conic (Dwg_Bbox *restrict bb, const double c[3], const double u[3],
+            const double v[3], double a0, double sweep)
+{
+  double a;
+  int i, k;
+
+  for (k = 0; k < 2; k++)
+    {
+      a = a0 + k * sweep;
+      bbox_add(bb, c[0] + u[0] * cos(a) + v[0] * sin(a),
+               c[1] + u[1] * cos(a) + v[1] * sin(a),
+               c[2] + u[2] * cos(a) + v[2] * sin(a));
+    }
+  for (i = 0; i < 3; i++)
+    {
+      if (u[i] == 0.0 && v[i] == 0.0)
+        continue;
+      a = atan2(v[i], u[i]);
+      for (k = 0; k < 2; k++, a += M_PI)
+        {
+          double d = fmod(a - a0, 2 * M_PI);
+          if (d < 0.0)
+            d += 2 * M_PI;
+          if (d <= sweep)
+            bbox_add(bb, c[0] + u[0] * cos(a) + v[0] * sin(a),
+                     c[1] + u[1] * cos(a) + v[1] * sin(a),
+                     c[2] + u[2] * cos(a) + v[2] * sin(a));
+        }
+    }
+}
+
+/* the circular arc around the OCS center cx, cy, z */
+static void
+bbox_arc (Dwg_Bbox *restrict bb, const double m[9], double cx, double cy,
+          double z, double r, double a0, double sweep)
+{
+  double c[3];
+  const double u[3] = { r * m[0], r * m[1], r * m[2] };
+  const double v[3] = { r * m[3], r * m[4], r * m[5] };
+  ocs_point(m, cx, cy, z, c);
+  bbox_conic(bb, c, u, v, a0, sweep);
+}
+
+/* the arc of the bulge from x0, y0 to x1, y1 in the OCS */
+static void
+bbox_bulge (Dwg_Bbox *restrict bb, const double m[9], double x0, double y0,
+            double x1, double y1, double z, double bulge)
+{
+  const double f = (1.0 - bulge * bulge) / (4.0 * bulge);
+  const double cx = (x0 + x1) / 2.0 - (y1 - y0) * f;
+  const double cy = (y0 + y1) / 2.0 + (x1 - x0) * f;
+  double a0 = atan2(y0 - cy, x0 - cx);
+  double sweep = 4.0 * atan(bulge);
+
+  if (sweep < 0.0)
+    {
+      a0 += sweep;
+      sweep = -sweep;
+    }
+  bbox_arc(bb, m, cx, cy, z, hypot(x0 - cx, y0 - cy), a0, sweep);
+}
+
+static int
+bbox_tessellation (Dwg_Bbox *restrict bb, const Dwg_Object *restrict obj,
+                   Dwg_Tessellation *restrict tess)
+{
+  int error = dwg_tessellate(obj, obj->parent->tolerance, tess);
+  if (!error)
+    bbox_add_points(bb, tess->num_points, tess->x, tess->y, tess->z);
+  return error;
+}
+
+static void
+bbox_lwpolyline (Dwg_Bbox *restrict bb, const Dwg_Object *restrict obj,
+                 const Dwg_Entity_LWPOLYLINE *restrict _obj)
+{
+  const BITCODE_BL n = _obj->points ? _obj->num_points : 0;
+  const BITCODE_BL segs = n > 1 && _obj->flag & 512 ? n : n - 1;
+  double m[9];
+  BITCODE_BL i;
+
+  dwg_entity_ocs(obj, m);
+  for (i = 0; i < n; i++)
+    bbox_add_ocs(bb, m, _obj->points[i].x, _obj->points[i].y,
+                 _obj->elevation);
+  if (!_obj->bulges || _obj->num_bulges < n)
+    return;
+  for (i = 0; n && i < segs; i++)
+    if (_obj->bulges[i] != 0.0)
+      {
+        const BITCODE_2RD *p0 = &_obj->points[i];
+        const BITCODE_2RD *p1 = &_obj->points[(i + 1) % n];
+        bbox_bulge(bb, m, p0->x, p0->y, p1->x, p1->y, _obj->elevation,
+                   _obj->bulges[i]);
+      }
+}
+
+static void
+bbox_hatch (Dwg_Bbox *restrict bb, const Dwg_Object *restrict obj,
+            const Dwg_Entity_HATCH *restrict _obj)
+{
+  const double z = _obj->elevation;
+  double m[9];
+  BITCODE_BL i, j, k;
+
+  dwg_entity_ocs(obj, m);
+  for (i = 0; _obj->paths && i < _obj->num_paths; i++)
+    {
+      const Dwg_HATCH_Path *path = &_obj->paths[i];
+      if (path->flag & 2)
+        {
+          const BITCODE_BL n
+              = path->polyline_paths ? path->num_segs_or_paths : 0;
+          for (j = 0; j < n; j++)
+            {
+              const Dwg_HATCH_PolylinePath *p = &path->polyline_paths[j];
+              bbox_add_ocs(bb, m, p->point.x, p->point.y, z);
+              if (path->bulges_present && p->bulge != 0.0
+                  && (path->closed || j + 1 < n))
+                {
+                  const Dwg_HATCH_PolylinePath *q
+                      = &path->polyline_paths[(j + 1) % n];
+                  bbox_bulge(bb, m, p->point.x, p->point.y, q->point.x,
+                             q->point.y, z, p->bulge);
+                }
+            }
+          continue;
+        }
+      for (j = 0; path->segs && j < path->num_segs_or_paths; j++)
+        {
+          const Dwg_HATCH_PathSeg *seg = &path->segs[j];
+          switch (seg->type_status)
+            {
+            case 1: // LINE
+              bbox_add_ocs(bb, m, seg->first_endpoint.x,
+                           seg->first_endpoint.y, z);
+              bbox_add_ocs(bb, m, seg->second_endpoint.x,
+                           seg->second_endpoint.y, z);
+              break;
+            case 2: // CIRCULAR ARC, clockwise ones as the full circle
+              {
+                double sweep = seg->end_angle - seg->start_angle;
+                while (sweep < 0.0)
+                  sweep += 2 * M_PI;
+                if (!seg->is_ccw || sweep > 2 * M_PI)
+                  sweep = 2 * M_PI;
+                bbox_arc(bb, m, seg->center.x, seg->center.y, z, seg->radius,
+                         seg->start_angle, sweep);
+              }
+              break;
+            case 3: // ELLIPTICAL ARC, as the full ellipse
+              {
+                const double ex = seg->endpoint.x, ey = seg->endpoint.y;
+                const double r = seg->minor_major_ratio;
+                double c[3], u[3], v[3];
+                ocs_point(m, seg->center.x, seg->center.y, z, c);
+                ocs_point(m, ex, ey, 0.0, u);
+                ocs_point(m, -r * ey, r * ex, 0.0, v);
+                bbox_conic(bb, c, u, v, 0.0, 2 * M_PI);
+              }
+              break;
+            case 4: // SPLINE, in the hull of its control points
+              for (k = 0; seg->control_points && k < seg->num_control_points;
+                   k++)
+                bbox_add_ocs(bb, m, seg->control_points[k].point.x,
+                             seg->control_points[k].point.y, z);
+              break;
+            default:
+              break;
+            }
+        }
+    }
+}
+
+static BITCODE_BL
+text_length (const Dwg_Data *restrict dwg, const char *restrict text)
+{
+  BITCODE_BL n = 0;
+  if (!text)
+    return 0;
+  if (dwg->header.version >= R_2007)
+    {
+      const BITCODE_TU wstr = (const BITCODE_TU)text;
+      while (wstr[n])
+        n++;
+      return n;
+    }
+  return (BITCODE_BL)strlen(text);
+}
+
+/* A line of text, with characters as wide as high. With an alignment,
+   around the alignment point. */
+static void
+bbox_text (Dwg_Bbox *restrict bb, const Dwg_Object *restrict obj,
+           const BITCODE_2DPOINT *ins_pt, const BITCODE_2DPOINT *align_pt,
+           int aligned, double elevation, double rotation, double height,
+           double width_factor, const char *text)
+{
+  const double w = text_length(obj->parent, text) * height
+                   * (width_factor > 0.0 ? width_factor : 1.0);
+  const double c = cos(rotation), s = sin(rotation);
+  const BITCODE_2DPOINT *p = aligned ? align_pt : ins_pt;
+  const double x0 = aligned ? -w : 0.0, y0 = aligned ? -height : 0.0;
+  double m[9];
+  int i;
+
+  dwg_entity_ocs(obj, m);
+  for (i = 0; i < 4; i++)
+    {
+      const double dx = i & 1 ? w : x0, dy = i & 2 ? height : y0;
+      bbox_add_ocs(bb, m, p->x + c * dx - s * dy, p->y + s * dx + c * dy,
+                   elevation);
+    }
+  if (aligned)
+    bbox_add_ocs(bb, m, ins_pt->x, ins_pt->y, elevation);
+}
+
+static void
+bbox_mtext (Dwg_Bbox *restrict bb, const Dwg_Entity_MTEXT *restrict _obj)
+{
+  const BITCODE_3BD *d = &_obj->x_axis_dir;
+  const BITCODE_3BD *e = &_obj->extrusion;
+  const int col = _obj->attachment >= 1 && _obj->attachment <= 9
+                      ? (_obj->attachment - 1) % 3 : 0;
+  const int row = _obj->attachment >= 1 && _obj->attachment <= 9
+                      ? (_obj->attachment - 1) / 3 : 0;
+  double x[3] = { d->x, d->y, d->z };
+  double n[3] = { e->x, e->y, e->z };
+  double y[3], len, w, h, x0, y0;
+  int i;
+
+  if (n[0] == 0.0 && n[1] == 0.0 && n[2] == 0.0)
+    n[2] = 1.0;
+  len = sqrt(x[0] * x[0] + x[1] * x[1] + x[2] * x[2]);
+  if (len == 0.0 || !isfinite(len))
+    {
+      // the x axis of the OCS
+      double m[9];
+      dwg_ocs_matrix(e, m);
+      memcpy(x, m, sizeof(x));
+      len = 1.0;
+    }
+  for (i = 0; i < 3; i++)
+    x[i] /= len;
+  y[0] = n[1] * x[2] - n[2] * x[1];
+  y[1] = n[2] * x[0] - n[0] * x[2];
+  y[2] = n[0] * x[1] - n[1] * x[0];
+  len = sqrt(y[0] * y[0] + y[1] * y[1] + y[2] * y[2]);
+  for (i = 0; len > 0.0 && i < 3; i++)
+    y[i] /= len;
+  w = _obj->rect_width > _obj->extents_width ? _obj->rect_width
+                                             : _obj->extents_width;
+  h = _obj->rect_height > _obj->extents_height ? _obj->rect_height
+                                               : _obj->extents_height;
+  if (h < _obj->text_height)
+    h = _obj->text_height;
+  // the attachment point is the top left, center or right, middle or bottom
+  x0 = -col * w / 2.0;
+  y0 = row * h / 2.0 - h;
+  for (i = 0; i < 4; i++)
+    {
+      const double dx = x0 + (i & 1 ? w : 0.0), dy = y0 + (i & 2 ? h : 0.0);
+      bbox_add(bb, _obj->insertion_pt.x + x[0] * dx + y[0] * dy,
+               _obj->insertion_pt.y + x[1] * dx + y[1] * dy,
+               _obj->insertion_pt.z + x[2] * dx + y[2] * dy);
+    }
+}
+
+/* The block extents in its own coordinates, cached in its BLOCK entity */
+static int
+block_extents (const Dwg_Data *restrict dwg, const Dwg_Object *restrict hdr,
+               Dwg_Bbox *restrict bb, Dwg_Tessellation *tess, int depth)
+{
+  Dwg_Object_BLOCK_HEADER *_hdr;
+  Dwg_Object_Entity *ent = NULL;
+  Dwg_Object *blk, *o;
+  Dwg_Owned_Iter it;
+  int error = 0;
+
+  if (!hdr || hdr->fixedtype != DWG_TYPE_BLOCK_HEADER || !hdr->tio.object
+      || !(_hdr = hdr->tio.object->tio.BLOCK_HEADER))
+    return DWG_ERR_INVALIDTYPE;
+  blk = _hdr->block_entity ? dwg_ref_object(dwg, _hdr->block_entity) : NULL;
+  if (blk && blk->supertype == DWG_SUPERTYPE_ENTITY
+      && blk->fixedtype == DWG_TYPE_BLOCK)
+    ent = blk->tio.entity;
+  if (ent)
+    {
+      if (ent->extents_state == DWG_EXTENTS_VALID)
+        {
+          *bb = ent->extents;
+          return 0;
+        }
+      if (ent->extents_state != DWG_EXTENTS_UNKNOWN)
+        return DWG_ERR_INVALIDTYPE;
+      ent->extents_state = DWG_EXTENTS_BUSY;
+    }
+  bbox_empty(bb);
+  if (!dwg_owned_iter_init(&it, hdr))
+    while ((o = dwg_owned_iter_next(&it)))
+      {
+        Dwg_Bbox b;
+        // the ATTDEF's are not drawn in the INSERT's
+        if (o->fixedtype == DWG_TYPE_ATTDEF || o->fixedtype == DWG_TYPE_BLOCK
+            || o->fixedtype == DWG_TYPE_ENDBLK)
+          continue;
+        error = entity_extents(o, &b, tess, depth + 1);
+        if (error == DWG_ERR_OUTOFMEM)
+          {
+            if (ent)
+              ent->extents_state = DWG_EXTENTS_UNKNOWN;
+            return error;
+          }
+        if (!error)
+          bbox_union(bb, &b);
+      }
+  error = bbox_is_empty(bb) ? DWG_ERR_INVALIDTYPE : 0;
+  if (ent)
+    {
+      if (!error)
+        ent->extents = *bb;
+      ent->extents_state = error ? DWG_EXTENTS_NONE : DWG_EXTENTS_VALID;
+    }
+  return error;
+}
+
+/* xf = OCS(extrusion) * T(ins_pt) * Rz(rotation) * S(scale) * T(-base_pt) */
+static void
+insert_matrix (double xf[3][4], const BITCODE_3BD *restrict extrusion,
+               const BITCODE_3BD *restrict ins_pt,
+               const BITCODE_3BD *restrict scale, double rotation,
+               const BITCODE_3BD *restrict base_pt)
+{
+  const double c = cos(rotation), s = sin(rotation);
+  const double t[3] = { ins_pt->x, ins_pt->y, ins_pt->z };
+  double l[3][4], m[9];
+  int i, j;
+
+  l[0][0] = c * scale->x; l[0][1] = -s * scale->y; l[0][2] = 0.0;
+  l[1][0] = s * scale->x; l[1][1] =  c * scale->y; l[1][2] = 0.0;
+  l[2][0] = 0.0;          l[2][1] = 0.0;           l[2][2] = scale->z;
+  for (i = 0; i < 3; i++)
+    l[i][3] = t[i] - l[i][0] * base_pt->x - l[i][1] * base_pt->y
+              - l[i][2] * base_pt->z;
+  dwg_ocs_matrix(extrusion, m);
+  for (i = 0; i < 3; i++)
+    for (j = 0; j < 4; j++)
+      xf[i][j] = m[i] * l[0][j] + m[3 + i] * l[1][j] + m[6 + i] * l[2][j];
+}
+
+/* Add the box b transformed by xf, by its center and the absolute
+   matrix applied to its half size */
+static void
+bbox_add_transformed (Dwg_Bbox *restrict bb, const Dwg_Bbox *restrict b,
+                      const double xf[3][4], const double offset[3])
+{
+  const double c[3] = { (b->min.x + b->max.x) / 2.0,
+                        (b->min.y + b->max.y) / 2.0,
+                        (b->min.z + b->max.z) / 2.0 };
+  const double h[3] = { (b->max.x - b->min.x) / 2.0,
+                        (b->max.y - b->min.y) / 2.0,
+                        (b->max.z - b->min.z) / 2.0 };
+  double lo[3], hi[3];
+  int i;
+
+  for (i = 0; i < 3; i++)
+    {
+      const double tc = xf[i][0] * c[0] + xf[i][1] * c[1] + xf[i][2] * c[2]
+                        + xf[i][3] + offset[i];
+      const double th = fabs(xf[i][0]) * h[0] + fabs(xf[i][1]) * h[1]
+                        + fabs(xf[i][2]) * h[2];
+      lo[i] = tc - th;
+      hi[i] = tc + th;
+    }
+  bbox_add(bb, lo[0], lo[1], lo[2]);
+  bbox_add(bb, hi[0], hi[1], hi[2]);
+}
+
+static int
+bbox_insert (Dwg_Bbox *restrict bb, const Dwg_Object *restrict obj,
+             Dwg_Tessellation *tess, int depth)
+{
+  const Dwg_Data *dwg = obj->parent;
+  const Dwg_Entity_INSERT *ins = NULL;
+  const Dwg_Entity_MINSERT *mins = NULL;
+  const Dwg_Object *hdr;
+  Dwg_Bbox blk;
+  double xf[3][4], m[9];
+  BITCODE_BS rows = 1, cols = 1;
+  int error, r, c;
+
+  if (obj->fixedtype == DWG_TYPE_MINSERT)
+    {
+      mins = obj->tio.entity->tio.MINSERT;
+      hdr = mins->block_header ? dwg_ref_object(dwg, mins->block_header)
+                               : NULL;
+      rows = mins->num_rows > 1 ? mins->num_rows : 1;
+      cols = mins->num_cols > 1 ? mins->num_cols : 1;
+    }
+  else
+    {
+      ins = obj->tio.entity->tio.INSERT;
+      hdr = ins->block_header ? dwg_ref_object(dwg, ins->block_header)
+                              : NULL;
+    }
+  if ((error = block_extents(dwg, hdr, &blk, tess, depth)))
+    return error;
+  if (mins)
+    insert_matrix(xf, &mins->extrusion, &mins->ins_pt, &mins->scale,
+                  mins->rotation, &hdr->tio.object->tio.BLOCK_HEADER->base_pt);
+  else
+    insert_matrix(xf, &ins->extrusion, &ins->ins_pt, &ins->scale,
+                  ins->rotation, &hdr->tio.object->tio.BLOCK_HEADER->base_pt);
+  if (mins)
+    dwg_ocs_matrix(&mins->extrusion, m);
+  // the grid is linear, its corners bound all of it
+  for (r = 0; r < (mins ? 2 : 1); r++)
+    for (c = 0; c < (mins ? 2 : 1); c++)
+      {
+        double offset[3] = { 0.0, 0.0, 0.0 };
+        if (mins)
+          {
+            const double cs = cos(mins->rotation), sn = sin(mins->rotation);
+            const double dx = c * (cols - 1) * mins->col_spacing;
+            const double dy = r * (rows - 1) * mins->row_spacing;
+            ocs_point(m, cs * dx - sn * dy, sn * dx + cs * dy, 0.0, offset);
+          }
+        bbox_add_transformed(bb, &blk, xf, offset);
+      }
+  return 0;
+}
+
+#define DIMENSION_BLOCK(type)                                                 \
+  case DWG_TYPE_DIMENSION_##type:                                             \
+    block = ent->tio.DIMENSION_##type->block;                                 \
+    break
+
+/* the anonymous block of a DIMENSION, in WCS */
+static int
+bbox_dimension (Dwg_Bbox *restrict bb, const Dwg_Object *restrict obj,
+                int type, Dwg_Tessellation *tess, int depth)
+{
+  const Dwg_Object_Entity *ent = obj->tio.entity;
+  BITCODE_H block = NULL;
+  Dwg_Bbox b;
+  int error;
+
+  switch (type)
+    {
+      DIMENSION_BLOCK(ORDINATE);
+      DIMENSION_BLOCK(LINEAR);
+      DIMENSION_BLOCK(ALIGNED);
+      DIMENSION_BLOCK(ANG3PT);
+      DIMENSION_BLOCK(ANG2LN);
+      DIMENSION_BLOCK(RADIUS);
+      DIMENSION_BLOCK(DIAMETER);
+    default:
+      break;
+    }
+  if (!block)
+    return DWG_ERR_INVALIDTYPE;
+  if ((error = block_extents(obj->parent, dwg_ref_object(obj->parent, block),
+                             &b, tess, depth)))
+    return error;
+  bbox_union(bb, &b);
+  return 0;
+}
+
+/* The cylinder around the axis of the HELIX, from its base to its end,
+   with the larger of its start and end radius */
+static int
+bbox_helix (Dwg_Bbox *restrict bb, const Dwg_Entity_HELIX *restrict _obj)
+{
+  const BITCODE_3BD *a = &_obj->axis_vector;
+  const BITCODE_3BD *p = &_obj->axis_base_pt;
+  const double len = sqrt(a->x * a->x + a->y * a->y + a->z * a->z);
+  const double n[3] = { a->x / len, a->y / len, a->z / len };
+  const double d[3] = { _obj->start_pt.x - p->x, _obj->start_pt.y - p->y,
+                        _obj->start_pt.z - p->z };
+  const double h = _obj->num_turns * _obj->turn_height;
+  const double t = d[0] * n[0] + d[1] * n[1] + d[2] * n[2];
+  double r = sqrt(fabs(d[0] * d[0] + d[1] * d[1] + d[2] * d[2] - t * t));
+  double e[3];
+  int i;
+
+  if (len == 0.0 || !isfinite(len))
+    return DWG_ERR_INVALIDTYPE;
+  if (fabs(_obj->radius) > r)
+    r = fabs(_obj->radius);
+  // per axis the circle extends by r times the sine to the helix axis
+  for (i = 0; i < 3; i++)
+    e[i] = r * sqrt(1.0 - (n[i] * n[i] < 1.0 ? n[i] * n[i] : 1.0));
+  bbox_add(bb, p->x - e[0], p->y - e[1], p->z - e[2]);
+  bbox_add(bb, p->x + e[0], p->y + e[1], p->z + e[2]);
+  bbox_add(bb, p->x + h * n[0] - e[0], p->y + h * n[1] - e[1],
+           p->z + h * n[2] - e[2]);
+  bbox_add(bb, p->x + h * n[0] + e[0], p->y + h * n[1] + e[1],
+           p->z + h * n[2] + e[2]);
+  return 0;
+}
+
+/* The wireframe of a 3DSOLID, REGION or BODY. The ACIS data is not
+   evaluated, without wires there are no extents. */
+static int
+bbox_solid (Dwg_Bbox *restrict bb, const Dwg_Entity_3DSOLID *restrict _obj)
+{
+  BITCODE_BL i, j;
+
+  for (i = 0; _obj->wires && i < _obj->num_wires; i++)
+    {
+      const Dwg_3DSOLID_wire *w = &_obj->wires[i];
+      for (j = 0; w->points && j < w->num_points; j++)
+        {
+          const BITCODE_3BD *q = &w->points[j];
+          if (!w->transform_present)
+            {
+              bbox_add(bb, q->x, q->y, q->z);
+              continue;
+            }
+          bbox_add(bb,
+                   w->translation.x + w->scale * (q->x * w->axis_x.x
+                       + q->y * w->axis_y.x + q->z * w->axis_z.x),
+                   w->translation.y + w->scale * (q->x * w->axis_x.y
+                       + q->y * w->axis_y.y + q->z * w->axis_z.y),
+                   w->translation.z + w->scale * (q->x * w->axis_x.z
+                       + q->y * w->axis_y.z + q->z * w->axis_z.z));
+        }
+    }
+  return bbox_is_empty(bb) ? DWG_ERR_INVALIDTYPE : 0;
+}
+
+#define IMAGE_CORNERS(_obj)                                                   \
+  for (i = 0; i < 4; i++)                                                     \
+    {                                                                         \
+      const double w = i & 1 ? _obj->size.width : 0.0;                        \
+      const double h = i & 2 ? _obj->size.height : 0.0;                       \
+      bbox_add(bb, _obj->pt0.x + w * _obj->uvec.x + h * _obj->vvec.x,         \
+               _obj->pt0.y + w * _obj->uvec.y + h * _obj->vvec.y,             \
+               _obj->pt0.z + w * _obj->uvec.z + h * _obj->vvec.z);            \
+    }
+
+static int
+entity_type (const Dwg_Object *obj)
+{
+  return obj->parent->header.version < R_13 ? (int)obj->type
+                                            : (int)obj->fixedtype;
+}
+
+static int
+entity_compute (const Dwg_Object *restrict obj, Dwg_Bbox *restrict bb,
+                Dwg_Tessellation *tess, int depth)
+{
+  const Dwg_Object_Entity *ent = obj->tio.entity;
+  const int type = entity_type(obj);
+  double m[9];
+  BITCODE_BL i;
+
+  bbox_empty(bb);
+  switch (type)
+    {
+    case DWG_TYPE_CIRCLE:
+    case DWG_TYPE_ARC:
+      {
+        // same layout up to the angles
+        const Dwg_Entity_ARC *_obj = ent->tio.ARC;
+        double sweep = 2 * M_PI, start = 0.0;
+        if (type == DWG_TYPE_ARC)
+          {
+            start = _obj->start_angle;
+            sweep = _obj->end_angle - start;
+            while (sweep <= 0.0)
+              sweep += 2 * M_PI;
+          }
+        dwg_entity_ocs(obj, m);
+        bbox_arc(bb, m, _obj->center.x, _obj->center.y, _obj->center.z,
+                 _obj->radius, start, sweep);
+      }
+      break;
+    case DWG_TYPE_ELLIPSE:
+      {
+        const Dwg_Entity_ELLIPSE *_obj = ent->tio.ELLIPSE;
+        const BITCODE_3BD *n = &_obj->extrusion;
+        const BITCODE_3BD *a = &_obj->sm_axis;
+        const double c[3] = { _obj->center.x, _obj->center.y, _obj->center.z };
+        const double u[3] = { a->x, a->y, a->z };
+        double len = sqrt(n->x * n->x + n->y * n->y + n->z * n->z);
+        double v[3], sweep = _obj->end_angle - _obj->start_angle;
+        if (len == 0.0)
+          len = 1.0;
+        v[0] = _obj->axis_ratio * (n->y * a->z - n->z * a->y) / len;
+        v[1] = _obj->axis_ratio * (n->z * a->x - n->x * a->z) / len;
+        v[2] = _obj->axis_ratio * (n->x * a->y - n->y * a->x) / len;
+        while (sweep <= 0.0)
+          sweep += 2 * M_PI;
+        bbox_conic(bb, c, u, v, _obj->start_angle, sweep);
+      }
+      break;
+    case DWG_TYPE_LWPOLYLINE:
+      bbox_lwpolyline(bb, obj, ent->tio.LWPOLYLINE);
+      break;
+    case DWG_TYPE_HATCH:
+      bbox_hatch(bb, obj, ent->tio.HATCH);
+      break;
+    case DWG_TYPE_LINE:
+    case DWG_TYPE_POINT:
+    case DWG_TYPE_GEOPOSITIONMARKER:
+    case DWG_TYPE_SPLINE:
+    case DWG_TYPE_POLYLINE_2D:
+    case DWG_TYPE_POLYLINE_3D:
+    case DWG_TYPE_POLYLINE_PFACE:
+    case DWG_TYPE_POLYLINE_MESH:
+    case DWG_TYPE_SOLID:
+    case DWG_TYPE_TRACE:
+    case DWG_TYPE__3DFACE:
+      return bbox_tessellation(bb, obj, tess);
+    case DWG_TYPE_TEXT:
+      {
+        const Dwg_Entity_TEXT *_obj = ent->tio.TEXT;
+        bbox_text(bb, obj, &_obj->insertion_pt, &_obj->alignment_pt,
+                  _obj->horiz_alignment || _obj->vert_alignment,
+                  _obj->elevation, _obj->rotation, _obj->height,
+                  _obj->width_factor, _obj->text_value);
+      }
+      break;
+    case DWG_TYPE_ATTRIB:
+      {
+        const Dwg_Entity_ATTRIB *_obj = ent->tio.ATTRIB;
+        bbox_text(bb, obj, &_obj->insertion_pt, &_obj->alignment_pt,
+                  _obj->horiz_alignment || _obj->vert_alignment,
+                  _obj->elevation, _obj->rotation, _obj->height,
+                  _obj->width_factor, _obj->text_value);
+      }
+      break;
+    case DWG_TYPE_ATTDEF:
+      {
+        const Dwg_Entity_ATTDEF *_obj = ent->tio.ATTDEF;
+        bbox_text(bb, obj, &_obj->insertion_pt, &_obj->alignment_pt,
+                  _obj->horiz_alignment || _obj->vert_alignment,
+                  _obj->elevation, _obj->rotation, _obj->height,
+                  _obj->width_factor, _obj->tag);
+      }
+      break;
+    case DWG_TYPE_MTEXT:
+      bbox_mtext(bb, ent->tio.MTEXT);
+      break;
+    case DWG_TYPE_INSERT:
+    case DWG_TYPE_MINSERT:
+      return bbox_insert(bb, obj, tess, depth);
+    case DWG_TYPE_DIMENSION_ORDINATE:
+    case DWG_TYPE_DIMENSION_LINEAR:
+    case DWG_TYPE_DIMENSION_ALIGNED:
+    case DWG_TYPE_DIMENSION_ANG3PT:
+    case DWG_TYPE_DIMENSION_ANG2LN:
+    case DWG_TYPE_DIMENSION_RADIUS:
+    case DWG_TYPE_DIMENSION_DIAMETER:
+      return bbox_dimension(bb, obj, type, tess, depth);
+    case DWG_TYPE_VIEWPORT:
+      {
+        const Dwg_Entity_VIEWPORT *_obj = ent->tio.VIEWPORT;
+        bbox_add(bb, _obj->center.x - _obj->width / 2.0,
+                 _obj->center.y - _obj->height / 2.0, _obj->center.z);
+        bbox_add(bb, _obj->center.x + _obj->width / 2.0,
+                 _obj->center.y + _obj->height / 2.0, _obj->center.z);
+      }
+      break;
+    case DWG_TYPE_LEADER:
+      {
+        const Dwg_Entity_LEADER *_obj = ent->tio.LEADER;
+        for (i = 0; _obj->points && i < _obj->numpts; i++)
+          bbox_add(bb, _obj->points[i].x, _obj->points[i].y,
+                   _obj->points[i].z);
+      }
+      break;
+    case DWG_TYPE_MLINE:
+      {
+        const Dwg_Entity_MLINE *_obj = ent->tio.MLINE;
+        for (i = 0; _obj->verts && i < _obj->num_verts; i++)
+          bbox_add(bb, _obj->verts[i].vertex.x, _obj->verts[i].vertex.y,
+                   _obj->verts[i].vertex.z);
+      }
+      break;
+    case DWG_TYPE_IMAGE:
+      {
+        const Dwg_Entity_IMAGE *_obj = ent->tio.IMAGE;
+        IMAGE_CORNERS(_obj);
+      }
+      break;
+    case DWG_TYPE_WIPEOUT:
+      {
+        const Dwg_Entity_WIPEOUT *_obj = ent->tio.WIPEOUT;
+        IMAGE_CORNERS(_obj);
+      }
+      break;
+    case DWG_TYPE_HELIX:
+      return bbox_helix(bb, ent->tio.HELIX);
+    case DWG_TYPE__3DSOLID:
+    case DWG_TYPE_REGION:
+    case DWG_TYPE_BODY:
+      // same layout
+      return bbox_solid(bb, ent->tio._3DSOLID);
+    case DWG_TYPE_XLINE:
+    case DWG_TYPE_RAY:
+      // unbounded, never cached as extents
+      return DWG_ERR_INVALIDTYPE;
+    default:
+      return DWG_ERR_INVALIDTYPE;
+    }
+  return 0;
+}
+
+/* The BLOCK_HEADER of the BLOCK entity blk, its owner. The BLOCK's of
+   the model and paper space have no owner handle. */
+static const Dwg_Object *
+block_header_of (const Dwg_Object *restrict blk)
+{
+  const Dwg_Data *dwg = blk->parent;
+  const Dwg_Object_Entity *ent = blk->tio.entity;
+  BITCODE_H owner = ent->subentity;
+  const Dwg_Object *hdr;
+  const Dwg_Object_BLOCK_HEADER *_hdr;
+
+  if (!owner && ent->entity_mode == 2)
+    owner = dwg->header_vars.BLOCK_RECORD_MSPACE;
+  else if (!owner && ent->entity_mode == 1)
+    owner = dwg->header_vars.BLOCK_RECORD_PSPACE;
+  hdr = owner ? dwg_ref_object(dwg, owner) : NULL;
+
+  if (!hdr || hdr->fixedtype != DWG_TYPE_BLOCK_HEADER || !hdr->tio.object
+      || !(_hdr = hdr->tio.object->tio.BLOCK_HEADER) || !_hdr->block_entity
+      || _hdr->block_entity->absolute_ref != blk->handle.value)
+    return NULL;
+  return hdr;
+}
+
+/* The cached extents of obj, or computed and cached */
+static int
+entity_extents (const Dwg_Object *restrict obj, Dwg_Bbox *restrict bb,
+                Dwg_Tessellation *tess, int depth)
+{
+  Dwg_Object_Entity *ent = obj->tio.entity;
+  int error;
+
+  if (obj->supertype != DWG_SUPERTYPE_ENTITY || !ent || !ent->tio.LINE)
+    return DWG_ERR_INVALIDTYPE;
+  switch (ent->extents_state)
+    {
+    case DWG_EXTENTS_VALID:
+      *bb = ent->extents;
+      return 0;
+    case DWG_EXTENTS_UNKNOWN:
+      break;
+    default:
+      return DWG_ERR_INVALIDTYPE;
+    }
+  // too deep is not cached, it might be shallow from elsewhere
+  if (depth > EXTENTS_MAX_NESTING)
+    return DWG_ERR_INVALIDTYPE;
+  // a BLOCK has the extents of its block
+  if (entity_type(obj) == DWG_TYPE_BLOCK)
+    return block_extents(obj->parent, block_header_of(obj), bb, tess, depth);
+  error = entity_compute(obj, bb, tess, depth);
+  if (error == DWG_ERR_OUTOFMEM)
+    return error;
+  if (!error && (bbox_is_empty(bb) || !bbox_is_finite(bb)))
+    error = DWG_ERR_INVALIDTYPE;
+  if (!error)
+    ent->extents = *bb;
+  ent->extents_state = error ? DWG_EXTENTS_NONE : DWG_EXTENTS_VALID;
+  return error;
+}
+
+int
+dwg_entity_extents (const Dwg_Object *restrict obj, Dwg_Bbox *restrict bbox)
+{
+  Dwg_Tessellation tess;
+  int error;
+
+  if (!obj || !obj->parent || !bbox)
+    return DWG_ERR_INVALIDDWG;
+  memset(&tess, 0, sizeof(tess));
+  error = entity_extents(obj, bbox, &tess, 0);
+  dwg_free_tessellation(&tess);
+  return error;
+}
+
+/* INSERT's, DIMENSION's and BLOCK's depend on the other entities */
+static int
+is_block_reference (const Dwg_Object *obj)
+{
+  switch (entity_type(obj))
+    {
+    case DWG_TYPE_INSERT:
+    case DWG_TYPE_MINSERT:
+    case DWG_TYPE_BLOCK:
+    case DWG_TYPE_DIMENSION_ORDINATE:
+    case DWG_TYPE_DIMENSION_LINEAR:
+    case DWG_TYPE_DIMENSION_ALIGNED:
+    case DWG_TYPE_DIMENSION_ANG3PT:
+    case DWG_TYPE_DIMENSION_ANG2LN:
+    case DWG_TYPE_DIMENSION_RADIUS:
+    case DWG_TYPE_DIMENSION_DIAMETER:
+      return 1;
+    default:
+      return 0;
+    }
+}
+
+static int
+compute_all_extents (Dwg_Data *dwg, Dwg_Bbox *restrict model)
+{
+  Dwg_Tessellation tess;
+  BITCODE_BL num = 0;
+  long i;
+  int error = 0;
+
+  for (i = 0; i < (long)dwg->num_objects; i++)
+    if (dwg->object[i].supertype == DWG_SUPERTYPE_ENTITY
+        && dwg->object[i].tio.entity)
+      dwg->object[i].tio.entity->extents_state = DWG_EXTENTS_UNKNOWN;
+
+  // first the independent entities, each thread with its own points
+#ifdef _OPENMP
+#pragma omp parallel if (dwg->num_objects > EXTENTS_CHUNK) reduction(|:error)
+#endif
+  {
+    Dwg_Tessellation ttess;
+    Dwg_Thread_State tstate;
+    memset(&ttess, 0, sizeof(ttess));
+    loglevel = dwg_log_enter(dwg, &tstate);
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, EXTENTS_CHUNK)
+#endif
+    for (i = 0; i < (long)dwg->num_objects; i++)
+      {
+        const Dwg_Object *obj = &dwg->object[i];
+        Dwg_Bbox bb;
+        if (obj->supertype != DWG_SUPERTYPE_ENTITY || !obj->tio.entity
+            || is_block_reference(obj))
+          continue;
+        if (entity_extents(obj, &bb, &ttess, 0) == DWG_ERR_OUTOFMEM)
+          error |= DWG_ERR_OUTOFMEM;
+      }
+    dwg_free_tessellation(&ttess);
+    dwg_log_leave(&tstate);
+  }
+  if (error)
+    {
+      LOG_ERROR("Out of memory");
+      return error;
+    }
+
+  // then the blocks and their references, nested by recursion
+  memset(&tess, 0, sizeof(tess));
+  for (i = 0; i < (long)dwg->num_objects; i++)
+    {
+      const Dwg_Object *obj = &dwg->object[i];
+      Dwg_Bbox bb;
+      if (obj->fixedtype == DWG_TYPE_BLOCK_HEADER)
+        error = block_extents(dwg, obj, &bb, &tess, 0);
+      else if (obj->supertype == DWG_SUPERTYPE_ENTITY && obj->tio.entity
+               && is_block_reference(obj))
+        error = entity_extents(obj, &bb, &tess, 0);
+      if (error == DWG_ERR_OUTOFMEM)
+        break;
+      error = 0;
+    }
+  dwg_free_tessellation(&tess);
+  if (error)
+    {
+      LOG_ERROR("Out of memory");
+      return error;
+    }
+
+  if (model)
+    bbox_empty(model);
+  for (i = 0; i < (long)dwg->num_objects; i++)
+    {
+      const Dwg_Object *obj = &dwg->object[i];
+      if (obj->supertype != DWG_SUPERTYPE_ENTITY || !obj->tio.entity
+          || obj->tio.entity->extents_state != DWG_EXTENTS_VALID)
+        continue;
+      num++;
+      if (model && obj->tio.entity->entity_mode == 2)
+        bbox_union(model, &obj->tio.entity->extents);
+    }
+  LOG_TRACE("extents: %u entities\n", (unsigned)num);
+  return 0;
+}
+
+int
+dwg_compute_all_extents (Dwg_Data *dwg, Dwg_Bbox *restrict model)
+{
+  Dwg_Thread_State state;
+  int error;
+
+  if (!dwg)
+    return DWG_ERR_INVALIDDWG;
+  loglevel = dwg_log_enter(dwg, &state);
+  error = compute_all_extents(dwg, model);
+  dwg_log_leave(&state);
+  return error;
+}
+
+void
+dwg_reset_extents (Dwg_Object *obj)
+{
+  Dwg_Data *dwg;
+  BITCODE_BL i;
+
+  if (!obj || !obj->parent || obj->supertype != DWG_SUPERTYPE_ENTITY
+      || !obj->tio.entity)
+    return;
+  obj->tio.entity->extents_state = DWG_EXTENTS_UNKNOWN;
+  // the blocks and their references, which may include it
+  dwg = obj->parent;
+  for (i = 0; i < dwg->num_objects; i++)
+    {
+      Dwg_Object *o = &dwg->object[i];
+      if (o->supertype == DWG_SUPERTYPE_ENTITY && o->tio.entity
+          && is_block_reference(o))
+        o->tio.entity->extents_state = DWG_EXTENTS_UNKNOWN;
+    }
+}
@@ -31,10 +31,7 @@
 #include "free.h"
 #include "hash.h"
 
-static unsigned int loglevel;
-#ifdef USE_TRACING
-static int env_var_checked_p;
-#endif
+static THREAD_LOCAL unsigned int loglevel;
 #define DWG_LOGLEVEL loglevel
 #include "logging.h"
 
@@ -50,7 +47,7 @@ static Bit_Chain *dat = &pdat;
 #define ACTION free
 #define IS_FREE
 
-#define FREE_IF(ptr) { if (ptr) free(ptr); ptr = NULL; }
+#define FREE_IF(ptr) { if (ptr) dwg_dealloc(ptr); ptr = NULL; }
 
 #define VALUE(value,type,dxf)
 #define VALUE_RC(value,dxf) VALUE(value, RC, dxf)
@@ -68,7 +65,7 @@ static Bit_Chain *dat = &pdat;
 #define FIELD_HANDLE(name,code,dxf) VALUE_HANDLE(_obj->name,code,dxf)
 #define VALUE_HANDLE(ref,code,dxf) \
   if (ref) { \
-    if (!ref->obj && !ref->handleref.size && !ref->absolute_ref) free(ref); \
+    if (!ref->obj && !ref->handleref.size && !ref->absolute_ref) dwg_dealloc(ref); \
   } /* else freed globally */
 #define FIELD_DATAHANDLE(name,code,dxf) FIELD_HANDLE(name, code, dxf)
 #define FIELD_HANDLE_N(name,vcount,code,dxf) FIELD_HANDLE(name, code, dxf)
@@ -90,7 +87,7 @@ static Bit_Chain *dat = &pdat;
 #define FIELD_TV(name,dxf) \
   if (FIELD_VALUE(name))\
     {\
-      free (FIELD_VALUE(name)); \
+      dwg_dealloc (FIELD_VALUE(name)); \
       FIELD_VALUE(name) = NULL; \
     }
 #define VALUE_TV(value,dxf) FREE_IF(value)
@@ -211,7 +208,8 @@ dwg_free_ ##token (Bit_Chain *restrict _dat, Dwg_Object *restrict obj)\
   int error = 0; \
   LOG_HANDLE("Free entity " #token "\n")\
   _ent = obj->tio.entity;\
-  _obj = ent = _ent->tio.token;
+  _obj = ent = _ent->tio.token;\
+  if (!_obj) { FREE_IF(obj->tio.entity); return 0; }
 
 #define DWG_ENTITY_END      \
   dwg_free_common_entity_data(obj); \
@@ -235,7 +233,8 @@ dwg_free_ ##token (Bit_Chain *restrict _dat, Dwg_Object *restrict obj) \
   LOG_HANDLE("Free object " #token " %p\n", obj) \
   if (strcmp(#token, "UNKNOWN_OBJ") && obj->supertype == DWG_SUPERTYPE_UNKNOWN) \
     return dwg_free_UNKNOWN_OBJ(_dat, obj); \
-  _obj = obj->tio.object->tio.token;
+  _obj = obj->tio.object->tio.token; \
+  if (!_obj) { FREE_IF(obj->tio.object); return 0; }
 
 /* obj itself is allocated via dwg->object[], dxfname is klass->dxfname */
 #define DWG_OBJECT_END       \
@@ -357,6 +356,8 @@ dwg_free_object(Dwg_Object *obj)
     return;
   if (obj->type == DWG_TYPE_FREED)
     return;
+  if (!obj->tio.object) // out of memory when it was added
+    return;
   dat->from_version = dat->version;
   if (obj->supertype == DWG_SUPERTYPE_UNKNOWN)
     goto unhandled;
@@ -637,7 +638,7 @@ dwg_free_object(Dwg_Object *obj)
             }
           else // not a class
             {
-              free(obj->tio.unknown);
+              dwg_dealloc(obj->tio.unknown);
             }
         }
     }
@@ -658,18 +659,8 @@ dwg_free(Dwg_Data * dwg)
   BITCODE_BL i;
   if (dwg)
     {
-      if (dwg->opts)
-        loglevel = dwg->opts & 0xf;
-#ifdef USE_TRACING
-      /* Before starting, set the logging level, but only do so once.  */
-      if (! env_var_checked_p)
-        {
-          char *probe = getenv ("LIBREDWG_TRACE");
-          if (probe)
-            loglevel = atoi (probe);
-          env_var_checked_p = 1;
-        }
-#endif  /* USE_TRACING */
+      Dwg_Thread_State state;
+      loglevel = dwg_log_enter(dwg, &state);
       LOG_INFO("\n============\ndwg_free\n")
       // copied table fields have duplicate pointers, but are freed only once
       for (i=0; i < dwg->num_objects; ++i)
@@ -680,7 +671,7 @@ dwg_free(Dwg_Data * dwg)
       FREE_IF(dwg->header.section);
       dwg_free_header_vars(dwg);
       if (dwg->picture.size && dwg->picture.chain)
-        free(dwg->picture.chain);
+        dwg_dealloc(dwg->picture.chain);
       for (i=0; i < dwg->header.num_infos; ++i)
         FREE_IF(dwg->header.section_info[i].sections);
       if (dwg->header.num_infos)
@@ -709,10 +700,29 @@ dwg_free(Dwg_Data * dwg)
           FREE_IF(dwg->object_ref[i]);
         }
       FREE_IF(dwg->object_ref);
+      FREE_IF(dwg->object_ref_owner);
+      FREE_IF(dwg->referrers_start);
+      FREE_IF(dwg->referrers);
+      FREE_IF(dwg->owned_start);
+      FREE_IF(dwg->owned);
+      FREE_IF(dwg->layered_start);
+      FREE_IF(dwg->layered);
+      FREE_IF(dwg->type_start);
+      FREE_IF(dwg->type_objects);
+      FREE_IF(dwg->type_groups_start);
+      FREE_IF(dwg->type_groups);
+      FREE_IF(dwg->type_tio);
+      FREE_IF(dwg->entities);
+      dwg_free_rtrees(dwg);
+      FREE_IF(dwg->stats.types);
+      FREE_IF(dwg->stats.profile);
+      dwg->stats.num_types = 0;
+      dwg->stats.num_profile = 0;
       FREE_IF(dwg->object);
       if (dwg->object_map)
         hash_free (dwg->object_map);
 #undef FREE_IF
+      dwg_log_leave(&state);
     }
 }
 
@@ -17,6 +17,7 @@
  * written by Reini Urban
  */
 
+#include "common.h"
 #include "hash.h"
 #include <stdlib.h>
 #include <stdio.h>
@@ -25,7 +26,7 @@
 
 dwg_inthash *hash_new(uint32_t size)
 {
-  dwg_inthash *hash = malloc(sizeof(dwg_inthash));
+  dwg_inthash *hash = dwg_malloc(sizeof(dwg_inthash));
   uint32_t cap;
   if (!hash)
     return NULL;
@@ -35,7 +36,12 @@ dwg_inthash *hash_new(uint32_t size)
   cap = (uint32_t)(size * 100.0/HASH_LOAD);
   while (size <= cap) // this is slow, but only done once. clz would be much faster
     size <<= 1U;
-  hash->array = calloc(size, sizeof(struct _hashbucket)); // key+value pairs
+  hash->array = dwg_calloc(size, sizeof(struct _hashbucket)); // key+value pairs
+  if (!hash->array)
+    {
+      dwg_dealloc(hash);
+      return NULL;
+    }
   hash->size = size;
   return hash;
 }
@@ -46,17 +52,18 @@ static inline int hash_need_resize(dwg_inthash *hash)
   return (uint32_t)(hash->elems * 100.0/HASH_LOAD) > hash->size;
 }
 
-static void hash_resize(dwg_inthash *hash)
+// 1 if out of memory, with the old array kept
+static int hash_resize(dwg_inthash *hash)
 {
   dwg_inthash oldhash = *hash;
   uint32_t size = hash->size * 2;
   uint32_t i;
 
   // allocate key+value pairs afresh
-  hash->array = calloc(size, sizeof(struct _hashbucket));
+  hash->array = dwg_calloc(size, sizeof(struct _hashbucket));
   if (!hash->array) {
     *hash = oldhash;
-    return;
+    return 1;
   }
   hash->elems = 0;
   hash->size = size;
@@ -67,8 +74,8 @@ static void hash_resize(dwg_inthash *hash)
       if (oldhash.array[i].key)
         hash_set(hash, oldhash.array[i].key, oldhash.array[i].value);
     }
-  free(oldhash.array);
-  return;
+  dwg_dealloc(oldhash.array);
+  return 0;
 }
 
 // found this gem by Thomas Mueller at stackoverflow. triviality threshold.
@@ -136,7 +143,8 @@ void hash_set(dwg_inthash *hash, uint32_t key, uint32_t value)
           // if does not exist, add at i+1
           if (hash_need_resize(hash)) {
             //fprintf(stderr, "resize at %d\n", hash->size);
-            hash_resize(hash);
+            if (hash_resize(hash)) // out of memory, the key is lost
+              return;
             return hash_set(hash, key, value);
           }
           while (hash->array[i].key) // find next empty slot
@@ -149,7 +157,8 @@ void hash_set(dwg_inthash *hash, uint32_t key, uint32_t value)
               if (i == j) // not found
                 {
                   //fprintf(stderr, "not found resize at %d\n", hash->size);
-                  hash_resize(hash); // guarantees new empty slots
+                  if (hash_resize(hash)) // guarantees new empty slots
+                    return;
                   hash_set(hash, key, value);
                   return;
                 }
@@ -172,9 +181,9 @@ void hash_set(dwg_inthash *hash, uint32_t key, uint32_t value)
 
 void hash_free(dwg_inthash *hash)
 {
-  free (hash->array);
+  dwg_dealloc (hash->array);
   hash->array = NULL;
   hash->size = 0;
   hash->elems = 0;
-  free (hash);
+  dwg_dealloc (hash);
 }
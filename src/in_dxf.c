@@ -39,7 +39,6 @@
 #include <string.h>
 #include <assert.h>
 #include <limits.h>
-#include <ctype.h>
 
 #include "common.h"
 #include "bits.h"
@@ -49,153 +48,459 @@
 #include "decode.h"
 #include "encode.h"
 
-static unsigned int loglevel;
+static THREAD_LOCAL unsigned int loglevel;
 #define DWG_LOGLEVEL loglevel
 #include "logging.h"
 
 /* the current version per spec block */
-static unsigned int cur_ver = 0;
-static char buf[4096];
-static long start, end; //stream offsets
+static THREAD_LOCAL unsigned int cur_ver = 0;
+/* the current import. The FIELD macros have no argument for it */
+static THREAD_LOCAL Dxf_Import *dxf_import;
 
+/* A DXF group, as returned by the tokenizer. The string is a view into
+   the input, not NUL terminated. Numbers are parsed by type: ints into
+   i, int32 into l, reals into d and hex handles into l. */
 typedef struct _dxf_pair {
   short code;
   enum RES_BUF_VALUE_TYPE type;
+  const char *s;
+  unsigned int len;
   union {
     int i;
-    char *s;
     long l;
     double d;
   } value;
 } Dxf_Pair;
 
-static long num_dxf_objs;  // how many elements are added
-static long size_dxf_objs; // how many elements are allocated
-static Dxf_Objs* dxf_objs;
+/* The next line as view, without its CRLF or LF */
+static const char *
+dxf_read_line(Bit_Chain *dat, unsigned int *len)
+{
+  const unsigned char *s, *e, *p;
 
-static inline void dxf_skip_ws(Bit_Chain *dat)
+  if (dat->byte >= dat->size)
+    {
+      *len = 0;
+      return "";
+    }
+  s = &dat->chain[dat->byte];
+  e = &dat->chain[dat->size];
+  p = (const unsigned char *)memchr(s, '\n', e - s);
+  if (!p)
+    p = e;
+  dat->byte = p - dat->chain + (p < e);
+  if (p > s && p[-1] == '\r')
+    p--;
+  *len = p - s;
+  return (const char *)s;
+}
+
+static inline int
+dxf_is_space(const char c)
 {
-  for (; !dat->chain[dat->byte] || isspace(dat->chain[dat->byte]); dat->byte++) ;
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/* Strip the blanks around a number */
+static const char *
+dxf_trim(const char *s, unsigned int *len)
+{
+  const char *e = s + *len;
+  for (; s < e && dxf_is_space(*s); s++) ;
+  for (; e > s && dxf_is_space(e[-1]); e--) ;
+  *len = e - s;
+  return s;
+}
+
+/* Returns the count of parsed chars, 0 if there is no number */
+static unsigned int
+dxf_parse_long(const char *s, const unsigned int len, long *num)
+{
+  unsigned int i = 0;
+  unsigned long n = 0;
+  int neg = 0;
+
+  if (i < len && (s[i] == '-' || s[i] == '+'))
+    neg = s[i++] == '-';
+  if (i == len || s[i] < '0' || s[i] > '9')
+    return 0;
+  for (; i < len && s[i] >= '0' && s[i] <= '9'; i++)
+    {
+      if (n > (unsigned long)LONG_MAX / 10)
+        n = (unsigned long)LONG_MAX + 1; // saturate
+      else
+        n = n * 10 + (s[i] - '0');
+    }
+  if (n > (unsigned long)LONG_MAX)
+    n = (unsigned long)LONG_MAX;
+  *num = neg ? -(long)n : (long)n;
+  return i;
 }
 
-static int dxf_read_code(Bit_Chain *dat)
+static unsigned int
+dxf_parse_hex(const char *s, const unsigned int len, unsigned long *num)
 {
-  char *endptr;
-  long num = strtol((char*)&dat->chain[dat->byte], &endptr, 10);
-  dat->byte += (unsigned char *)endptr - &dat->chain[dat->byte];
-  dxf_skip_ws(dat);
-  if (num > INT_MAX)
+  unsigned int i;
+  unsigned long n = 0;
+
+  for (i = 0; i < len; i++)
+    {
+      const char c = s[i];
+      if (c >= '0' && c <= '9')
+        n = (n << 4) | (c - '0');
+      else if (c >= 'A' && c <= 'F')
+        n = (n << 4) | (c - 'A' + 10);
+      else if (c >= 'a' && c <= 'f')
+        n = (n << 4) | (c - 'a' + 10);
+      else
+        break;
+    }
+  *num = n;
+  return i;
+}
+
+/* Parse a real. Up to 19 significant digits and powers of ten up to 22
+   are exact in doubles, so the mantissa and the scale are both exact and
+   the single multiplication or division is correctly rounded.
+   Everything else falls back to strtod on a NUL terminated copy.
+   Returns the count of parsed chars, less than len if s is no real. */
+static unsigned int
+dxf_parse_double(const char *s, const unsigned int len, double *d)
+{
+  static const double pow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+  unsigned int i = 0, digits = 0, zeros = 0;
+  BITCODE_RLL m = 0;
+  int neg = 0, exp10 = 0;
+  char tmp[64], *copy, *end;
+
+  *d = 0.0;
+  if (i < len && (s[i] == '-' || s[i] == '+'))
+    neg = s[i++] == '-';
+  for (; i < len && s[i] >= '0' && s[i] <= '9'; i++)
+    {
+      if (m || s[i] != '0')
+        digits++;
+      else
+        zeros++;
+      m = m * 10 + (s[i] - '0');
+    }
+  if (i < len && s[i] == '.')
+    for (i++; i < len && s[i] >= '0' && s[i] <= '9'; i++)
+      {
+        if (m || s[i] != '0')
+          digits++;
+        else
+          zeros++;
+        m = m * 10 + (s[i] - '0');
+        exp10--;
+      }
+  if (i < len && (s[i] == 'e' || s[i] == 'E'))
+    {
+      long e;
+      unsigned int n = dxf_parse_long(&s[i + 1], len - i - 1, &e);
+      if (!n || e > 1000 || e < -1000)
+        goto slow;
+      exp10 += (int)e;
+      i += n + 1;
+    }
+  if (i == len && (digits || zeros) && digits <= 19
+      && m <= ((BITCODE_RLL)1 << 53)
+      && exp10 >= -22 && exp10 <= 22)
+    {
+      *d = (double)m;
+      *d = exp10 < 0 ? *d / pow10[-exp10] : *d * pow10[exp10];
+      if (neg)
+        *d = -*d;
+      return len;
+    }
+ slow:
+  copy = len < sizeof(tmp) ? tmp : (char *)dwg_malloc(len + 1);
+  if (!copy)
+    return 0;
+  memcpy(copy, s, len);
+  copy[len] = '\0';
+  *d = strtod(copy, &end);
+  i = end - copy;
+  if (copy != tmp)
+    dwg_dealloc(copy);
+  return i;
+}
+
+/* The next group code line, or -1 */
+static int
+dxf_read_code(Bit_Chain *dat)
+{
+  unsigned int len;
+  long num;
+  const char *s = dxf_read_line(dat, &len);
+
+  s = dxf_trim(s, &len);
+  if (!len || dxf_parse_long(s, len, &num) != len)
+    return -1;
+  if (num > INT_MAX || num < INT_MIN)
     LOG_ERROR("%s: int overflow %ld (at %lu)", __FUNCTION__, num, dat->byte)
   return (int)num;
 }
 
-static int dxf_read_group(Bit_Chain *dat, int dxf)
+/* Consumes the group code line if it is dxf */
+static int
+dxf_read_group(Bit_Chain *dat, int dxf)
 {
-  char *endptr;
-  long num = strtol((char*)&dat->chain[dat->byte], &endptr, 10);
-  if ((int)num == dxf) {
+  const unsigned long pos = dat->byte;
+  if (dxf_read_code(dat) == dxf) {
     LOG_HANDLE("group %d\n", dxf);
-    dat->byte += (unsigned char *)endptr - &dat->chain[dat->byte];
-    dxf_skip_ws(dat);
     return 1;
   }
+  dat->byte = pos;
   return 0;
 }
 
-static void dxf_read_string(Bit_Chain *dat, char **string)
+/* Copies the string of the pair into *dest, reusing its old buffer.
+   Returns 0 or DWG_ERR_OUTOFMEM */
+static int
+dxf_strcpy(char **dest, const Dxf_Pair *pair)
 {
-  int i;
-  dxf_skip_ws(dat);
-  for (i = 0; !isspace(dat->chain[dat->byte]); dat->byte++)
+  char *s = (char *)dwg_realloc(*dest, pair->len + 1);
+  if (!s)
     {
-      buf[i++] = dat->chain[dat->byte];
+      LOG_ERROR("Out of memory");
+      return DWG_ERR_OUTOFMEM;
     }
-  buf[i] = '\0';
-  //int i = sscanf(&dat->chain[dat->byte], "%s", buf);
-  if (i) {
-    dxf_skip_ws(dat);
-    if (!string)
-      return; // ignore
-    if (!*string)
-      *string = malloc(strlen(buf)+1);
-    strcpy(*string, buf);
-  }
+  memcpy(s, pair->s, pair->len);
+  s[pair->len] = '\0';
+  *dest = s;
+  return 0;
+}
+
+static int
+dxf_is(const Dxf_Pair *pair, const char *str)
+{
+  const size_t len = strlen(str);
+  return pair->len == len && !memcmp(pair->s, str, len);
+}
+
+/* Reads the value line, and copies it into string if not NULL.
+   Returns 0, DWG_ERR_OUTOFMEM or DWG_ERR_INVALIDDWG at EOF */
+static int
+dxf_read_string(Bit_Chain *dat, char **string)
+{
+  Dxf_Pair pair;
+  if (dat->byte >= dat->size)
+    {
+      LOG_ERROR("Missing DXF string at EOF")
+      return DWG_ERR_INVALIDDWG;
+    }
+  pair.s = dxf_read_line(dat, &pair.len);
+  return string ? dxf_strcpy(string, &pair) : 0;
+}
+
+/* Reads the UTF-8 value line into the TU *wstring, replacing the old.
+   Returns 0, DWG_ERR_OUTOFMEM or DWG_ERR_INVALIDDWG at EOF */
+static int
+dxf_read_wstring(Bit_Chain *dat, BITCODE_TU *wstring)
+{
+  char *s = NULL;
+  BITCODE_TU w;
+  int error = dxf_read_string(dat, &s);
+  if (error)
+    return error;
+  w = bit_utf8_to_TU(s);
+  dwg_dealloc(s);
+  if (!w)
+    {
+      LOG_ERROR("Out of memory");
+      return DWG_ERR_OUTOFMEM;
+    }
+  dwg_dealloc(*wstring);
+  *wstring = w;
+  return 0;
 }
 
-#define STRADD(field, string) \
-  field = malloc(strlen(string)+1); strcpy(field, string)
+/* Sets the reactor i to the handle absref, or appends it */
+static int
+dxf_add_reactor(Dwg_Object *obj, BITCODE_H **reactors,
+                BITCODE_BL *num_reactors, BITCODE_BL i, unsigned long absref)
+{
+  BITCODE_H *r;
+  if (i < *num_reactors && (*reactors)[i])
+    {
+      (*reactors)[i]->absolute_ref = absref;
+      return 0;
+    }
+  r = (BITCODE_H *)dwg_realloc(*reactors, (*num_reactors + 1) * sizeof(BITCODE_H));
+  if (!r)
+    {
+      LOG_ERROR("Out of memory");
+      return DWG_ERR_OUTOFMEM;
+    }
+  *reactors = r;
+  r[*num_reactors] = dwg_add_handleref(obj->parent, 4, absref, obj);
+  if (!r[*num_reactors])
+    return DWG_ERR_OUTOFMEM;
+  (*num_reactors)++;
+  return 0;
+}
 
-static void dxf_free_pair(Dxf_Pair* pair)
+/* Reads the value line as real. Returns 0 or DWG_ERR_INVALIDDWG */
+static int
+dxf_read_double(Bit_Chain *dat, double *d)
 {
-  if (pair->type == VT_STRING ||
-      pair->type == VT_BINARY)
+  unsigned int len;
+  const char *s = dxf_read_line(dat, &len);
+  s = dxf_trim(s, &len);
+  if (dxf_parse_double(s, len, d) != len)
     {
-      free(pair->value.s);
+      LOG_ERROR("Invalid DXF real %.*s (at %lu)", (int)len, s, dat->byte)
+      return DWG_ERR_INVALIDDWG;
     }
-  free(pair);
-  pair = NULL;
+  return 0;
+}
+
+static unsigned long
+dxf_read_handle(Bit_Chain *dat)
+{
+  unsigned int len;
+  unsigned long h = 0;
+  const char *s = dxf_read_line(dat, &len);
+  s = dxf_trim(s, &len);
+  dxf_parse_hex(s, len, &h);
+  return h;
+}
+
+/* Reads a days.ms pair of ints, as written by out_dxf */
+static void
+dxf_read_timebll(Bit_Chain *dat, Dwg_Bitcode_TimeBLL *date)
+{
+  unsigned int len, n;
+  long num = 0;
+  const char *s = dxf_read_line(dat, &len);
+
+  s = dxf_trim(s, &len);
+  n = dxf_parse_long(s, len, &num);
+  date->days = (BITCODE_BL)num;
+  num = 0;
+  if (n < len && s[n] == '.')
+    dxf_parse_long(&s[n + 1], len - n - 1, &num);
+  date->ms = (BITCODE_BL)num;
 }
 
-static Dxf_Pair* dxf_read_pair(Bit_Chain *dat)
+#define STRADD(field, pair) error = dxf_strcpy(&field, pair)
+
+/* The tokenizer: reads the next group into pair, without any allocation.
+   Returns 0 or DWG_ERR_INVALIDDWG on an invalid group code or EOF. */
+static int
+dxf_read_pair(Bit_Chain *dat, Dxf_Pair *pair)
 {
-  Dxf_Pair *pair = calloc(1, sizeof(Dxf_Pair));
-  pair->code = (short)dxf_read_code(dat);
+  const char *s;
+  unsigned int len;
+  long num;
+  int code;
+
+  memset(pair, 0, sizeof(Dxf_Pair));
+  pair->s = "";
+  if (dat->byte >= dat->size)
+    return DWG_ERR_INVALIDDWG;
+  code = dxf_read_code(dat);
+  if (code < 0 || code > SHRT_MAX)
+    {
+      LOG_ERROR("Invalid DXF group code (at %lu)", dat->byte)
+      return DWG_ERR_INVALIDDWG;
+    }
+  pair->code = (short)code;
   pair->type = get_base_value_type(pair->code);
+  if (dat->byte >= dat->size)
+    {
+      LOG_ERROR("Missing DXF value for group %d at EOF", code)
+      return DWG_ERR_INVALIDDWG;
+    }
+  pair->s = dxf_read_line(dat, &pair->len);
   switch (pair->type)
     {
     case VT_STRING:
-      dxf_read_string(dat, &pair->value.s);
-      LOG_TRACE("dxf{%d, %s}\n", (int)pair->code, pair->value.s);
-      SINCE(R_2007) {
-        BITCODE_TU wstr = bit_utf8_to_TU(pair->value.s);
-        free(pair->value.s);
-        pair->value.s = (char*)wstr;
-      }
+    case VT_BINARY:
+      LOG_TRACE("dxf{%d, %.*s}\n", (int)pair->code, (int)pair->len, pair->s);
       break;
     case VT_BOOL:
     case VT_INT8:
     case VT_INT16:
     case VT_INT32:
-      pair->value.i = dxf_read_code(dat);
-      LOG_TRACE("dxf{%d, %d}\n", (int)pair->code, pair->value.i);
+      len = pair->len;
+      s = dxf_trim(pair->s, &len);
+      num = 0;
+      dxf_parse_long(s, len, &num);
+      if (pair->type == VT_INT32)
+        pair->value.l = num;
+      else
+        pair->value.i = (int)num;
+      LOG_TRACE("dxf{%d, %ld}\n", (int)pair->code, num);
       break;
     case VT_REAL:
     case VT_POINT3D:
-      dxf_skip_ws(dat);
-      sscanf((char*)&dat->chain[dat->byte], "%lf", &pair->value.d);
+      len = pair->len;
+      s = dxf_trim(pair->s, &len);
+      if (dxf_parse_double(s, len, &pair->value.d) != len)
+        {
+          LOG_ERROR("Invalid DXF real %.*s for group %d", (int)len, s,
+                    (int)pair->code)
+          return DWG_ERR_INVALIDDWG;
+        }
       LOG_TRACE("dxf{%d, %f}\n", pair->code, pair->value.d);
       break;
-    case VT_BINARY:
-      //read into buf only?
-      dxf_read_string(dat, &pair->value.s);
-      //TODO convert %02X to string
-      LOG_TRACE("dxf{%d, %s}\n", (int)pair->code, pair->value.s);
-      break;
     case VT_HANDLE:
     case VT_OBJECTID:
-      dxf_read_string(dat, NULL);
-      sscanf(buf, "%X", &pair->value.i);
-      LOG_TRACE("dxf{%d,%X}\n", (int)pair->code, pair->value.i);
+      {
+        unsigned long h;
+        len = pair->len;
+        s = dxf_trim(pair->s, &len);
+        dxf_parse_hex(s, len, &h);
+        pair->value.l = (long)h;
+        LOG_TRACE("dxf{%d, %lX}\n", (int)pair->code, h);
+      }
       break;
     case VT_INVALID:
     default:
-      LOG_ERROR("Invalid DXF group code: %d", pair->code);
-      return NULL;
+      // a value line follows any code, e.g. the int64 160-169
+      LOG_WARN("Unknown DXF group code: %d", pair->code);
+      pair->type = VT_STRING;
+      break;
     }
-  return pair;
+  return 0;
+}
+
+/* Consumes the group if it is the given code and string */
+static int
+dxf_read_record(Bit_Chain *dat, const int code, const char *record)
+{
+  Dxf_Pair pair;
+  const unsigned long pos = dat->byte;
+  if (!dxf_read_pair(dat, &pair) && pair.code == code && dxf_is(&pair, record))
+    return 1;
+  dat->byte = pos;
+  return 0;
 }
 
 #define DXF_CHECK_EOF           \
   if (dat->byte >= dat->size || \
-      (pair->code == 0 && !strcmp(pair->value.s, "EOF"))) \
+      (pair->code == 0 && dxf_is(pair, "EOF"))) \
     return 1
 
+/* Reads the next pair, or returns from the caller at EOF with 1, or
+   with the error */
+#define DXF_READ_PAIR                   \
+  if (dxf_read_pair(dat, pair))         \
+    {                                   \
+      DXF_CHECK_EOF;                    \
+      return DWG_ERR_INVALIDDWG;        \
+    }
+
 static int dxf_skip_comment(Bit_Chain *dat, Dxf_Pair *pair)
 {
   while (pair->code == 999)
     {
-      dxf_free_pair(pair);
-      pair = dxf_read_pair(dat);
+      DXF_READ_PAIR;
       DXF_CHECK_EOF;
     }
   return 0;
@@ -205,9 +510,9 @@ static int dxf_check_code(Bit_Chain *dat, Dxf_Pair *pair, int code)
 {
   if (pair->code == code)
     {
-      dxf_skip_comment(dat, pair);
+      if (dxf_skip_comment(dat, pair) > 1)
+        return 0;
       DXF_CHECK_EOF;
-      dxf_free_pair(pair);
       return 1;
     }
   return 0;
@@ -228,29 +533,24 @@ static int dxf_check_code(Bit_Chain *dat, Dxf_Pair *pair, int code)
 #define FIELD(name,type,dxf) dxf_add_field(obj, #name, #type, dxf)
 #define FIELD_CAST(name,type,cast,dxf) FIELD(name,cast,dxf)
 #define FIELD_TRACE(name,type)
-#define VALUE_TV(value, dxf)  dxf_read_string(dat, (char**)&value)
-#define SUBCLASS(text) VALUE_TV(buf, 100);
+#define VALUE_TV(value, dxf)  error |= dxf_read_string(dat, (char**)&value)
+#define SUBCLASS(text) PAIR(100, text);
 
 #define VALUE_TU(value,dxf) \
-  { BITCODE_TU wstr; \
-    VALUE_TV(buf, dxf); \
-    wstr = bit_utf8_to_TU(buf); \
-    /* TODO get TU length, copy to &value */ \
-  }
+  error |= dxf_read_wstring(dat, (BITCODE_TU*)&value)
 
 #define FIELD_VALUE(name) _obj->name
 #define ANYCODE -1
 #define VALUE_HANDLE(hdlptr, handle_code, dxf) \
   if (dxf && hdlptr) { \
-    if (GROUP(dxf)) { \
-      int i = sscanf((char*)&dat->chain[dat->byte], "%lX", \
-                     &hdlptr->absolute_ref); \
-      dat->byte += i; \
-    } \
+    if (GROUP(dxf)) \
+      hdlptr->absolute_ref = dxf_read_handle(dat); \
   }
 #define FIELD_HANDLE(name, handle_code, dxf) VALUE_HANDLE(_obj->name, handle_code, dxf)
+/* Consumes the 9 $name group. The values are read only after it, so
+   that a missing variable does not shift the following groups. */
 #define HEADER_9(name) \
-    GROUP(9)
+    dxf_read_record(dat, 9, "$" #name)
 #define VALUE_H(value,dxf) \
   {\
     Dwg_Object_Ref *ref = value;\
@@ -263,10 +563,9 @@ static int dxf_check_code(Bit_Chain *dat, Dxf_Pair *pair, int code)
 
 #define HEADER_VALUE(name, type, dxf, value) \
   if (dxf) {\
-    char *headername; \
-    if (GROUP(9)) { \
-      dxf_read_string(dat, &headername); \
+    if (HEADER_9(name)) { \
       LOG_TRACE("9 %s:\n", #name); \
+      DXF_READ_PAIR; \
       VALUE (value, type, dxf); \
     } \
     else { \
@@ -277,50 +576,43 @@ static int dxf_check_code(Bit_Chain *dat, Dxf_Pair *pair, int code)
   HEADER_VALUE(name, type, dxf, dwg->header_vars.name)
 
 #define HEADER_3D(name)\
-  HEADER_9(name);\
-  POINT_3D (name, header_vars.name, 10, 20, 30)
+  if (HEADER_9(name))\
+    POINT_3D (name, header_vars.name, 10, 20, 30)
 #define HEADER_2D(name)\
-  HEADER_9(name);\
-  POINT_2D (name, header_vars.name, 10, 20)
+  if (HEADER_9(name))\
+    POINT_2D (name, header_vars.name, 10, 20)
 #define HEADER_BLL(name, dxf) \
   HEADER_9(name);\
   VALUE_BLL(dwg->header_vars.name, dxf)
 #define HEADER_TIMEBLL(name, dxf) \
-  HEADER_9(name);\
-  FIELD_TIMEBLL(name, dxf)
+  if (HEADER_9(name))\
+    FIELD_TIMEBLL(name, dxf)
 
 #define SECTION(section) RECORD(SECTION); PAIR(2, section)
 #define ENDSEC()       RECORD(ENDSEC)
 #define TABLE(table)   RECORD(TABLE); PAIR(2, table)
 #define ENDTAB()       RECORD(ENDTAB)
-#define PAIR(n, record) \
-  { GROUP(n); \
-    dxf_read_string(dat, NULL); }
+#define PAIR(n, record) dxf_read_record(dat, n, #record)
 #define RECORD(record) PAIR(0, record)
 #define GROUP(dxf) dxf_read_group(dat, dxf)
 
 #define VALUE(value, type, dxf) {}
 
 #define HEADER_HANDLE_NAME(name, dxf, section) \
-  HEADER_9(name);\
+  if (HEADER_9(name)) \
   {\
     Dwg_Object_Ref *ref = dwg->header_vars.name;\
-    pair = dxf_read_pair(dat); \
+    DXF_READ_PAIR; \
     DXF_CHECK_EOF; \
     if (ref && ref->obj && pair->type == VT_HANDLE) { \
       /* TODO: set the table handle */ \
-      ;/*ref->obj->handle.absolute_ref = pair->value.i; */ \
-      /*ref->obj->tio.object->tio.section->entry_name = strdup(pair->value.s);*/ \
+      ;/*ref->obj->handle.absolute_ref = pair->value.l; */ \
+      /*dxf_strcpy(&ref->obj->tio.object->tio.section->entry_name, pair);*/ \
     } \
   }
 //FIXME
 #define HANDLE_NAME(id, dxf) \
-  { \
-    Dwg_Object_Ref *ref = id;\
-    char *tmp; \
-    Dwg_Object *o = ref ? ref->obj : NULL;\
-    VALUE_TV(tmp, dxf); \
-}
+  error |= dxf_read_string(dat, NULL)
 
 #define FIELD_DATAHANDLE(name, code, dxf) FIELD_HANDLE(name, code, dxf)
 #define FIELD_HANDLE_N(name, vcount, handle_code, dxf) FIELD_HANDLE(name, handle_code, dxf)
@@ -330,9 +622,9 @@ static int dxf_check_code(Bit_Chain *dat, Dxf_Pair *pair, int code)
 #define HEADER_RL(name,dxf)  HEADER_9(name); FIELD(name, RL, dxf)
 #define HEADER_RD(name,dxf)  HEADER_9(name); FIELD(name, RD, dxf)
 #define HEADER_RLL(name,dxf) HEADER_9(name); FIELD(name, RLL, dxf)
-#define HEADER_TV(name,dxf)  HEADER_9(name); VALUE_TV(_obj->name,dxf)
-#define HEADER_TU(name,dxf)  HEADER_9(name); VALUE_TU(_obj->name,dxf)
-#define HEADER_T(name,dxf)   HEADER_9(name); VALUE_T(_obj->name, dxf)
+#define HEADER_TV(name,dxf)  if (HEADER_9(name) && GROUP(dxf)) VALUE_TV(_obj->name,dxf)
+#define HEADER_TU(name,dxf)  if (HEADER_9(name) && GROUP(dxf)) VALUE_TU(_obj->name,dxf)
+#define HEADER_T(name,dxf)   if (HEADER_9(name) && GROUP(dxf)) VALUE_T(_obj->name, dxf)
 #define HEADER_B(name,dxf)   HEADER_9(name); FIELD(name, B, dxf)
 #define HEADER_BS(name,dxf)  HEADER_9(name); FIELD(name, BS, dxf)
 #define HEADER_BL(name,dxf)  HEADER_9(name); FIELD(name, BL, dxf)
@@ -366,12 +658,12 @@ static int dxf_check_code(Bit_Chain *dat, Dxf_Pair *pair, int code)
 #define FIELD_RLL(name,dxf) FIELD(name, RLL, dxf)
 #define FIELD_MC(name,dxf)  FIELD(name, MC, dxf)
 #define FIELD_MS(name,dxf)  FIELD(name, MS, dxf)
-#define FIELD_TF(name,len,dxf)  VALUE_TV(_obj->name, dxf)
-#define FIELD_TFF(name,len,dxf) VALUE_TV(_obj->name, dxf)
+#define FIELD_TF(name,len,dxf)  if (dxf && GROUP(dxf)) VALUE_TV(_obj->name, dxf)
+#define FIELD_TFF(name,len,dxf) if (dxf && GROUP(dxf)) VALUE_TV(_obj->name, dxf)
 #define FIELD_TV(name,dxf) \
-  if (_obj->name != NULL && dxf != 0) { GROUP(dxf); VALUE_TV(_obj->name, dxf); }
+  if (_obj->name != NULL && dxf != 0 && GROUP(dxf)) { VALUE_TV(_obj->name, dxf); }
 #define FIELD_TU(name,dxf) \
-  if (_obj->name != NULL && dxf != 0) { GROUP(dxf); VALUE_TU((BITCODE_TU)_obj->name, dxf); }
+  if (_obj->name != NULL && dxf != 0 && GROUP(dxf)) { VALUE_TU(_obj->name, dxf); }
 #define FIELD_T(name,dxf) \
   { if (dat->version >= R_2007) { FIELD_TU(name, dxf); } \
     else                        { FIELD_TV(name, dxf); } }
@@ -398,41 +690,32 @@ static int dxf_check_code(Bit_Chain *dat, Dxf_Pair *pair, int code)
   VALUE_RS(_obj->color.index, dxf1)
 // TODO: rgb
 #define FIELD_TIMEBLL(name,dxf) \
-  GROUP(dxf);\
-  sscanf((char*)&dat->chain[dat->byte], "%u.%u", \
-        &_obj->name.days, &_obj->name.ms)
+  if (GROUP(dxf)) \
+    dxf_read_timebll(dat, &_obj->name)
 #define HEADER_CMC(name,dxf) \
     HEADER_9(name);\
     VALUE_RS(dwg->header_vars.name.index, dxf)
 
 #define POINT_3D(name, var, c1, c2, c3)\
   {\
-    pair = dxf_read_pair(dat); \
+    DXF_READ_PAIR; \
     DXF_CHECK_EOF; \
-    if (pair && pair->code == c1) { \
+    if (pair->code == c1) { \
       dwg->var.x = pair->value.d; \
-      dxf_free_pair(pair); \
-      pair = dxf_read_pair(dat); \
-      if (pair && pair->code == c2) \
+      if (!dxf_read_pair(dat, pair) && pair->code == c2) \
         dwg->var.y = pair->value.d; \
-      dxf_free_pair(pair); \
-      pair = dxf_read_pair(dat); \
-      if (pair && pair->code == c3) \
+      if (!dxf_read_pair(dat, pair) && pair->code == c3) \
         dwg->var.z = pair->value.d; \
-      dxf_free_pair(pair); \
     } \
   }
 #define POINT_2D(name, var, c1, c2) \
   {\
-    pair = dxf_read_pair(dat); \
+    DXF_READ_PAIR; \
     DXF_CHECK_EOF; \
-    if (pair && pair->code == c1) { \
+    if (pair->code == c1) { \
       dwg->var.x = pair->value.d; \
-      dxf_free_pair(pair); \
-      pair = dxf_read_pair(dat); \
-      if (pair && pair->code == c2) \
+      if (!dxf_read_pair(dat, pair) && pair->code == c2) \
         dwg->var.y = pair->value.d; \
-      dxf_free_pair(pair); \
     } \
   }
 
@@ -444,8 +727,9 @@ static int dxf_check_code(Bit_Chain *dat, Dxf_Pair *pair, int code)
     {\
       for (vcount=0; vcount < (BITCODE_BL)size; vcount++)\
         {\
-          sscanf((char*)&dat->chain[dat->byte], #name ": " FORMAT_##type ",\n", \
-                 &_obj->name[vcount]);\
+          double d;\
+          if (GROUP(dxf) && !dxf_read_double(dat, &d)) \
+            _obj->name[vcount] = (BITCODE_##type)d;\
         }\
     }
 
@@ -502,23 +786,27 @@ static int dxf_check_code(Bit_Chain *dat, Dxf_Pair *pair, int code)
 #define FIELD_XDATA(name, size)
 
 #define REACTORS(code)\
-  pair = dxf_read_pair(dat); \
+  DXF_READ_PAIR; \
   if (dxf_check_code(dat, pair, 102)) { /* {ACAD_REACTORS */ \
-    dxf_free_pair(pair); vcount = 0; \
-    while (dxf_check_code(dat, pair, 330)) { \
-      vcount++; obj->tio.object->num_reactors++; \
-      VALUE_HANDLE(obj->tio.object->reactors[vcount], code, 330); \
+    vcount = 0; \
+    while (!dxf_read_pair(dat, pair) && dxf_check_code(dat, pair, 330)) { \
+      error |= dxf_add_reactor(obj, &obj->tio.object->reactors, \
+                               &obj->tio.object->num_reactors, vcount, \
+                               (unsigned long)pair->value.l); \
+      vcount++; \
     } \
     dxf_check_code(dat, pair, 102); \
   }
 
 #define ENT_REACTORS(code)\
-  pair = dxf_read_code(dat); \
+  DXF_READ_PAIR; \
   if (dxf_check_code(dat, pair, 102)) { /* {ACAD_REACTORS */ \
-    dxf_free_pair(pair); vcount = 0; \
-    while (dxf_check_code(dat, pair, 330)) { \
-      vcount++; _obj->num_reactors++; \
-      VALUE_HANDLE(obj->tio.entity->reactors[vcount], code, 330); \
+    vcount = 0; \
+    while (!dxf_read_pair(dat, pair) && dxf_check_code(dat, pair, 330)) { \
+      error |= dxf_add_reactor(obj, &obj->tio.entity->reactors, \
+                               &obj->tio.entity->num_reactors, vcount, \
+                               (unsigned long)pair->value.l); \
+      vcount++; \
     } \
     dxf_check_code(dat, pair, 102); \
   }
@@ -544,7 +832,7 @@ dwg_indxf_##token (Bit_Chain *restrict dat, Dwg_Object *restrict obj) \
   Bit_Chain *hdl_dat = dat;\
   Dwg_Data* dwg = obj->parent;\
   Dwg_Object_Entity *_ent;\
-  Dxf_Pair *pair; \
+  Dxf_Pair _pair, *pair = &_pair; \
   int error = 0;\
   LOG_INFO("Entity " #token ":\n")\
   _ent = obj->tio.entity;\
@@ -565,7 +853,7 @@ dwg_indxf_ ##token (Bit_Chain *restrict dat, Dwg_Object *restrict obj) \
   Bit_Chain *hdl_dat = dat;\
   Dwg_Data* dwg = obj->parent;\
   Dwg_Object_##token *_obj;\
-  Dxf_Pair *pair; \
+  Dxf_Pair _pair, *pair = &_pair; \
   int error = 0; \
   obj->fixedtype = DWG_TYPE_##token;\
   LOG_INFO("Object " #token ":\n")\
@@ -577,89 +865,217 @@ dwg_indxf_ ##token (Bit_Chain *restrict dat, Dwg_Object *restrict obj) \
 
 #define DWG_OBJECT_END return error; }
 
-//TODO: we have only one obj per DXF context/section. simplify
-void dxf_add_field(Dwg_Object *restrict obj, const char *restrict name,
-                   const char *restrict type, int dxf)
+void
+dxf_import_init(Dxf_Import *imp)
 {
-  int i;
-  Dxf_Objs *found = NULL;
-  Dxf_Field *field;
+  memset(imp, 0, sizeof(Dxf_Import));
+}
 
-  //array of [obj -> [fields], ...]
-  if (num_dxf_objs >= size_dxf_objs)
+void
+dxf_import_free(Dxf_Import *imp)
+{
+  uint32_t i;
+  for (i = 0; i < imp->num_objs; i++)
+    dwg_dealloc(imp->objs[i].fields);
+  for (i = 0; i < imp->num_fields; i++)
     {
-      size_dxf_objs += 1000;
-      dxf_objs = realloc(dxf_objs, size_dxf_objs*sizeof(Dxf_Objs));
-      memset(&dxf_objs[num_dxf_objs], 0, 1000*sizeof(Dxf_Objs));
+      dwg_dealloc(imp->fields[i].name);
+      dwg_dealloc(imp->fields[i].type);
     }
-  //search obj ptr in array
-  for (i=0; i<num_dxf_objs; i++)
+  if (imp->objmap)
+    hash_free(imp->objmap);
+  if (imp->objs)
+    dwg_dealloc(imp->objs);
+  if (imp->fields)
+    dwg_dealloc(imp->fields);
+  if (imp->fieldmap)
+    dwg_dealloc(imp->fieldmap);
+  memset(imp, 0, sizeof(Dxf_Import));
+}
+
+// FNV-1a of the name, mixed with the dxf code
+static uint32_t
+dxf_field_hash(const char *name, int dxf)
+{
+  uint32_t h = 2166136261U;
+  for (; *name; name++)
+    h = (h ^ (unsigned char)*name) * 16777619U;
+  h ^= (uint32_t)dxf;
+  h = ((h >> 16) ^ h) * 0x45d9f3b;
+  return (h >> 16) ^ h;
+}
+
+static int
+dxf_field_eq(const Dxf_Field *f, const char *name, const char *type, int dxf)
+{
+  return f->dxf == dxf && !strcmp(f->name, name)
+         && (!type || !strcmp(f->type, type));
+}
+
+// the slot of (name, dxf) in the fieldmap, empty if not interned
+static uint32_t
+dxf_field_slot(const Dxf_Import *imp, const char *name, const char *type,
+               int dxf)
+{
+  const uint32_t mask = imp->size_fieldmap - 1;
+  uint32_t i = dxf_field_hash(name, dxf) & mask;
+  while (imp->fieldmap[i]
+         && !dxf_field_eq(&imp->fields[imp->fieldmap[i] - 1], name, type, dxf))
+    i = (i + 1) & mask;
+  return i;
+}
+
+// the id of the interned field, or -1 if out of memory
+static uint32_t
+dxf_intern_field(Dxf_Import *imp, const char *name, const char *type, int dxf)
+{
+  uint32_t i;
+  Dxf_Field *field;
+
+  // keep the fieldmap below 50% fill
+  if (2 * (imp->num_fields + 1) > imp->size_fieldmap)
     {
-      if (dxf_objs[i].obj == obj)
+      uint32_t size = imp->size_fieldmap ? 2 * imp->size_fieldmap : 256;
+      uint32_t *map = (uint32_t *)dwg_calloc(size, sizeof(uint32_t));
+      if (!map)
+        return (uint32_t)-1;
+      if (imp->fieldmap)
+        dwg_dealloc(imp->fieldmap);
+      imp->fieldmap = map;
+      imp->size_fieldmap = size;
+      for (i = 0; i < imp->num_fields; i++)
         {
-          found = &dxf_objs[i];
-          break;
+          const Dxf_Field *f = &imp->fields[i];
+          map[dxf_field_slot(imp, f->name, f->type, f->dxf)] = i + 1;
         }
     }
-  if (!found) // new object (first field)
-    {
-      found = &dxf_objs[num_dxf_objs];
-      found->obj = obj;
-      found->num_fields = 1;
-      found->size_fields = 16;
-      found->fields = (Dxf_Field*)calloc(16, sizeof(Dxf_Field));
-      num_dxf_objs++;
-    }
-  /*if (!found->fields)
+  i = dxf_field_slot(imp, name, type, dxf);
+  if (imp->fieldmap[i])
+    return imp->fieldmap[i] - 1;
+
+  if (imp->num_fields >= imp->size_fields)
     {
-      found->num_fields = 1;
-      found->size_fields = 16;
-      found->fields = calloc(found->size_fields, sizeof(Dxf_Field));
+      uint32_t size = imp->size_fields ? 2 * imp->size_fields : 128;
+      Dxf_Field *fields = (Dxf_Field *)dwg_realloc(imp->fields,
+                                                   size * sizeof(Dxf_Field));
+      if (!fields)
+        return (uint32_t)-1;
+      imp->fields = fields;
+      imp->size_fields = size;
     }
-    else */
-  if (found->num_fields > found->size_fields)
+  field = &imp->fields[imp->num_fields];
+  field->name = (char *)dwg_malloc(strlen(name) + 1);
+  field->type = (char *)dwg_malloc(strlen(type) + 1);
+  if (!field->name || !field->type)
     {
-      found->size_fields += 16;
-      found->fields = realloc(found->fields, found->size_fields*sizeof(Dxf_Field));
-      memset(&found->fields[found->num_fields], 0, 16*sizeof(Dxf_Field));
+      if (field->name)
+        dwg_dealloc(field->name);
+      if (field->type)
+        dwg_dealloc(field->type);
+      return (uint32_t)-1;
     }
-
-  // fill the new field
-  field = &found->fields[found->num_fields];
-  field->name = malloc(strlen(name)+1);
-  strcpy(field->name, (char*)name);
-  field->type = malloc(strlen(type)+1);
-  strcpy(field->type, (char*)type);
+  strcpy(field->name, name);
+  strcpy(field->type, type);
   field->dxf = dxf;
-  found->num_fields++;
+  imp->fieldmap[i] = ++imp->num_fields;
+  return imp->num_fields - 1;
 }
 
-//TODO: we have only one obj per DXF context/section. simplify
-Dxf_Field* dxf_search_field(Dwg_Object *restrict obj, const char *restrict name,
-                            const char *restrict type, int dxf)
+// the header variables have no object
+static inline uint32_t
+dxf_obj_key(const Dwg_Object *obj)
 {
-  int i;
-  Dxf_Objs *found = NULL;
+  return obj ? obj->index + 2 : 1;
+}
+
+static Dxf_Objs *
+dxf_find_obj(const Dxf_Import *imp, const Dwg_Object *obj)
+{
+  uint32_t i;
+  if (!imp->objmap)
+    return NULL;
+  i = hash_get(imp->objmap, dxf_obj_key(obj));
+  return i == HASH_NOT_FOUND ? NULL : &imp->objs[i];
+}
+
+/* Adds the field to the fields of obj in the current import */
+void dxf_add_field(Dwg_Object *restrict obj, const char *restrict name,
+                   const char *restrict type, int dxf)
+{
+  Dxf_Import *imp = dxf_import;
+  Dxf_Objs *found;
+  uint32_t id;
 
-  // first search obj ptr in array
-  for (i=0; i<num_dxf_objs; i++)
+  if (!imp)
+    {
+      LOG_ERROR("%s: no DXF import", __FUNCTION__);
+      return;
+    }
+  found = dxf_find_obj(imp, obj);
+  if (!found) // new object (first field)
     {
-      if (dxf_objs[i].obj == obj)
+      if (!imp->objmap && !(imp->objmap = hash_new(1024)))
+        goto oom;
+      if (imp->num_objs >= imp->size_objs)
         {
-          found = &dxf_objs[i];
-          break;
+          uint32_t size = imp->size_objs ? 2 * imp->size_objs : 1024;
+          Dxf_Objs *objs = (Dxf_Objs *)dwg_realloc(imp->objs,
+                                                   size * sizeof(Dxf_Objs));
+          if (!objs)
+            goto oom;
+          imp->objs = objs;
+          imp->size_objs = size;
         }
+      found = &imp->objs[imp->num_objs];
+      memset(found, 0, sizeof(Dxf_Objs));
+      found->obj = obj;
+      hash_set(imp->objmap, dxf_obj_key(obj), imp->num_objs++);
+    }
+  if (found->num_fields >= found->size_fields)
+    {
+      uint32_t size = found->size_fields ? 2 * found->size_fields : 16;
+      uint32_t *fields = (uint32_t *)dwg_realloc(found->fields,
+                                                 size * sizeof(uint32_t));
+      if (!fields)
+        goto oom;
+      found->fields = fields;
+      found->size_fields = size;
     }
+  id = dxf_intern_field(imp, name, type, dxf);
+  if (id == (uint32_t)-1)
+    goto oom;
+  found->fields[found->num_fields++] = id;
+  return;
+
+ oom:
+  LOG_ERROR("Out of memory");
+}
+
+/* Searches the interned field by its name and dxf code, and then its id
+   in the fields of obj. A NULL type matches any type. */
+Dxf_Field* dxf_search_field(Dwg_Object *restrict obj, const char *restrict name,
+                            const char *restrict type, int dxf)
+{
+  const Dxf_Import *imp = dxf_import;
+  const Dxf_Objs *found;
+  uint32_t i, id;
+
+  if (!imp || !imp->fieldmap)
+    return NULL;
+  found = dxf_find_obj(imp, obj);
   if (!found)
     {
       LOG_ERROR("obj not found\n");
       return NULL;
     }
-  // then search field
-  for (i=0; i<found->num_fields; i++)
+  i = dxf_field_slot(imp, name, type, dxf);
+  if (!imp->fieldmap[i])
+    return NULL;
+  id = imp->fieldmap[i] - 1;
+  for (i = 0; i < found->num_fields; i++)
     {
-      if (!strcmp(found->fields[i].name, name))
-        return &found->fields[i];
+      if (found->fields[i] == id)
+        return &imp->fields[id];
     }
   return NULL;
 }
@@ -914,12 +1330,11 @@ dwg_indxf_object(Bit_Chain *restrict dat, Dwg_Object *restrict obj)
     return 0
 #define DXF_BREAK_ENDSEC \
   if (dat->byte >= dat->size || \
-      (pair->code == 0 && !strcmp(pair->value.s, "ENDSEC"))) \
+      (pair->code == 0 && dxf_is(pair, "ENDSEC"))) \
     break
 #define DXF_RETURN_ENDSEC(what) \
   if (dat->byte >= dat->size || \
-      (pair->code == 0 && !strcmp(pair->value.s, "ENDSEC"))) { \
-    dxf_free_pair(pair); \
+      (pair->code == 0 && dxf_is(pair, "ENDSEC"))) { \
     return what; \
   }
 
@@ -927,9 +1342,11 @@ static int dxf_expect_code(Bit_Chain *dat, Dxf_Pair *pair, int code)
 {
   while (pair->code != code)
     {
-      dxf_free_pair(pair);
-      pair = dxf_read_pair(dat);
-      dxf_skip_comment(dat, pair);
+      int error;
+      DXF_READ_PAIR;
+      error = dxf_skip_comment(dat, pair);
+      if (error > 1)
+        return error;
       DXF_CHECK_EOF;
       if (pair->code != code) {
         LOG_ERROR("Expecting DXF code %d, got %d (at %lu)",
@@ -947,53 +1364,81 @@ dxf_header_read(Bit_Chain *dat, Dwg_Data* dwg)
   const int minimal = dwg->opts & 0x10;
   double ms;
   char* codepage;
-  Dxf_Pair *pair = dxf_read_pair(dat);
+  Dxf_Pair _pair, *pair = &_pair;
+  int error = 0;
 
   // define fields (unordered)
+  // the spec stops at the first unknown or unread variable
+#undef ENDSEC
+#define ENDSEC() if (RECORD(ENDSEC)) return error
   #include "header_variables_dxf.spec"
+#undef ENDSEC
+#define ENDSEC() RECORD(ENDSEC)
 
-  while (pair->code != 0) {
-    pair = dxf_read_pair(dat);
+  // skip the rest
+  do {
+    if (dxf_read_pair(dat, pair))
+      {
+        DXF_BREAK_ENDSEC;
+        return DWG_ERR_INVALIDDWG;
+      }
     DXF_BREAK_ENDSEC;
 
     //TODO find name in header struct and set value
-
-    dxf_free_pair(pair);
-  }
-  dxf_free_pair(pair);
+  } while (pair->code != 0);
 
   // TODO: convert DWGCODEPAGE string to header.codepage number
-  if (!strcmp(_obj->DWGCODEPAGE, "ANSI_1252"))
+  if (_obj->DWGCODEPAGE && !strcmp(_obj->DWGCODEPAGE, "ANSI_1252"))
       dwg->header.codepage = 30;
 
-  return 0;
+  return error;
 }
 
 static int
 dxf_classes_read (Bit_Chain *dat, Dwg_Data * dwg)
 {
   BITCODE_BL i;
-  Dxf_Pair *pair = dxf_read_pair(dat);
+  Dxf_Pair _pair, *pair = &_pair;
   Dwg_Class *klass;
+  int error = 0;
 
+  if (dxf_read_pair(dat, pair))
+    {
+      DXF_RETURN_ENDSEC(0);
+      return DWG_ERR_CLASSESNOTFOUND;
+    }
   while (1) { // read next class
+    DXF_RETURN_ENDSEC(0); // next class or ENDSEC
+    if (pair->code != 0 || !dxf_is(pair, "CLASS")) { // or something else
+      LOG_ERROR("Unexpexted DXF %d %.*s at class[%d]", pair->code,
+                (int)pair->len, pair->s, dwg->num_classes);
+      return DWG_ERR_CLASSESNOTFOUND;
+    }
     // add class (see decode)
     i = dwg->num_classes;
     if (i == 0)
-      dwg->dwg_class = malloc(sizeof(Dwg_Class));
+      dwg->dwg_class = dwg_malloc(sizeof(Dwg_Class));
     else
-      dwg->dwg_class = realloc(dwg->dwg_class, (i + 1) * sizeof(Dwg_Class));
+      dwg->dwg_class = dwg_realloc(dwg->dwg_class, (i + 1) * sizeof(Dwg_Class));
     if (!dwg->dwg_class) { LOG_ERROR("Out of memory"); return DWG_ERR_OUTOFMEM; }
 
     klass = &dwg->dwg_class[i];
     memset(klass, 0, sizeof(Dwg_Class));
 
-    while (pair->code != 0) { // read until next 0 CLASS
-      pair = dxf_read_pair(dat);
+    // read until next 0 CLASS
+    while (1) {
+      if (dxf_read_pair(dat, pair))
+        {
+          dwg->num_classes++;
+          DXF_RETURN_ENDSEC(0);
+          return DWG_ERR_CLASSESNOTFOUND;
+        }
+      if (pair->code == 0)
+        break;
       switch (pair->code) {
-      case 1: STRADD(klass->dxfname, pair->value.s); break;
-      case 2: STRADD(klass->cppname, pair->value.s); break;
-      case 3: STRADD(klass->appname, pair->value.s); break;
+      case 1: STRADD(klass->dxfname, pair); break;
+      case 2: STRADD(klass->cppname, pair); break;
+      case 3: STRADD(klass->appname, pair); break;
       case 90: klass->proxyflag = pair->value.l; break;
       case 91: klass->num_instances = pair->value.l; break;
       case 280: klass->wasazombie = (BITCODE_B)pair->value.i; break;
@@ -1001,12 +1446,11 @@ dxf_classes_read (Bit_Chain *dat, Dwg_Data * dwg)
       default: LOG_WARN("Unknown DXF code for class[%d].%d", i, pair->code);
                break;
       }
-      dxf_free_pair(pair);
-    }
-    DXF_RETURN_ENDSEC(0); // next class or ENDSEC
-    if (strcmp(pair->value.s, "CLASS")) { // or something else
-      LOG_ERROR("Unexpexted DXF 0 %s at class[%d]", pair->value.s, i);
-      return DWG_ERR_CLASSESNOTFOUND;
+      if (error)
+        {
+          dwg->num_classes++;
+          return error;
+        }
     }
     dwg->num_classes++;
   }
@@ -1040,15 +1484,19 @@ dxf_blocks_read (Bit_Chain *restrict dat, Dwg_Data *restrict dwg)
 static int
 dxf_entities_read (Bit_Chain *restrict dat, Dwg_Data *restrict dwg)
 {
-  Dxf_Pair *pair;
+  Dxf_Pair _pair, *pair = &_pair;
   Dwg_Object *obj = NULL;
   (void)dwg;
 
   SECTION(ENTITIES);
   while (dat->byte < dat->size) {
-    pair = dxf_read_pair(dat);
-    dxf_expect_code(dat, pair, 0);
+    int error;
+    DXF_READ_PAIR;
+    error = dxf_expect_code(dat, pair, 0);
+    if (error > 1)
+      return error;
     DXF_CHECK_EOF;
+    DXF_BREAK_ENDSEC;
     dwg_indxf_object(dat, obj); //TODO obj must be already created here
   }
   ENDSEC();
@@ -1058,15 +1506,19 @@ dxf_entities_read (Bit_Chain *restrict dat, Dwg_Data *restrict dwg)
 static int
 dxf_objects_read (Bit_Chain *restrict dat, Dwg_Data *restrict dwg)
 {
-  Dxf_Pair *pair;
+  Dxf_Pair _pair, *pair = &_pair;
   Dwg_Object *obj = NULL;
   (void)dwg;
 
   SECTION(OBJECTS);
   while (dat->byte < dat->size) {
-    pair = dxf_read_pair(dat);
-    dxf_expect_code(dat, pair, 0);
+    int error;
+    DXF_READ_PAIR;
+    error = dxf_expect_code(dat, pair, 0);
+    if (error > 1)
+      return error;
     DXF_CHECK_EOF;
+    DXF_BREAK_ENDSEC;
     dwg_indxf_object(dat, obj); //TODO obj must be already created here
   }
   ENDSEC();
@@ -1088,63 +1540,71 @@ int
 dwg_read_dxf(Bit_Chain *restrict dat, Dwg_Data *restrict dwg)
 {
   const int minimal = dwg->opts & 0x10;
-  Dxf_Pair *pair;
+  Dxf_Pair _pair, *pair = &_pair;
+  Dxf_Import imp;
+  int error = 0, ret;
+  Dwg_Thread_State state;
   //warn if minimal != 0
   //struct Dwg_Header *obj = &dwg->header;
-  loglevel = dwg->opts & 0xf;
-
-  num_dxf_objs = 0;
-  size_dxf_objs = 1000;
-  dxf_objs = malloc(1000*sizeof(Dxf_Objs));
+  loglevel = dwg_log_enter(dwg, &state);
 
+  dxf_import_init(&imp);
+  dxf_import = &imp;
   while (dat->byte < dat->size) {
-    pair = dxf_read_pair(dat);
-    dxf_expect_code(dat, pair, 0);
-    DXF_CHECK_EOF;
-    if (!strcmp(pair->value.s, "SECTION"))
+    if (dxf_read_pair(dat, pair))
       {
-        dxf_free_pair(pair);
-        pair = dxf_read_pair(dat);
-        dxf_expect_code(dat, pair, 2);
-        DXF_CHECK_EOF;
-        if (!strcmp(pair->value.s, "HEADER"))
-          {
-            dxf_free_pair(pair);
-            dxf_header_read (dat, dwg);
-          }
-        else if (!strcmp(pair->value.s, "CLASSES"))
-          {
-            dxf_free_pair(pair);
-            dxf_classes_read (dat, dwg);
-          }
-        else if (!strcmp(pair->value.s, "TABLES"))
-          {
-            dxf_free_pair(pair);
-            dxf_tables_read (dat, dwg);
-          }
-        else if (!strcmp(pair->value.s, "BLOCKS"))
-          {
-            dxf_free_pair(pair);
-            dxf_blocks_read (dat, dwg);
-          }
-        else if (!strcmp(pair->value.s, "ENTITIES"))
-          {
-            dxf_free_pair(pair);
-            dxf_entities_read (dat, dwg);
-          }
-        else if (!strcmp(pair->value.s, "OBJECTS"))
+        if (dat->byte < dat->size) // not at EOF
+          error |= DWG_ERR_INVALIDDWG;
+        break;
+      }
+    // the readers return 1 at EOF
+    if ((ret = dxf_expect_code(dat, pair, 0)) > 1)
+      {
+        error |= ret;
+        break;
+      }
+    if (dat->byte >= dat->size || (pair->code == 0 && dxf_is(pair, "EOF")))
+      break;
+    if (dxf_is(pair, "SECTION"))
+      {
+        if (dxf_read_pair(dat, pair))
           {
-            dxf_free_pair(pair);
-            dxf_objects_read (dat, dwg);
+            if (dat->byte < dat->size)
+              error |= DWG_ERR_INVALIDDWG;
+            break;
           }
-        if (!strcmp(pair->value.s, "THUMBNAIL"))
+        if ((ret = dxf_expect_code(dat, pair, 2)) > 1)
           {
-            dxf_free_pair(pair);
-            dxf_preview_read (dat, dwg);
+            error |= ret;
+            break;
           }
+        if (dat->byte >= dat->size)
+          break;
+        ret = 0;
+        if (dxf_is(pair, "HEADER"))
+          ret = dxf_header_read (dat, dwg);
+        else if (dxf_is(pair, "CLASSES"))
+          ret = dxf_classes_read (dat, dwg);
+        else if (dxf_is(pair, "TABLES"))
+          ret = dxf_tables_read (dat, dwg);
+        else if (dxf_is(pair, "BLOCKS"))
+          ret = dxf_blocks_read (dat, dwg);
+        else if (dxf_is(pair, "ENTITIES"))
+          ret = dxf_entities_read (dat, dwg);
+        else if (dxf_is(pair, "OBJECTS"))
+          ret = dxf_objects_read (dat, dwg);
+        else if (dxf_is(pair, "THUMBNAILIMAGE"))
+          ret = dxf_preview_read (dat, dwg);
+        if (ret > 1)
+          error |= ret;
+        if (error >= DWG_ERR_CRITICAL)
+          break;
       }
   }
-  return dwg->num_objects ? 1 : 0;
+  dxf_import = NULL;
+  dxf_import_free(&imp);
+  dwg_log_leave(&state);
+  return error;
 }
 
 #undef IS_ENCODE
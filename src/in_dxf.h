@@ -20,22 +20,38 @@
 
 #include "dwg.h"
 #include "bits.h"
+#include "hash.h"
 
-// global array of [obj -> [fields], ...]
+// a field, interned by name and dxf code
 typedef struct _dxf_field {
   char *name;
   char *type;
   int dxf;
 } Dxf_Field;
 
-// to search obj ptr in array
+// the fields of an object, as ids into Dxf_Import.fields
 typedef struct _dxf_objs {
   Dwg_Object *obj;
-  int num_fields;
-  int size_fields;
-  Dxf_Field *fields;
+  uint32_t num_fields;
+  uint32_t size_fields;
+  uint32_t *fields;
 } Dxf_Objs;
 
+// the state of one import, current per thread
+typedef struct _dxf_import {
+  dwg_inthash *objmap; // obj index + 2, or 1 for the header -> objs[]
+  Dxf_Objs *objs;
+  uint32_t num_objs;
+  uint32_t size_objs;
+  Dxf_Field *fields;   // interned
+  uint32_t num_fields;
+  uint32_t size_fields;
+  uint32_t *fieldmap;  // open addressing, field id + 1
+  uint32_t size_fieldmap;
+} Dxf_Import;
+
+void dxf_import_init(Dxf_Import *imp);
+void dxf_import_free(Dxf_Import *imp);
 void dxf_add_field(Dwg_Object *restrict obj, const char *restrict name,
                    const char *restrict type, int dxf);
 Dxf_Field* dxf_search_field(Dwg_Object *restrict obj, const char *restrict name,
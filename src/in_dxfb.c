@@ -33,8 +33,8 @@
 #include "logging.h"
 
 /* the current version per spec block */
-static unsigned int cur_ver = 0;
-static char buf[4096];
+static THREAD_LOCAL unsigned int cur_ver = 0;
+static THREAD_LOCAL char buf[4096];
 
 /*--------------------------------------------------------------------------------
  * MACROS
@@ -0,0 +1,165 @@
+/*****************************************************************************/
+/*  LibreDWG - free implementation of the DWG file format                    */
+/*                                                                           */
+/*  Copyright (C) 2018 Free Software Foundation, Inc.                        */
+/*                                                                           */
+/*  This library is free software, licensed under the terms of the GNU       */
+/*  General Public License as published by the Free Software Foundation,     */
+/*  either version 3 of the License, or (at your option) any later version.  */
+/*  You should have received a copy of the GNU General Public License        */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.    */
+/*****************************************************************************/
+
+/*
+ * logging.c: per-thread buffered log output.
+ *         A message is often written by several LOG_* calls, so each
+ *         thread collects its output up to the last newline and writes
+ *         it at once to the log callback of its Dwg_Data, or to stderr.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "common.h"
+#include "dwg.h"
+#include "logging.h"
+
+#define LOG_BUFSIZE 4096
+
+struct _log_sink
+{
+  Dwg_Log_Callback callback;
+  void *data;
+  FILE *fp;
+  size_t len;
+  char buf[LOG_BUFSIZE];
+};
+static THREAD_LOCAL struct _log_sink sink;
+
+static void
+log_write(const char *msg, size_t len)
+{
+  if (!len)
+    return;
+  if (sink.callback)
+    sink.callback(sink.data, msg, len);
+  else
+    fwrite(msg, 1, len, sink.fp ? sink.fp : stderr);
+}
+
+/* Write the buffered lines, and keep the last unfinished one */
+static void
+log_lines(void)
+{
+  size_t i = sink.len;
+  while (i > 0 && sink.buf[i - 1] != '\n')
+    i--;
+  if (i)
+    {
+      log_write(sink.buf, i);
+      sink.len -= i;
+      memmove(sink.buf, &sink.buf[i], sink.len);
+    }
+}
+
+/* Write all, also an unfinished line */
+void
+dwg_log_flush(void)
+{
+  log_write(sink.buf, sink.len);
+  sink.len = 0;
+}
+
+int
+dwg_log_printf(FILE *fp, const char *fmt, ...)
+{
+  va_list ap;
+  int len;
+
+  if (fp != sink.fp)
+    {
+      dwg_log_flush();
+      sink.fp = fp;
+    }
+  va_start(ap, fmt);
+  len = vsnprintf(&sink.buf[sink.len], LOG_BUFSIZE - sink.len, fmt, ap);
+  va_end(ap);
+  if (len < 0)
+    return len;
+  if ((size_t)len < LOG_BUFSIZE - sink.len)
+    {
+      sink.len += len;
+      log_lines();
+      return len;
+    }
+  // too long for the rest of the buffer: write it separately
+  dwg_log_flush();
+  if ((size_t)len < LOG_BUFSIZE)
+    {
+      va_start(ap, fmt);
+      vsnprintf(sink.buf, LOG_BUFSIZE, fmt, ap);
+      va_end(ap);
+      sink.len = len;
+      log_lines();
+    }
+  else
+    {
+      char *s = (char *) malloc(len + 1);
+      if (!s)
+        return -1;
+      va_start(ap, fmt);
+      vsnprintf(s, len + 1, fmt, ap);
+      va_end(ap);
+      log_write(s, len);
+      free(s);
+    }
+  return len;
+}
+
+unsigned int
+dwg_log_init(const Dwg_Data *dwg)
+{
+  unsigned int level = dwg->opts & 0xf;
+#ifdef USE_TRACING
+  char *probe = getenv ("LIBREDWG_TRACE");
+  if (probe)
+    level = atoi (probe);
+#endif  /* USE_TRACING */
+
+  if (sink.callback != dwg->log_callback || sink.data != dwg->log_data)
+    {
+      dwg_log_flush();
+      sink.callback = dwg->log_callback;
+      sink.data = dwg->log_data;
+    }
+  dwg_alloc_init(dwg);
+  return level;
+}
+
+unsigned int
+dwg_log_enter(const Dwg_Data *dwg, Dwg_Thread_State *saved)
+{
+  saved->callback = sink.callback;
+  saved->data = sink.data;
+  dwg_alloc_enter(dwg, &saved->allocator);
+  return dwg_log_init(dwg);
+}
+
+void
+dwg_log_leave(const Dwg_Thread_State *saved)
+{
+  dwg_log_flush();
+  sink.callback = saved->callback;
+  sink.data = saved->data;
+  dwg_alloc_leave(&saved->allocator);
+}
+
+void
+dwg_set_log_callback(Dwg_Data *dwg, Dwg_Log_Callback callback, void *data)
+{
+  dwg->log_callback = callback;
+  dwg->log_data = data;
+}
@@ -24,6 +24,8 @@
 
 #include <stdio.h>
 #include <string.h>
+#include "common.h"
+#include "dwg.h"
 
 /*
  * If more logging levels are necessary, put them in the right place and
@@ -45,11 +47,48 @@
 # define DWG_LOGLEVEL DWG_LOGLEVEL_ERROR
 #endif
 
-#define HANDLER fprintf
+/* The highest level compiled in. With --disable-trace-logging only errors
+   and warnings are left, all other LOG_* calls are dead code. */
+#ifndef DWG_LOGLEVEL_MAX
+# ifdef DISABLE_TRACE_LOGGING
+#  define DWG_LOGLEVEL_MAX DWG_LOGLEVEL_ERROR
+# else
+#  define DWG_LOGLEVEL_MAX DWG_LOGLEVEL_ALL
+# endif
+#endif
+#define LOG_ENABLED(level) \
+  (DWG_LOGLEVEL_##level <= DWG_LOGLEVEL_MAX \
+   && DWG_LOGLEVEL >= DWG_LOGLEVEL_##level)
+
+/* Each thread buffers its log output up to the last newline, and passes
+   it on to the log callback of the current Dwg_Data or OUTPUT. See logging.c */
+EXPORT int dwg_log_printf (FILE *fp, const char *fmt, ...)
+#ifdef __GNUC__
+  __attribute__ ((format (printf, 2, 3)))
+#endif
+  ;
+EXPORT void dwg_log_flush (void);
+/* Set the sink and the allocator of the calling thread, and return the
+   loglevel of dwg */
+EXPORT unsigned int dwg_log_init (const Dwg_Data *dwg);
+/* The sink and the allocator of the calling thread before an API call.
+   dwg_log_enter() saves them and calls dwg_log_init(), dwg_log_leave()
+   flushes and restores them. */
+typedef struct _dwg_thread_state
+{
+  Dwg_Log_Callback callback;
+  void *data;
+  Dwg_Allocator allocator;
+} Dwg_Thread_State;
+EXPORT unsigned int dwg_log_enter (const Dwg_Data *dwg,
+                                  Dwg_Thread_State *saved);
+EXPORT void dwg_log_leave (const Dwg_Thread_State *saved);
+
+#define HANDLER dwg_log_printf
 #define OUTPUT stderr
 
 #define LOG(level, args...) \
-          if (DWG_LOGLEVEL >= DWG_LOGLEVEL_##level) { \
+          if (LOG_ENABLED(level)) { \
             HANDLER(OUTPUT, args); \
           }
 
@@ -88,7 +127,7 @@
    LOG_TEXT_UNICODE(TRACE, (BITCODE_TU)wstr) \
    LOG_TRACE("\" [TU %d]\n", dxf)
 # define LOG_TEXT_UNICODE(level, wstr) \
-  if (DWG_LOGLEVEL >= DWG_LOGLEVEL_##level && wstr) { \
+  if (LOG_ENABLED(level) && wstr) { \
     BITCODE_TU ws = wstr;                             \
     uint16_t _c;                                      \
     while ((_c = *ws++)) {                            \
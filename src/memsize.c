@@ -0,0 +1,859 @@
+/*****************************************************************************/
+/*  LibreDWG - free implementation of the DWG file format                    */
+/*                                                                           */
+/*  Copyright (C) 2018 Free Software Foundation, Inc.                        */
+/*                                                                           */
+/*  This library is free software, licensed under the terms of the GNU       */
+/*  General Public License as published by the Free Software Foundation,     */
+/*  either version 3 of the License, or (at your option) any later version.  */
+/*  You should have received a copy of the GNU General Public License        */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.    */
+/*****************************************************************************/
+
+/*
+ * memsize.c: the heap memory held by a Dwg_Data, see dwg_memory_usage().
+ *            Walks the spec fields like free.c, counting instead of freeing.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "common.h"
+#include "bits.h"
+#include "dwg.h"
+#include "decode.h"
+#include "hash.h"
+
+static THREAD_LOCAL unsigned int loglevel;
+#define DWG_LOGLEVEL loglevel
+#include "logging.h"
+
+/* the current version per spec block */
+static THREAD_LOCAL unsigned int cur_ver = 0;
+
+/* the bytes and string bytes of the current object */
+static THREAD_LOCAL BITCODE_RLL mem_bytes;
+static THREAD_LOCAL BITCODE_RLL mem_strings;
+
+/*--------------------------------------------------------------------------------
+ * MACROS
+ */
+
+#define ACTION memsize
+#define IS_MEMSIZE
+
+#define MEM_ADD(size) mem_bytes += (BITCODE_RLL)(size)
+#define MEM_STRING(size) \
+  { mem_bytes += (BITCODE_RLL)(size); mem_strings += (BITCODE_RLL)(size); }
+
+#define VALUE(value,type,dxf)
+#define VALUE_RC(value,dxf) VALUE(value, RC, dxf)
+#define VALUE_RS(value,dxf) VALUE(value, RS, dxf)
+#define VALUE_RL(value,dxf) VALUE(value, RL, dxf)
+#define VALUE_RD(value,dxf) VALUE(value, RD, dxf)
+
+#define FIELD(name,type) {}
+#define FIELD_TRACE(name,type) \
+  LOG_TRACE(#name ": " FORMAT_##type "\n", _obj->name)
+#define FIELD_CAST(name,type,cast,dxf) {}
+#define FIELD_VALUE(name) _obj->name
+
+#define ANYCODE -1
+#define FIELD_HANDLE(name,code,dxf) VALUE_HANDLE(_obj->name,code,dxf)
+/* as in free.c, all other refs are counted with dwg->object_ref */
+#define VALUE_HANDLE(ref,code,dxf) \
+  if (ref && !ref->obj && !ref->handleref.size && !ref->absolute_ref) \
+    MEM_ADD(sizeof(Dwg_Object_Ref));
+#define FIELD_DATAHANDLE(name,code,dxf) FIELD_HANDLE(name, code, dxf)
+#define FIELD_HANDLE_N(name,vcount,code,dxf) FIELD_HANDLE(name, code, dxf)
+
+#define FIELD_B(name,dxf) FIELD(name, B)
+#define FIELD_BB(name,dxf) FIELD(name, BB)
+#define FIELD_3B(name,dxf) FIELD(name, 3B)
+#define FIELD_BS(name,dxf) FIELD(name, BS)
+#define FIELD_BL(name,dxf) FIELD(name, BL)
+#define FIELD_BLL(name,dxf) FIELD(name, BLL)
+#define FIELD_BD(name,dxf) FIELD(name, BD)
+#define FIELD_RC(name,dxf) FIELD(name, RC)
+#define FIELD_RS(name,dxf) FIELD(name, RS)
+#define FIELD_RD(name,dxf) FIELD(name, RD)
+#define FIELD_RL(name,dxf) FIELD(name, RL)
+#define FIELD_RLL(name,dxf) FIELD(name, RLL)
+#define FIELD_MC(name,dxf) FIELD(name, MC)
+#define FIELD_MS(name,dxf) FIELD(name, MS)
+#define VALUE_TV(value,dxf) \
+  if (value) MEM_STRING(strlen((const char *)value) + 1)
+#define VALUE_TU(value,dxf) \
+  if (value) MEM_STRING(2 * (tu_length((BITCODE_TU)value) + 1))
+#define VALUE_TF(value,dxf) {}
+#define VALUE_TFF(value,dxf)
+#define FIELD_TV(name,dxf) VALUE_TV(_obj->name, dxf)
+#define FIELD_TU(name,dxf) VALUE_TU(_obj->name, dxf)
+#define FIELD_T(name,dxf) \
+  { if (dat->version >= R_2007) { FIELD_TU(name, dxf) } \
+    else { FIELD_TV(name, dxf) } }
+/* fixed text and binary chunks, not counted as strings */
+#define FIELD_TF(name,len,dxf) \
+  if (_obj->name) MEM_ADD((len) + 1);
+#define FIELD_TFF(name,len,dxf) {}
+#define FIELD_BT(name,dxf) FIELD(name, BT);
+#define FIELD_4BITS(name,dxf) {}
+#define FIELD_BE(name,dxf) {}
+#define FIELD_DD(name, _default, dxf) {}
+#define FIELD_2DD(name, d1, d2, dxf) {}
+#define FIELD_3DD(name, def, dxf) {}
+#define FIELD_2RD(name,dxf) {}
+#define FIELD_2BD(name,dxf) {}
+#define FIELD_2BD_1(name,dxf) {}
+#define FIELD_3RD(name,dxf) {}
+#define FIELD_3BD(name,dxf) {}
+#define FIELD_3BD_1(name,dxf) {}
+#define FIELD_3DPOINT(name,dxf) {}
+#define FIELD_TIMEBLL(name,dxf)
+#define FIELD_CMC(color,dxf1,dxf2) \
+  { FIELD_TV(color.name, 0); \
+    FIELD_TV(color.book_name, 0); }
+
+#define FIELD_VECTOR_N(name, type, size, dxf) \
+  if ((size) && _obj->name) { \
+    MEM_ADD((BITCODE_RLL)(size) * sizeof(*_obj->name)); \
+    for (vcount=0; vcount < (BITCODE_BL)(size); vcount++) \
+      FIELD_##type(name[vcount], dxf); \
+  }
+#define FIELD_VECTOR_T(name, size, dxf) FIELD_VECTOR_N(name, T, _obj->size, dxf)
+#define FIELD_VECTOR(name, type, size, dxf) FIELD_VECTOR_N(name, type, _obj->size, dxf)
+#define FIELD_2RD_VECTOR(name, size, dxf) \
+  if (_obj->name) MEM_ADD((BITCODE_RLL)_obj->size * sizeof(*_obj->name));
+#define FIELD_2DD_VECTOR(name, size, dxf) FIELD_2RD_VECTOR(name, size, dxf)
+#define FIELD_3DPOINT_VECTOR(name, size, dxf) FIELD_2RD_VECTOR(name, size, dxf)
+#define HANDLE_VECTOR_N(name, size, code, dxf) \
+  if (_obj->name) { \
+    MEM_ADD((BITCODE_RLL)(size) * sizeof(BITCODE_H)); \
+    for (vcount=0; vcount < (BITCODE_BL)(size); vcount++) \
+      { \
+        FIELD_HANDLE_N(name[vcount], vcount, code, dxf); \
+      } \
+  }
+#define HANDLE_VECTOR(name, sizefield, code, dxf) \
+  HANDLE_VECTOR_N(name, FIELD_VALUE(sizefield), code, dxf)
+
+#define FIELD_NUM_INSERTS(num_inserts, type, dxf)
+#define FIELD_XDATA(name, size) \
+  memsize_xdata(dat, _obj->name)
+
+#define REACTORS(code) \
+  if (obj->tio.object->reactors) { \
+    MEM_ADD((BITCODE_RLL)obj->tio.object->num_reactors * sizeof(BITCODE_H)); \
+    for (vcount=0; vcount < obj->tio.object->num_reactors; vcount++) \
+      VALUE_HANDLE(obj->tio.object->reactors[vcount], code, 330); \
+  }
+#define ENT_REACTORS(code) \
+  if (ent->reactors) { \
+    MEM_ADD((BITCODE_RLL)ent->num_reactors * sizeof(BITCODE_H)); \
+    for (vcount=0; vcount < ent->num_reactors; vcount++) \
+      VALUE_HANDLE(ent->reactors[vcount], code, 330); \
+  }
+#define XDICOBJHANDLE(code) \
+  VALUE_HANDLE(obj->tio.object->xdicobjhandle, code, 0)
+#define ENT_XDICOBJHANDLE(code) \
+  VALUE_HANDLE(ent->xdicobjhandle, code, 0)
+
+/* The decoder allocates times elements of type */
+#define REPEAT_CN(times, name, type) \
+  if (_obj->name && (MEM_ADD((BITCODE_RLL)(times) * sizeof(type)), 1)) \
+    for (rcount1=0; rcount1<(BITCODE_BL)(times); rcount1++)
+#define REPEAT_N(times, name, type) REPEAT_CN(times, name, type)
+#define _REPEAT_N(times, name, type, idx) \
+  if (_obj->name && (MEM_ADD((BITCODE_RLL)(times) * sizeof(type)), 1)) \
+    for (rcount##idx=0; rcount##idx<(BITCODE_BL)(times); rcount##idx++)
+#define _REPEAT(times, name, type, idx) \
+  _REPEAT_N(_obj->times, name, type, idx)
+#define _REPEAT_C(times, name, type, idx) _REPEAT(times, name, type, idx)
+#define REPEAT(times, name, type)  _REPEAT(times, name, type, 1)
+#define REPEAT2(times, name, type) _REPEAT(times, name, type, 2)
+#define REPEAT3(times, name, type) _REPEAT(times, name, type, 3)
+#define REPEAT4(times, name, type) _REPEAT(times, name, type, 4)
+#define REPEAT_C(times, name, type)  _REPEAT_C(times, name, type, 1)
+#define REPEAT2_C(times, name, type) _REPEAT_C(times, name, type, 2)
+#define REPEAT3_C(times, name, type) _REPEAT_C(times, name, type, 3)
+#define REPEAT4_C(times, name, type) _REPEAT_C(times, name, type, 4)
+
+#define COMMON_ENTITY_HANDLE_DATA \
+  SINCE(R_13) {\
+    memsize_common_entity_handle_data(dat, obj); \
+  }
+#define SECTION_STRING_STREAM
+#define START_STRING_STREAM
+#define END_STRING_STREAM
+#define START_HANDLE_STREAM
+
+static int dwg_memsize_UNKNOWN_ENT (Bit_Chain *restrict dat, Dwg_Object *restrict obj);
+static int dwg_memsize_UNKNOWN_OBJ (Bit_Chain *restrict dat, Dwg_Object *restrict obj);
+
+#define DWG_ENTITY(token) \
+static int \
+dwg_memsize_ ##token (Bit_Chain *restrict dat, Dwg_Object *restrict obj)\
+{\
+  BITCODE_BL vcount, rcount1, rcount2, rcount3, rcount4;\
+  Dwg_Entity_##token *ent, *_obj;\
+  Dwg_Object_Entity *_ent;\
+  Bit_Chain *hdl_dat = dat;\
+  Bit_Chain* str_dat = dat;\
+  Dwg_Data* dwg = obj->parent;\
+  int error = 0; \
+  _ent = obj->tio.entity;\
+  MEM_ADD(sizeof(Dwg_Object_Entity)); \
+  _obj = ent = _ent->tio.token;\
+  if (!_obj) return 0; \
+  MEM_ADD(sizeof(Dwg_Entity_##token));
+
+#define DWG_ENTITY_END      \
+  memsize_common_entity_data(dat, obj); \
+  memsize_eed(obj);         \
+  return 0;                 \
+}
+
+#define DWG_OBJECT(token) \
+static int \
+dwg_memsize_ ##token (Bit_Chain *restrict dat, Dwg_Object *restrict obj) \
+{ \
+  BITCODE_BL vcount, rcount1, rcount2, rcount3, rcount4; \
+  Dwg_Object_##token *_obj;                      \
+  Bit_Chain *hdl_dat = dat;                      \
+  Bit_Chain* str_dat = dat;                      \
+  Dwg_Data* dwg = obj->parent;                   \
+  int error = 0; \
+  if (strcmp(#token, "UNKNOWN_OBJ") && obj->supertype == DWG_SUPERTYPE_UNKNOWN) \
+    return dwg_memsize_UNKNOWN_OBJ(dat, obj); \
+  MEM_ADD(sizeof(Dwg_Object_Object)); \
+  _obj = obj->tio.object->tio.token; \
+  if (!_obj) return 0; \
+  MEM_ADD(sizeof(Dwg_Object_##token));
+
+#define DWG_OBJECT_END       \
+  memsize_eed(obj);          \
+  return 0;                  \
+}
+
+static size_t
+tu_length(const BITCODE_TU wstr)
+{
+  size_t len = 0;
+  while (wstr[len])
+    len++;
+  return len;
+}
+
+static void
+memsize_common_entity_handle_data(Bit_Chain *restrict dat, Dwg_Object *obj)
+{
+  Dwg_Data *dwg = obj->parent;
+  Dwg_Object_Entity *_obj;
+  BITCODE_BL vcount;
+  Dwg_Object_Entity *ent;
+  int error = 0;
+
+  ent = obj->tio.entity;
+  _obj = ent;
+
+  #include "common_entity_handle_data.spec"
+}
+
+static void
+memsize_common_entity_data(Bit_Chain *restrict dat, Dwg_Object *obj)
+{
+  Dwg_Data *dwg = obj->parent;
+  Dwg_Object_Entity *_obj;
+  Dwg_Object_Entity *ent;
+  Bit_Chain *hdl_dat = NULL;
+  BITCODE_BL vcount;
+  int error = 0;
+
+  ent = obj->tio.entity;
+  _obj = ent;
+
+  #include "common_entity_data.spec"
+}
+
+/* see dwg_decode_xdata */
+static void
+memsize_xdata(Bit_Chain *restrict dat, const Dwg_Resbuf *rbuf)
+{
+  enum RES_BUF_VALUE_TYPE type;
+  for (; rbuf; rbuf = rbuf->next)
+    {
+      MEM_ADD(sizeof(Dwg_Resbuf));
+      if (!rbuf->value.str.u.data)
+        continue;
+      type = get_base_value_type(rbuf->type);
+      if (type == VT_STRING && dat->version >= R_2007)
+        MEM_STRING(2 * (rbuf->value.str.size + 1))
+      else if (type == VT_STRING)
+        MEM_STRING(rbuf->value.str.size + 1)
+      else if (type == VT_BINARY)
+        MEM_ADD(rbuf->value.str.size + 1);
+    }
+}
+
+/* see dwg_free_eed */
+static void
+memsize_eed(const Dwg_Object *obj)
+{
+  BITCODE_BL i, num_eed;
+  const Dwg_Eed *eed;
+
+  if (obj->supertype == DWG_SUPERTYPE_ENTITY)
+    {
+      num_eed = obj->tio.entity->num_eed;
+      eed = obj->tio.entity->eed;
+    }
+  else
+    {
+      num_eed = obj->tio.object->num_eed;
+      eed = obj->tio.object->eed;
+    }
+  if (!eed)
+    return;
+  MEM_ADD((BITCODE_RLL)num_eed * sizeof(Dwg_Eed));
+  for (i = 0; i < num_eed; i++)
+    {
+      if (eed[i].size && eed[i].raw)
+        MEM_ADD(eed[i].size + 1);
+      if (eed[i].data) // at least, allocated with the remaining size
+        MEM_ADD(eed[i].size + 8);
+    }
+}
+
+#include "dwg.spec"
+
+/* The ACIS data is only walked by the decoder, see free_3dsolid */
+static void
+memsize_3dsolid(const Dwg_Entity_3DSOLID *_obj)
+{
+  BITCODE_BL i;
+
+  if (_obj->encr_sat_data)
+    {
+      MEM_ADD((BITCODE_RLL)(_obj->num_blocks + 1) * sizeof(BITCODE_RC*));
+      for (i = 0; i < _obj->num_blocks; i++)
+        if (_obj->encr_sat_data[i] && _obj->block_size)
+          MEM_ADD(_obj->block_size[i] + 1);
+    }
+  if (_obj->block_size)
+    MEM_ADD((BITCODE_RLL)(_obj->num_blocks + 1) * sizeof(BITCODE_BL));
+  if (_obj->acis_data)
+    MEM_ADD(strlen((const char *)_obj->acis_data) + 1);
+  if (_obj->wires)
+    MEM_ADD((BITCODE_RLL)_obj->num_wires * sizeof(Dwg_3DSOLID_wire));
+  if (_obj->silhouettes)
+    {
+      MEM_ADD((BITCODE_RLL)_obj->num_silhouettes
+              * sizeof(Dwg_3DSOLID_silhouette));
+      for (i = 0; i < _obj->num_silhouettes; i++)
+        if (_obj->silhouettes[i].wires)
+          MEM_ADD((BITCODE_RLL)_obj->silhouettes[i].num_wires
+                  * sizeof(Dwg_3DSOLID_wire));
+    }
+}
+
+static int
+dwg_memsize_variable_type(Dwg_Data *restrict dwg, Bit_Chain *restrict dat,
+                          Dwg_Object *restrict obj)
+{
+  int i;
+  int is_entity;
+  Dwg_Class *klass;
+
+  i = obj->type - 500;
+  if (i < 0 || i >= (int)dwg->num_classes)
+    return DWG_ERR_INVALIDTYPE;
+
+  klass = &dwg->dwg_class[i];
+  if (!klass || !klass->dxfname)
+    return DWG_ERR_INTERNALERROR;
+  is_entity = dwg_class_is_entity(klass);
+
+  #include "classes.inc"
+
+  return DWG_ERR_UNHANDLEDCLASS;
+}
+
+/* Adds the bytes of obj to mem_bytes and mem_strings, as dwg_free_object
+   would free them. */
+static void
+dwg_memsize_object(Bit_Chain *restrict dat, Dwg_Object *restrict obj)
+{
+  int error;
+
+  if (obj->type == DWG_TYPE_FREED || !obj->tio.object)
+    return;
+  if (obj->unknown_bits)
+    MEM_ADD((obj->num_unknown_bits + 7) / 8 + 1);
+  if (obj->supertype == DWG_SUPERTYPE_UNKNOWN)
+    goto unhandled;
+
+  switch (obj->type)
+    {
+    case DWG_TYPE_TEXT:
+      dwg_memsize_TEXT(dat, obj);
+      break;
+    case DWG_TYPE_ATTRIB:
+      dwg_memsize_ATTRIB(dat, obj);
+      break;
+    case DWG_TYPE_ATTDEF:
+      dwg_memsize_ATTDEF(dat, obj);
+      break;
+    case DWG_TYPE_BLOCK:
+      dwg_memsize_BLOCK(dat, obj);
+      break;
+    case DWG_TYPE_ENDBLK:
+      dwg_memsize_ENDBLK(dat, obj);
+      break;
+    case DWG_TYPE_SEQEND:
+      dwg_memsize_SEQEND(dat, obj);
+      break;
+    case DWG_TYPE_INSERT:
+      dwg_memsize_INSERT(dat, obj);
+      break;
+    case DWG_TYPE_MINSERT:
+      dwg_memsize_MINSERT(dat, obj);
+      break;
+    case DWG_TYPE_VERTEX_2D:
+      dwg_memsize_VERTEX_2D(dat, obj);
+      break;
+    case DWG_TYPE_VERTEX_3D:
+      dwg_memsize_VERTEX_3D(dat, obj);
+      break;
+    case DWG_TYPE_VERTEX_MESH:
+      dwg_memsize_VERTEX_MESH(dat, obj);
+      break;
+    case DWG_TYPE_VERTEX_PFACE:
+      dwg_memsize_VERTEX_PFACE(dat, obj);
+      break;
+    case DWG_TYPE_VERTEX_PFACE_FACE:
+      dwg_memsize_VERTEX_PFACE_FACE(dat, obj);
+      break;
+    case DWG_TYPE_POLYLINE_2D:
+      dwg_memsize_POLYLINE_2D(dat, obj);
+      break;
+    case DWG_TYPE_POLYLINE_3D:
+      dwg_memsize_POLYLINE_3D(dat, obj);
+      break;
+    case DWG_TYPE_ARC:
+      dwg_memsize_ARC(dat, obj);
+      break;
+    case DWG_TYPE_CIRCLE:
+      dwg_memsize_CIRCLE(dat, obj);
+      break;
+    case DWG_TYPE_LINE:
+      dwg_memsize_LINE(dat, obj);
+      break;
+    case DWG_TYPE_DIMENSION_ORDINATE:
+      dwg_memsize_DIMENSION_ORDINATE(dat, obj);
+      break;
+    case DWG_TYPE_DIMENSION_LINEAR:
+      dwg_memsize_DIMENSION_LINEAR(dat, obj);
+      break;
+    case DWG_TYPE_DIMENSION_ALIGNED:
+      dwg_memsize_DIMENSION_ALIGNED(dat, obj);
+      break;
+    case DWG_TYPE_DIMENSION_ANG3PT:
+      dwg_memsize_DIMENSION_ANG3PT(dat, obj);
+      break;
+    case DWG_TYPE_DIMENSION_ANG2LN:
+      dwg_memsize_DIMENSION_ANG2LN(dat, obj);
+      break;
+    case DWG_TYPE_DIMENSION_RADIUS:
+      dwg_memsize_DIMENSION_RADIUS(dat, obj);
+      break;
+    case DWG_TYPE_DIMENSION_DIAMETER:
+      dwg_memsize_DIMENSION_DIAMETER(dat, obj);
+      break;
+    case DWG_TYPE_POINT:
+      dwg_memsize_POINT(dat, obj);
+      break;
+    case DWG_TYPE__3DFACE:
+      dwg_memsize__3DFACE(dat, obj);
+      break;
+    case DWG_TYPE_POLYLINE_PFACE:
+      dwg_memsize_POLYLINE_PFACE(dat, obj);
+      break;
+    case DWG_TYPE_POLYLINE_MESH:
+      dwg_memsize_POLYLINE_MESH(dat, obj);
+      break;
+    case DWG_TYPE_SOLID:
+      dwg_memsize_SOLID(dat, obj);
+      break;
+    case DWG_TYPE_TRACE:
+      dwg_memsize_TRACE(dat, obj);
+      break;
+    case DWG_TYPE_SHAPE:
+      dwg_memsize_SHAPE(dat, obj);
+      break;
+    case DWG_TYPE_VIEWPORT:
+      dwg_memsize_VIEWPORT(dat, obj);
+      break;
+    case DWG_TYPE_ELLIPSE:
+      dwg_memsize_ELLIPSE(dat, obj);
+      break;
+    case DWG_TYPE_SPLINE:
+      dwg_memsize_SPLINE(dat, obj);
+      break;
+    case DWG_TYPE_REGION:
+      dwg_memsize_REGION(dat, obj);
+      if (obj->tio.entity->tio.REGION)
+        memsize_3dsolid(obj->tio.entity->tio.REGION);
+      break;
+    case DWG_TYPE__3DSOLID:
+      dwg_memsize__3DSOLID(dat, obj);
+      if (obj->tio.entity->tio._3DSOLID)
+        memsize_3dsolid(obj->tio.entity->tio._3DSOLID);
+      break;
+    case DWG_TYPE_BODY:
+      dwg_memsize_BODY(dat, obj);
+      if (obj->tio.entity->tio.BODY)
+        memsize_3dsolid(obj->tio.entity->tio.BODY);
+      break;
+    case DWG_TYPE_RAY:
+      dwg_memsize_RAY(dat, obj);
+      break;
+    case DWG_TYPE_XLINE:
+      dwg_memsize_XLINE(dat, obj);
+      break;
+    case DWG_TYPE_DICTIONARY:
+      dwg_memsize_DICTIONARY(dat, obj);
+      break;
+    case DWG_TYPE_MTEXT:
+      dwg_memsize_MTEXT(dat, obj);
+      break;
+    case DWG_TYPE_LEADER:
+      dwg_memsize_LEADER(dat, obj);
+      break;
+    case DWG_TYPE_TOLERANCE:
+      dwg_memsize_TOLERANCE(dat, obj);
+      break;
+    case DWG_TYPE_MLINE:
+      dwg_memsize_MLINE(dat, obj);
+      break;
+    case DWG_TYPE_BLOCK_CONTROL:
+      dwg_memsize_BLOCK_CONTROL(dat, obj);
+      break;
+    case DWG_TYPE_BLOCK_HEADER:
+      dwg_memsize_BLOCK_HEADER(dat, obj);
+      break;
+    case DWG_TYPE_LAYER_CONTROL:
+      dwg_memsize_LAYER_CONTROL(dat, obj);
+      break;
+    case DWG_TYPE_LAYER:
+      dwg_memsize_LAYER(dat, obj);
+      break;
+    case DWG_TYPE_STYLE_CONTROL:
+      dwg_memsize_STYLE_CONTROL(dat, obj);
+      break;
+    case DWG_TYPE_STYLE:
+      dwg_memsize_STYLE(dat, obj);
+      break;
+    case DWG_TYPE_LTYPE_CONTROL:
+      dwg_memsize_LTYPE_CONTROL(dat, obj);
+      break;
+    case DWG_TYPE_LTYPE:
+      dwg_memsize_LTYPE(dat, obj);
+      break;
+    case DWG_TYPE_VIEW_CONTROL:
+      dwg_memsize_VIEW_CONTROL(dat, obj);
+      break;
+    case DWG_TYPE_VIEW:
+      dwg_memsize_VIEW(dat, obj);
+      break;
+    case DWG_TYPE_UCS_CONTROL:
+      dwg_memsize_UCS_CONTROL(dat, obj);
+      break;
+    case DWG_TYPE_UCS:
+      dwg_memsize_UCS(dat, obj);
+      break;
+    case DWG_TYPE_VPORT_CONTROL:
+      dwg_memsize_VPORT_CONTROL(dat, obj);
+      break;
+    case DWG_TYPE_VPORT:
+      dwg_memsize_VPORT(dat, obj);
+      break;
+    case DWG_TYPE_APPID_CONTROL:
+      dwg_memsize_APPID_CONTROL(dat, obj);
+      break;
+    case DWG_TYPE_APPID:
+      dwg_memsize_APPID(dat, obj);
+      break;
+    case DWG_TYPE_DIMSTYLE_CONTROL:
+      dwg_memsize_DIMSTYLE_CONTROL(dat, obj);
+      break;
+    case DWG_TYPE_DIMSTYLE:
+      dwg_memsize_DIMSTYLE(dat, obj);
+      break;
+    case DWG_TYPE_VPORT_ENTITY_CONTROL:
+      dwg_memsize_VPORT_ENTITY_CONTROL(dat, obj);
+      break;
+    case DWG_TYPE_VPORT_ENTITY_HEADER:
+      dwg_memsize_VPORT_ENTITY_HEADER(dat, obj);
+      break;
+    case DWG_TYPE_GROUP:
+      dwg_memsize_GROUP(dat, obj);
+      break;
+    case DWG_TYPE_MLINESTYLE:
+      dwg_memsize_MLINESTYLE(dat, obj);
+      break;
+    case DWG_TYPE_OLE2FRAME:
+      dwg_memsize_OLE2FRAME(dat, obj);
+      break;
+    case DWG_TYPE_DUMMY:
+      dwg_memsize_DUMMY(dat, obj);
+      break;
+    case DWG_TYPE_LONG_TRANSACTION:
+      dwg_memsize_LONG_TRANSACTION(dat, obj);
+      break;
+    case DWG_TYPE_LWPOLYLINE:
+      dwg_memsize_LWPOLYLINE(dat, obj);
+      break;
+    case DWG_TYPE_HATCH:
+      dwg_memsize_HATCH(dat, obj);
+      break;
+    case DWG_TYPE_XRECORD:
+      dwg_memsize_XRECORD(dat, obj);
+      break;
+    case DWG_TYPE_PLACEHOLDER:
+      dwg_memsize_PLACEHOLDER(dat, obj);
+      break;
+    case DWG_TYPE_OLEFRAME:
+      dwg_memsize_OLEFRAME(dat, obj);
+      break;
+#ifdef DEBUG_VBA_PROJECT
+    case DWG_TYPE_VBA_PROJECT:
+      dwg_memsize_VBA_PROJECT(dat, obj);
+      break;
+#endif
+    case DWG_TYPE_LAYOUT:
+      dwg_memsize_LAYOUT(dat, obj);
+      break;
+    case DWG_TYPE_PROXY_ENTITY:
+      dwg_memsize_PROXY_ENTITY(dat, obj);
+      break;
+    case DWG_TYPE_PROXY_OBJECT:
+      dwg_memsize_PROXY_OBJECT(dat, obj);
+      break;
+    default:
+      if (obj->type == obj->parent->layout_number)
+        dwg_memsize_LAYOUT(dat, obj);
+      else if ((error = dwg_memsize_variable_type(obj->parent, dat, obj))
+               & DWG_ERR_UNHANDLEDCLASS)
+        {
+          Dwg_Data *dwg;
+          Dwg_Class *klass;
+          int i;
+
+        unhandled:
+          dwg = obj->parent;
+          i = obj->type - 500;
+          klass = NULL;
+          if (dwg->dwg_class && i >= 0 && i < (int)dwg->num_classes)
+            klass = &dwg->dwg_class[i];
+          if (klass && !dwg_class_is_entity(klass))
+            dwg_memsize_UNKNOWN_OBJ(dat, obj);
+          else if (klass)
+            dwg_memsize_UNKNOWN_ENT(dat, obj);
+        }
+    }
+}
+
+static void
+dwg_memsize_header_vars(Bit_Chain *restrict dat, Dwg_Data *restrict dwg)
+{
+  Dwg_Header_Variables *_obj = &dwg->header_vars;
+  Dwg_Object *obj = NULL;
+  int error = 0;
+
+  #include "header_variables.spec"
+}
+
+/* the bucket of obj in report->types */
+static BITCODE_BL
+memsize_type_index(const Dwg_Object *obj)
+{
+  if (obj->supertype == DWG_SUPERTYPE_UNKNOWN
+      || obj->fixedtype > DWG_TYPE_XREFPANELOBJECT)
+    return obj->fixedtype == DWG_TYPE_UNKNOWN_ENT
+      || obj->supertype == DWG_SUPERTYPE_ENTITY
+      ? DWG_MEMORY_NUM_TYPES - 2 : DWG_MEMORY_NUM_TYPES - 1;
+  return obj->fixedtype;
+}
+
+static int
+memsize_cmp(const void *a, const void *b)
+{
+  const BITCODE_RLL ba = ((const Dwg_Memory_Type *)a)->bytes;
+  const BITCODE_RLL bb = ((const Dwg_Memory_Type *)b)->bytes;
+  return ba < bb ? 1 : ba > bb ? -1 : 0;
+}
+
+/* the capacity of an array grown by REFS_PER_REALLOC */
+#define REFS_CAPACITY(num) \
+  (((BITCODE_RLL)(num) + REFS_PER_REALLOC - 1) / REFS_PER_REALLOC \
+   * REFS_PER_REALLOC)
+
+EXPORT int
+dwg_memory_usage(const Dwg_Data *dwg, Dwg_Memory_Report *report)
+{
+  Bit_Chain dat = { NULL, 0, 0, 0, 0, 0 };
+  // the spec only writes back fields derived from others, as in dwg_free
+  Dwg_Data *_dwg = (Dwg_Data *)dwg;
+  Dwg_Thread_State state;
+  BITCODE_BL i, j;
+
+  if (!dwg || !report)
+    return DWG_ERR_INVALIDDWG;
+  loglevel = dwg_log_enter(dwg, &state);
+  memset(report, 0, sizeof(Dwg_Memory_Report));
+  dat.version = dat.from_version = dwg->header.version;
+
+  for (i = 0; i < dwg->num_objects; i++)
+    {
+      Dwg_Object *obj = &_dwg->object[i];
+      Dwg_Memory_Type *t;
+
+      if (!obj->parent)
+        continue;
+      mem_bytes = mem_strings = 0;
+      dwg_memsize_object(&dat, obj);
+      t = &report->types[memsize_type_index(obj)];
+      if (!t->count++)
+        {
+          t->fixedtype = memsize_type_index(obj) < DWG_MEMORY_NUM_TYPES - 2
+            ? obj->fixedtype
+            : memsize_type_index(obj) == DWG_MEMORY_NUM_TYPES - 2
+              ? DWG_TYPE_UNKNOWN_ENT : DWG_TYPE_UNKNOWN_OBJ;
+          t->name = obj->dxfname;
+        }
+      t->bytes += mem_bytes;
+      t->strings += mem_strings;
+      report->objects += mem_bytes;
+      report->strings += mem_strings;
+      if (obj->supertype == DWG_SUPERTYPE_ENTITY && obj->tio.entity)
+        report->extents += sizeof(obj->tio.entity->extents)
+          + sizeof(obj->tio.entity->extents_state);
+    }
+  if (dwg->object)
+    report->objects += REFS_CAPACITY(dwg->num_objects) * sizeof(Dwg_Object);
+
+  mem_bytes = mem_strings = 0;
+  dwg_memsize_header_vars(&dat, _dwg);
+  report->header = mem_bytes;
+  report->strings += mem_strings;
+
+  if (dwg->object_ref)
+    report->handles = REFS_CAPACITY(dwg->num_object_refs)
+      * (sizeof(Dwg_Object_Ref *) + sizeof(BITCODE_BL));
+  for (i = 0; i < dwg->num_object_refs; i++)
+    if (dwg->object_ref[i])
+      report->handles += sizeof(Dwg_Object_Ref);
+  if (dwg->object_map)
+    report->object_map = sizeof(dwg_inthash)
+      + (BITCODE_RLL)dwg->object_map->size * sizeof(struct _hashbucket);
+  // both are allocated with at least one element
+  if (dwg->referrers_start)
+    {
+      j = dwg->referrers_start[dwg->num_objects];
+      report->indices += (dwg->num_objects + 2) * sizeof(BITCODE_BL)
+        + (j ? j : 1) * sizeof(Dwg_Referrer);
+    }
+  if (dwg->owned_start)
+    {
+      j = dwg->owned_start[dwg->num_objects];
+      report->indices += (dwg->num_objects + 1) * sizeof(BITCODE_BL)
+        + (j ? j : 1) * sizeof(BITCODE_BL);
+    }
+  if (dwg->layered_start)
+    {
+      j = dwg->layered_start[dwg->num_objects];
+      report->indices += (dwg->num_objects + 2) * sizeof(BITCODE_BL)
+        + (j ? j : 1) * sizeof(BITCODE_BL);
+    }
+  if (dwg->type_start)
+    {
+      Dwg_Object_Entity **ent = dwg->entities;
+      while (*ent)
+        ent++;
+      report->indices += (ent - dwg->entities + 1) * sizeof(Dwg_Object_Entity *);
+      j = dwg->type_groups_start[DWG_TYPE_INDEX_SIZE];
+      report->indices += (2 * DWG_TYPE_INDEX_SIZE + 3) * sizeof(BITCODE_BL)
+        + (dwg->num_objects ? dwg->num_objects : 1) * sizeof(BITCODE_BL)
+        + (j ? j : 1) * sizeof(Dwg_Type_Group)
+        + (dwg->num_objects + j + 1) * sizeof(void *);
+    }
+  if (dwg->rtree)
+    {
+      report->rtrees = dwg->num_rtree * sizeof(Dwg_RTree *);
+      for (i = 0; i < dwg->num_rtree; i++)
+        {
+          const Dwg_RTree *tree = dwg->rtree[i];
+          // the boxes and indices are allocated with at least one element
+          if (tree)
+            report->rtrees += sizeof(Dwg_RTree)
+              + (tree->num_boxes ? tree->num_boxes : 1)
+                * (sizeof(Dwg_Bbox) + sizeof(BITCODE_BL));
+        }
+    }
+
+  if (dwg->header.section)
+    report->sections += dwg->header.num_sections * sizeof(Dwg_Section);
+  if (dwg->header.section_info)
+    {
+      report->sections += dwg->header.num_infos * sizeof(Dwg_Section_Info);
+      for (i = 0; i < dwg->header.num_infos; i++)
+        if (dwg->header.section_info[i].sections)
+          report->sections += dwg->header.section_info[i].num_sections
+            * sizeof(Dwg_Section *);
+    }
+  for (i = 0; i < dwg->second_header.num_handlers; i++)
+    if (dwg->second_header.handlers[i].data)
+      report->sections += dwg->second_header.handlers[i].size;
+
+  if (dwg->dwg_class)
+    {
+      report->classes = dwg->num_classes * sizeof(Dwg_Class);
+      for (i = 0; i < dwg->num_classes; i++)
+        {
+          const Dwg_Class *klass = &dwg->dwg_class[i];
+          if (klass->appname)
+            report->classes += strlen(klass->appname) + 1;
+          if (klass->cppname)
+            report->classes += strlen(klass->cppname) + 1;
+          if (klass->dxfname)
+            report->classes += strlen(klass->dxfname) + 1;
+          if (klass->dxfname_u && dwg->header.version >= R_2007)
+            report->classes += 2 * (tu_length(klass->dxfname_u) + 1);
+        }
+    }
+  if (dwg->picture.size && dwg->picture.chain)
+    report->picture = dwg->picture.size;
+  report->stats = dwg->stats.num_types * sizeof(Dwg_Stats_Type)
+    + dwg->stats.num_profile * sizeof(Dwg_Profile_Type);
+
+  report->total = report->objects + report->header + report->handles
+    + report->object_map + report->indices + report->rtrees
+    + report->sections + report->classes + report->picture + report->stats;
+
+  for (i = j = 0; i < DWG_MEMORY_NUM_TYPES; i++)
+    {
+      if (report->types[i].count)
+        report->types[j++] = report->types[i];
+    }
+  report->num_types = j;
+  memset(&report->types[j], 0, (DWG_MEMORY_NUM_TYPES - j)
+                                   * sizeof(Dwg_Memory_Type));
+  qsort(report->types, j, sizeof(Dwg_Memory_Type), memsize_cmp);
+  dwg_log_leave(&state);
+  return 0;
+}
+
+#undef IS_MEMSIZE
@@ -0,0 +1,188 @@
+/*****************************************************************************/
+/*  LibreDWG - free implementation of the DWG file format                    */
+/*                                                                           */
+/*  Copyright (C) 2018 Free Software Foundation, Inc.                        */
+/*                                                                           */
+/*  This library is free software, licensed under the terms of the GNU       */
+/*  General Public License as published by the Free Software Foundation,     */
+/*  either version 3 of the License, or (at your option) any later version.  */
+/*  You should have received a copy of the GNU General Public License        */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.    */
+/*****************************************************************************/
+
+/*
+ * ocs.c: the object coordinate system of the planar entities, by the
+ *        arbitrary axis algorithm. The matrices of the last extrusions
+ *        are cached per thread, as most drawings have only a few.
+ *        The points are transformed in bulk, over separate x, y, z arrays.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <math.h>
+
+#include "common.h"
+#include "dwg.h"
+
+/* Cached matrices per thread */
+#define OCS_CACHE_SIZE 8
+/* The arbitrary axis limit, 1/64 */
+#define OCS_ARBITRARY_AXIS 0.015625
+
+typedef struct _ocs_cache_entry
+{
+  BITCODE_3BD extrusion;
+  double m[9];
+  int is_wcs;
+} Ocs_Cache_Entry;
+
+static THREAD_LOCAL Ocs_Cache_Entry ocs_cache[OCS_CACHE_SIZE];
+static THREAD_LOCAL int ocs_cache_used;
+static THREAD_LOCAL int ocs_cache_next;
+
+static void
+ocs_compute (const BITCODE_3BD *restrict ext, Ocs_Cache_Entry *restrict e)
+{
+  double *m = e->m;
+  double n[3] = { ext->x, ext->y, ext->z };
+  double len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+  double ax[3], ay[3];
+
+  memset(e->m, 0, sizeof(e->m));
+  e->extrusion = *ext;
+  // none or invalid: the WCS
+  if (len == 0.0 || isnan(len) || isinf(len))
+    {
+      m[0] = m[4] = m[8] = 1.0;
+      e->is_wcs = 1;
+      return;
+    }
+  n[0] /= len;
+  n[1] /= len;
+  n[2] /= len;
+  // Ax = Wy x N or Wz x N
+  if (fabs(n[0]) < OCS_ARBITRARY_AXIS && fabs(n[1]) < OCS_ARBITRARY_AXIS)
+    {
+      ax[0] = n[2];
+      ax[1] = 0.0;
+      ax[2] = -n[0];
+    }
+  else
+    {
+      ax[0] = -n[1];
+      ax[1] = n[0];
+      ax[2] = 0.0;
+    }
+  len = sqrt(ax[0] * ax[0] + ax[1] * ax[1] + ax[2] * ax[2]);
+  ax[0] /= len;
+  ax[1] /= len;
+  ax[2] /= len;
+  // Ay = N x Ax, already unit
+  ay[0] = n[1] * ax[2] - n[2] * ax[1];
+  ay[1] = n[2] * ax[0] - n[0] * ax[2];
+  ay[2] = n[0] * ax[1] - n[1] * ax[0];
+  memcpy(&m[0], ax, sizeof(ax));
+  memcpy(&m[3], ay, sizeof(ay));
+  memcpy(&m[6], n, sizeof(n));
+  e->is_wcs = m[0] == 1.0 && m[4] == 1.0 && m[8] == 1.0;
+}
+
+int
+dwg_ocs_matrix (const BITCODE_3BD *restrict extrusion, double m[9])
+{
+  Ocs_Cache_Entry *e;
+  int i;
+
+  if (!extrusion
+      || (extrusion->x == 0.0 && extrusion->y == 0.0 && extrusion->z == 1.0))
+    {
+      memset(m, 0, 9 * sizeof(double));
+      m[0] = m[4] = m[8] = 1.0;
+      return 0;
+    }
+  for (i = 0; i < ocs_cache_used; i++)
+    {
+      e = &ocs_cache[i];
+      if (e->extrusion.x == extrusion->x && e->extrusion.y == extrusion->y
+          && e->extrusion.z == extrusion->z)
+        {
+          memcpy(m, e->m, sizeof(e->m));
+          return !e->is_wcs;
+        }
+    }
+  // replace the oldest
+  e = &ocs_cache[ocs_cache_next];
+  ocs_cache_next = (ocs_cache_next + 1) % OCS_CACHE_SIZE;
+  if (ocs_cache_used < OCS_CACHE_SIZE)
+    ocs_cache_used++;
+  ocs_compute(extrusion, e);
+  memcpy(m, e->m, sizeof(e->m));
+  return !e->is_wcs;
+}
+
+void
+dwg_ocs_to_wcs (const double m[9], BITCODE_BL n, double *restrict x,
+                double *restrict y, double *restrict z)
+{
+  const double m0 = m[0], m1 = m[1], m2 = m[2];
+  const double m3 = m[3], m4 = m[4], m5 = m[5];
+  const double m6 = m[6], m7 = m[7], m8 = m[8];
+  BITCODE_BL i;
+
+  for (i = 0; i < n; i++)
+    {
+      const double px = x[i], py = y[i], pz = z[i];
+      x[i] = m0 * px + m3 * py + m6 * pz;
+      y[i] = m1 * px + m4 * py + m7 * pz;
+      z[i] = m2 * px + m5 * py + m8 * pz;
+    }
+}
+
+const BITCODE_3BD *
+dwg_entity_extrusion (const Dwg_Object *obj)
+{
+  const Dwg_Object_Entity *ent;
+
+  if (!obj || obj->supertype != DWG_SUPERTYPE_ENTITY || !obj->tio.entity
+      || !obj->parent || !obj->tio.entity->tio.CIRCLE)
+    return NULL;
+  ent = obj->tio.entity;
+  switch (obj->parent->header.version < R_13 ? (int)obj->type
+                                             : (int)obj->fixedtype)
+    {
+    case DWG_TYPE_CIRCLE:
+      return &ent->tio.CIRCLE->extrusion;
+    case DWG_TYPE_ARC:
+      return &ent->tio.ARC->extrusion;
+    case DWG_TYPE_LWPOLYLINE:
+      return &ent->tio.LWPOLYLINE->extrusion;
+    case DWG_TYPE_POLYLINE_2D:
+      return &ent->tio.POLYLINE_2D->extrusion;
+    case DWG_TYPE_TEXT:
+      return &ent->tio.TEXT->extrusion;
+    case DWG_TYPE_ATTRIB:
+      return &ent->tio.ATTRIB->extrusion;
+    case DWG_TYPE_ATTDEF:
+      return &ent->tio.ATTDEF->extrusion;
+    case DWG_TYPE_INSERT:
+      return &ent->tio.INSERT->extrusion;
+    case DWG_TYPE_MINSERT:
+      return &ent->tio.MINSERT->extrusion;
+    case DWG_TYPE_SOLID:
+      return &ent->tio.SOLID->extrusion;
+    case DWG_TYPE_TRACE:
+      return &ent->tio.TRACE->extrusion;
+    case DWG_TYPE_SHAPE:
+      return &ent->tio.SHAPE->extrusion;
+    case DWG_TYPE_HATCH:
+      return &ent->tio.HATCH->extrusion;
+    default:
+      return NULL;
+    }
+}
+
+int
+dwg_entity_ocs (const Dwg_Object *obj, double m[9])
+{
+  return dwg_ocs_matrix(dwg_entity_extrusion(obj), m);
+}
@@ -27,8 +27,12 @@ Add CLASSES for those
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
 #include <assert.h>
 //#include <math.h>
+#ifdef _OPENMP
+# include <omp.h>
+#endif
 
 #include "common.h"
 #include "bits.h"
@@ -40,8 +44,356 @@ Add CLASSES for those
 #include "logging.h"
 
 /* the current version per spec block */
-static unsigned int cur_ver = 0;
-static char buf[255];
+static THREAD_LOCAL unsigned int cur_ver = 0;
+
+/* The output buffer. Formatting goes into it and it is flushed with
+   fwrite, instead of two or three fprintf per group. Without fh it grows,
+   for the chunks of the parallel writer. */
+#define DXF_BUFSIZE (1 << 18)
+/* Objects per chunk of the parallel ENTITIES and OBJECTS writer */
+#define DXF_OBJECTS_PER_CHUNK 512
+typedef struct _dxf_writer
+{
+  char *buf;
+  size_t len;
+  size_t size;
+  FILE *fh;
+  int error;
+} Dxf_Writer;
+static THREAD_LOCAL Dxf_Writer out;
+
+/* The kind of the value per group code, formerly the long chain of range
+   checks in dxf_format(). Negative codes besides -5 are doubles. */
+enum DXF_KIND
+{
+  DXF_UNKNOWN = 0,
+  DXF_STRING,
+  DXF_HEX,
+  DXF_DOUBLE,
+  DXF_INT16,
+  DXF_INT32,
+  DXF_INT64
+};
+/* runs of 2 to 50 codes of one kind */
+#define K2(k)  k, k
+#define K4(k)  K2(k), K2(k)
+#define K5(k)  K4(k), k
+#define K10(k) K5(k), K5(k)
+#define K20(k) K10(k), K10(k)
+#define K30(k) K20(k), K10(k)
+#define K40(k) K20(k), K20(k)
+#define K50(k) K40(k), K10(k)
+#define DXF_NUM_CODES 1072
+static const unsigned char dxf_kinds[DXF_NUM_CODES] = {
+  /* 0 */    K5(DXF_STRING), DXF_HEX, K4(DXF_STRING), K50(DXF_DOUBLE),
+  /* 60 */   K20(DXF_INT16), K20(DXF_INT32),
+  [100] = DXF_STRING, [102] = DXF_STRING, [105] = DXF_HEX,
+  [110] = K40(DXF_DOUBLE),
+  [160] = K10(DXF_INT64), K10(DXF_INT16),
+  [210] = K30(DXF_DOUBLE),
+  [270] = K30(DXF_INT16),
+  /* 300 */  K20(DXF_STRING), K50(DXF_HEX), K20(DXF_INT16), K10(DXF_HEX),
+  /* 400 */  K10(DXF_INT16), K10(DXF_STRING), K10(DXF_INT32), K10(DXF_STRING),
+  /* 440 */  K10(DXF_INT32), K10(DXF_INT64), K10(DXF_DOUBLE), K10(DXF_STRING),
+  /* 480 */  K2(DXF_HEX),
+  [999] = DXF_STRING, K10(DXF_STRING), K50(DXF_DOUBLE),
+  /* 1060 */ K10(DXF_INT16), DXF_INT16, DXF_INT32
+};
+#undef K2
+#undef K4
+#undef K5
+#undef K10
+#undef K20
+#undef K30
+#undef K40
+#undef K50
+
+static inline enum DXF_KIND
+dxf_kind (int code)
+{
+  if (code >= 0 && code < DXF_NUM_CODES)
+    return (enum DXF_KIND)dxf_kinds[code];
+  if (code < 0)
+    return code == -5 ? DXF_HEX : DXF_DOUBLE;
+  return DXF_UNKNOWN;
+}
+
+static int
+dxf_writer_init (FILE *fh)
+{
+  memset(&out, 0, sizeof(out));
+  out.fh = fh;
+  out.buf = (char*)dwg_malloc(DXF_BUFSIZE);
+  if (!out.buf)
+    {
+      LOG_ERROR("Out of memory");
+      return DWG_ERR_OUTOFMEM;
+    }
+  out.size = DXF_BUFSIZE;
+  return 0;
+}
+
+static void
+dxf_flush (void)
+{
+  if (out.len && out.fh)
+    {
+      if (fwrite(out.buf, 1, out.len, out.fh) != out.len)
+        out.error = 1;
+      out.len = 0;
+    }
+}
+
+static void
+dxf_write (const char *restrict s, size_t len)
+{
+  if (out.len + len > out.size && !out.fh)
+    {
+      size_t size = out.size ? out.size : DXF_BUFSIZE;
+      char *buf;
+      while (size < out.len + len)
+        size *= 2;
+      buf = (char*)dwg_realloc(out.buf, size);
+      if (!buf)
+        {
+          out.error = 1;
+          return;
+        }
+      out.buf = buf;
+      out.size = size;
+    }
+  else if (out.len + len > out.size)
+    {
+      dxf_flush();
+      if (len > out.size)
+        {
+          if (fwrite(s, 1, len, out.fh) != len)
+            out.error = 1;
+          return;
+        }
+    }
+  memcpy(&out.buf[out.len], s, len);
+  out.len += len;
+}
+
+/* flush and free the buffer, 1 if any write failed */
+static int
+dxf_writer_end (void)
+{
+  int error;
+  dxf_flush();
+  dwg_dealloc(out.buf);
+  error = out.error;
+  memset(&out, 0, sizeof(out));
+  return error;
+}
+
+static inline void
+dxf_puts (const char *restrict s)
+{
+  dxf_write(s, strlen(s));
+}
+
+/* right-aligned to width, as %<width>li */
+static void
+dxf_int (long value, int width)
+{
+  char s[24];
+  char *p = &s[sizeof(s)];
+  unsigned long u = value < 0 ? 0UL - (unsigned long)value : (unsigned long)value;
+
+  do {
+    *--p = '0' + (u % 10);
+    u /= 10;
+  } while (u);
+  if (value < 0)
+    *--p = '-';
+  while (&s[sizeof(s)] - p < width)
+    *--p = ' ';
+  dxf_write(p, &s[sizeof(s)] - p);
+}
+
+static void
+dxf_hex (BITCODE_RLL value)
+{
+  static const char hex[] = "0123456789ABCDEF";
+  char s[16];
+  char *p = &s[sizeof(s)];
+
+  do {
+    *--p = hex[value & 0xf];
+    value >>= 4;
+  } while (value);
+  dxf_write(p, &s[sizeof(s)] - p);
+}
+
+static inline void
+dxf_group (int dxf)
+{
+  dxf_int(dxf, 3);
+  dxf_write("\r\n", 2);
+}
+
+/* The same text as snprintf "%-16.14f" for |d| < 1e15, rounded exactly
+   and half to even, as with glibc. The fraction f = m * 2^e is scaled
+   by 10^14 = 2^14 * 5^14 in 128 bit. Returns the length, or 0 if not
+   handled here. */
+static int
+dxf_fixed14 (char *restrict s, double d)
+{
+#ifdef __SIZEOF_INT128__
+  uint64_t bits, ip, frac = 0;
+  double a, f;
+  int i, n = 0;
+  char digits[20];
+
+  if (!(d > -1e15 && d < 1e15)) // also NaN
+    return 0;
+  memcpy(&bits, &d, sizeof(bits));
+  if (bits >> 63)
+    s[n++] = '-';
+  a = d < 0.0 ? -d : d;
+  ip = (uint64_t)a;
+  f = a - (double)ip; // exact
+  if (f != 0.0)
+    {
+      unsigned __int128 N, q, rem, half;
+      uint64_t m;
+      int exp, sh;
+      memcpy(&bits, &f, sizeof(bits));
+      exp = (int)((bits >> 52) & 0x7ff);
+      m = bits & ((1ULL << 52) - 1);
+      if (exp)
+        m |= 1ULL << 52;
+      else
+        exp = 1;
+      // f * 10^14 = m * 5^14 * 2^(exp - 1075 + 14), f < 1 so sh >= 39
+      sh = 1075 - 14 - exp;
+      N = (unsigned __int128)m * 6103515625ULL; // < 2^86
+      if (sh < 128)
+        {
+          q = N >> sh;
+          rem = N - (q << sh);
+          half = (unsigned __int128)1 << (sh - 1);
+          if (rem > half || (rem == half && (q & 1)))
+            q++;
+          frac = (uint64_t)q;
+          if (frac >= 100000000000000ULL)
+            {
+              frac -= 100000000000000ULL;
+              ip++;
+            }
+        }
+    }
+  i = 0;
+  do {
+    digits[i++] = '0' + (ip % 10);
+    ip /= 10;
+  } while (ip);
+  while (i)
+    s[n++] = digits[--i];
+  s[n++] = '.';
+  for (i = 13; i >= 0; i--)
+    {
+      s[n + i] = '0' + (frac % 10);
+      frac /= 10;
+    }
+  return n + 14;
+#else
+  (void)s; (void)d;
+  return 0;
+#endif
+}
+
+/* %-16.14f, or with shorten, shortened to .0, .5 or .125 */
+static void
+dxf_double (double value, int shorten)
+{
+  char s[512];
+  int len = dxf_fixed14(s, value);
+
+  if (!len)
+    {
+      len = snprintf(s, sizeof(s), "%-16.14f", value);
+      if (len < 0 || len >= (int)sizeof(s))
+        len = (int)strlen(s);
+    }
+  if (shorten)
+    {
+      char *p = strchr(s, '.');
+      if (p && len - (p - s) >= 15)
+        {
+          if (!memcmp(p, ".00000000000000", 15))
+            len = (int)(p - s) + 2;
+          else if (!memcmp(p, ".50000000000000", 15))
+            len = (int)(p - s) + 2;
+          else if (!memcmp(p, ".12500000000000", 15))
+            len = (int)(p - s) + 4;
+        }
+    }
+  dxf_write(s, len);
+  dxf_write("\r\n", 2);
+}
+
+/* as %s\r\n */
+static inline void
+dxf_string (const char *restrict s)
+{
+  if (s)
+    dxf_puts(s);
+  else
+    dxf_write("(null)", 6);
+  dxf_write("\r\n", 2);
+}
+
+/* as %02X */
+static inline void
+dxf_binary (unsigned int c)
+{
+  static const char hex[] = "0123456789ABCDEF";
+  if (c > 0xff)
+    dxf_hex(c);
+  else
+    {
+      char s[2];
+      s[0] = hex[c >> 4];
+      s[1] = hex[c & 0xf];
+      dxf_write(s, 2);
+    }
+}
+
+/* for the rest */
+static void dxf_printf (const char *restrict fmt, ...)
+#ifdef __GNUC__
+  __attribute__ ((format (printf, 1, 2)))
+#endif
+  ;
+static void
+dxf_printf (const char *restrict fmt, ...)
+{
+  char s[1024];
+  int len;
+  va_list ap;
+
+  va_start(ap, fmt);
+  len = vsnprintf(s, sizeof(s), fmt, ap);
+  va_end(ap);
+  if (len < 0)
+    return;
+  if (len < (int)sizeof(s))
+    dxf_write(s, len);
+  else
+    {
+      char *p = (char*)dwg_malloc(len + 1);
+      if (!p)
+        return;
+      va_start(ap, fmt);
+      vsnprintf(p, len + 1, fmt, ap);
+      va_end(ap);
+      dxf_write(p, len);
+      dwg_dealloc(p);
+    }
+}
 
 // private
 static int
@@ -66,11 +418,11 @@ static int dxf_3dsolid(Bit_Chain *restrict dat,
 
 #define VALUE_TV(value,dxf) \
   { GROUP(dxf); \
-    fprintf(dat->fh, "%s\r\n", value); }
+    dxf_string(value); }
 #ifdef HAVE_NATIVE_WCHAR2
 # define VALUE_TU(value,dxf)\
   { GROUP(dxf); \
-    fprintf(dat->fh, "%ls\r\n", value ? (wchar_t*)value : L""); }
+    dxf_printf("%ls\r\n", value ? (wchar_t*)value : L""); }
 #else
 # define VALUE_TU(wstr,dxf) \
   { \
@@ -79,9 +431,10 @@ static int dxf_3dsolid(Bit_Chain *restrict dat,
     GROUP(dxf);\
     if (wstr) \
       while ((_c = *ws++)) { \
-        fprintf(dat->fh, "%c", (char)(_c & 0xff)); \
+        char _ch = (char)(_c & 0xff); \
+        dxf_write(&_ch, 1); \
       } \
-    fprintf(dat->fh, "\r\n"); \
+    dxf_write("\r\n", 2); \
   }
 #endif
 #define VALUE_TFF(str,dxf)    VALUE_TV(str, dxf)
@@ -94,9 +447,9 @@ static int dxf_3dsolid(Bit_Chain *restrict dat,
     GROUP(dxf); \
     if (value) \
       for (j=0; j < l; j++) { \
-        fprintf(dat->fh, "%02X", value[j]); \
+        dxf_binary(value[j]); \
       } \
-    fprintf(dat->fh, "\r\n"); \
+    dxf_write("\r\n", 2); \
     len -= 127; \
   } while (len > 127); \
 }
@@ -106,7 +459,9 @@ static int dxf_3dsolid(Bit_Chain *restrict dat,
 // the hex code
 #define VALUE_HANDLE(value, handle_code, dxf) \
   if (dxf) { \
-    fprintf(dat->fh, "%3i\r\n%lX\r\n", dxf, value ? value->absolute_ref : 0); \
+    GROUP(dxf); \
+    dxf_hex(value ? value->absolute_ref : 0); \
+    dxf_write("\r\n", 2); \
   }
 // the name in the table, referenced by the handle
 // names on: 6 7 8. which else? there are more styles: plot, ...
@@ -119,15 +474,21 @@ static int dxf_3dsolid(Bit_Chain *restrict dat,
       FIELD_HANDLE_NAME(name, dxf, STYLE) \
     else if (dxf == 8) \
       FIELD_HANDLE_NAME(name, dxf, LAYER) \
-    else if (dat->version >= R_13) \
-      fprintf(dat->fh, "%3i\r\n%lX\r\n", dxf, _obj->name->absolute_ref); \
+    else if (dat->version >= R_13) { \
+      GROUP(dxf); \
+      dxf_hex(_obj->name->absolute_ref); \
+      dxf_write("\r\n", 2); \
+    } \
   }
 #define HEADER_9(name) \
     GROUP(9);\
-    fprintf (dat->fh, "$%s\r\n", #name)
+    dxf_write("$" #name "\r\n", sizeof("$" #name "\r\n") - 1)
 #define VALUE_H(value, dxf) \
-    if (dxf) \
-      fprintf(dat->fh, "%3i\r\n%lX\r\n", dxf, value ? value->absolute_ref : 0)
+    if (dxf) { \
+      GROUP(dxf); \
+      dxf_hex(value ? value->absolute_ref : 0); \
+      dxf_write("\r\n", 2); \
+    }
 #define HEADER_H(name,dxf) \
     HEADER_9(name);\
     VALUE_H(dwg->header_vars.name, dxf)
@@ -135,9 +496,15 @@ static int dxf_3dsolid(Bit_Chain *restrict dat,
 #define HEADER_VALUE(name, type, dxf, value) \
   if (dxf) {\
     GROUP(9);\
-    fprintf (dat->fh, "$" #name "\r\n");\
-    VALUE (value, type, dxf);\
+    dxf_puts("$" #name "\r\n");\
+    HEADER_VALUE_##type (value, dxf);\
   }
+/* VALUE only takes numbers */
+#define HEADER_VALUE_TV(value, dxf) VALUE_TV(value, dxf)
+#define HEADER_VALUE_TU(value, dxf) VALUE_TU(value, dxf)
+#define HEADER_VALUE_RC(value, dxf) VALUE(value, RC, dxf)
+#define HEADER_VALUE_RS(value, dxf) VALUE(value, RS, dxf)
+#define HEADER_VALUE_BD(value, dxf) VALUE(value, BD, dxf)
 #define HEADER_VAR(name, type, dxf) \
   HEADER_VALUE(name, type, dxf, dwg->header_vars.name)
 
@@ -151,62 +518,68 @@ static int dxf_3dsolid(Bit_Chain *restrict dat,
   HEADER_9(name);\
   VALUE_BLL(dwg->header_vars.name, dxf)
 
-#define SECTION(section) fprintf(dat->fh, "  0\r\nSECTION\r\n  2\r\n" #section "\r\n")
-#define ENDSEC()         fprintf(dat->fh, "  0\r\nENDSEC\r\n")
-#define TABLE(table)     fprintf(dat->fh, "  0\r\nTABLE\r\n  2\r\n" #table "\r\n")
-#define ENDTAB()         fprintf(dat->fh, "  0\r\nENDTAB\r\n")
-#define RECORD(record)   fprintf(dat->fh, "  0\r\n" #record "\r\n")
+#define SECTION(section) dxf_puts("  0\r\nSECTION\r\n  2\r\n" #section "\r\n")
+#define ENDSEC()         dxf_puts("  0\r\nENDSEC\r\n")
+#define TABLE(table)     dxf_puts("  0\r\nTABLE\r\n  2\r\n" #table "\r\n")
+#define ENDTAB()         dxf_puts("  0\r\nENDTAB\r\n")
+#define RECORD(record)   dxf_puts("  0\r\n" #record "\r\n")
 #define SUBCLASS(text)   if (dat->from_version >= R_2000) { VALUE_TV(#text, 100); }
 
-#define GROUP(dxf) \
-    fprintf (dat->fh, "%3i\r\n", dxf)
-/* avoid empty numbers, and fixup some bad %f libc formatting */
+#define GROUP(dxf) dxf_group(dxf)
+/* avoid empty numbers, and shorten some %f zeros */
 #define VALUE(value, type, dxf) \
   if (dxf) { \
-    char *_s; \
-    const char *_fmt = dxf_format (dxf); \
     GROUP(dxf); \
-    GCC_DIAG_IGNORE(-Wformat-nonliteral) \
-    snprintf(buf, 255, _fmt, value); \
-    GCC_DIAG_RESTORE \
-    /* not a string, empty num. must be zero */ \
-    if (strcmp(_fmt, "%s") && !*buf) \
-      strcpy(buf, "0"); \
-    else if (90 <= dxf && dxf < 100) { \
-      /* -Wpointer-to-int-cast */ \
-      const int32_t _si = (int32_t)(intptr_t)(value); \
-      snprintf(buf, 255, "%6i", _si); \
-    } else if (!strcmp(_fmt, "%-16.14f")) {      \
-      if (!strcmp(buf, "0.00000000000000")) \
-        strcpy(buf, "0.0"); \
-      else if ((_s = strstr(buf, ".00000000000000"))) \
-        strcpy(_s, ".0"); \
-      else if ((_s = strstr(buf, ".50000000000000"))) \
-        strcpy(_s, ".5"); \
-      else if ((_s = strstr(buf, ".12500000000000"))) \
-        strcpy(_s, ".125"); \
+    switch (dxf_kind(dxf)) { \
+    case DXF_DOUBLE: \
+      dxf_double((double)(value), 1); \
+      break; \
+    case DXF_HEX: \
+      dxf_hex((BITCODE_RLL)(value)); \
+      dxf_write("\r\n", 2); \
+      break; \
+    case DXF_INT16: \
+      dxf_int((int)(value), 6); \
+      dxf_write("\r\n", 2); \
+      break; \
+    case DXF_INT32: \
+    case DXF_INT64: \
+      if (90 <= dxf && dxf < 100) \
+        /* -Wpointer-to-int-cast */ \
+        dxf_int((int32_t)(intptr_t)(value), 6); \
+      else \
+        dxf_int((long)(value), dxf_kind(dxf) == DXF_INT32 ? 9 : 12); \
+      dxf_write("\r\n", 2); \
+      break; \
+    case DXF_STRING: \
+      dxf_int((long)(value), 0); \
+      dxf_write("\r\n", 2); \
+      break; \
+    case DXF_UNKNOWN: \
+    default: \
+      dxf_puts("(unknown code)\r\n"); \
+      break; \
     } \
-    fprintf(dat->fh, "%s\r\n", buf); \
   }
 #define VALUE_RD(value, dxf) \
   if (dxf && !bit_isnan(value)) { \
     GROUP(dxf); \
     if (value == 0.0 || value == 0) \
-      fprintf(dat->fh, "0.0\r\n"); \
+      dxf_write("0.0\r\n", 5); \
     else if (value == 0.5) \
-      fprintf(dat->fh, "0.5\r\n"); \
+      dxf_write("0.5\r\n", 5); \
     else if (value == 0.125) \
-      fprintf(dat->fh, "0.125\r\n"); \
+      dxf_write("0.125\r\n", 7); \
     else \
-      fprintf(dat->fh, "%-16.14f\r\n", value); \
+      dxf_double(value, 0); \
   }
 #define VALUE_B(value, dxf) \
   if (dxf) { \
     GROUP(dxf); \
     if (value == 0) \
-      fprintf(dat->fh, "     0\r\n"); \
+      dxf_write("     0\r\n", 8); \
     else \
-      fprintf(dat->fh, "     1\r\n"); \
+      dxf_write("     1\r\n", 8); \
   }
 
 #define FIELD_HANDLE_NAME(name, dxf, table) \
@@ -303,8 +676,8 @@ static int dxf_3dsolid(Bit_Chain *restrict dat,
 #define HEADER_TIMEBLL(name, dxf) \
   HEADER_9(name); FIELD_TIMEBLL(name, dxf)
 #define FIELD_TIMEBLL(name,dxf) \
-  GROUP(dxf); fprintf(dat->fh, FORMAT_RL "." FORMAT_RL "\r\n", \
-                      _obj->name.days, _obj->name.ms)
+  GROUP(dxf); dxf_printf(FORMAT_RL "." FORMAT_RL "\r\n", \
+                         _obj->name.days, _obj->name.ms)
 #define HEADER_CMC(name,dxf) \
     HEADER_9(name);\
     VALUE_RS(dwg->header_vars.name.index, dxf)
@@ -401,30 +774,30 @@ static int dxf_3dsolid(Bit_Chain *restrict dat,
       obj->tio.object->xdicobjhandle && \
       obj->tio.object->xdicobjhandle->absolute_ref) \
   { \
-    fprintf(dat->fh, "102\r\n{ACAD_XDICTIONARY\r\n");\
+    dxf_puts("102\r\n{ACAD_XDICTIONARY\r\n");\
     VALUE_HANDLE(obj->tio.object->xdicobjhandle, code, 360); \
-    fprintf(dat->fh, "102\r\n}\r\n");\
+    dxf_puts("102\r\n}\r\n");\
   }
 #define _REACTORS(code)\
   if (dat->version >= R_13 && \
       obj->tio.object->num_reactors && \
       obj->tio.object->reactors) \
   { \
-    fprintf(dat->fh, "102\r\n{ACAD_REACTORS\r\n");\
+    dxf_puts("102\r\n{ACAD_REACTORS\r\n");\
     for (vcount=0; vcount < obj->tio.object->num_reactors; vcount++)\
       { /* soft ptr */ \
         VALUE_HANDLE(obj->tio.object->reactors[vcount], code, 330); \
       }\
-    fprintf(dat->fh, "102\r\n}\r\n");\
+    dxf_puts("102\r\n}\r\n");\
   }
 #define ENT_REACTORS(code)\
   if (dat->version >= R_13 && _obj->num_reactors && _obj->reactors) {\
-    fprintf(dat->fh, "102\r\n{ACAD_REACTORS\r\n");\
+    dxf_puts("102\r\n{ACAD_REACTORS\r\n");\
     for (vcount=0; vcount < _obj->num_reactors; vcount++)\
       {\
         VALUE_HANDLE(_obj->reactors[vcount], code, 330); \
       }\
-    fprintf(dat->fh, "102\r\n}\r\n");\
+    dxf_puts("102\r\n}\r\n");\
   }
 #define REACTORS(code)
 #define XDICOBJHANDLE(code)
@@ -433,9 +806,9 @@ static int dxf_3dsolid(Bit_Chain *restrict dat,
       obj->tio.entity->xdicobjhandle && \
       obj->tio.entity->xdicobjhandle->absolute_ref) \
   { \
-    fprintf(dat->fh, "102\r\n{ACAD_XDICTIONARY\r\n");\
+    dxf_puts("102\r\n{ACAD_XDICTIONARY\r\n");\
     VALUE_HANDLE(obj->tio.entity->xdicobjhandle, code, 360); \
-    fprintf(dat->fh, "102\r\n}\r\n");\
+    dxf_puts("102\r\n}\r\n");\
   }
 
 #define COMMON_ENTITY_HANDLE_DATA
@@ -481,7 +854,7 @@ dwg_dxf_##token (Bit_Chain *restrict dat, const Dwg_Object *restrict obj) \
     return dwg_dxf_TABLECONTENT(dat, obj); \
   } \
   else if (obj->type >= 500 && obj->dxfname) \
-    fprintf(dat->fh, "  0\r\n%s\r\n", obj->dxfname); \
+    { dxf_puts("  0\r\n"); dxf_puts(obj->dxfname); dxf_write("\r\n", 2); } \
   else\
     RECORD(token);\
   _ent = obj->tio.entity;\
@@ -492,7 +865,9 @@ dwg_dxf_##token (Bit_Chain *restrict dat, const Dwg_Object *restrict obj) \
               obj->handle.code,\
               obj->handle.size,\
               obj->handle.value); \
-    fprintf(dat->fh, "%3i\r\n%lX\r\n", 5, obj->handle.value); \
+    GROUP(5); \
+    dxf_hex(obj->handle.value); \
+    dxf_write("\r\n", 2); \
   } \
   SINCE(R_13) { \
     VALUE_HANDLE (obj->parent->header_vars.BLOCK_RECORD_MSPACE, 5, 330); \
@@ -517,7 +892,7 @@ dwg_dxf_ ##token (Bit_Chain *restrict dat, const Dwg_Object *restrict obj) \
     if (obj->fixedtype == DWG_TYPE_TABLE) \
       ; \
     else if (obj->type >= 500 && obj->dxfname)        \
-      fprintf(dat->fh, "  0\r\n%s\r\n", obj->dxfname); \
+      { dxf_puts("  0\r\n"); dxf_puts(obj->dxfname); dxf_write("\r\n", 2); } \
     else if (obj->type == DWG_TYPE_PLACEHOLDER) \
       RECORD(ACDBPLACEHOLDER); \
     else if (obj->type != DWG_TYPE_BLOCK_HEADER) \
@@ -525,7 +900,9 @@ dwg_dxf_ ##token (Bit_Chain *restrict dat, const Dwg_Object *restrict obj) \
     SINCE(R_13) { \
       int dxf = 5; \
       if (obj->type == DWG_TYPE_DIMSTYLE) dxf = 105; \
-      fprintf(dat->fh, "%3i\r\n%lX\r\n", dxf, obj->handle.value); \
+      GROUP(dxf); \
+      dxf_hex(obj->handle.value); \
+      dxf_write("\r\n", 2); \
       _XDICOBJHANDLE(3); \
       _REACTORS(4); \
     } \
@@ -549,9 +926,8 @@ dxf_write_xdata(Bit_Chain *restrict dat, Dwg_Resbuf *restrict rbuf, BITCODE_BL s
   while (rbuf)
     {
       int dxftype = rbuf->type;
-      const char* fmt = dxf_format(rbuf->type);
       short type = get_base_value_type(rbuf->type);
-      if (!strcmp(fmt, "(unknown code)"))
+      if (dxf_kind(dxftype) == DXF_UNKNOWN)
         {
           if (type == VT_INVALID) {
             LOG_WARN("Invalid xdata code %d", dxftype);
@@ -593,13 +969,15 @@ dxf_write_xdata(Bit_Chain *restrict dat, Dwg_Resbuf *restrict rbuf, BITCODE_BL s
           break;
         case VT_HANDLE:
         case VT_OBJECTID:
-          fprintf(dat->fh, "%3i\r\n%lX\r\n", dxftype,
-                  (unsigned long)*(uint64_t*)rbuf->value.hdl);
+          GROUP(dxftype);
+          dxf_hex(*(uint64_t*)rbuf->value.hdl);
+          dxf_write("\r\n", 2);
           break;
         case VT_INVALID:
           break; //skip
         default:
-          fprintf(dat->fh, "%3i\r\n\r\n", dxftype);
+          GROUP(dxftype);
+          dxf_write("\r\n", 2);
           break;
         }
       rbuf = tmp;
@@ -624,39 +1002,42 @@ dxf_cvt_tablerecord(Bit_Chain *restrict dat, const Dwg_Object *restrict obj,
       if (dat->from_version >= R_13 && dat->version < R_13)
         { // convert the other way round, from newer to older
           if (!strcmp(entry_name, "Standard"))
-            fprintf(dat->fh, "%3i\r\nSTANDARD\r\n", dxf);
+            VALUE_TV("STANDARD", dxf)
           else if (!strcmp(entry_name, "ByLayer"))
-            fprintf(dat->fh, "%3i\r\nBYLAYER\r\n", dxf);
+            VALUE_TV("BYLAYER", dxf)
           else if (!strcmp(entry_name, "ByBlock"))
-            fprintf(dat->fh, "%3i\r\nBYBLOCK\r\n", dxf);
+            VALUE_TV("BYBLOCK", dxf)
           else if (!strcmp(entry_name, "*Active"))
-            fprintf(dat->fh, "%3i\r\n*ACTIVE\r\n", dxf);
+            VALUE_TV("*ACTIVE", dxf)
           else
-            fprintf(dat->fh, "%3i\r\n%s\r\n", dxf, entry_name);
+            VALUE_TV(entry_name, dxf)
         }
       else
         { // convert some standard names
           if (dat->version >= R_13 && !strcmp(entry_name, "STANDARD"))
-            fprintf(dat->fh, "%3i\r\nStandard\r\n", dxf);
+            VALUE_TV("Standard", dxf)
           else if (dat->version >= R_13 && !strcmp(entry_name, "BYLAYER"))
-            fprintf(dat->fh, "%3i\r\nByLayer\r\n", dxf);
+            VALUE_TV("ByLayer", dxf)
           else if (dat->version >= R_13 && !strcmp(entry_name, "BYBLOCK"))
-            fprintf(dat->fh, "%3i\r\nByBlock\r\n", dxf);
+            VALUE_TV("ByBlock", dxf)
           else if (dat->version >= R_13 && !strcmp(entry_name, "*ACTIVE"))
-            fprintf(dat->fh, "%3i\r\n*Active\r\n", dxf);
+            VALUE_TV("*Active", dxf)
           else
-            fprintf(dat->fh, "%3i\r\n%s\r\n", dxf, entry_name);
+            VALUE_TV(entry_name, dxf)
         }
     }
   else {
-    fprintf(dat->fh, "%3i\r\n\r\n", dxf);
+    GROUP(dxf);
+    dxf_write("\r\n", 2);
   }
 }
 
 // 5 written here first
 #define COMMON_TABLE_CONTROL_FLAGS \
     SINCE(R_13) { \
-      fprintf(dat->fh, "%3i\r\n%lX\r\n", 5, ctrl->handle.value);\
+      GROUP(5);\
+      dxf_hex(ctrl->handle.value);\
+      dxf_write("\r\n", 2);\
     } \
     SINCE(R_14) { \
       VALUE_H (_ctrl->null_handle, 330); \
@@ -728,10 +1109,11 @@ static int dxf_3dsolid(Bit_Chain *restrict dat,
                     GROUP(1);
                   else
                     GROUP(3);
+                  dxf_write(s, l);
                   if (s[l-1] == '\r')
-                    fprintf(dat->fh, "%.*s\n", l, s);
+                    dxf_write("\n", 1);
                   else
-                    fprintf(dat->fh, "%.*s\r\n", l, s);
+                    dxf_write("\r\n", 2);
                   l++;
                   len -= l;
                   s += l;
@@ -1088,74 +1470,10 @@ dxf_common_entity_handle_data(Bit_Chain *restrict dat, const Dwg_Object *restric
 const char *
 dxf_format (int code)
 {
-  if (0 <= code && code < 5)
-    return "%s";
-  if (code == 5 || code == -5)
-    return "%X";
-  if (5 < code && code < 10)
-    return "%s";
-  if (code < 60)
-    return "%-16.14f";
-  if (code < 80)
-    return "%6i";
-  if (80 <= code && code <= 99) //BL int32
-    return "%9li";
-  if (code == 100)
-    return "%s";
-  if (code == 102)
-    return "%s";
-  if (code == 105)
-    return "%X";
-  if (110 <= code && code <= 149)
-    return "%-16.14f";
-  if (160 <= code && code <= 169)
-    return "%12li";
-  if (170 <= code && code <= 179)
-    return "%6i";
-  if (210 <= code && code <= 239)
-    return "%-16.14f";
-  if (270 <= code && code <= 289)
-    return "%6i";
-  if (290 <= code && code <= 299)
-    return "%6i"; // boolean
-  if (300 <= code && code <= 319)
-    return "%s";
-  if (320 <= code && code <= 369)
-    return "%X";
-  if (370 <= code && code <= 389)
-    return "%6i";
-  if (390 <= code && code <= 399)
-    return "%X";
-  if (400 <= code && code <= 409)
-    return "%6i";
-  if (410 <= code && code <= 419)
-    return "%s";
-  if (420 <= code && code <= 429)
-    return "%9li"; //int32_t
-  if (430 <= code && code <= 439)
-    return "%s";
-  if (440 <= code && code <= 449)
-    return "%9li"; //int32_t
-  if (450 <= code && code <= 459)
-    return "%12li"; //long
-  if (460 <= code && code <= 469)
-    return "%-16.14f";
-  if (470 <= code && code <= 479)
-    return "%s";
-  if (480 <= code && code <= 481)
-    return "%X";
-  if (code == 999)
-    return "%s";
-  if (1000 <= code && code <= 1009)
-    return "%s";
-  if (1010 <= code && code <= 1059)
-    return "%-16.14f";
-  if (1060 <= code && code <= 1070)
-    return "%6i";
-  if (code == 1071)
-    return "%9li"; //int32_t
-
-  return "(unknown code)";
+  static const char *const formats[] = {
+    "(unknown code)", "%s", "%X", "%-16.14f", "%6i", "%9li", "%12li"
+  };
+  return formats[dxf_kind(code)];
 }
 
 const char* dxf_codepage (int code, Dwg_Data* dwg)
@@ -1498,20 +1816,91 @@ dxf_blocks_write (Bit_Chain *restrict dat, Dwg_Data *restrict dwg)
   return error;
 }
 
+/* the ENTITIES, without the blocks, or the OBJECTS in [start, end) */
 static int
-dxf_entities_write (Bit_Chain *restrict dat, Dwg_Data *restrict dwg)
+dxf_write_range (Bit_Chain *restrict dat, Dwg_Data *restrict dwg,
+                 const int entities, BITCODE_BL start, const BITCODE_BL end)
 {
   int error = 0;
-  BITCODE_BL i;
-
-  SECTION(ENTITIES);
-  for (i=0; i<dwg->num_objects; i++)
+  for (; start < end; start++)
     {
-      if (dwg->object[i].supertype == DWG_SUPERTYPE_ENTITY &&
-          dwg->object[i].type != DWG_TYPE_BLOCK &&
-          dwg->object[i].type != DWG_TYPE_ENDBLK)
-        error |= dwg_dxf_object(dat, &dwg->object[i]);
+      const Dwg_Object *obj = &dwg->object[start];
+      if (entities
+          ? (obj->supertype == DWG_SUPERTYPE_ENTITY
+             && obj->type != DWG_TYPE_BLOCK
+             && obj->type != DWG_TYPE_ENDBLK)
+          : obj->supertype == DWG_SUPERTYPE_OBJECT)
+        error |= dwg_dxf_object(dat, obj);
     }
+  return error;
+}
+
+#ifdef _OPENMP
+/* Each thread renders contiguous chunks of objects into its own buffer,
+   which are written in order, so the output is the same as serially. */
+static int
+dxf_write_parallel (Bit_Chain *restrict dat, Dwg_Data *restrict dwg,
+                    const int entities)
+{
+  const long num_chunks = (long)((dwg->num_objects + DXF_OBJECTS_PER_CHUNK - 1)
+                                 / DXF_OBJECTS_PER_CHUNK);
+  Dxf_Writer file;
+  int error = 0;
+  int io_error = 0;
+  long c;
+
+  dxf_flush();
+  file = out;
+#pragma omp parallel reduction(|:error)
+  {
+    Bit_Chain tdat = *dat;
+    Dwg_Thread_State state;
+    dwg_log_enter(dwg, &state);
+    memset(&out, 0, sizeof(out));
+#pragma omp for ordered schedule(dynamic, 1)
+    for (c = 0; c < num_chunks; c++)
+      {
+        BITCODE_BL start = (BITCODE_BL)c * DXF_OBJECTS_PER_CHUNK;
+        BITCODE_BL end = start + DXF_OBJECTS_PER_CHUNK;
+        if (end > dwg->num_objects)
+          end = dwg->num_objects;
+        out.len = 0;
+        error |= dxf_write_range(&tdat, dwg, entities, start, end);
+#pragma omp ordered
+        {
+          if (out.len && fwrite(out.buf, 1, out.len, file.fh) != out.len)
+            io_error = 1;
+        }
+      }
+    if (dxf_writer_end())
+      error |= DWG_ERR_OUTOFMEM;
+    dwg_log_leave(&state);
+  }
+  out = file;
+  if (io_error)
+    out.error = 1;
+  return error;
+}
+#endif
+
+static int
+dxf_write_objects (Bit_Chain *restrict dat, Dwg_Data *restrict dwg,
+                   const int entities)
+{
+#ifdef _OPENMP
+  if (dwg->num_objects > DXF_OBJECTS_PER_CHUNK && omp_get_max_threads() > 1)
+    return dxf_write_parallel(dat, dwg, entities);
+#endif
+  return dxf_write_range(dat, dwg, entities, 0, dwg->num_objects);
+}
+
+static int
+dxf_entities_write (Bit_Chain *restrict dat, Dwg_Data *restrict dwg)
+{
+  int error;
+
+  SECTION(ENTITIES);
+  error = dxf_write_objects(dat, dwg, 1);
   ENDSEC();
   return error;
 }
@@ -1519,15 +1908,10 @@ dxf_entities_write (Bit_Chain *restrict dat, Dwg_Data *restrict dwg)
 static int
 dxf_objects_write (Bit_Chain *restrict dat, Dwg_Data *restrict dwg)
 {
-  int error = 0;
-  BITCODE_BL i;
+  int error;
 
   SECTION(OBJECTS);
-  for (i=0; i<dwg->num_objects; i++)
-    {
-      if (dwg->object[i].supertype == DWG_SUPERTYPE_OBJECT)
-        error |= dwg_dxf_object(dat, &dwg->object[i]);
-    }
+  error = dxf_write_objects(dat, dwg, 0);
   ENDSEC();
   return error;
 }
@@ -1553,9 +1937,17 @@ dwg_write_dxf(Bit_Chain *dat, Dwg_Data * dwg)
 {
   const int minimal = dwg->opts & 0x10;
   struct Dwg_Header *obj = &dwg->header;
+  Dwg_Thread_State state;
+  int error;
 
   if (dat->from_version == R_INVALID)
     dat->from_version = dat->version;
+  dwg_log_enter(dwg, &state);
+  if (dxf_writer_init(dat->fh))
+    {
+      dwg_log_leave(&state);
+      return 1;
+    }
 
   VALUE_TV(PACKAGE_STRING, 999);
 
@@ -1593,8 +1985,12 @@ dwg_write_dxf(Bit_Chain *dat, Dwg_Data * dwg)
   }
   RECORD(EOF);
 
-  return 0;
+  error = dxf_writer_end();
+  dwg_log_leave(&state);
+  return error;
  fail:
+  dxf_writer_end();
+  dwg_log_leave(&state);
   return 1;
 }
 
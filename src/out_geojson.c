@@ -14,12 +14,11 @@
  * out_geojson.c: write as GeoJSON
  * written by Reini Urban
  */
-/* TODO: Arc, Circle, Ellipsis, Bulge (Curve) tessellation.
- *       ocs/ucs transforms, explode of inserts?
- *       NOCOMMA and \n not with stdout. stdout is line-buffered,
- *       so NOCOMMA cannot backup past the previous \n to delete the comma.
- *       We really have to add the comma before, not after, and special case the first
- *       field, not the last to omit the comma.
+/* Curves are tessellated by dwg_tessellate() to LineStrings and Polygons,
+ * with the chord tolerance dwg->tolerance. INSERT's are exploded into a GeometryCollection.
+ * The features are written one at a time through a buffer, with the comma
+ * before each but the first, so this also works on stdout.
+ * Entities without a tessellation, as HATCH and TEXT, are skipped.
  */
 
 #include "config.h"
@@ -40,10 +39,6 @@
 #include "logging.h"
 #include "dwg_api.h"
 
-/* the current version per spec block */
-static unsigned int cur_ver = 0;
-
-
 /*--------------------------------------------------------------------------------
  * See http://geojson.org/geojson-spec.html
  * Arc, AttributeDefinition, BlockReference, Ellipse, Hatch, Line,
@@ -59,171 +54,216 @@ static unsigned int cur_ver = 0;
              "Linetype": null,
              "EntityHandle": "8B",
              "Text": null
-           }, 
+           },
          "geometry":
            { "type": "LineString",
-             "coordinates": [ [ 370.858611653430728, 730.630303522043732, 0.0 ], [ 450.039756420260289, 619.219273076899071, 0.0 ] ] 
+             "coordinates": [ [ 370.858611653430728, 730.630303522043732, 0.0 ], [ 450.039756420260289, 619.219273076899071, 0.0 ] ]
            }
        },
      ], ...
    }
- *
+ */
+
+/* Nested INSERT's at most */
+#define GEOJSON_MAX_NESTING 16
+
+/*--------------------------------------------------------------------------------
+ * The output buffer, as in out_json.c
+ */
+
+#define GEOJSON_BUFSIZE (1 << 16)
+typedef struct _geojson_writer
+{
+  char *buf;
+  size_t len;
+  size_t size;
+  FILE *fh;
+  int error;
+} Geojson_Writer;
+static THREAD_LOCAL Geojson_Writer out;
+
+static int
+geojson_writer_init (FILE *fh)
+{
+  memset(&out, 0, sizeof(out));
+  out.fh = fh;
+  out.buf = (char*)dwg_malloc(GEOJSON_BUFSIZE);
+  if (!out.buf)
+    {
+      LOG_ERROR("Out of memory");
+      return DWG_ERR_OUTOFMEM;
+    }
+  out.size = GEOJSON_BUFSIZE;
+  return 0;
+}
+
+static void
+geojson_flush (void)
+{
+  if (out.len)
+    {
+      if (fwrite(out.buf, 1, out.len, out.fh) != out.len)
+        out.error = 1;
+      out.len = 0;
+    }
+}
+
+static void
+geojson_write (const char *restrict s, size_t len)
+{
+  if (out.len + len > out.size)
+    {
+      geojson_flush();
+      if (len > out.size)
+        {
+          if (fwrite(s, 1, len, out.fh) != len)
+            out.error = 1;
+          return;
+        }
+    }
+  memcpy(&out.buf[out.len], s, len);
+  out.len += len;
+}
+
+/* flush and free the buffer, 1 if any write failed */
+static int
+geojson_writer_end (void)
+{
+  int error;
+  geojson_flush();
+  dwg_dealloc(out.buf);
+  error = out.error;
+  memset(&out, 0, sizeof(out));
+  return error;
+}
+
+static inline void
+geojson_puts (const char *restrict s)
+{
+  geojson_write(s, strlen(s));
+}
+
+/* 2 spaces per level */
+static void
+geojson_prefix (const Bit_Chain *restrict dat)
+{
+  static const char spaces[] = "                                ";
+  size_t n = 2 * (size_t)dat->bit;
+  while (n > sizeof(spaces) - 1)
+    {
+      geojson_write(spaces, sizeof(spaces) - 1);
+      n -= sizeof(spaces) - 1;
+    }
+  geojson_write(spaces, n);
+}
+
+/* With 6 decimals as FORMAT_DD, but without trailing zeros */
+static void
+geojson_double (double value)
+{
+  char s[40];
+  char *p = &s[sizeof(s)];
+  int64_t v;
+  uint64_t u;
+  int i, digits = 0;
+
+  if (!(value > -9e12 && value < 9e12))
+    {
+      int len = snprintf(s, sizeof(s), "%.17g", isfinite(value) ? value : 0.0);
+      geojson_write(s, len);
+      return;
+    }
+  v = llround(value * 1e6);
+  u = v < 0 ? 0ULL - (uint64_t)v : (uint64_t)v;
+  for (i = 0; i < 6; i++)
+    {
+      const int d = u % 10;
+      u /= 10;
+      if (d || digits)
+        {
+          *--p = '0' + d;
+          digits++;
+        }
+    }
+  if (digits)
+    *--p = '.';
+  do {
+    *--p = '0' + (u % 10);
+    u /= 10;
+  } while (u);
+  if (v < 0)
+    *--p = '-';
+  geojson_write(p, &s[sizeof(s)] - p);
+}
+
+/* as JSON string, escaped */
+static void
+geojson_string (const char *restrict s)
+{
+  const char *p;
+  geojson_write("\"", 1);
+  for (p = s; p && *p; p++)
+    {
+      const unsigned char c = (unsigned char)*p;
+      if (c >= 0x20 && c != '"' && c != '\\')
+        continue;
+      geojson_write(s, p - s);
+      s = p + 1;
+      if (c == '"' || c == '\\')
+        {
+          const char e[2] = { '\\', (char)c };
+          geojson_write(e, 2);
+        }
+      else
+        {
+          char e[8];
+          geojson_write(e, snprintf(e, sizeof(e), "\\u%04x", c));
+        }
+    }
+  if (p)
+    geojson_write(s, p - s);
+  geojson_write("\"", 1);
+}
+
+/* the lower byte of each UCS-2 char, as for JSON */
+static void
+geojson_string_tu (BITCODE_TU ws)
+{
+  char s[256];
+  size_t len = 0;
+  while (ws && *ws && len < sizeof(s) - 1)
+    {
+      const char c = (char)(*ws++ & 0xff);
+      s[len++] = c;
+    }
+  s[len] = '\0';
+  geojson_string(s);
+}
+
+/*--------------------------------------------------------------------------------
  * MACROS
  */
 
 #define ACTION geojson
 #define IS_PRINT
 
-#define PREFIX   for (int _i=0; _i<dat->bit; _i++) { fprintf (dat->fh, "  "); }
-#define ARRAY     PREFIX fprintf (dat->fh, "[\n"); dat->bit++
-#define SAMEARRAY PREFIX fprintf (dat->fh, "["); dat->bit++
-#define ENDARRAY  dat->bit--; PREFIX fprintf (dat->fh, "],\n")
-#define LASTENDARRAY dat->bit--; PREFIX fprintf (dat->fh, "]\n")
-#define HASH      PREFIX fprintf (dat->fh, "{\n"); dat->bit++
-#define SAMEHASH  fprintf (dat->fh, "{\n"); dat->bit++
-#define ENDHASH   dat->bit--; PREFIX fprintf (dat->fh, "},\n")
-#define LASTENDHASH dat->bit--; PREFIX fprintf (dat->fh, "}\n")
-#define SECTION(name) PREFIX fprintf (dat->fh, "\"%s\": [\n", #name); dat->bit++;
-#define ENDSEC()  ENDARRAY
-#define NOCOMMA   fseek(dat->fh, -2, SEEK_CUR)
+#define PREFIX    geojson_prefix(dat);
+#define HASH      PREFIX geojson_write("{\n", 2); dat->bit++
+#define SAMEHASH  geojson_write("{\n", 2); dat->bit++
+#define ENDHASH   dat->bit--; PREFIX geojson_write("},\n", 3)
+#define LASTENDHASH dat->bit--; PREFIX geojson_write("}\n", 2)
+#define ENDARRAY  dat->bit--; PREFIX geojson_write("],\n", 3)
+#define LASTENDARRAY dat->bit--; PREFIX geojson_write("]\n", 2)
+#define KEY(name) \
+    PREFIX geojson_write("\"" #name "\": ", sizeof(#name) + 3)
 #define PAIR_S(name, value) \
-    PREFIX fprintf(dat->fh, "\"" #name "\": \"%s\",\n", value)
+    KEY(name); geojson_string(value); geojson_write(",\n", 2)
 #define LASTPAIR_S(name, value) \
-    PREFIX fprintf(dat->fh, "\"" #name "\": \"%s\"\n", value)
+    KEY(name); geojson_string(value); geojson_write("\n", 1)
 #define PAIR_NULL(name) \
-    PREFIX fprintf(dat->fh, "\"" #name "\": null,\n")
-#define KEY(name) \
-    PREFIX fprintf(dat->fh, "\"" #name "\": ")
-#define GEOMETRY(name) \
-    KEY(geometry); SAMEHASH; \
-    PAIR_S(type, #name)
-#define ENDGEOMETRY LASTENDHASH
-
-//#define VALUE(value,type,dxf)
-//    fprintf(dat->fh, FORMAT_##type, value)
-//#define VALUE_RC(value,dxf) VALUE(value, RC, dxf)
-
-#define FIELD(name,type,dxf)
-//    PREFIX fprintf(dat->fh, "\"" #name "\": " FORMAT_##type ",\n", _obj->name)
-#define _FIELD(name,type,value)
-//    PREFIX fprintf(dat->fh, "\"" #name "\": " FORMAT_##type ",\n", obj->name)
-#define ENT_FIELD(name,type,value)
-//    PREFIX fprintf(dat->fh, "\"" #name "\": " FORMAT_##type ",\n", _ent->name)
-#define FIELD_CAST(name,type,cast,dxf) FIELD(name,cast,dxf)
-#define FIELD_TRACE(name,type)
-#define FIELD_TEXT(name,str) 
-#define FIELD_TEXT_TU(name,wstr) 
-
-#define FIELD_VALUE(name) _obj->name
-#define ANYCODE -1
-// todo: only the name, not the ref
-#define FIELD_HANDLE(name, handle_code, dxf)
-#define FIELD_DATAHANDLE(name, code, dxf)
-#define FIELD_HANDLE_N(name, vcount, handle_code, dxf)
-#define FIELD_B(name,dxf)   FIELD(name, B, dxf)
-#define FIELD_BB(name,dxf)  FIELD(name, BB, dxf)
-#define FIELD_3B(name,dxf)  FIELD(name, 3B, dxf)
-#define FIELD_BS(name,dxf)  FIELD(name, BS, dxf)
-#define FIELD_BL(name,dxf)  FIELD(name, BL, dxf)
-#define FIELD_BLL(name,dxf) FIELD(name, BLL, dxf)
-#define FIELD_BD(name,dxf)  FIELD(name, BD, dxf)
-#define FIELD_RC(name,dxf)  FIELD(name, RC, dxf)
-#define FIELD_RS(name,dxf)  FIELD(name, RS, dxf)
-#define FIELD_RD(name,dxf)  FIELD(name, RD, dxf)
-#define FIELD_RL(name,dxf)  FIELD(name, RL, dxf)
-#define FIELD_RLL(name,dxf) FIELD(name, RLL, dxf)
-#define FIELD_MC(name,dxf)  FIELD(name, MC, dxf)
-#define FIELD_MS(name,dxf)  FIELD(name, MS, dxf)
-#define FIELD_TF(name,len,dxf)  FIELD_TEXT(name, _obj->name)
-#define FIELD_TFF(name,len,dxf) FIELD_TEXT(name, _obj->name)
-#define FIELD_TV(name,dxf)      FIELD_TEXT(name, _obj->name)
-#define FIELD_TU(name,dxf)      FIELD_TEXT_TU(name, (BITCODE_TU)_obj->name)
-#define FIELD_T(name,dxf)
-//  { if (dat->version >= R_2007) { FIELD_TU(name, dxf); }
-//    else                        { FIELD_TV(name, dxf); } }
-#define FIELD_BT(name,dxf)    FIELD(name, BT, dxf);
-#define FIELD_4BITS(name,dxf) FIELD(name,4BITS,dxf)
-#define FIELD_BE(name,dxf)    FIELD_3RD(name,dxf)
-#define FIELD_DD(name, _default, dxf) \
-    PREFIX fprintf(dat->fh, FORMAT_DD ", ", _obj->name)
-#define FIELD_2DD(name, d1, d2, dxf)
-#define FIELD_3DD(name, def, dxf)
-#define FIELD_2RD(name,dxf) 
-#define FIELD_2BD(name,dxf)
-#define FIELD_2BD_1(name,dxf)
-#define FIELD_3RD(name,dxf) ;
-#define FIELD_3BD(name,dxf)
-#define FIELD_3BD_1(name,dxf)
-#define VALUE_2DPOINT(px, py) \
-  PREFIX fprintf(dat->fh, "[ " FORMAT_DD ", " FORMAT_DD " ],\n", px, py)
-#define LASTVALUE_2DPOINT(px, py) \
-  PREFIX fprintf(dat->fh, "[ " FORMAT_DD ", " FORMAT_DD " ]\n", px, py)
-#define FIELD_2DPOINT(name)     VALUE_2DPOINT(_obj->name.x, _obj->name.y)
-#define LASTFIELD_2DPOINT(name) LASTVALUE_2DPOINT(_obj->name.x, _obj->name.y)
-#define VALUE_3DPOINT(px, py, pz) \
-    PREFIX fprintf(dat->fh, "[ " FORMAT_DD ", " FORMAT_DD ", " FORMAT_DD " ],\n", \
-            px, py, pz)
-#define LASTVALUE_3DPOINT(px, py, pz) \
-    PREFIX fprintf(dat->fh, "[ " FORMAT_DD ", " FORMAT_DD ", " FORMAT_DD " ]\n", \
-            px, py, pz)
-#define FIELD_3DPOINT(name)     VALUE_3DPOINT(_obj->name.x, _obj->name.y, _obj->name.z)
-#define LASTFIELD_3DPOINT(name) LASTVALUE_3DPOINT(_obj->name.x, _obj->name.y, _obj->name.z)
-#define FIELD_CMC(name,dxf1,dxf2)
-#define FIELD_TIMEBLL(name,dxf)
-
-//FIELD_VECTOR_N(name, type, size):
-// reads data of the type indicated by 'type' 'size' times and stores
-// it all in the vector called 'name'.
-#define FIELD_VECTOR_N(name, type, size, dxf)\
-    ARRAY; \
-    for (vcount=0; vcount < (BITCODE_BL)size; vcount++)\
-      {\
-        PREFIX fprintf(dat->fh, "\"" #name "\": " FORMAT_##type ",\n", _obj->name[vcount]); \
-      }\
-    if (size) NOCOMMA;\
-    ENDARRAY;
-#define FIELD_VECTOR_T(name, size, dxf)\
-    ARRAY; \
-    PRE (R_2007) { \
-      for (vcount=0; vcount < (BITCODE_BL)_obj->size; vcount++) { \
-        PREFIX fprintf(dat->fh, "\"" #name "\": \"%s\",\n", _obj->name[vcount]); \
-      }\
-    } else { \
-      for (vcount=0; vcount < (BITCODE_BL)_obj->size; vcount++)\
-        FIELD_TEXT_TU(name, _obj->name[vcount]); \
-    } \
-    if (_obj->size) NOCOMMA;\
-    ENDARRAY;
-
-#define FIELD_VECTOR(name, type, size, dxf) FIELD_VECTOR_N(name, type, _obj->size, dxf)
-
-#define FIELD_2RD_VECTOR(name, size, dxf)\
-  ARRAY;\
-  for (vcount=0; vcount < (BITCODE_BL)_obj->size; vcount++)\
-    {\
-      FIELD_2RD(name[vcount], dxf);\
-    }\
-  if (_obj->size) NOCOMMA;\
-  ENDARRAY;
-
-#define FIELD_2DD_VECTOR(name, size, dxf)\
-  ARRAY;\
-  FIELD_2RD(name[0], 0);\
-  for (vcount = 1; vcount < (BITCODE_BL)_obj->size; vcount++)\
-    {\
-      FIELD_2DD(name[vcount], FIELD_VALUE(name[vcount - 1].x), FIELD_VALUE(name[vcount - 1].y), dxf);\
-    }\
-  if (_obj->size) NOCOMMA;\
-  ENDARRAY;
-
-#define FIELD_3DPOINT_VECTOR(name, size, dxf)\
-  ARRAY;\
-  for (vcount=0; vcount < (BITCODE_BL)_obj->size; vcount++)\
-    {\
-      FIELD_3DPOINT(name[vcount], dxf);\
-    }\
-  if (_obj->size) NOCOMMA;\
-  ENDARRAY;
+    KEY(name); geojson_write("null,\n", 6)
+#define SECTION(name) \
+    KEY(name); geojson_write("[\n", 2); dat->bit++
 
 #define WARN_UNSTABLE_CLASS \
       LOG_WARN("Unstable Class %s %d %s (0x%x%s) -@%ld", is_entity ? "entity" : "object",\
@@ -231,303 +271,470 @@ static unsigned int cur_ver = 0;
                klass->wasazombie ? " was proxy" : "",\
                obj->address + obj->size)
 
+/*--------------------------------------------------------------------------------
+ * Geometry, from dwg_tessellate()
+ */
+
+/* The affine transform p' = m * p + t of the INSERT's, row-major 3x4 */
+typedef struct _geojson_xform
+{
+  double m[3][4];
+} Geojson_Xform;
+
+/* The points of the current entity */
+static THREAD_LOCAL Dwg_Tessellation tess;
+static THREAD_LOCAL int has_z;
+
+static void
+xform_identity (Geojson_Xform *restrict xf)
+{
+  memset(xf, 0, sizeof(Geojson_Xform));
+  xf->m[0][0] = xf->m[1][1] = xf->m[2][2] = 1.0;
+}
+
+static int
+xform_is_identity (const Geojson_Xform *restrict xf)
+{
+  Geojson_Xform id;
+  xform_identity(&id);
+  return !memcmp(xf, &id, sizeof(Geojson_Xform));
+}
+
+/* xf = parent * OCS(extrusion) * T(ins_pt) * Rz(rotation) * S(scale)
+        * T(-base_pt) */
+static void
+xform_insert (Geojson_Xform *restrict xf, const Geojson_Xform *restrict parent,
+              const BITCODE_3BD *restrict extrusion,
+              const BITCODE_3DPOINT *restrict ins_pt,
+              const BITCODE_3DPOINT *restrict scale, double rotation,
+              const BITCODE_3DPOINT *restrict base_pt)
+{
+  const double c = cos(rotation), s = sin(rotation);
+  double l[3][4], ocs[9];
+  int i, j;
+
+  l[0][0] = c * scale->x; l[0][1] = -s * scale->y; l[0][2] = 0.0;
+  l[1][0] = s * scale->x; l[1][1] =  c * scale->y; l[1][2] = 0.0;
+  l[2][0] = 0.0;          l[2][1] = 0.0;           l[2][2] = scale->z;
+  for (i = 0; i < 3; i++)
+    l[i][3] = (i == 0 ? ins_pt->x : i == 1 ? ins_pt->y : ins_pt->z)
+              - l[i][0] * base_pt->x - l[i][1] * base_pt->y
+              - l[i][2] * base_pt->z;
+  if (dwg_ocs_matrix(extrusion, ocs))
+    for (j = 0; j < 4; j++)
+      {
+        const double l0 = l[0][j], l1 = l[1][j], l2 = l[2][j];
+        for (i = 0; i < 3; i++)
+          l[i][j] = ocs[i] * l0 + ocs[3 + i] * l1 + ocs[6 + i] * l2;
+      }
+  for (i = 0; i < 3; i++)
+    {
+      for (j = 0; j < 4; j++)
+        xf->m[i][j] = parent->m[i][0] * l[0][j] + parent->m[i][1] * l[1][j]
+                      + parent->m[i][2] * l[2][j];
+      xf->m[i][3] += parent->m[i][3];
+    }
+}
+
+/* all points at once, over the separate x, y, z arrays */
+static void
+xform_points (const Geojson_Xform *restrict xf, Dwg_Tessellation *restrict t)
+{
+  double *restrict x = t->x;
+  double *restrict y = t->y;
+  double *restrict z = t->z;
+  const double (*m)[4] = xf->m;
+  BITCODE_BL i;
+  for (i = 0; i < t->num_points; i++)
+    {
+      const double px = x[i], py = y[i], pz = z[i];
+      x[i] = m[0][0] * px + m[0][1] * py + m[0][2] * pz + m[0][3];
+      y[i] = m[1][0] * px + m[1][1] * py + m[1][2] * pz + m[1][3];
+      z[i] = m[2][0] * px + m[2][1] * py + m[2][2] * pz + m[2][3];
+    }
+}
+
+/* part i of tess is a closed ring, of at least 4 positions */
+static int
+geojson_ring (BITCODE_BL i)
+{
+  const BITCODE_BL to = i + 1 < tess.num_parts ? tess.parts[i + 1]
+                                               : tess.num_points;
+  return tess.closed[i] && to - tess.parts[i] >= 4;
+}
+
+/* The GeoJSON geometry type of tess. Shorter closed parts are not
+   valid rings, so with one of them all are LineStrings. */
+static const char *
+geojson_type (void)
+{
+  BITCODE_BL i;
+
+  if (tess.num_parts == 1)
+    {
+      if (tess.num_points == 1)
+        return "Point";
+      return geojson_ring(0) ? "Polygon" : "LineString";
+    }
+  for (i = 0; i < tess.num_parts; i++)
+    if (!geojson_ring(i))
+      return "MultiLineString";
+  return "MultiPolygon";
+}
+
+/* The GeoJSON geometry type of obj, its points in tess, transformed by
+   xf. NULL for no geometry. */
+static const char *
+geojson_tessellate (const Dwg_Object *restrict obj,
+                    const Geojson_Xform *restrict xf, double tol,
+                    int *restrict error)
+{
+  BITCODE_BL i;
+
+  has_z = 0;
+  if ((*error = dwg_tessellate(obj, tol, &tess)))
+    {
+      if (*error != DWG_ERR_OUTOFMEM)
+        *error = 0;
+      return NULL;
+    }
+  if (!tess.num_points)
+    return NULL;
+  if (!xform_is_identity(xf))
+    xform_points(xf, &tess);
+  for (i = 0; i < tess.num_points; i++)
+    if (fabs(tess.z[i]) > 0.000001)
+      {
+        has_z = 1;
+        break;
+      }
+  return geojson_type();
+}
+
+/*--------------------------------------------------------------------------------
+ * Output
+ */
+
+static void
+geojson_position (Bit_Chain *restrict dat, BITCODE_BL i)
+{
+  PREFIX geojson_write("[ ", 2);
+  geojson_double(tess.x[i]);
+  geojson_write(", ", 2);
+  geojson_double(tess.y[i]);
+  if (has_z)
+    {
+      geojson_write(", ", 2);
+      geojson_double(tess.z[i]);
+    }
+  geojson_write(" ]", 2);
+}
+
+/* the positions from..to, as array */
+static void
+geojson_positions (Bit_Chain *restrict dat, BITCODE_BL from, BITCODE_BL to)
+{
+  BITCODE_BL i;
+  PREFIX geojson_write("[\n", 2);
+  dat->bit++;
+  for (i = from; i < to; i++)
+    {
+      geojson_position(dat, i);
+      geojson_write(i + 1 < to ? ",\n" : "\n", i + 1 < to ? 2 : 1);
+    }
+  dat->bit--;
+  PREFIX geojson_write("]", 1);
+}
+
+/* tess as geometry object, without the newline */
+static void
+geojson_geometry (Bit_Chain *restrict dat, const char *restrict type)
+{
+  BITCODE_BL i;
+  const int multi = !strcmp(type, "MultiPolygon");
+
+  geojson_write("{\n", 2);
+  dat->bit++;
+  PAIR_S(type, type);
+  KEY(coordinates);
+  if (!strcmp(type, "Point"))
+    {
+      dat->bit--;
+      geojson_position(dat, 0);
+      dat->bit++;
+      geojson_write("\n", 1);
+    }
+  else if (!strcmp(type, "LineString"))
+    {
+      geojson_write("\n", 1);
+      geojson_positions(dat, 0, tess.num_points);
+      geojson_write("\n", 1);
+    }
+  else
+    {
+      // Polygon with its ring, MultiLineString, MultiPolygon of rings
+      geojson_write("[\n", 2);
+      dat->bit++;
+      for (i = 0; i < tess.num_parts; i++)
+        {
+          const BITCODE_BL to = i + 1 < tess.num_parts ? tess.parts[i + 1]
+                                                       : tess.num_points;
+          if (multi)
+            {
+              PREFIX geojson_write("[\n", 2);
+              dat->bit++;
+            }
+          geojson_positions(dat, tess.parts[i], to);
+          if (multi)
+            {
+              geojson_write("\n", 1);
+              dat->bit--;
+              PREFIX geojson_write("]", 1);
+            }
+          geojson_write(i + 1 < tess.num_parts ? ",\n" : "\n",
+                        i + 1 < tess.num_parts ? 2 : 1);
+        }
+      dat->bit--;
+      PREFIX geojson_write("]\n", 2);
+    }
+  dat->bit--;
+  PREFIX geojson_write("}", 1);
+}
+
 // common properties
 static void
-dwg_geojson_feature(Bit_Chain *restrict dat, Dwg_Object *restrict obj,
+dwg_geojson_feature(Bit_Chain *restrict dat, const Dwg_Object *restrict obj,
                     const char *restrict subclass)
 {
   char tmp[64];
+  const Dwg_Object *layer = obj->supertype == DWG_SUPERTYPE_ENTITY
+                            && obj->tio.entity->layer
+                            ? obj->tio.entity->layer->obj : NULL;
   PAIR_S(type, "Feature");
   KEY(properties);
   SAMEHASH;
-  PAIR_S(Layer, "0"); //TODO layer name
+    KEY(Layer);
+    if (layer && layer->supertype == DWG_SUPERTYPE_OBJECT
+        && layer->fixedtype == DWG_TYPE_LAYER && layer->tio.object->tio.LAYER)
+      {
+        const Dwg_Object_LAYER *_layer = layer->tio.object->tio.LAYER;
+        if (dat->version >= R_2007)
+          geojson_string_tu((BITCODE_TU)_layer->entry_name);
+        else
+          geojson_string(_layer->entry_name);
+      }
+    else
+      geojson_string("0");
+    geojson_write(",\n", 2);
     PAIR_S(SubClasses, subclass);
     PAIR_NULL(ExtendedEntity);
     PAIR_NULL(Linetype);
 
-    sprintf(tmp, "%lX", obj->handle.value);
+    snprintf(tmp, sizeof(tmp), "%lX", obj->handle.value);
     PAIR_S(EntityHandle, tmp);
     //TODO if has name or text
-    if (obj->type == DWG_TYPE_GEOPOSITIONMARKER) {
+    if (obj->fixedtype == DWG_TYPE_GEOPOSITIONMARKER) {
       Dwg_Entity_GEOPOSITIONMARKER *_obj = obj->tio.entity->tio.GEOPOSITIONMARKER;
-      PAIR_S(Text, _obj->text);
+      KEY(Text);
+      if (dat->version >= R_2007)
+        geojson_string_tu((BITCODE_TU)_obj->text);
+      else
+        geojson_string(_obj->text);
+      geojson_write("\n", 1);
     }
     else
-      PAIR_NULL(Text);
+      {
+        KEY(Text);
+        geojson_write("null\n", 5);
+      }
   ENDHASH;
 }
 
-#define FEATURE(subclass, obj) HASH; dwg_geojson_feature(dat, obj, #subclass)
-#define ENDFEATURE ENDHASH
+static const char *
+geojson_subclass (const Dwg_Object *restrict obj)
+{
+  switch (obj->parent->header.version < R_13 ? (int)obj->type
+                                             : (int)obj->fixedtype)
+    {
+    case DWG_TYPE_INSERT:
+    case DWG_TYPE_MINSERT:  return "AcDbEntity:AcDbBlockReference";
+    case DWG_TYPE_LINE:     return "AcDbEntity:AcDbLine";
+    case DWG_TYPE_POINT:    return "AcDbEntity:AcDbPoint";
+    case DWG_TYPE_CIRCLE:   return "AcDbEntity:AcDbCircle";
+    case DWG_TYPE_ARC:      return "AcDbEntity:AcDbCircle:AcDbArc";
+    case DWG_TYPE_ELLIPSE:  return "AcDbEntity:AcDbEllipse";
+    case DWG_TYPE_SPLINE:   return "AcDbEntity:AcDbSpline";
+    case DWG_TYPE_LWPOLYLINE: return "AcDbEntity:AcDbLwPolyline";
+    case DWG_TYPE_POLYLINE_2D:
+    case DWG_TYPE_POLYLINE_3D: return "AcDbEntity:AcDbPolyline";
+    case DWG_TYPE_POLYLINE_PFACE: return "AcDbEntity:AcDbPolyFaceMesh";
+    case DWG_TYPE_POLYLINE_MESH: return "AcDbEntity:AcDbPolygonMesh";
+    case DWG_TYPE_SOLID:
+    case DWG_TYPE_TRACE:    return "AcDbEntity:AcDbTrace";
+    case DWG_TYPE__3DFACE:  return "AcDbEntity:AcDbFace";
+    case DWG_TYPE_GEOPOSITIONMARKER:
+      return "AcDbEntity:AcDbGeoPositionMarker";
+    default:                return "AcDbEntity";
+    }
+}
 
-/* returns 0 if object could be printed
- */
+/* The geometries of the entities of the block of an INSERT or MINSERT,
+   flattened into the current GeometryCollection */
 static int
-dwg_geojson_variable_type(Dwg_Data *restrict dwg, Bit_Chain *restrict dat,
-                          Dwg_Object *restrict obj)
+geojson_insert (Bit_Chain *restrict dat, const Dwg_Object *restrict obj,
+                const Geojson_Xform *restrict parent, double tol, int depth,
+                int *restrict first)
 {
-  int i;
-  char *dxfname;
-  Dwg_Class *klass;
-  int is_entity;
-
-  i = obj->type - 500;
-  if (i < 0 || i >= (int)dwg->num_classes)
-    return DWG_ERR_INVALIDTYPE;
-
-  klass = &dwg->dwg_class[i];
-  if (!klass || ! klass->dxfname)
-    return DWG_ERR_INTERNALERROR;
-  dxfname = klass->dxfname;
-  // almost always false
-  is_entity = dwg_class_is_entity(klass);
-  
-  if (!strcmp(dxfname, "LWPOLYLINE"))
+  Dwg_Data *dwg = obj->parent;
+  const Dwg_Entity_MINSERT *mins = NULL;
+  const Dwg_Entity_INSERT *ins = NULL;
+  Dwg_Object *hdr;
+  BITCODE_3DPOINT base_pt = { 0.0, 0.0, 0.0 };
+  BITCODE_BS rows = 1, cols = 1, r, c;
+
+  if (depth > GEOJSON_MAX_NESTING)
     {
-      BITCODE_BL j;
-      Dwg_Entity_LWPOLYLINE *_obj = obj->tio.entity->tio.LWPOLYLINE;
-      //TODO: if closed and num_points > 3 use a Polygon
-      FEATURE(AcDbEntity:AcDbLwPolyline, obj);
-      GEOMETRY(LineString);
-      KEY(coordinates);
-        ARRAY;
-        for (j = 0; j < _obj->num_points-1 ; j++)
-        {
-          FIELD_2DPOINT(points[j]);
-        }
-        LASTFIELD_2DPOINT(points[j+1]);
-        LASTENDARRAY;
-      ENDGEOMETRY;
-      ENDFEATURE;
+      LOG_WARN("INSERT nested too deep");
       return 0;
     }
-  if (!strcmp(dxfname, "GEODATA"))
+  if (obj->fixedtype == DWG_TYPE_MINSERT)
     {
-      Dwg_Object_GEODATA *_obj = obj->tio.object->tio.GEODATA;
-      WARN_UNSTABLE_CLASS;
-      FEATURE(AcDbObject:AcDbGeoData, obj);
-      //which fields?
-      ENDFEATURE;
-      return 0;
+      mins = obj->tio.entity->tio.MINSERT;
+      hdr = mins->block_header ? dwg_ref_object(dwg, mins->block_header) : NULL;
+      rows = mins->num_rows ? mins->num_rows : 1;
+      cols = mins->num_cols ? mins->num_cols : 1;
     }
-  if (!strcmp(dxfname, "GEOPOSITIONMARKER"))
+  else
     {
-      Dwg_Entity_GEOPOSITIONMARKER *_obj = obj->tio.entity->tio.GEOPOSITIONMARKER;
-      WARN_UNSTABLE_CLASS;
-      // now even with text
-      FEATURE(AcDbEntity:AcDbGeoPositionMarker, obj);
-      GEOMETRY(Point);
-      KEY(coordinates);
-      if (fabs(_obj->position.z) > 0.000001)
-        {
-          VALUE_3DPOINT(_obj->position.x, _obj->position.y, _obj->position.z);
-        }
-      else
-        {
-          VALUE_2DPOINT(_obj->position.x, _obj->position.y);
-        }
-      ENDGEOMETRY;
-      ENDFEATURE;
-      return 0;
+      ins = obj->tio.entity->tio.INSERT;
+      hdr = ins->block_header ? dwg_ref_object(dwg, ins->block_header) : NULL;
     }
+  if (!hdr || hdr->fixedtype != DWG_TYPE_BLOCK_HEADER
+      || !hdr->tio.object->tio.BLOCK_HEADER)
+    return 0;
+  base_pt = hdr->tio.object->tio.BLOCK_HEADER->base_pt;
 
-  return DWG_ERR_UNHANDLEDCLASS;
-}
-
-static void
-dwg_geojson_object(Bit_Chain *restrict dat, Dwg_Object *restrict obj)
-{
-  switch (obj->type)
-    {
-    case DWG_TYPE_INSERT:
-      {
-        Dwg_Entity_INSERT *_obj = obj->tio.entity->tio.INSERT;
-        FEATURE(AcDbEntity:AcDbBlockReference, obj);
-        //TODO: explode insert into a GeometryCollection
-        GEOMETRY(Point);
-        KEY(coordinates);
-        ARRAY; LASTFIELD_3DPOINT(ins_pt); LASTENDARRAY;
-        ENDGEOMETRY;
-        ENDFEATURE;
-      }
-      break;
-    case DWG_TYPE_MINSERT:
-      //dwg_geojson_MINSERT(dat, obj);
-      break;
-    case DWG_TYPE_VERTEX_2D:
-      //dwg_geojson_VERTEX_2D(dat, obj);
-      break;
-    case DWG_TYPE_VERTEX_3D:
-      //dwg_geojson_VERTEX_3D(dat, obj);
-      break;
-    case DWG_TYPE_VERTEX_MESH:
-      //dwg_geojson_VERTEX_MESH(dat, obj);
-      break;
-    case DWG_TYPE_VERTEX_PFACE:
-      //dwg_geojson_VERTEX_PFACE(dat, obj);
-      break;
-    case DWG_TYPE_VERTEX_PFACE_FACE:
-      //dwg_geojson_VERTEX_PFACE_FACE(dat, obj);
-      break;
-    case DWG_TYPE_POLYLINE_2D:
+  for (r = 0; r < rows; r++)
+    for (c = 0; c < cols; c++)
       {
+        Geojson_Xform xf;
+        BITCODE_3DPOINT ins_pt;
+        Dwg_Owned_Iter it;
+        Dwg_Object *o;
         int error;
-        BITCODE_BL j, numpts;
-        dwg_point_2d *pts;
-        FEATURE(AcDbEntity:AcDbPolyline, obj);
-        GEOMETRY(MultiLineString);
-        KEY(coordinates);
-          ARRAY;
-          numpts = dwg_object_polyline_2d_get_numpoints(obj, &error);
-          pts = dwg_object_polyline_2d_get_points(obj, &error);
-          for (j=0; j<numpts; j++)
-            {
-              if (j == numpts-1)
-                {
-                  LASTVALUE_2DPOINT(pts[j].x, pts[j].y);
-                }
-              else
-                {
-                  VALUE_2DPOINT(pts[j].x, pts[j].y);
-                }
-            }
-          LASTENDARRAY;
-        ENDGEOMETRY;
-        ENDFEATURE;
-      }
-      break;
-    case DWG_TYPE_POLYLINE_3D:
-      {
-        int error;
-        BITCODE_BL j, numpts;
-        dwg_point_3d *pts;
-        FEATURE(AcDbEntity:AcDbPolyline, obj);
-        GEOMETRY(MultiLineString);
-        KEY(coordinates);
-          ARRAY;
-          numpts = dwg_object_polyline_3d_get_numpoints(obj, &error);
-          pts = dwg_object_polyline_3d_get_points(obj, &error);
-          for (j=0; j<numpts; j++)
-            {
-              if (j == numpts-1)
-                {
-                  LASTVALUE_3DPOINT(pts[j].x, pts[j].y, pts[j].z);
-                }
-              else
-                {
-                  VALUE_3DPOINT(pts[j].x, pts[j].y, pts[j].z);
-                }
-            }
-          LASTENDARRAY;
-        ENDGEOMETRY;
-        ENDFEATURE;
-      }
-      break;
-    case DWG_TYPE_ARC:
-      //dwg_geojson_ARC(dat, obj);
-      break;
-    case DWG_TYPE_CIRCLE:
-      //dwg_geojson_CIRCLE(dat, obj);
-      break;
-    case DWG_TYPE_LINE:
-      {
-        Dwg_Entity_LINE *_obj = obj->tio.entity->tio.LINE;
-        FEATURE(AcDbEntity:AcDbLine, obj);
-        GEOMETRY(LineString);
-        KEY(coordinates);
-          ARRAY;
-          FIELD_3DPOINT(start); LASTFIELD_3DPOINT(end);
-          LASTENDARRAY;
-        ENDGEOMETRY;
-        ENDFEATURE;
-      }
-      break;
-    case DWG_TYPE_POINT:
-      {
-        Dwg_Entity_POINT *_obj = obj->tio.entity->tio.POINT;
-        FEATURE(AcDbEntity:AcDbPoint, obj);
-        GEOMETRY(Point);
-        KEY(coordinates);
-        if (fabs(_obj->z) > 0.000001)
+        if (mins)
           {
-            VALUE_3DPOINT(_obj->x, _obj->y, _obj->z);
+            // the grid is in the rotated block, in front of the scale
+            const double cs = cos(mins->rotation), sn = sin(mins->rotation);
+            const double dx = c * mins->col_spacing, dy = r * mins->row_spacing;
+            ins_pt.x = mins->ins_pt.x + cs * dx - sn * dy;
+            ins_pt.y = mins->ins_pt.y + sn * dx + cs * dy;
+            ins_pt.z = mins->ins_pt.z;
+            xform_insert(&xf, parent, &mins->extrusion, &ins_pt,
+                         &mins->scale, mins->rotation, &base_pt);
           }
         else
+          xform_insert(&xf, parent, &ins->extrusion, &ins->ins_pt,
+                       &ins->scale, ins->rotation, &base_pt);
+        if (dwg_owned_iter_init(&it, hdr))
+          return 0;
+        while ((o = dwg_owned_iter_next(&it)))
           {
-            VALUE_2DPOINT(_obj->x, _obj->y);
+            const char *type;
+            if (o->fixedtype == DWG_TYPE_INSERT
+                || o->fixedtype == DWG_TYPE_MINSERT)
+              {
+                if ((error = geojson_insert(dat, o, &xf, tol, depth + 1,
+                                            first)))
+                  return error;
+                continue;
+              }
+            type = geojson_tessellate(o, &xf, tol, &error);
+            if (error)
+              return error;
+            if (!type)
+              continue;
+            if (!*first)
+              geojson_write(",\n", 2);
+            *first = 0;
+            PREFIX geojson_geometry(dat, type);
           }
-        ENDGEOMETRY;
-        ENDFEATURE;
       }
-      break;
-    case DWG_TYPE__3DFACE:
-      //dwg_geojson__3DFACE(dat, obj);
-      break;
-    case DWG_TYPE_POLYLINE_PFACE:
-      //dwg_geojson_POLYLINE_PFACE(dat, obj);
-      break;
-    case DWG_TYPE_POLYLINE_MESH:
-      //dwg_geojson_POLYLINE_MESH(dat, obj);
-      break;
-    case DWG_TYPE_SOLID:
-      //dwg_geojson_SOLID(dat, obj);
-      break;
-    case DWG_TYPE_TRACE:
-      //dwg_geojson_TRACE(dat, obj);
-      break;
-    case DWG_TYPE_ELLIPSE:
-      //dwg_geojson_ELLIPSE(dat, obj);
-      break;
-    case DWG_TYPE_SPLINE:
-      //dwg_geojson_SPLINE(dat, obj);
-      break;
-    case DWG_TYPE_REGION:
-      //dwg_geojson_REGION(dat, obj);
-      break;
-    case DWG_TYPE_HATCH:
-      //dwg_geojson_HATCH(dat, obj);
-      break;
-    case DWG_TYPE__3DSOLID:
-      //dwg_geojson__3DSOLID(dat, obj);
-      break; /* Check the type of the object
-              */
-    case DWG_TYPE_BODY:
-      //dwg_geojson_BODY(dat, obj);
-      break;
-    case DWG_TYPE_RAY:
-      //dwg_geojson_RAY(dat, obj);
-      break;
-    case DWG_TYPE_XLINE:
-      //dwg_geojson_XLINE(dat, obj);
-      break;
-    case DWG_TYPE_MTEXT:
-      //dwg_geojson_MTEXT(dat, obj);
-      break;
-    case DWG_TYPE_MLINE:
-      //dwg_geojson_MLINE(dat, obj);
-      break;
-    case DWG_TYPE_LWPOLYLINE:
-      //dwg_geojson_LWPOLYLINE(dat, obj);
-      break;
-    default:
-      if (obj->type != obj->parent->layout_number)
-        dwg_geojson_variable_type(obj->parent, dat, obj);
+  return 0;
+}
+
+/* returns 1 if written */
+static int
+dwg_geojson_object(Bit_Chain *restrict dat, const Dwg_Object *restrict obj,
+                   double tol, int first, int *restrict error)
+{
+  Geojson_Xform xf;
+  const char *type;
+  xform_identity(&xf);
+  if (obj->supertype != DWG_SUPERTYPE_ENTITY)
+    return 0;
+  if (obj->fixedtype == DWG_TYPE_INSERT || obj->fixedtype == DWG_TYPE_MINSERT)
+    {
+      int first_geom = 1;
+      if (!first)
+        geojson_write(",\n", 2);
+      HASH;
+      dwg_geojson_feature(dat, obj, geojson_subclass(obj));
+      KEY(geometry);
+      SAMEHASH;
+      PAIR_S(type, "GeometryCollection");
+      KEY(geometries);
+      geojson_write("[\n", 2);
+      dat->bit++;
+      *error = geojson_insert(dat, obj, &xf, tol, 0, &first_geom);
+      if (!first_geom)
+        geojson_write("\n", 1);
+      LASTENDARRAY;
+      LASTENDHASH;
+      dat->bit--;
+      PREFIX geojson_write("}", 1);
+      return 1;
     }
+  type = geojson_tessellate(obj, &xf, tol, error);
+  if (!type)
+    return 0;
+  if (!first)
+    geojson_write(",\n", 2);
+  HASH;
+  dwg_geojson_feature(dat, obj, geojson_subclass(obj));
+  KEY(geometry);
+  geojson_geometry(dat, type);
+  geojson_write("\n", 1);
+  dat->bit--;
+  PREFIX geojson_write("}", 1);
+  return 1;
 }
 
+/* the entities of the model space, one feature each */
 static int
 geojson_entities_write (Bit_Chain *restrict dat, Dwg_Data *restrict dwg)
 {
   BITCODE_BL i;
+  int first = 1, error = 0;
+  const double tol = dwg->tolerance;
 
   SECTION(features);
   for (i=0; i < dwg->num_objects; i++)
     {
       Dwg_Object *obj = &dwg->object[i];
-      dwg_geojson_object(dat, obj);
+      if (obj->supertype != DWG_SUPERTYPE_ENTITY || !obj->tio.entity)
+        continue;
+      // skip the entities of blocks and paper space
+      if (dwg->header.version >= R_13 && obj->tio.entity->entity_mode != 2)
+        continue;
+      if (dwg_geojson_object(dat, obj, tol, first, &error))
+        first = 0;
+      if (error)
+        return error;
     }
-  NOCOMMA;
-  ENDSEC();
+  if (!first)
+    geojson_write("\n", 1);
+  ENDARRAY;
   return 0;
 }
 
@@ -537,22 +744,33 @@ dwg_write_geojson(Bit_Chain *restrict dat, Dwg_Data *restrict dwg)
   //const int minimal = dwg->opts & 0x10;
   char date[12] = "YYYY-MM-DD";
   time_t rawtime;
+  int error;
+  Dwg_Thread_State state;
 
+  dwg_log_enter(dwg, &state);
+  if (geojson_writer_init(dat->fh))
+    {
+      dwg_log_leave(&state);
+      return 1;
+    }
+  dat->bit = 0;
   HASH;
   PAIR_S(type, "FeatureCollection");
 
   //array of features
-  if (geojson_entities_write (dat, dwg))
+  error = geojson_entities_write (dat, dwg);
+  dwg_free_tessellation(&tess);
+  if (error)
     goto fail;
 
   KEY(geocoding);
-  HASH;
+  SAMEHASH;
     time(&rawtime);
     strftime(date, 12, "%Y-%m-%d", localtime(&rawtime));
     PAIR_S(creation_date, date);
     KEY(generator);
-    HASH;
-      KEY(author); HASH; PAIR_S(name, "dwgread"); ENDHASH;
+    SAMEHASH;
+      KEY(author); SAMEHASH; LASTPAIR_S(name, "dwgread"); ENDHASH;
       PAIR_S(package, PACKAGE_NAME);
       LASTPAIR_S(version, PACKAGE_VERSION);
     LASTENDHASH;
@@ -560,8 +778,12 @@ dwg_write_geojson(Bit_Chain *restrict dat, Dwg_Data *restrict dwg)
   LASTENDHASH;
 
   LASTENDHASH;
-  return 0;
+  error = geojson_writer_end();
+  dwg_log_leave(&state);
+  return error;
  fail:
+  geojson_writer_end();
+  dwg_log_leave(&state);
   return 1;
 }
 
@@ -19,6 +19,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <float.h>
 #include <assert.h>
 
 #include "common.h"
@@ -33,6 +36,367 @@
 /* the current version per spec block */
 static unsigned int cur_ver = 0;
 
+/* The output buffer. Everything is formatted into it and written with
+   fwrite, instead of one fprintf per field and per indentation level.
+   A flush keeps the last bytes back, so that NOCOMMA can still take back
+   a trailing comma, also on pipes where fseek fails. Without fh it grows,
+   for dwg_write_json_buffer(). */
+#define JSON_BUFSIZE (1 << 16)
+#define JSON_KEEP 2
+typedef struct _json_writer
+{
+  char *buf;
+  size_t len;
+  size_t size;
+  FILE *fh;
+  int error;
+  int compact; /* no indentation and newlines, opts 0x80 */
+} Json_Writer;
+static THREAD_LOCAL Json_Writer out;
+
+static int
+json_writer_init (FILE *fh, int compact)
+{
+  memset(&out, 0, sizeof(out));
+  out.fh = fh;
+  out.compact = compact;
+  out.buf = (char*)dwg_malloc(JSON_BUFSIZE);
+  if (!out.buf)
+    {
+      LOG_ERROR("Out of memory");
+      return DWG_ERR_OUTOFMEM;
+    }
+  out.size = JSON_BUFSIZE;
+  return 0;
+}
+
+/* write all but the last keep bytes */
+static void
+json_flush (size_t keep)
+{
+  size_t n;
+  if (!out.fh || out.len <= keep)
+    return;
+  n = out.len - keep;
+  if (fwrite(out.buf, 1, n, out.fh) != n)
+    out.error = 1;
+  memmove(out.buf, &out.buf[n], keep);
+  out.len = keep;
+}
+
+static void
+json_write (const char *restrict s, size_t len)
+{
+  if (out.len + len > out.size && !out.fh)
+    {
+      size_t size = out.size ? out.size : JSON_BUFSIZE;
+      char *buf;
+      while (size < out.len + len)
+        size *= 2;
+      buf = (char*)dwg_realloc(out.buf, size);
+      if (!buf)
+        {
+          out.error = 1;
+          return;
+        }
+      out.buf = buf;
+      out.size = size;
+    }
+  else if (out.len + len > out.size)
+    {
+      json_flush(JSON_KEEP);
+      if (out.len + len > out.size)
+        {
+          /* too long for the buffer: write through, all but the tail */
+          size_t n = len - JSON_KEEP;
+          json_flush(0);
+          if (fwrite(s, 1, n, out.fh) != n)
+            out.error = 1;
+          s += n;
+          len = JSON_KEEP;
+        }
+    }
+  memcpy(&out.buf[out.len], s, len);
+  out.len += len;
+}
+
+/* flush and free the buffer, 1 if any write failed */
+static int
+json_writer_end (void)
+{
+  int error;
+  json_flush(0);
+  dwg_dealloc(out.buf);
+  error = out.error;
+  memset(&out, 0, sizeof(out));
+  return error;
+}
+
+static inline void
+json_putc (char c)
+{
+  if (out.len < out.size)
+    out.buf[out.len++] = c;
+  else
+    json_write(&c, 1);
+}
+
+/* 2 spaces per level */
+static void
+json_prefix (const Bit_Chain *restrict dat)
+{
+  static const char spaces[] = "                                "
+                               "                                ";
+  size_t n;
+  if (out.compact)
+    return;
+  n = 2 * (size_t)dat->bit;
+  while (n > sizeof(spaces) - 1)
+    {
+      json_write(spaces, sizeof(spaces) - 1);
+      n -= sizeof(spaces) - 1;
+    }
+  json_write(spaces, n);
+}
+
+static inline void
+json_newline (void)
+{
+  if (!out.compact)
+    json_putc('\n');
+}
+
+/* "name": */
+static void
+json_key (const char *restrict name, size_t len)
+{
+  json_putc('"');
+  json_write(name, len);
+  if (out.compact)
+    json_write("\":", 2);
+  else
+    json_write("\": ", 3);
+}
+
+static void
+json_end (void)
+{
+  if (out.compact)
+    json_putc(',');
+  else
+    json_write(",\n", 2);
+}
+
+/* take back the comma of the last value, if any */
+static void
+json_nocomma (void)
+{
+  if (out.compact)
+    {
+      if (out.len && out.buf[out.len - 1] == ',')
+        out.len--;
+    }
+  else if (out.len >= 2 && !memcmp(&out.buf[out.len - 2], ",\n", 2))
+    {
+      out.buf[out.len - 2] = '\n';
+      out.len--;
+    }
+}
+
+static void
+json_open (Bit_Chain *restrict dat, char c)
+{
+  json_prefix(dat);
+  json_putc(c);
+  json_newline();
+  dat->bit++;
+}
+
+static void
+json_close (Bit_Chain *restrict dat, char c)
+{
+  dat->bit--;
+  json_prefix(dat);
+  json_putc(c);
+  json_end();
+}
+
+/* "name": [ */
+static void
+json_open_key (Bit_Chain *restrict dat, const char *restrict name, size_t len)
+{
+  json_prefix(dat);
+  json_key(name, len);
+  json_putc('[');
+  json_newline();
+  dat->bit++;
+}
+
+static void
+json_int (BITCODE_RLL value)
+{
+  char s[24];
+  char *p = &s[sizeof(s)];
+  uint64_t u = value < 0 ? 0ULL - (uint64_t)value : (uint64_t)value;
+
+  do {
+    *--p = '0' + (u % 10);
+    u /= 10;
+  } while (u);
+  if (value < 0)
+    *--p = '-';
+  json_write(p, &s[sizeof(s)] - p);
+}
+
+/* as %x, with prefix 0x for RC */
+static void
+json_hex (unsigned long value, int prefix)
+{
+  static const char hex[] = "0123456789abcdef";
+  char s[24];
+  char *p = &s[sizeof(s)];
+
+  do {
+    *--p = hex[value & 0xf];
+    value >>= 4;
+  } while (value);
+  if (prefix)
+    {
+      *--p = 'x';
+      *--p = '0';
+    }
+  json_write(p, &s[sizeof(s)] - p);
+}
+
+/* The shortest text which reads back as the same double: integers
+   directly, else the first of %.15g, %.16g or %.17g which round-trips.
+   A decimal of up to 15 digits which reads back as a normal double is
+   within half an ulp of it, less than half a unit in the 15th digit, so
+   %.15g prints that decimal, with the trailing zeros dropped. Subnormals
+   have a larger relative ulp and start with %.1g. JSON has no NaN and
+   Infinity, they are null. */
+static void
+json_double (double value)
+{
+  char s[32];
+  int len, prec;
+
+  if (isnan(value) || isinf(value))
+    {
+      json_write("null", 4);
+      return;
+    }
+  if (value > -1e15 && value < 1e15 && value == (double)(BITCODE_RLL)value)
+    {
+      if (value == 0.0 && signbit(value))
+        json_write("-0", 2);
+      else
+        json_int((BITCODE_RLL)value);
+      return;
+    }
+  prec = value > -DBL_MIN && value < DBL_MIN ? 1 : 15;
+  for (; prec <= 17; prec++)
+    {
+      len = snprintf(s, sizeof(s), "%.*g", prec, value);
+      if (len < 0 || len >= (int)sizeof(s))
+        return;
+      if (prec == 17 || strtod(s, NULL) == value)
+        break;
+    }
+  json_write(s, len);
+}
+
+/* the text without quotes, with " \\ and the control chars escaped */
+static void
+json_escape (const char *restrict s, size_t len)
+{
+  static const char hex[] = "0123456789abcdef";
+  const char *end = s + len;
+  const char *p;
+
+  for (p = s; p < end; p++)
+    {
+      const unsigned char c = (unsigned char)*p;
+      if (c >= 0x20 && c != '"' && c != '\\')
+        continue;
+      json_write(s, p - s);
+      s = p + 1;
+      switch (c)
+        {
+        case '"':  json_write("\\\"", 2); break;
+        case '\\': json_write("\\\\", 2); break;
+        case '\n': json_write("\\n", 2); break;
+        case '\r': json_write("\\r", 2); break;
+        case '\t': json_write("\\t", 2); break;
+        default:
+          {
+            const char u[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf] };
+            json_write(u, 6);
+          }
+        }
+    }
+  json_write(s, p - s);
+}
+
+static void
+json_string (const char *restrict s)
+{
+  json_putc('"');
+  if (s)
+    json_escape(s, strlen(s));
+  json_putc('"');
+}
+
+/* the lower byte of each UCS-2 char */
+static void
+json_string_tu (BITCODE_TU ws)
+{
+  char s[256];
+  size_t len;
+
+  json_putc('"');
+  while (ws && *ws)
+    {
+      for (len = 0; *ws && len < sizeof(s); len++)
+        s[len] = (char)(*ws++ & 0xff);
+      json_escape(s, len);
+    }
+  json_putc('"');
+}
+
+/* for the rest */
+static void json_printf (const char *restrict fmt, ...)
+#ifdef __GNUC__
+  __attribute__ ((format (printf, 1, 2)))
+#endif
+  ;
+static void
+json_printf (const char *restrict fmt, ...)
+{
+  char s[1024];
+  int len;
+  va_list ap;
+
+  va_start(ap, fmt);
+  len = vsnprintf(s, sizeof(s), fmt, ap);
+  va_end(ap);
+  if (len < 0)
+    return;
+  if (len < (int)sizeof(s))
+    json_write(s, len);
+  else
+    {
+      char *p = (char*)dwg_malloc(len + 1);
+      if (!p)
+        return;
+      va_start(ap, fmt);
+      vsnprintf(p, len + 1, fmt, ap);
+      va_end(ap);
+      json_write(p, len);
+      dwg_dealloc(p);
+    }
+}
+
 /*--------------------------------------------------------------------------------
  * MACROS
  */
@@ -40,73 +404,80 @@ static unsigned int cur_ver = 0;
 #define ACTION json
 #define IS_PRINT
 
-#define PREFIX   for (int _i=0; _i<dat->bit; _i++) { fprintf (dat->fh, "  "); }
-#define ARRAY    PREFIX fprintf (dat->fh, "[\n"); dat->bit++
-#define ENDARRAY dat->bit--; PREFIX fprintf (dat->fh, "],\n")
-#define HASH     PREFIX fprintf (dat->fh, "{\n"); dat->bit++
-#define ENDHASH  dat->bit--; PREFIX fprintf (dat->fh, "},\n")
-#define SECTION(name) PREFIX fprintf (dat->fh, "\"%s\": [\n", #name); dat->bit++;
+#define PREFIX   json_prefix(dat);
+#define ARRAY    json_open(dat, '[')
+#define ENDARRAY json_close(dat, ']')
+#define HASH     json_open(dat, '{')
+#define ENDHASH  json_close(dat, '}')
+#define SECTION(name) json_open_key(dat, #name, sizeof(#name) - 1);
 #define ENDSEC()  ENDARRAY
-#define NOCOMMA   fseek(dat->fh, -2, SEEK_CUR)
+#define NOCOMMA   json_nocomma()
+#define KEY(name) json_key(#name, sizeof(#name) - 1)
+
+/* the value per type, RC as hex */
+#define JSON_B(value)     json_int(value)
+#define JSON_BB(value)    json_int(value)
+#define JSON_3B(value)    json_int(value)
+#define JSON_BS(value)    json_int(value)
+#define JSON_RS(value)    json_int(value)
+#define JSON_BL(value)    json_int(value)
+#define JSON_RL(value)    json_int(value)
+#define JSON_BLL(value)   json_int(value)
+#define JSON_RLL(value)   json_int(value)
+#define JSON_MC(value)    json_int(value)
+#define JSON_MS(value)    json_int((BITCODE_RLL)(value))
+#define JSON_RC(value)    json_hex((unsigned char)(value), 1)
+#define JSON_4BITS(value) json_hex((unsigned char)(value), 0)
+#define JSON_BD(value)    json_double(value)
+#define JSON_RD(value)    json_double(value)
+#define JSON_DD(value)    json_double(value)
+#define JSON_BT(value)    json_double(value)
 
-#define VALUE(value,type,dxf) \
-    fprintf(dat->fh, FORMAT_##type, value)
+#define VALUE(value,type,dxf) JSON_##type(value)
 #define VALUE_RC(value,dxf) VALUE(value, RC, dxf)
 #define VALUE_RS(value,dxf) VALUE(value, RS, dxf)
 #define VALUE_RL(value,dxf) VALUE(value, RL, dxf)
 #define VALUE_RD(value,dxf) VALUE(value, RD, dxf)
 
 #define FIELD(name,type,dxf) \
-    PREFIX fprintf(dat->fh, "\"" #name "\": " FORMAT_##type ",\n", _obj->name)
+    { PREFIX KEY(name); JSON_##type(_obj->name); json_end(); }
 #define _FIELD(name,type,value) \
-    PREFIX fprintf(dat->fh, "\"" #name "\": " FORMAT_##type ",\n", obj->name)
+    { PREFIX KEY(name); JSON_##type(obj->name); json_end(); }
 #define ENT_FIELD(name,type,value) \
-    PREFIX fprintf(dat->fh, "\"" #name "\": " FORMAT_##type ",\n", _ent->name)
+    { PREFIX KEY(name); JSON_##type(_ent->name); json_end(); }
 #define FIELD_CAST(name,type,cast,dxf) FIELD(name,cast,dxf)
 #define FIELD_TRACE(name,type)
 #define FIELD_TEXT(name,str) \
-    PREFIX fprintf(dat->fh, "\"" #name "\": \"%s\",\n", str ? str : "")
-#ifdef HAVE_NATIVE_WCHAR2
-# define FIELD_TEXT_TU(name,wstr) \
-    PREFIX fprintf(dat->fh, "\"" #name "\": \"%ls\",\n", wstr ? (wchar_t*)wstr : L"")
-#else
-# define FIELD_TEXT_TU(name,wstr) \
-  { \
-    BITCODE_TU ws = (BITCODE_TU)wstr;\
-    uint16_t _c; PREFIX \
-    fprintf(dat->fh, "\"" #name "\": \""); \
-    if (ws) { \
-      while ((_c = *ws++)) { \
-        fprintf(dat->fh, "%c", (char)(_c & 0xff)); \
-      } \
-    }\
-    fprintf(dat->fh, "\",\n"); \
-  }
-#endif
+    { PREFIX KEY(name); json_string(str); json_end(); }
+#define FIELD_TEXT_TU(name,wstr) \
+    { PREFIX KEY(name); json_string_tu((BITCODE_TU)wstr); json_end(); }
 
 #define FIELD_VALUE(name) _obj->name
 #define ANYCODE -1
 // todo: only the name, not the ref
 #define VALUE_HANDLE(hdlptr, name, handle_code, dxf)     \
-  PREFIX if (hdlptr) { \
-    fprintf(dat->fh, "\"%s\": \"HANDLE(%d.%d.%lu) absolute:%lu\",\n", #name, \
+  if (hdlptr) { \
+    PREFIX KEY(name); \
+    json_printf("\"HANDLE(%d.%d.%lu) absolute:%lu\"",  \
            hdlptr->handleref.code,                     \
            hdlptr->handleref.size,                     \
            hdlptr->handleref.value,                    \
            hdlptr->absolute_ref);                      \
+    json_end(); \
   }
 #define FIELD_HANDLE(name, handle_code, dxf) VALUE_HANDLE(_obj->name, name, handle_code, dxf)
 #define FIELD_DATAHANDLE(name, code, dxf) FIELD_HANDLE(name, code, dxf)
 #define FIELD_HANDLE_N(name, vcount, handle_code, dxf) \
   PREFIX if (_obj->name) { \
-    fprintf(dat->fh, "\"HANDLE(%d.%d.%lu) absolute:%lu\",\n",\
+    json_printf("\"HANDLE(%d.%d.%lu) absolute:%lu\"",     \
            _obj->name->handleref.code,                     \
            _obj->name->handleref.size,                     \
            _obj->name->handleref.value,                    \
            _obj->name->absolute_ref);                      \
   } else {\
-    fprintf(dat->fh, "\"\",\n"); \
-  }
+    json_write("\"\"", 2); \
+  }\
+  json_end();
 
 #define FIELD_B(name,dxf)   FIELD(name, B, dxf)
 #define FIELD_BB(name,dxf)  FIELD(name, BB, dxf)
@@ -132,8 +503,7 @@ static unsigned int cur_ver = 0;
 #define FIELD_BT(name,dxf)    FIELD(name, BT, dxf);
 #define FIELD_4BITS(name,dxf) FIELD(name,4BITS,dxf)
 #define FIELD_BE(name,dxf)    FIELD_3RD(name,dxf)
-#define FIELD_DD(name, _default, dxf) \
-    PREFIX fprintf(dat->fh, "\"" #name "\": " FORMAT_DD ",\n", _obj->name)
+#define FIELD_DD(name, _default, dxf) FIELD(name, DD, dxf)
 #define FIELD_2DD(name, d1, d2, dxf) { \
     FIELD_DD(name.x, d1, dxf); \
     FIELD_DD(name.y, d2, dxf+10); }
@@ -152,18 +522,23 @@ static unsigned int cur_ver = 0;
     FIELD(name.z, BD, dxf+2);}
 #define FIELD_3DPOINT(name,dxf) FIELD_3BD(name,dxf)
 #define FIELD_CMC(color,dxf1,dxf2) { \
-  PREFIX fprintf(dat->fh, "\"" #color "\": %d,\n", _obj->color.index); \
+  PREFIX KEY(color); json_int(_obj->color.index); json_end(); \
   if (dat->version >= R_2004) { \
-      PREFIX fprintf(dat->fh, "\"" #color "\".rgb: %06x,\n", (unsigned)_obj->color.rgb); \
-    if (_obj->color.flag & 1) \
-      PREFIX fprintf(dat->fh, "\"" #color ".name\": \"%s\",\n", _obj->color.name); \
-    if (_obj->color.flag & 2) \
-      PREFIX fprintf(dat->fh, "\"" #color ".bookname\": \"%s\",\n", _obj->color.book_name); \
+    PREFIX KEY(color.rgb); \
+    json_printf("\"%06x\"", (unsigned)_obj->color.rgb); json_end(); \
+    if (_obj->color.flag & 1) { \
+      PREFIX KEY(color.name); json_string(_obj->color.name); json_end(); \
+    } \
+    if (_obj->color.flag & 2) { \
+      PREFIX KEY(color.bookname); json_string(_obj->color.book_name); \
+      json_end(); \
+    } \
   }\
 }
 #define FIELD_TIMEBLL(name,dxf) \
-    PREFIX fprintf(dat->fh, "\"" #name "\": " FORMAT_BL "." FORMAT_BL ",\n", \
-            _obj->name.days, _obj->name.ms)
+    { PREFIX KEY(name); \
+      json_printf(FORMAT_BL "." FORMAT_BL, _obj->name.days, _obj->name.ms); \
+      json_end(); }
 
 //FIELD_VECTOR_N(name, type, size):
 // reads data of the type indicated by 'type' 'size' times and stores
@@ -172,16 +547,15 @@ static unsigned int cur_ver = 0;
     ARRAY; \
     for (vcount=0; vcount < (BITCODE_BL)size; vcount++)\
       {\
-        PREFIX fprintf(dat->fh, "\"" #name "\": " FORMAT_##type ",\n", _obj->name[vcount]); \
+        PREFIX KEY(name); JSON_##type(_obj->name[vcount]); json_end(); \
       }\
     if (size) NOCOMMA;\
     ENDARRAY;
 #define FIELD_VECTOR_T(name, size, dxf)\
     ARRAY; \
     PRE (R_2007) { \
-      for (vcount=0; vcount < (BITCODE_BL)_obj->size; vcount++) { \
-        PREFIX fprintf(dat->fh, "\"" #name "\": \"%s\",\n", _obj->name[vcount]); \
-      }\
+      for (vcount=0; vcount < (BITCODE_BL)_obj->size; vcount++) \
+        FIELD_TEXT(name, _obj->name[vcount]); \
     } else { \
       for (vcount=0; vcount < (BITCODE_BL)_obj->size; vcount++)\
         FIELD_TEXT_TU(name, _obj->name[vcount]); \
@@ -237,8 +611,7 @@ static unsigned int cur_ver = 0;
 #define FIELD_XDATA(name, size)
 
 #define REACTORS(code)\
-  PREFIX; \
-  fprintf(dat->fh, "\"reactors\":"); ARRAY; \
+  json_open_key(dat, "reactors", 8); \
   for (vcount=0; vcount < obj->tio.object->num_reactors; vcount++)\
     {\
       VALUE_HANDLE(obj->tio.object->reactors[vcount], reactors, code, 330); \
@@ -656,15 +1029,15 @@ json_preview_write (Bit_Chain *restrict dat, Dwg_Data *restrict dwg)
   return 0;
 }
 
-EXPORT int
-dwg_write_json(Bit_Chain *restrict dat, Dwg_Data *restrict dwg)
+static int
+json_write_all (Bit_Chain *restrict dat, Dwg_Data *restrict dwg)
 {
   const int minimal = dwg->opts & 0x10;
   struct Dwg_Header *obj = &dwg->header;
 
-  fprintf (dat->fh, "{\n"
-                     "  \"created_by\": \"%s\",\n", PACKAGE_STRING);
-  dat->bit++;
+  dat->bit = 0;
+  HASH;
+  FIELD_TEXT(created_by, PACKAGE_STRING);
   // a minimal header requires only $ACADVER, $HANDSEED, and then ENTITIES
   // see https://pythonhosted.org/ezdxf/dxfinternals/filestructure.html
   json_header_write (dat, dwg);
@@ -673,35 +1046,84 @@ dwg_write_json(Bit_Chain *restrict dat, Dwg_Data *restrict dwg)
     {
       SINCE(R_2000) {
         if (json_classes_write (dat, dwg))
-          goto fail;
+          return 1;
       }
 
       if (json_tables_write (dat, dwg))
-        goto fail;
-      
+        return 1;
+
       if (json_blocks_write (dat, dwg))
-        goto fail;
+        return 1;
     }
 
   if (json_entities_write (dat, dwg))
-    goto fail;
+    return 1;
 
   /* only the object map
   SINCE(R_13) {
     if (json_objects_write (dat, dwg))
-      goto fail;
+      return 1;
   }*/
 
   if (!minimal && dat->version >= R_2000) {
     if (json_preview_write (dat, dwg))
-      goto fail;
+      return 1;
   }
 
+  NOCOMMA;
   dat->bit--;
-  fprintf (dat->fh, "}\n");
+  json_putc('}');
+  json_newline();
+  return 0;
+}
+
+EXPORT int
+dwg_write_json(Bit_Chain *restrict dat, Dwg_Data *restrict dwg)
+{
+  Dwg_Thread_State state;
+  int error = 1;
+
+  dwg_log_enter(dwg, &state);
+  if (!json_writer_init(dat->fh, dwg->opts & 0x80))
+    {
+      error = json_write_all(dat, dwg);
+      if (json_writer_end())
+        error = 1;
+    }
+  dwg_log_leave(&state);
+  return error;
+}
+
+/* The same into a new buffer instead of dat->fh, for servers. */
+EXPORT int
+dwg_write_json_buffer(Bit_Chain *restrict dat, Dwg_Data *restrict dwg)
+{
+  Dwg_Thread_State state;
+  int error;
+
+  dat->chain = NULL;
+  dat->size = dat->byte = 0;
+  dwg_log_enter(dwg, &state);
+  if (json_writer_init(NULL, dwg->opts & 0x80))
+    {
+      dwg_log_leave(&state);
+      return 1;
+    }
+  error = json_write_all(dat, dwg);
+  json_putc('\0');
+  if (error || out.error)
+    {
+      json_writer_end(); // with the allocator of dwg
+      dwg_log_leave(&state);
+      return 1;
+    }
+  dwg_log_leave(&state);
+  dat->chain = (unsigned char*)out.buf;
+  dat->size = out.size;
+  dat->byte = out.len - 1;
+  dat->bit = 0;
+  memset(&out, 0, sizeof(out));
   return 0;
- fail:
-  return 1;
 }
 
 #undef IS_PRINT
@@ -22,6 +22,10 @@
 #include "bits.h"
 
 EXPORT int dwg_write_json(Bit_Chain *restrict dat, Dwg_Data *restrict dwg);
+/* Writes into a new NUL-terminated dat->chain of dat->byte chars, allocated
+   with the allocator of the dwg (free() by default). Returns 0 or 1. */
+EXPORT int dwg_write_json_buffer(Bit_Chain *restrict dat,
+                                 Dwg_Data *restrict dwg);
 EXPORT int dwg_write_geojson(Bit_Chain *restrict dat, Dwg_Data *restrict dwg);
 
 #endif
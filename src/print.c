@@ -29,6 +29,8 @@
 #include "print.h"
 
 #define DWG_LOGLEVEL DWG_LOGLEVEL_TRACE
+/* the print output is wanted, also with --disable-trace-logging */
+#define DWG_LOGLEVEL_MAX DWG_LOGLEVEL_ALL
 #include "logging.h"
 
 /* the current version per spec block */
@@ -0,0 +1,725 @@
+/*****************************************************************************/
+/*  LibreDWG - free implementation of the DWG file format                    */
+/*                                                                           */
+/*  Copyright (C) 2018 Free Software Foundation, Inc.                        */
+/*                                                                           */
+/*  This library is free software, licensed under the terms of the GNU       */
+/*  General Public License as published by the Free Software Foundation,     */
+/*  either version 3 of the License, or (at your option) any later version.  */
+/*  You should have received a copy of the GNU General Public License        */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.    */
+/*****************************************************************************/
+
+/*
+ * rtree.c: packed R-trees over the entity extents, one per block,
+ *          bulk loaded by Sort-Tile-Recursive (Leutenegger et al. 1997).
+ *          The tree is a flat array of boxes, the leaves first and
+ *          the root last, so it is built without pointers and
+ *          serialized as is.
+ */
+
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+
+#include "common.h"
+#include "dwg.h"
+
+static THREAD_LOCAL unsigned int loglevel;
+#define DWG_LOGLEVEL loglevel
+#include "logging.h"
+
+#define RTREE_NODE_SIZE 16
+#define RTREE_MAX_LEVELS 32
+/* Items or nodes per parallel chunk */
+#define RTREE_CHUNK 1024
+#define RTREE_MAGIC "DWGRTREE"
+#define RTREE_VERSION 1
+
+typedef struct _rtree_item
+{
+  Dwg_Bbox box;
+  double cx, cy;
+  BITCODE_BL index;
+} Rtree_Item;
+
+typedef struct _rtree_heap_entry
+{
+  double dist;
+  BITCODE_BL pos;
+} Rtree_Heap_Entry;
+
+/* The serialized header, followed by the level ends, boxes and indices */
+typedef struct _rtree_file_header
+{
+  char magic[8];
+  BITCODE_RL version;
+  BITCODE_RL num_objects;
+  BITCODE_RL block;
+  BITCODE_RL num_items;
+  BITCODE_RL num_boxes;
+  BITCODE_RS node_size;
+  BITCODE_RS num_levels;
+} Rtree_File_Header;
+
+static int
+cmp_x (const void *a, const void *b)
+{
+  const Rtree_Item *ia = (const Rtree_Item *)a;
+  const Rtree_Item *ib = (const Rtree_Item *)b;
+  if (ia->cx != ib->cx)
+    return ia->cx < ib->cx ? -1 : 1;
+  // stable for any thread count
+  return ia->index < ib->index ? -1 : ia->index > ib->index;
+}
+
+static int
+cmp_y (const void *a, const void *b)
+{
+  const Rtree_Item *ia = (const Rtree_Item *)a;
+  const Rtree_Item *ib = (const Rtree_Item *)b;
+  if (ia->cy != ib->cy)
+    return ia->cy < ib->cy ? -1 : 1;
+  return ia->index < ib->index ? -1 : ia->index > ib->index;
+}
+
+static inline int
+bbox_intersects (const Dwg_Bbox *restrict a, const Dwg_Bbox *restrict b)
+{
+  return a->min.x <= b->max.x && a->max.x >= b->min.x
+         && a->min.y <= b->max.y && a->max.y >= b->min.y
+         && a->min.z <= b->max.z && a->max.z >= b->min.z;
+}
+
+/* The squared XY distance of pt to the box, 0 inside */
+static inline double
+bbox_dist2 (const Dwg_Bbox *restrict b, const BITCODE_2RD *restrict pt)
+{
+  double dx = pt->x < b->min.x ? b->min.x - pt->x
+              : pt->x > b->max.x ? pt->x - b->max.x : 0.0;
+  double dy = pt->y < b->min.y ? b->min.y - pt->y
+              : pt->y > b->max.y ? pt->y - b->max.y : 0.0;
+  return dx * dx + dy * dy;
+}
+
+static void
+rtree_free (Dwg_RTree *tree)
+{
+  if (!tree)
+    return;
+  dwg_dealloc(tree->boxes);
+  dwg_dealloc(tree->indices);
+  dwg_dealloc(tree);
+}
+
+void
+dwg_free_rtrees (Dwg_Data *dwg)
+{
+  Dwg_Allocator saved;
+  BITCODE_BL i;
+
+  if (!dwg || !dwg->rtree)
+    return;
+  dwg_alloc_enter(dwg, &saved);
+  for (i = 0; i < dwg->num_rtree; i++)
+    rtree_free(dwg->rtree[i]);
+  dwg_dealloc(dwg->rtree);
+  dwg_alloc_leave(&saved);
+  dwg->rtree = NULL;
+  dwg->num_rtree = 0;
+}
+
+/* The BLOCK_HEADER of a BLOCK_HEADER or LAYOUT, or of the model space */
+static const Dwg_Object *
+rtree_block (Dwg_Data *restrict dwg, const Dwg_Object *restrict block)
+{
+  Dwg_Object_Ref *ref;
+
+  if (block)
+    {
+      if (block->fixedtype == DWG_TYPE_BLOCK_HEADER)
+        return block;
+      if (block->fixedtype == DWG_TYPE_LAYOUT && block->tio.object
+          && block->tio.object->tio.LAYOUT)
+        {
+          ref = block->tio.object->tio.LAYOUT->pspace_block_record;
+          block = ref ? dwg_ref_object(dwg, ref) : NULL;
+          if (block && block->fixedtype == DWG_TYPE_BLOCK_HEADER)
+            return block;
+        }
+      return NULL;
+    }
+  ref = dwg->header_vars.BLOCK_RECORD_MSPACE;
+  if (!ref || !dwg_ref_object(dwg, ref))
+    ref = dwg->block_control.model_space;
+  block = ref ? dwg_ref_object(dwg, ref) : NULL;
+  return block && block->fixedtype == DWG_TYPE_BLOCK_HEADER ? block : NULL;
+}
+
+/* The level of the node at pos */
+static inline int
+rtree_level (const Dwg_RTree *tree, BITCODE_BL pos)
+{
+  int level = 0;
+  while (pos >= tree->level_end[level])
+    level++;
+  return level;
+}
+
+/* Sort the items into STR order: by x into vertical slices of
+   slices * node_size items, each slice by y. */
+static void
+str_sort (Rtree_Item *items, BITCODE_BL n)
+{
+  const BITCODE_BL leaves = (n + RTREE_NODE_SIZE - 1) / RTREE_NODE_SIZE;
+  const BITCODE_BL slices = (BITCODE_BL)ceil(sqrt((double)leaves));
+  const BITCODE_BL per_slice = slices * RTREE_NODE_SIZE;
+  long s;
+
+  qsort(items, n, sizeof(Rtree_Item), cmp_x);
+#ifdef _OPENMP
+#pragma omp parallel for if (n > RTREE_CHUNK) schedule(dynamic, 1)
+#endif
+  for (s = 0; s < (long)slices; s++)
+    {
+      const BITCODE_BL start = (BITCODE_BL)s * per_slice;
+      if (start < n)
+        qsort(&items[start],
+              n - start < per_slice ? n - start : per_slice,
+              sizeof(Rtree_Item), cmp_y);
+    }
+}
+
+/* Pack the STR-sorted items into a tree for the block */
+static Dwg_RTree *
+rtree_pack (const Rtree_Item *items, BITCODE_BL n, const Dwg_Object *hdr)
+{
+  Dwg_RTree *tree;
+  BITCODE_BL count = n, num_boxes = n, i;
+  int level;
+
+  tree = (Dwg_RTree *)dwg_calloc(1, sizeof(Dwg_RTree));
+  if (!tree)
+    return NULL;
+  tree->block = hdr->index;
+  tree->num_objects = hdr->parent->num_objects;
+  tree->num_items = n;
+  tree->node_size = RTREE_NODE_SIZE;
+  tree->level_end[0] = n;
+  tree->num_levels = n ? 1 : 0;
+  while (count > 1)
+    {
+      count = (count + RTREE_NODE_SIZE - 1) / RTREE_NODE_SIZE;
+      num_boxes += count;
+      tree->level_end[tree->num_levels++] = num_boxes;
+    }
+  tree->num_boxes = num_boxes;
+  tree->boxes = (Dwg_Bbox *)dwg_malloc((num_boxes ? num_boxes : 1)
+                                       * sizeof(Dwg_Bbox));
+  tree->indices = (BITCODE_BL *)dwg_malloc((num_boxes ? num_boxes : 1)
+                                           * sizeof(BITCODE_BL));
+  if (!tree->boxes || !tree->indices)
+    {
+      rtree_free(tree);
+      return NULL;
+    }
+  for (i = 0; i < n; i++)
+    {
+      tree->boxes[i] = items[i].box;
+      tree->indices[i] = items[i].index;
+    }
+  for (level = 1; level < tree->num_levels; level++)
+    {
+      const BITCODE_BL child_start = level > 1 ? tree->level_end[level - 2] : 0;
+      const BITCODE_BL child_end = tree->level_end[level - 1];
+      const BITCODE_BL start = child_end;
+      const BITCODE_BL end = tree->level_end[level];
+      long j;
+#ifdef _OPENMP
+#pragma omp parallel for if (end - start > RTREE_CHUNK) schedule(static)
+#endif
+      for (j = (long)start; j < (long)end; j++)
+        {
+          const BITCODE_BL first
+              = child_start + ((BITCODE_BL)j - start) * RTREE_NODE_SIZE;
+          const BITCODE_BL last = first + RTREE_NODE_SIZE < child_end
+                                      ? first + RTREE_NODE_SIZE
+                                      : child_end;
+          Dwg_Bbox *b = &tree->boxes[j];
+          BITCODE_BL c;
+          *b = tree->boxes[first];
+          for (c = first + 1; c < last; c++)
+            {
+              const Dwg_Bbox *cb = &tree->boxes[c];
+              b->min.x = cb->min.x < b->min.x ? cb->min.x : b->min.x;
+              b->min.y = cb->min.y < b->min.y ? cb->min.y : b->min.y;
+              b->min.z = cb->min.z < b->min.z ? cb->min.z : b->min.z;
+              b->max.x = cb->max.x > b->max.x ? cb->max.x : b->max.x;
+              b->max.y = cb->max.y > b->max.y ? cb->max.y : b->max.y;
+              b->max.z = cb->max.z > b->max.z ? cb->max.z : b->max.z;
+            }
+          tree->indices[j] = first;
+        }
+    }
+  return tree;
+}
+
+/* Build the tree of the BLOCK_HEADER hdr. With cached, only use the
+   extents already computed, as in parallel builds. */
+static int
+rtree_build (Dwg_Data *restrict dwg, const Dwg_Object *restrict hdr,
+             const int cached, Dwg_RTree **restrict treep)
+{
+  Dwg_Owned_Iter it;
+  Dwg_Object *obj;
+  Rtree_Item *items;
+  BITCODE_BL n = 0;
+  int mode, error;
+
+  *treep = NULL;
+  error = dwg_owned_iter_init(&it, hdr);
+  if (error)
+    return error;
+  // the R13-R2000 chain may pass the entities of other blocks,
+  // and of complex entities
+  if (hdr == rtree_block(dwg, NULL))
+    mode = 2;
+  else if (dwg->header_vars.BLOCK_RECORD_PSPACE
+           && hdr == dwg_ref_object(dwg, dwg->header_vars.BLOCK_RECORD_PSPACE))
+    mode = 1;
+  else
+    mode = 0;
+  items = (Rtree_Item *)dwg_malloc((it.num ? it.num : 1) * sizeof(Rtree_Item));
+  if (!items)
+    {
+      LOG_ERROR("Out of memory");
+      return DWG_ERR_OUTOFMEM;
+    }
+  while ((obj = dwg_owned_iter_next(&it)) && n < it.num)
+    {
+      Rtree_Item *item = &items[n];
+      if (obj->supertype != DWG_SUPERTYPE_ENTITY || !obj->tio.entity
+          || obj->tio.entity->entity_mode != mode
+          || (!mode
+              && (!obj->tio.entity->subentity
+                  || obj->tio.entity->subentity->absolute_ref
+                         != hdr->handle.value)))
+        continue;
+      if (cached)
+        {
+          if (obj->tio.entity->extents_state != DWG_EXTENTS_VALID)
+            continue;
+          item->box = obj->tio.entity->extents;
+        }
+      else if ((error = dwg_entity_extents(obj, &item->box)))
+        {
+          if (error == DWG_ERR_OUTOFMEM)
+            {
+              dwg_dealloc(items);
+              return error;
+            }
+          continue;
+        }
+      item->cx = 0.5 * (item->box.min.x + item->box.max.x);
+      item->cy = 0.5 * (item->box.min.y + item->box.max.y);
+      item->index = obj->index;
+      n++;
+    }
+  str_sort(items, n);
+  *treep = rtree_pack(items, n, hdr);
+  dwg_dealloc(items);
+  if (!*treep)
+    {
+      LOG_ERROR("Out of memory");
+      return DWG_ERR_OUTOFMEM;
+    }
+  LOG_TRACE("rtree: %u entities of block %u, %d levels\n", (unsigned)n,
+            (unsigned)hdr->index, (int)(*treep)->num_levels);
+  return 0;
+}
+
+/* The rtree slots for all objects */
+static int
+rtree_alloc (Dwg_Data *dwg)
+{
+  if (dwg->rtree && dwg->num_rtree == dwg->num_objects)
+    return 0;
+  dwg_free_rtrees(dwg);
+  dwg->rtree = (Dwg_RTree **)dwg_calloc(dwg->num_objects ? dwg->num_objects : 1,
+                                        sizeof(Dwg_RTree *));
+  if (!dwg->rtree)
+    {
+      LOG_ERROR("Out of memory");
+      return DWG_ERR_OUTOFMEM;
+    }
+  dwg->num_rtree = dwg->num_objects;
+  return 0;
+}
+
+static int
+rtree_get (Dwg_Data *restrict dwg, const Dwg_Object *restrict block,
+           const Dwg_RTree **restrict treep)
+{
+  const Dwg_Object *hdr;
+  Dwg_Thread_State state;
+  int error;
+
+  *treep = NULL;
+  if (!dwg || !dwg->object)
+    return DWG_ERR_INVALIDDWG;
+  loglevel = dwg_log_enter(dwg, &state);
+  hdr = rtree_block(dwg, block);
+  if (!hdr)
+    error = DWG_ERR_INVALIDTYPE;
+  else if (!(error = rtree_alloc(dwg)) && !dwg->rtree[hdr->index])
+    error = rtree_build(dwg, hdr, 0, &dwg->rtree[hdr->index]);
+  if (!error)
+    *treep = dwg->rtree[hdr->index];
+  dwg_log_leave(&state);
+  return error;
+}
+
+const Dwg_RTree *
+dwg_rtree (Dwg_Data *dwg, const Dwg_Object *block)
+{
+  const Dwg_RTree *tree;
+  return rtree_get(dwg, block, &tree) ? NULL : tree;
+}
+
+int
+dwg_build_rtrees (Dwg_Data *dwg)
+{
+  Dwg_Thread_State state;
+  int error;
+  long i;
+
+  if (!dwg || !dwg->object)
+    return DWG_ERR_INVALIDDWG;
+  error = dwg_compute_all_extents(dwg, NULL);
+  if (error)
+    return error;
+  loglevel = dwg_log_enter(dwg, &state);
+  dwg_free_rtrees(dwg);
+  if ((error = rtree_alloc(dwg)))
+    {
+      dwg_log_leave(&state);
+      return error;
+    }
+#ifdef _OPENMP
+#pragma omp parallel reduction(|:error)
+#endif
+  {
+    Dwg_Thread_State tstate;
+    loglevel = dwg_log_enter(dwg, &tstate);
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 1)
+#endif
+    for (i = 0; i < (long)dwg->num_objects; i++)
+      {
+        if (dwg->object[i].fixedtype != DWG_TYPE_BLOCK_HEADER)
+          continue;
+        if (rtree_build(dwg, &dwg->object[i], 1, &dwg->rtree[i])
+            == DWG_ERR_OUTOFMEM)
+          error |= DWG_ERR_OUTOFMEM;
+      }
+    dwg_log_leave(&tstate);
+  }
+  dwg_log_leave(&state);
+  return error;
+}
+
+int
+dwg_query_bbox (Dwg_Data *dwg, const Dwg_Object *block,
+                const Dwg_Bbox *restrict bbox, Dwg_Query_Callback cb,
+                void *data)
+{
+  BITCODE_BL stack[RTREE_MAX_LEVELS * RTREE_NODE_SIZE];
+  const Dwg_RTree *tree;
+  int sp = 0;
+  int error = rtree_get(dwg, block, &tree);
+
+  if (error)
+    return error;
+  if (!tree->num_boxes || !bbox || !cb)
+    return 0;
+  stack[sp++] = tree->num_boxes - 1;
+  while (sp)
+    {
+      const BITCODE_BL pos = stack[--sp];
+      if (!bbox_intersects(&tree->boxes[pos], bbox))
+        continue;
+      if (pos < tree->num_items)
+        {
+          if (cb(&dwg->object[tree->indices[pos]], data))
+            return 0;
+        }
+      else
+        {
+          const int level = rtree_level(tree, pos);
+          const BITCODE_BL end = tree->level_end[level - 1];
+          BITCODE_BL c = tree->indices[pos];
+          BITCODE_BL last = c + tree->node_size < end ? c + tree->node_size
+                                                      : end;
+          for (; c < last; c++)
+            stack[sp++] = c;
+        }
+    }
+  return 0;
+}
+
+static void
+heap_push (Rtree_Heap_Entry *heap, BITCODE_BL *num, double dist,
+           BITCODE_BL pos)
+{
+  BITCODE_BL i = (*num)++;
+  while (i)
+    {
+      BITCODE_BL parent = (i - 1) / 2;
+      if (heap[parent].dist <= dist)
+        break;
+      heap[i] = heap[parent];
+      i = parent;
+    }
+  heap[i].dist = dist;
+  heap[i].pos = pos;
+}
+
+static Rtree_Heap_Entry
+heap_pop (Rtree_Heap_Entry *heap, BITCODE_BL *num)
+{
+  Rtree_Heap_Entry top = heap[0];
+  Rtree_Heap_Entry last = heap[--(*num)];
+  BITCODE_BL i = 0, n = *num;
+  for (;;)
+    {
+      BITCODE_BL c = 2 * i + 1;
+      if (c >= n)
+        break;
+      if (c + 1 < n && heap[c + 1].dist < heap[c].dist)
+        c++;
+      if (last.dist <= heap[c].dist)
+        break;
+      heap[i] = heap[c];
+      i = c;
+    }
+  if (n)
+    heap[i] = last;
+  return top;
+}
+
+int
+dwg_query_nearest (Dwg_Data *dwg, const Dwg_Object *block,
+                   const BITCODE_2RD *restrict pt, BITCODE_BL k,
+                   Dwg_Object **restrict result, double *restrict dist,
+                   BITCODE_BL *restrict num)
+{
+  const Dwg_RTree *tree;
+  Rtree_Heap_Entry *heap;
+  BITCODE_BL num_heap = 0, size = 64;
+  Dwg_Thread_State state;
+  int error;
+
+  if (!num)
+    return DWG_ERR_INVALIDDWG;
+  *num = 0;
+  if ((error = rtree_get(dwg, block, &tree)))
+    return error;
+  if (!tree->num_boxes || !pt || !k || !result)
+    return 0;
+  loglevel = dwg_log_enter(dwg, &state);
+  heap = (Rtree_Heap_Entry *)dwg_malloc(size * sizeof(Rtree_Heap_Entry));
+  if (!heap)
+    goto oom;
+  heap_push(heap, &num_heap, 0.0, tree->num_boxes - 1);
+  // nodes are never further than their children, so the leaves come
+  // off the heap nearest first
+  while (num_heap && *num < k)
+    {
+      const Rtree_Heap_Entry e = heap_pop(heap, &num_heap);
+      if (e.pos < tree->num_items)
+        {
+          result[*num] = &dwg->object[tree->indices[e.pos]];
+          if (dist)
+            dist[*num] = sqrt(e.dist);
+          (*num)++;
+        }
+      else
+        {
+          const int level = rtree_level(tree, e.pos);
+          const BITCODE_BL end = tree->level_end[level - 1];
+          BITCODE_BL c = tree->indices[e.pos];
+          BITCODE_BL last = c + tree->node_size < end ? c + tree->node_size
+                                                      : end;
+          if (num_heap + tree->node_size > size)
+            {
+              Rtree_Heap_Entry *h;
+              size *= 2;
+              h = (Rtree_Heap_Entry *)dwg_realloc(
+                  heap, size * sizeof(Rtree_Heap_Entry));
+              if (!h)
+                {
+                  dwg_dealloc(heap);
+                  goto oom;
+                }
+              heap = h;
+            }
+          for (; c < last; c++)
+            heap_push(heap, &num_heap, bbox_dist2(&tree->boxes[c], pt), c);
+        }
+    }
+  dwg_dealloc(heap);
+  dwg_log_leave(&state);
+  return 0;
+ oom:
+  LOG_ERROR("Out of memory");
+  dwg_log_leave(&state);
+  return DWG_ERR_OUTOFMEM;
+}
+
+size_t
+dwg_rtree_serialize (const Dwg_RTree *restrict tree, unsigned char *restrict buf,
+                     size_t size)
+{
+  Rtree_File_Header h;
+  size_t need, off;
+
+  if (!tree)
+    return 0;
+  need = sizeof(h) + tree->num_levels * sizeof(BITCODE_BL)
+         + tree->num_boxes * (sizeof(Dwg_Bbox) + sizeof(BITCODE_BL));
+  if (!buf || size < need)
+    return need;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, RTREE_MAGIC, sizeof(h.magic));
+  h.version = RTREE_VERSION;
+  h.block = tree->block;
+  h.num_items = tree->num_items;
+  h.num_boxes = tree->num_boxes;
+  h.node_size = tree->node_size;
+  h.num_levels = tree->num_levels;
+  h.num_objects = tree->num_objects;
+  memcpy(buf, &h, sizeof(h));
+  off = sizeof(h);
+  memcpy(&buf[off], tree->level_end, tree->num_levels * sizeof(BITCODE_BL));
+  off += tree->num_levels * sizeof(BITCODE_BL);
+  memcpy(&buf[off], tree->boxes, tree->num_boxes * sizeof(Dwg_Bbox));
+  off += tree->num_boxes * sizeof(Dwg_Bbox);
+  memcpy(&buf[off], tree->indices, tree->num_boxes * sizeof(BITCODE_BL));
+  return need;
+}
+
+static int
+rtree_deserialize (Dwg_Data *dwg, const unsigned char *buf, size_t size)
+{
+  Rtree_File_Header h;
+  Dwg_RTree *tree;
+  size_t need, off;
+  BITCODE_BL i;
+  int level, error;
+
+  if (!dwg->object || !buf || size < sizeof(h))
+    return DWG_ERR_INVALIDDWG;
+  memcpy(&h, buf, sizeof(h));
+  if (memcmp(h.magic, RTREE_MAGIC, sizeof(h.magic))
+      || h.version != RTREE_VERSION || h.num_objects != dwg->num_objects
+      || h.block >= dwg->num_objects
+      || dwg->object[h.block].fixedtype != DWG_TYPE_BLOCK_HEADER
+      || h.node_size < 2 || h.node_size > RTREE_NODE_SIZE
+      || h.num_levels > RTREE_MAX_LEVELS || h.num_items > h.num_boxes
+      || !h.num_levels != !h.num_boxes)
+    {
+      LOG_ERROR("Invalid rtree");
+      return DWG_ERR_INVALIDDWG;
+    }
+  need = sizeof(h) + h.num_levels * sizeof(BITCODE_BL)
+         + (size_t)h.num_boxes * (sizeof(Dwg_Bbox) + sizeof(BITCODE_BL));
+  if (size < need)
+    {
+      LOG_ERROR("Invalid rtree size %lu, need %lu", (unsigned long)size,
+                (unsigned long)need);
+      return DWG_ERR_INVALIDDWG;
+    }
+  tree = (Dwg_RTree *)dwg_calloc(1, sizeof(Dwg_RTree));
+  if (!tree)
+    goto oom;
+  tree->block = h.block;
+  tree->num_objects = h.num_objects;
+  tree->num_items = h.num_items;
+  tree->num_boxes = h.num_boxes;
+  tree->node_size = h.node_size;
+  tree->num_levels = h.num_levels;
+  off = sizeof(h);
+  memcpy(tree->level_end, &buf[off], h.num_levels * sizeof(BITCODE_BL));
+  off += h.num_levels * sizeof(BITCODE_BL);
+  tree->boxes = (Dwg_Bbox *)dwg_malloc((h.num_boxes ? h.num_boxes : 1)
+                                       * sizeof(Dwg_Bbox));
+  tree->indices = (BITCODE_BL *)dwg_malloc((h.num_boxes ? h.num_boxes : 1)
+                                           * sizeof(BITCODE_BL));
+  if (!tree->boxes || !tree->indices)
+    {
+      rtree_free(tree);
+      goto oom;
+    }
+  memcpy(tree->boxes, &buf[off], h.num_boxes * sizeof(Dwg_Bbox));
+  off += h.num_boxes * sizeof(Dwg_Bbox);
+  memcpy(tree->indices, &buf[off], h.num_boxes * sizeof(BITCODE_BL));
+
+  // the queries trust the layout, so check it all
+  error = h.num_levels && (tree->level_end[0] != h.num_items
+                           || tree->level_end[h.num_levels - 1] != h.num_boxes);
+  for (level = 1; !error && level < h.num_levels; level++)
+    {
+      const BITCODE_BL child_start = level > 1 ? tree->level_end[level - 2] : 0;
+      const BITCODE_BL start = tree->level_end[level - 1];
+      const BITCODE_BL count = start - child_start;
+      if (tree->level_end[level] <= start
+          || tree->level_end[level] - start
+                 != (count + h.node_size - 1) / h.node_size)
+        error = 1;
+      for (i = start; !error && i < tree->level_end[level]; i++)
+        error = tree->indices[i] != child_start + (i - start) * h.node_size;
+    }
+  if (!error && h.num_levels
+      && tree->level_end[h.num_levels - 1]
+             - (h.num_levels > 1 ? tree->level_end[h.num_levels - 2] : 0)
+             != 1)
+    error = 1; // one root
+  for (i = 0; !error && i < h.num_items; i++)
+    error = tree->indices[i] >= dwg->num_objects;
+  if (error)
+    {
+      rtree_free(tree);
+      LOG_ERROR("Invalid rtree");
+      return DWG_ERR_INVALIDDWG;
+    }
+
+  if ((error = rtree_alloc(dwg)))
+    {
+      rtree_free(tree);
+      return error;
+    }
+  rtree_free(dwg->rtree[h.block]);
+  dwg->rtree[h.block] = tree;
+  return 0;
+ oom:
+  LOG_ERROR("Out of memory");
+  return DWG_ERR_OUTOFMEM;
+}
+
+int
+dwg_rtree_deserialize (Dwg_Data *dwg, const unsigned char *buf, size_t size)
+{
+  Dwg_Thread_State state;
+  int error;
+
+  if (!dwg)
+    return DWG_ERR_INVALIDDWG;
+  loglevel = dwg_log_enter(dwg, &state);
+  error = rtree_deserialize(dwg, buf, size);
+  dwg_log_leave(&state);
+  return error;
+}
@@ -0,0 +1,1057 @@
+/*****************************************************************************/
+/*  LibreDWG - free implementation of the DWG file format                    */
+/*                                                                           */
+/*  Copyright (C) 2018 Free Software Foundation, Inc.                        */
+/*                                                                           */
+/*  This library is free software, licensed under the terms of the GNU       */
+/*  General Public License as published by the Free Software Foundation,     */
+/*  either version 3 of the License, or (at your option) any later version.  */
+/*  You should have received a copy of the GNU General Public License        */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.    */
+/*****************************************************************************/
+
+/*
+ * tessellate.c: the curves and faces of entities as polylines, for the
+ *               exporters. The points are generated in batches of
+ *               TESS_BATCH into separate x, y, z arrays, so that the
+ *               inner loops have no dependencies and vectorize.
+ *               The planar entities are transformed from their OCS.
+ */
+
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "common.h"
+#include "dwg.h"
+
+#ifndef M_PI
+# define M_PI 3.14159265358979323846
+#endif
+
+/* The default chord tolerance, relative to the radius */
+#define TESS_TOLERANCE 0.001
+/* Segments per curve at most */
+#define TESS_MAX_SEGMENTS 4096
+/* Segments per spline knot span, at least and at most */
+#define TESS_SPAN_MIN 4
+#define TESS_SPAN_MAX 1024
+#define TESS_MAX_DEGREE 15
+/* Points per batch */
+#define TESS_BATCH 8
+
+static int
+tess_reserve (Dwg_Tessellation *restrict t, BITCODE_BL n)
+{
+  BITCODE_BL size;
+  double *p;
+
+  if (t->num_points + n <= t->size_points)
+    return 0;
+  size = t->size_points ? t->size_points : 64;
+  while (size < t->num_points + n)
+    size *= 2;
+  if (!(p = (double *)dwg_realloc(t->x, size * sizeof(double))))
+    return DWG_ERR_OUTOFMEM;
+  t->x = p;
+  if (!(p = (double *)dwg_realloc(t->y, size * sizeof(double))))
+    return DWG_ERR_OUTOFMEM;
+  t->y = p;
+  if (!(p = (double *)dwg_realloc(t->z, size * sizeof(double))))
+    return DWG_ERR_OUTOFMEM;
+  t->z = p;
+  t->size_points = size;
+  return 0;
+}
+
+/* starts the next polyline */
+static int
+tess_part (Dwg_Tessellation *restrict t)
+{
+  if (t->num_parts == t->size_parts)
+    {
+      const BITCODE_BL size = t->size_parts ? 2 * t->size_parts : 16;
+      BITCODE_BL *parts;
+      BITCODE_B *closed;
+      if (!(parts = (BITCODE_BL *)dwg_realloc(t->parts,
+                                              size * sizeof(BITCODE_BL))))
+        return DWG_ERR_OUTOFMEM;
+      t->parts = parts;
+      if (!(closed = (BITCODE_B *)dwg_realloc(t->closed, size)))
+        return DWG_ERR_OUTOFMEM;
+      t->closed = closed;
+      t->size_parts = size;
+    }
+  t->parts[t->num_parts] = t->num_points;
+  t->closed[t->num_parts] = 0;
+  t->num_parts++;
+  return 0;
+}
+
+static int
+tess_point (Dwg_Tessellation *restrict t, double x, double y, double z)
+{
+  if (tess_reserve(t, 1))
+    return DWG_ERR_OUTOFMEM;
+  t->x[t->num_points] = x;
+  t->y[t->num_points] = y;
+  t->z[t->num_points] = z;
+  t->num_points++;
+  return 0;
+}
+
+/* makes the current polyline a ring, repeating its first point */
+static int
+tess_close (Dwg_Tessellation *restrict t)
+{
+  BITCODE_BL first, last;
+  if (!t->num_parts || !t->num_points)
+    return 0;
+  first = t->parts[t->num_parts - 1];
+  last = t->num_points - 1;
+  t->closed[t->num_parts - 1] = 1;
+  if (first == last)
+    return 0;
+  // a full circle ends with cos(2 pi), only near the first
+  if (fabs(t->x[first] - t->x[last]) > 1e-9 * (1.0 + fabs(t->x[first]))
+      || fabs(t->y[first] - t->y[last]) > 1e-9 * (1.0 + fabs(t->y[first]))
+      || fabs(t->z[first] - t->z[last]) > 1e-9 * (1.0 + fabs(t->z[first])))
+    return tess_point(t, t->x[first], t->y[first], t->z[first]);
+  t->x[last] = t->x[first];
+  t->y[last] = t->y[first];
+  t->z[last] = t->z[first];
+  return 0;
+}
+
+/* the number of chords of an arc with this radius and sweep, so that
+   they deviate at most tol from it */
+static BITCODE_BL
+tess_segments (double radius, double sweep, double tol)
+{
+  double step, n;
+  radius = fabs(radius);
+  if (tol <= 0.0)
+    tol = radius * TESS_TOLERANCE;
+  if (tol >= radius)
+    step = M_PI / 2;
+  else
+    {
+      step = 2.0 * acos(1.0 - tol / radius);
+      if (step > M_PI / 2)
+        step = M_PI / 2;
+    }
+  n = ceil(fabs(sweep) / step);
+  if (!(n >= 1.0)) // also NaN
+    return 1;
+  return n > TESS_MAX_SEGMENTS ? TESS_MAX_SEGMENTS : (BITCODE_BL)n;
+}
+
+/* The n segments of c + cos(a) * u + sin(a) * v, a from a0 by sweep.
+   Each batch is the previous rotated by TESS_BATCH steps, so only the
+   first needs cos and sin. With skip_first, the first point is already
+   the last of t. */
+static int
+tess_conic (Dwg_Tessellation *restrict t, const double c[3],
+            const double u[3], const double v[3], double a0, double sweep,
+            BITCODE_BL n, int skip_first)
+{
+  const double step = sweep / n;
+  const double cb = cos(TESS_BATCH * step), sb = sin(TESS_BATCH * step);
+  double cs[TESS_BATCH], sn[TESS_BATCH];
+  double *restrict x, *restrict y, *restrict z;
+  double first[3] = { 0.0, 0.0, 0.0 };
+  BITCODE_BL i, base;
+  int j;
+
+  if (tess_reserve(t, n + 1))
+    return DWG_ERR_OUTOFMEM;
+  base = t->num_points - (skip_first ? 1 : 0);
+  if (skip_first)
+    {
+      first[0] = t->x[base];
+      first[1] = t->y[base];
+      first[2] = t->z[base];
+    }
+  x = &t->x[base];
+  y = &t->y[base];
+  z = &t->z[base];
+  for (j = 0; j < TESS_BATCH; j++)
+    {
+      cs[j] = cos(a0 + j * step);
+      sn[j] = sin(a0 + j * step);
+    }
+  for (i = 0; i <= n; i += TESS_BATCH)
+    {
+      const int m = n + 1 - i < TESS_BATCH ? (int)(n + 1 - i) : TESS_BATCH;
+      for (j = 0; j < m; j++)
+        {
+          x[i + j] = c[0] + cs[j] * u[0] + sn[j] * v[0];
+          y[i + j] = c[1] + cs[j] * u[1] + sn[j] * v[1];
+          z[i + j] = c[2] + cs[j] * u[2] + sn[j] * v[2];
+        }
+      for (j = 0; j < TESS_BATCH; j++)
+        {
+          const double c1 = cs[j] * cb - sn[j] * sb;
+          sn[j] = cs[j] * sb + sn[j] * cb;
+          cs[j] = c1;
+        }
+    }
+  // no drift at the end
+  {
+    const double ce = cos(a0 + sweep), se = sin(a0 + sweep);
+    x[n] = c[0] + ce * u[0] + se * v[0];
+    y[n] = c[1] + ce * u[1] + se * v[1];
+    z[n] = c[2] + ce * u[2] + se * v[2];
+  }
+  if (skip_first)
+    {
+      x[0] = first[0];
+      y[0] = first[1];
+      z[0] = first[2];
+    }
+  t->num_points = base + n + 1;
+  return 0;
+}
+
+static int
+tess_arc (Dwg_Tessellation *restrict t, const BITCODE_3BD *restrict center,
+          double radius, double a0, double sweep, double tol)
+{
+  const double c[3] = { center->x, center->y, center->z };
+  const double u[3] = { radius, 0.0, 0.0 };
+  const double v[3] = { 0.0, radius, 0.0 };
+  return tess_conic(t, c, u, v, a0, sweep, tess_segments(radius, sweep, tol),
+                    0);
+}
+
+/* the segment from the last point p0 to p1 with bulge, the tangent of a
+   quarter of the included angle, counterclockwise if positive */
+static int
+tess_bulge (Dwg_Tessellation *restrict t, double x1, double y1, double z,
+            double bulge, double tol)
+{
+  const double x0 = t->x[t->num_points - 1], y0 = t->y[t->num_points - 1];
+  const double dx = x1 - x0, dy = y1 - y0;
+  double f, c[3], u[3], v[3], r, sweep;
+  int error;
+
+  if (fabs(bulge) < 1e-10 || (dx == 0.0 && dy == 0.0))
+    return tess_point(t, x1, y1, z);
+  // the center is off the midpoint of the chord, left for bulge > 0
+  f = (1.0 - bulge * bulge) / (4.0 * bulge);
+  c[0] = (x0 + x1) / 2.0 - dy * f;
+  c[1] = (y0 + y1) / 2.0 + dx * f;
+  c[2] = z;
+  r = hypot(x0 - c[0], y0 - c[1]);
+  sweep = 4.0 * atan(bulge);
+  u[0] = r; u[1] = 0.0; u[2] = 0.0;
+  v[0] = 0.0; v[1] = r; v[2] = 0.0;
+  error = tess_conic(t, c, u, v, atan2(y0 - c[1], x0 - c[0]), sweep,
+                     tess_segments(r, sweep, tol), 1);
+  if (!error)
+    {
+      t->x[t->num_points - 1] = x1;
+      t->y[t->num_points - 1] = y1;
+    }
+  return error;
+}
+
+static int
+tess_ellipse (Dwg_Tessellation *restrict t,
+              const Dwg_Entity_ELLIPSE *restrict _obj, double tol)
+{
+  const BITCODE_3BD *n = &_obj->extrusion;
+  const BITCODE_3BD *a = &_obj->sm_axis;
+  const double c[3] = { _obj->center.x, _obj->center.y, _obj->center.z };
+  const double u[3] = { a->x, a->y, a->z };
+  double len = sqrt(n->x * n->x + n->y * n->y + n->z * n->z);
+  double v[3], sweep = _obj->end_angle - _obj->start_angle;
+  int full, error;
+
+  if (len == 0.0)
+    len = 1.0;
+  // minor = axis_ratio * (normal x major)
+  v[0] = _obj->axis_ratio * (n->y * a->z - n->z * a->y) / len;
+  v[1] = _obj->axis_ratio * (n->z * a->x - n->x * a->z) / len;
+  v[2] = _obj->axis_ratio * (n->x * a->y - n->y * a->x) / len;
+  while (sweep <= 0.0)
+    sweep += 2 * M_PI;
+  full = sweep >= 2 * M_PI - 1e-9;
+  if (full)
+    sweep = 2 * M_PI;
+  error = tess_part(t);
+  error |= tess_conic(t, c, u, v, _obj->start_angle, sweep,
+                      tess_segments(sqrt(u[0] * u[0] + u[1] * u[1]
+                                         + u[2] * u[2]),
+                                    sweep, tol), 0);
+  if (full && !error)
+    error = tess_close(t);
+  return error;
+}
+
+/* de Boor in homogeneous coordinates, for TESS_BATCH parameters u in
+   the knot span k */
+static void
+spline_eval_batch (const Dwg_Entity_SPLINE *restrict _obj, BITCODE_BL k,
+                   const double *restrict u, double *restrict px,
+                   double *restrict py, double *restrict pz)
+{
+  const int deg = _obj->degree;
+  double d[TESS_MAX_DEGREE + 1][4][TESS_BATCH];
+  int i, j, r;
+
+  for (j = 0; j <= deg; j++)
+    {
+      const Dwg_SPLINE_control_point *c = &_obj->ctrl_pts[j + k - deg];
+      const double w = _obj->weighted && c->w > 0.0 ? c->w : 1.0;
+      for (i = 0; i < TESS_BATCH; i++)
+        {
+          d[j][0][i] = c->x * w;
+          d[j][1][i] = c->y * w;
+          d[j][2][i] = c->z * w;
+          d[j][3][i] = w;
+        }
+    }
+  for (r = 1; r <= deg; r++)
+    for (j = deg; j >= r; j--)
+      {
+        const double k0 = _obj->knots[j + k - deg];
+        const double k1 = _obj->knots[j + 1 + k - r];
+        const double f = k1 > k0 ? 1.0 / (k1 - k0) : 0.0;
+        int l;
+        for (l = 0; l < 4; l++)
+          for (i = 0; i < TESS_BATCH; i++)
+            {
+              const double alpha = (u[i] - k0) * f;
+              d[j][l][i] = (1.0 - alpha) * d[j - 1][l][i] + alpha * d[j][l][i];
+            }
+      }
+  for (i = 0; i < TESS_BATCH; i++)
+    {
+      px[i] = d[deg][0][i] / d[deg][3][i];
+      py[i] = d[deg][1][i] / d[deg][3][i];
+      pz[i] = d[deg][2][i] / d[deg][3][i];
+    }
+}
+
+/* the n points at u[] of the span k */
+static void
+spline_eval (const Dwg_Entity_SPLINE *restrict _obj, BITCODE_BL k,
+             const double *restrict u, BITCODE_BL n, double *restrict px,
+             double *restrict py, double *restrict pz)
+{
+  BITCODE_BL i;
+  for (i = 0; i < n; i += TESS_BATCH)
+    {
+      double ub[TESS_BATCH], xb[TESS_BATCH], yb[TESS_BATCH], zb[TESS_BATCH];
+      const BITCODE_BL m = n - i < TESS_BATCH ? n - i : TESS_BATCH;
+      BITCODE_BL j;
+      for (j = 0; j < TESS_BATCH; j++)
+        ub[j] = u[i + (j < m ? j : m - 1)];
+      spline_eval_batch(_obj, k, ub, xb, yb, zb);
+      memcpy(&px[i], xb, m * sizeof(double));
+      memcpy(&py[i], yb, m * sizeof(double));
+      memcpy(&pz[i], zb, m * sizeof(double));
+    }
+}
+
+/* The knot span k [u0,u1] after the last point. Halves all its segments
+   until their midpoints are within tol of the chords. */
+static int
+tess_spline_span (Dwg_Tessellation *restrict t,
+                  const Dwg_Entity_SPLINE *restrict _obj, BITCODE_BL k,
+                  double tol)
+{
+  const double u0 = _obj->knots[k], u1 = _obj->knots[k + 1];
+  const BITCODE_BL base = t->num_points - 1;
+  double um[TESS_SPAN_MAX / 2];
+  double mx[TESS_SPAN_MAX / 2], my[TESS_SPAN_MAX / 2], mz[TESS_SPAN_MAX / 2];
+  BITCODE_BL i, n = TESS_SPAN_MIN;
+
+  if (tess_reserve(t, n))
+    return DWG_ERR_OUTOFMEM;
+  for (i = 0; i < n; i++)
+    um[i] = u0 + (u1 - u0) * (i + 1) / n;
+  spline_eval(_obj, k, um, n, &t->x[base + 1], &t->y[base + 1],
+              &t->z[base + 1]);
+  while (n < TESS_SPAN_MAX)
+    {
+      const double *restrict x = &t->x[base];
+      const double *restrict y = &t->y[base];
+      const double *restrict z = &t->z[base];
+      double max = 0.0;
+      for (i = 0; i < n; i++)
+        um[i] = u0 + (u1 - u0) * (2 * i + 1) / (2 * n);
+      spline_eval(_obj, k, um, n, mx, my, mz);
+      // the squared distances of the midpoints from the chords
+      for (i = 0; i < n; i++)
+        {
+          const double ax = x[i + 1] - x[i], ay = y[i + 1] - y[i],
+                       az = z[i + 1] - z[i];
+          const double bx = mx[i] - x[i], by = my[i] - y[i], bz = mz[i] - z[i];
+          const double cx = ay * bz - az * by, cy = az * bx - ax * bz,
+                       cz = ax * by - ay * bx;
+          const double la = ax * ax + ay * ay + az * az;
+          const double dist = la > 0.0 ? (cx * cx + cy * cy + cz * cz) / la
+                                       : bx * bx + by * by + bz * bz;
+          if (dist > max)
+            max = dist;
+        }
+      if (max <= tol * tol)
+        break;
+      if (tess_reserve(t, 2 * n + 1 - (t->num_points - base)))
+        return DWG_ERR_OUTOFMEM;
+      // interleave from the end, the moved points are past the unmoved
+      for (i = n; i > 0; i--)
+        {
+          t->x[base + 2 * i] = t->x[base + i];
+          t->y[base + 2 * i] = t->y[base + i];
+          t->z[base + 2 * i] = t->z[base + i];
+          t->x[base + 2 * i - 1] = mx[i - 1];
+          t->y[base + 2 * i - 1] = my[i - 1];
+          t->z[base + 2 * i - 1] = mz[i - 1];
+        }
+      n *= 2;
+    }
+  t->num_points = base + n + 1;
+  return 0;
+}
+
+/* The unit tangent v scaled to len into D[0..2] at row i, 0 if none */
+static int
+spline_fit_tangent (const double v[3], double len, double *D[3],
+                    BITCODE_BL i)
+{
+  const double l = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+  int k;
+  if (!(l > 0.0) || !isfinite(l))
+    return 0;
+  for (k = 0; k < 3; k++)
+    D[k][i] = v[k] * len / l;
+  return 1;
+}
+
+/* The C2 cubic through the fit points, with the knots at their chord
+   lengths, its square roots or uniform by the knotparam, clamped to the
+   end tangents if given, else natural. A closed one is clamped to the
+   tangent across its first point. The slopes D of its Hermite segments
+   solve the tridiagonal system, with d[i] = (P[i+1] - P[i]) / h[i]:
+     h[i] D[i-1] + 2 (h[i-1] + h[i]) D[i] + h[i-1] D[i+1]
+       = 3 (h[i] d[i-1] + h[i-1] d[i]) */
+static int
+tess_spline_fit (Dwg_Tessellation *restrict t,
+                 const Dwg_Entity_SPLINE *restrict _obj, double tol)
+{
+  const BITCODE_BL size = _obj->num_fit_pts + 1;
+  double *P[3], *D[3], *h, *cp, *buf;
+  double t0[3], t1[3], min[3], max[3];
+  BITCODE_BL i, j, n = 0, m;
+  int k, clamp0, clamp1, error = 0;
+
+  if (!_obj->fit_pts || !_obj->num_fit_pts)
+    return 0;
+  buf = (double *)dwg_malloc(8 * size * sizeof(double));
+  if (!buf)
+    return DWG_ERR_OUTOFMEM;
+  for (k = 0; k < 3; k++)
+    {
+      P[k] = &buf[k * size];
+      D[k] = &buf[(3 + k) * size];
+    }
+  h = &buf[6 * size];
+  cp = &buf[7 * size];
+  // the distinct points, the first again at the end when closed
+  for (i = 0; i < _obj->num_fit_pts; i++)
+    {
+      const Dwg_SPLINE_point *f = &_obj->fit_pts[i];
+      if (n && f->x == P[0][n - 1] && f->y == P[1][n - 1]
+          && f->z == P[2][n - 1])
+        continue;
+      P[0][n] = f->x;
+      P[1][n] = f->y;
+      P[2][n] = f->z;
+      n++;
+    }
+  if (_obj->closed_b && n > 2
+      && (P[0][0] != P[0][n - 1] || P[1][0] != P[1][n - 1]
+          || P[2][0] != P[2][n - 1]))
+    {
+      for (k = 0; k < 3; k++)
+        P[k][n] = P[k][0];
+      n++;
+    }
+  if (n < 2)
+    {
+      error = tess_point(t, P[0][0], P[1][0], P[2][0]);
+      dwg_dealloc(buf);
+      return error;
+    }
+  m = n - 1;
+  for (k = 0; k < 3; k++)
+    min[k] = max[k] = P[k][0];
+  for (i = 0; i < m; i++)
+    {
+      const double dx = P[0][i + 1] - P[0][i], dy = P[1][i + 1] - P[1][i],
+                   dz = P[2][i + 1] - P[2][i];
+      const double chord = sqrt(dx * dx + dy * dy + dz * dz);
+      h[i] = _obj->knotparam == 2 ? 1.0
+             : _obj->knotparam == 1 ? sqrt(chord) : chord;
+      for (k = 0; k < 3; k++)
+        {
+          if (P[k][i + 1] < min[k]) min[k] = P[k][i + 1];
+          if (P[k][i + 1] > max[k]) max[k] = P[k][i + 1];
+        }
+    }
+  if (tol <= 0.0)
+    tol = TESS_TOLERANCE
+          * sqrt((max[0] - min[0]) * (max[0] - min[0])
+                 + (max[1] - min[1]) * (max[1] - min[1])
+                 + (max[2] - min[2]) * (max[2] - min[2]));
+  if (_obj->closed_b && P[0][0] == P[0][m] && P[1][0] == P[1][m]
+      && P[2][0] == P[2][m] && m > 1)
+    for (k = 0; k < 3; k++)
+      t0[k] = t1[k] = P[k][1] - P[k][m - 1];
+  else
+    {
+      t0[0] = _obj->beg_tan_vec.x;
+      t0[1] = _obj->beg_tan_vec.y;
+      t0[2] = _obj->beg_tan_vec.z;
+      t1[0] = _obj->end_tan_vec.x;
+      t1[1] = _obj->end_tan_vec.y;
+      t1[2] = _obj->end_tan_vec.z;
+    }
+
+  // the first row, clamped to the speed of the first chord, or natural
+  {
+    const double dx = P[0][1] - P[0][0], dy = P[1][1] - P[1][0],
+                 dz = P[2][1] - P[2][0];
+    clamp0 = spline_fit_tangent(t0, sqrt(dx * dx + dy * dy + dz * dz) / h[0],
+                                D, 0);
+    if (!clamp0)
+      for (k = 0; k < 3; k++)
+        D[k][0] = 1.5 * (P[k][1] - P[k][0]) / h[0];
+    cp[0] = clamp0 ? 0.0 : 0.5;
+  }
+  // the forward elimination of the inner rows
+  for (i = 1; i < m; i++)
+    {
+      const double a = h[i], c = h[i - 1];
+      const double b = 2.0 * (h[i - 1] + h[i]) - a * cp[i - 1];
+      cp[i] = c / b;
+      for (k = 0; k < 3; k++)
+        {
+          const double r = 3.0 * (h[i] * (P[k][i] - P[k][i - 1]) / h[i - 1]
+                                  + h[i - 1] * (P[k][i + 1] - P[k][i]) / h[i]);
+          D[k][i] = (r - a * D[k][i - 1]) / b;
+        }
+    }
+  // the last row
+  {
+    const double dx = P[0][m] - P[0][m - 1], dy = P[1][m] - P[1][m - 1],
+                 dz = P[2][m] - P[2][m - 1];
+    clamp1 = spline_fit_tangent(
+        t1, sqrt(dx * dx + dy * dy + dz * dz) / h[m - 1], D, m);
+    if (!clamp1)
+      {
+        const double b = 2.0 - cp[m - 1];
+        for (k = 0; k < 3; k++)
+          D[k][m] = (3.0 * (P[k][m] - P[k][m - 1]) / h[m - 1] - D[k][m - 1])
+                    / b;
+      }
+  }
+  for (i = m; i > 0; i--)
+    for (k = 0; k < 3; k++)
+      D[k][i - 1] -= cp[i - 1] * D[k][i];
+
+  // the segments, as many chords as their second derivative needs
+  error = tess_point(t, P[0][0], P[1][0], P[2][0]);
+  for (i = 0; i < m && !error; i++)
+    {
+      double e = 0.0, nseg;
+      BITCODE_BL ns;
+      for (k = 0; k < 3; k++)
+        {
+          const double dp = P[k][i + 1] - P[k][i];
+          const double e0 = 6.0 * dp - h[i] * (4.0 * D[k][i] + 2.0 * D[k][i + 1]);
+          const double e1 = -6.0 * dp + h[i] * (2.0 * D[k][i] + 4.0 * D[k][i + 1]);
+          e += (fabs(e0) > fabs(e1) ? e0 * e0 : e1 * e1);
+        }
+      // the chord error of a cubic is at most max|P''| / 8 ns^2
+      nseg = tol > 0.0 ? ceil(sqrt(sqrt(e) / (8.0 * tol))) : TESS_SPAN_MIN;
+      ns = !(nseg >= 1.0) ? 1
+           : nseg > TESS_SPAN_MAX ? TESS_SPAN_MAX : (BITCODE_BL)nseg;
+      if ((error = tess_reserve(t, ns)))
+        break;
+      for (j = 1; j <= ns; j++)
+        {
+          const double u = (double)j / ns, u2 = u * u, u3 = u2 * u;
+          const double h00 = 2.0 * u3 - 3.0 * u2 + 1.0;
+          const double h10 = (u3 - 2.0 * u2 + u) * h[i];
+          const double h01 = -2.0 * u3 + 3.0 * u2;
+          const double h11 = (u3 - u2) * h[i];
+          const BITCODE_BL q = t->num_points + j - 1;
+          t->x[q] = h00 * P[0][i] + h10 * D[0][i] + h01 * P[0][i + 1]
+                    + h11 * D[0][i + 1];
+          t->y[q] = h00 * P[1][i] + h10 * D[1][i] + h01 * P[1][i + 1]
+                    + h11 * D[1][i + 1];
+          t->z[q] = h00 * P[2][i] + h10 * D[2][i] + h01 * P[2][i + 1]
+                    + h11 * D[2][i + 1];
+        }
+      t->num_points += ns;
+    }
+  dwg_dealloc(buf);
+  if (_obj->closed_b && !error)
+    error = tess_close(t);
+  return error;
+}
+
+static int
+tess_spline (Dwg_Tessellation *restrict t,
+             const Dwg_Entity_SPLINE *restrict _obj, double tol)
+{
+  const BITCODE_BL n = _obj->num_ctrl_pts;
+  const int deg = _obj->degree;
+  BITCODE_BL i, k;
+  double u, x, y, z;
+  int error = tess_part(t);
+
+  if (!n || !_obj->ctrl_pts)
+    return error | tess_spline_fit(t, _obj, tol);
+  if (deg < 1 || deg > TESS_MAX_DEGREE || n <= (BITCODE_BL)deg
+      || _obj->num_knots != n + deg + 1 || !_obj->knots)
+    {
+      // the control polygon
+      for (i = 0; i < n; i++)
+        error |= tess_point(t, _obj->ctrl_pts[i].x, _obj->ctrl_pts[i].y,
+                            _obj->ctrl_pts[i].z);
+      return error;
+    }
+  if (tol <= 0.0)
+    {
+      // relative to the extent of the control points
+      double min[3], max[3];
+      min[0] = max[0] = _obj->ctrl_pts[0].x;
+      min[1] = max[1] = _obj->ctrl_pts[0].y;
+      min[2] = max[2] = _obj->ctrl_pts[0].z;
+      for (i = 1; i < n; i++)
+        {
+          const Dwg_SPLINE_control_point *c = &_obj->ctrl_pts[i];
+          if (c->x < min[0]) min[0] = c->x;
+          if (c->x > max[0]) max[0] = c->x;
+          if (c->y < min[1]) min[1] = c->y;
+          if (c->y > max[1]) max[1] = c->y;
+          if (c->z < min[2]) min[2] = c->z;
+          if (c->z > max[2]) max[2] = c->z;
+        }
+      tol = TESS_TOLERANCE
+            * sqrt((max[0] - min[0]) * (max[0] - min[0])
+                   + (max[1] - min[1]) * (max[1] - min[1])
+                   + (max[2] - min[2]) * (max[2] - min[2]));
+    }
+  u = _obj->knots[deg];
+  spline_eval(_obj, deg, &u, 1, &x, &y, &z);
+  error |= tess_point(t, x, y, z);
+  for (k = deg; k < n && !error; k++)
+    {
+      if (!(_obj->knots[k + 1] > _obj->knots[k]))
+        continue;
+      error = tess_spline_span(t, _obj, k, tol);
+    }
+  if (_obj->closed_b && !error)
+    error = tess_close(t);
+  return error;
+}
+
+/* The VERTEX objects of a POLYLINE_*: by handle since R2004, else from
+   first_vertex to last_vertex, or up to the SEQEND before R13.
+   Into a new *list, returns their number. */
+static BITCODE_BL
+tess_vertices (const Dwg_Object *restrict obj, BITCODE_BL num_owned,
+               BITCODE_H first_vertex, BITCODE_H last_vertex,
+               BITCODE_H *restrict vertex, Dwg_Object ***list, int *error)
+{
+  Dwg_Data *dwg = obj->parent;
+  BITCODE_BL num = 0, max = dwg->num_objects;
+  Dwg_Object *v = NULL, *last = NULL;
+
+  *list = NULL;
+  if (dwg->header.version >= R_2004)
+    max = vertex ? num_owned : 0;
+  else if (dwg->header.version >= R_13)
+    {
+      v = first_vertex ? dwg_ref_object(dwg, first_vertex) : NULL;
+      last = last_vertex ? dwg_ref_object(dwg, last_vertex) : NULL;
+      if (!v || !last)
+        return 0;
+      // at most the objects up to the last
+      max = last->index >= v->index ? last->index - v->index + 1 : 0;
+    }
+  else
+    v = dwg_next_object(obj);
+  if (!max)
+    return 0;
+  if (!(*list = (Dwg_Object **)dwg_malloc(max * sizeof(Dwg_Object *))))
+    {
+      *error = DWG_ERR_OUTOFMEM;
+      return 0;
+    }
+  if (dwg->header.version >= R_2004)
+    {
+      BITCODE_BL i;
+      for (i = 0; i < num_owned; i++)
+        if ((v = dwg_ref_object(dwg, vertex[i])))
+          (*list)[num++] = v;
+      return num;
+    }
+  for (; v && num < max; v = dwg_next_object(v))
+    {
+      if (v->type == DWG_TYPE_SEQEND)
+        break;
+      if (v->type >= DWG_TYPE_VERTEX_2D && v->type <= DWG_TYPE_VERTEX_PFACE_FACE)
+        (*list)[num++] = v;
+      if (v == last)
+        break;
+    }
+  return num;
+}
+
+#define POLYLINE_VERTICES(_obj) \
+  tess_vertices(obj, _obj->num_owned, _obj->first_vertex, \
+                _obj->last_vertex, _obj->vertex, &vertices, &error)
+
+static int
+tess_lwpolyline (Dwg_Tessellation *restrict t,
+                 const Dwg_Entity_LWPOLYLINE *restrict _obj, double tol)
+{
+  const BITCODE_BL n = _obj->num_points;
+  const int closed = _obj->flag & 512 && n > 1;
+  const BITCODE_BD *bulges = _obj->num_bulges == n ? _obj->bulges : NULL;
+  BITCODE_BL i;
+  int error;
+
+  if (!n || !_obj->points)
+    return 0;
+  error = tess_part(t);
+  error |= tess_point(t, _obj->points[0].x, _obj->points[0].y,
+                      _obj->elevation);
+  for (i = 0; i + 1 < n + (closed ? 1 : 0) && !error; i++)
+    {
+      const BITCODE_BL j = (i + 1) % n;
+      error = tess_bulge(t, _obj->points[j].x, _obj->points[j].y,
+                         _obj->elevation, bulges ? bulges[i] : 0.0, tol);
+    }
+  if (closed && !error)
+    error = tess_close(t);
+  return error;
+}
+
+static int
+tess_polyline_2d (Dwg_Tessellation *restrict t,
+                  const Dwg_Object *restrict obj, double tol)
+{
+  const Dwg_Entity_POLYLINE_2D *_obj = obj->tio.entity->tio.POLYLINE_2D;
+  Dwg_Object **vertices;
+  int error = 0;
+  const BITCODE_BL n = POLYLINE_VERTICES(_obj);
+  const int closed = _obj->flag & 1 && n > 1;
+  const Dwg_Entity_VERTEX_2D *prev = NULL;
+  BITCODE_BL i;
+
+  if (n)
+    error |= tess_part(t);
+  for (i = 0; i < n + (closed ? 1 : 0) && !error; i++)
+    {
+      const Dwg_Object *o = vertices[i % n];
+      const Dwg_Entity_VERTEX_2D *v = o->tio.entity->tio.VERTEX_2D;
+      if (o->type != DWG_TYPE_VERTEX_2D)
+        continue;
+      if (!prev)
+        error = tess_point(t, v->point.x, v->point.y, _obj->elevation);
+      else
+        error = tess_bulge(t, v->point.x, v->point.y, _obj->elevation,
+                           prev->bulge, tol);
+      prev = v;
+    }
+  if (closed && !error)
+    error = tess_close(t);
+  dwg_dealloc(vertices);
+  return error;
+}
+
+static int
+tess_polyline_3d (Dwg_Tessellation *restrict t,
+                  const Dwg_Object *restrict obj)
+{
+  const Dwg_Entity_POLYLINE_3D *_obj = obj->tio.entity->tio.POLYLINE_3D;
+  Dwg_Object **vertices;
+  int error = 0;
+  const BITCODE_BL n = POLYLINE_VERTICES(_obj);
+  const int closed = _obj->flag2 & 1 && n > 1;
+  BITCODE_BL i;
+
+  if (n)
+    error |= tess_part(t);
+  for (i = 0; i < n && !error; i++)
+    {
+      const Dwg_Entity_VERTEX_3D *v = vertices[i]->tio.entity->tio.VERTEX_3D;
+      error = tess_point(t, v->point.x, v->point.y, v->point.z);
+    }
+  if (closed && !error)
+    error = tess_close(t);
+  dwg_dealloc(vertices);
+  return error;
+}
+
+/* each face as ring */
+static int
+tess_polyline_pface (Dwg_Tessellation *restrict t,
+                     const Dwg_Object *restrict obj)
+{
+  const Dwg_Entity_POLYLINE_PFACE *_obj
+      = obj->tio.entity->tio.POLYLINE_PFACE;
+  Dwg_Object **vertices;
+  int error = 0;
+  const BITCODE_BL n = POLYLINE_VERTICES(_obj);
+  BITCODE_BL i, numverts = 0;
+
+  // the vertices first, then the faces
+  while (numverts < n && vertices[numverts]->type != DWG_TYPE_VERTEX_PFACE_FACE)
+    numverts++;
+  for (i = numverts; i < n && !error; i++)
+    {
+      const Dwg_Entity_VERTEX_PFACE_FACE *f
+          = vertices[i]->tio.entity->tio.VERTEX_PFACE_FACE;
+      int j, num = 0;
+      if (vertices[i]->type != DWG_TYPE_VERTEX_PFACE_FACE)
+        continue;
+      for (j = 0; j < 4 && !error; j++)
+        {
+          // negative for an invisible edge
+          const BITCODE_BL vi = (BITCODE_BL)abs((int16_t)f->vertind[j]);
+          const Dwg_Entity_VERTEX_3D *v;
+          if (!vi || vi > numverts)
+            continue;
+          v = vertices[vi - 1]->tio.entity->tio.VERTEX_3D;
+          if (!num++)
+            error = tess_part(t);
+          error |= tess_point(t, v->point.x, v->point.y, v->point.z);
+        }
+      if (num == 1)
+        {
+          // a single vertex is no face
+          t->num_parts--;
+          t->num_points--;
+        }
+      else if (num && !error)
+        error = tess_close(t);
+    }
+  dwg_dealloc(vertices);
+  return error;
+}
+
+/* each quad of the M x N mesh as ring */
+static int
+tess_polyline_mesh (Dwg_Tessellation *restrict t,
+                    const Dwg_Object *restrict obj)
+{
+  const Dwg_Entity_POLYLINE_MESH *_obj = obj->tio.entity->tio.POLYLINE_MESH;
+  Dwg_Object **vertices;
+  int error = 0;
+  const BITCODE_BL n = POLYLINE_VERTICES(_obj);
+  const BITCODE_BL m_verts = _obj->num_m_verts, n_verts = _obj->num_n_verts;
+  const BITCODE_BL m_max = _obj->flag & 1 ? m_verts : m_verts - 1;
+  const BITCODE_BL n_max = _obj->flag & 32 ? n_verts : n_verts - 1;
+  BITCODE_BL i, j;
+
+  if (m_verts && n_verts && n >= m_verts * n_verts)
+    for (i = 0; i < m_max && !error; i++)
+      for (j = 0; j < n_max && !error; j++)
+        {
+          const BITCODE_BL q[4]
+              = { i * n_verts + j, i * n_verts + (j + 1) % n_verts,
+                  ((i + 1) % m_verts) * n_verts + (j + 1) % n_verts,
+                  ((i + 1) % m_verts) * n_verts + j };
+          int k;
+          error = tess_part(t);
+          for (k = 0; k < 4 && !error; k++)
+            {
+              const Dwg_Entity_VERTEX_3D *v
+                  = vertices[q[k]]->tio.entity->tio.VERTEX_3D;
+              error = tess_point(t, v->point.x, v->point.y, v->point.z);
+            }
+          if (!error)
+            error = tess_close(t);
+        }
+  dwg_dealloc(vertices);
+  return error;
+}
+
+static int
+tessellate (const Dwg_Object *restrict obj, double tolerance,
+            Dwg_Tessellation *restrict out)
+{
+  const Dwg_Data *dwg = obj->parent;
+  double ocs[9];
+  int error = 0;
+
+  if (out->dwg != dwg)
+    {
+      // the arrays of another dwg were allocated by its allocator
+      if (out->dwg)
+        dwg_free_tessellation(out);
+      out->dwg = dwg;
+    }
+  out->num_points = 0;
+  out->num_parts = 0;
+  if (obj->supertype != DWG_SUPERTYPE_ENTITY || !obj->tio.entity)
+    return DWG_ERR_INVALIDTYPE;
+
+  switch (dwg->header.version < R_13 ? (int)obj->type : (int)obj->fixedtype)
+    {
+    case DWG_TYPE_LINE:
+      {
+        const Dwg_Entity_LINE *_obj = obj->tio.entity->tio.LINE;
+        error = tess_part(out);
+        error |= tess_point(out, _obj->start.x, _obj->start.y, _obj->start.z);
+        error |= tess_point(out, _obj->end.x, _obj->end.y, _obj->end.z);
+      }
+      break;
+    case DWG_TYPE_POINT:
+      {
+        const Dwg_Entity_POINT *_obj = obj->tio.entity->tio.POINT;
+        error = tess_part(out);
+        error |= tess_point(out, _obj->x, _obj->y, _obj->z);
+      }
+      break;
+    case DWG_TYPE_GEOPOSITIONMARKER:
+      {
+        const Dwg_Entity_GEOPOSITIONMARKER *_obj
+            = obj->tio.entity->tio.GEOPOSITIONMARKER;
+        error = tess_part(out);
+        error |= tess_point(out, _obj->position.x, _obj->position.y,
+                            _obj->position.z);
+      }
+      break;
+    case DWG_TYPE_CIRCLE:
+      {
+        const Dwg_Entity_CIRCLE *_obj = obj->tio.entity->tio.CIRCLE;
+        error = tess_part(out);
+        error |= tess_arc(out, &_obj->center, _obj->radius, 0.0, 2 * M_PI,
+                          tolerance);
+        if (!error)
+          error = tess_close(out);
+      }
+      break;
+    case DWG_TYPE_ARC:
+      {
+        const Dwg_Entity_ARC *_obj = obj->tio.entity->tio.ARC;
+        double sweep = _obj->end_angle - _obj->start_angle;
+        while (sweep <= 0.0)
+          sweep += 2 * M_PI;
+        error = tess_part(out);
+        error |= tess_arc(out, &_obj->center, _obj->radius,
+                          _obj->start_angle, sweep, tolerance);
+      }
+      break;
+    case DWG_TYPE_ELLIPSE:
+      error = tess_ellipse(out, obj->tio.entity->tio.ELLIPSE, tolerance);
+      break;
+    case DWG_TYPE_SPLINE:
+      error = tess_spline(out, obj->tio.entity->tio.SPLINE, tolerance);
+      break;
+    case DWG_TYPE_LWPOLYLINE:
+      error = tess_lwpolyline(out, obj->tio.entity->tio.LWPOLYLINE, tolerance);
+      break;
+    case DWG_TYPE_POLYLINE_2D:
+      error = tess_polyline_2d(out, obj, tolerance);
+      break;
+    case DWG_TYPE_POLYLINE_3D:
+      error = tess_polyline_3d(out, obj);
+      break;
+    case DWG_TYPE_POLYLINE_PFACE:
+      error = tess_polyline_pface(out, obj);
+      break;
+    case DWG_TYPE_POLYLINE_MESH:
+      error = tess_polyline_mesh(out, obj);
+      break;
+    case DWG_TYPE_SOLID:
+    case DWG_TYPE_TRACE:
+      {
+        // same layout, the corners in the order 1 2 4 3
+        const Dwg_Entity_SOLID *_obj = obj->tio.entity->tio.SOLID;
+        error = tess_part(out);
+        error |= tess_point(out, _obj->corner1.x, _obj->corner1.y,
+                            _obj->elevation);
+        error |= tess_point(out, _obj->corner2.x, _obj->corner2.y,
+                            _obj->elevation);
+        error |= tess_point(out, _obj->corner4.x, _obj->corner4.y,
+                            _obj->elevation);
+        error |= tess_point(out, _obj->corner3.x, _obj->corner3.y,
+                            _obj->elevation);
+        if (!error)
+          error = tess_close(out);
+      }
+      break;
+    case DWG_TYPE__3DFACE:
+      {
+        const Dwg_Entity__3DFACE *_obj = obj->tio.entity->tio._3DFACE;
+        error = tess_part(out);
+        error |= tess_point(out, _obj->corner1.x, _obj->corner1.y,
+                            _obj->corner1.z);
+        error |= tess_point(out, _obj->corner2.x, _obj->corner2.y,
+                            _obj->corner2.z);
+        error |= tess_point(out, _obj->corner3.x, _obj->corner3.y,
+                            _obj->corner3.z);
+        error |= tess_point(out, _obj->corner4.x, _obj->corner4.y,
+                            _obj->corner4.z);
+        if (!error)
+          error = tess_close(out);
+      }
+      break;
+    default:
+      return DWG_ERR_INVALIDTYPE;
+    }
+  if (error)
+    {
+      out->num_points = 0;
+      out->num_parts = 0;
+    }
+  else if (dwg_entity_ocs(obj, ocs))
+    dwg_ocs_to_wcs(ocs, out->num_points, out->x, out->y, out->z);
+  return error;
+}
+
+int
+dwg_tessellate (const Dwg_Object *restrict obj, double tolerance,
+                Dwg_Tessellation *restrict out)
+{
+  Dwg_Allocator saved;
+  int error;
+
+  if (!obj || !obj->parent || !out)
+    return DWG_ERR_INVALIDDWG;
+  dwg_alloc_enter(obj->parent, &saved);
+  error = tessellate(obj, tolerance, out);
+  dwg_alloc_leave(&saved);
+  return error;
+}
+
+void
+dwg_free_tessellation (Dwg_Tessellation *tess)
+{
+  Dwg_Allocator saved;
+
+  if (!tess)
+    return;
+  if (tess->dwg)
+    dwg_alloc_enter(tess->dwg, &saved);
+  dwg_dealloc(tess->x);
+  dwg_dealloc(tess->y);
+  dwg_dealloc(tess->z);
+  dwg_dealloc(tess->parts);
+  dwg_dealloc(tess->closed);
+  if (tess->dwg)
+    dwg_alloc_leave(&saved);
+  memset(tess, 0, sizeof(Dwg_Tessellation));
+}
@@ -265,6 +265,43 @@ bit_write_RD_tests (void)
     fail("bit_write_RD");
 }
 
+/* Each DD code: 0 as the default, 1 with its high 4 bytes,
+   2 with its high 2 bytes, 3 as RD. */
+void
+bit_write_DD_tests (void)
+{
+  static const double dd[][3] = {
+    /* value, default, code */
+    { 1.0, 1.0, 0 },
+    { 1.0000001, 1.0000002, 1 },
+    { 1.0, 0.0, 3 },
+    { 20.256, 50.252, 3 },
+    { 20.256, 20.255, 2 },
+    { -3.5, 1e10, 3 },
+  };
+  unsigned i;
+
+  for (i = 0; i < sizeof (dd) / sizeof (dd[0]); i++)
+    {
+      Bit_Chain bitchain;
+      double result;
+      unsigned char code;
+
+      bitprepare (&bitchain, 16);
+      bit_write_DD (&bitchain, dd[i][0], dd[i][1]);
+      bitchain.byte = 0;
+      bitchain.bit = 0;
+      code = bitchain.chain[0] >> 6;
+      result = bit_read_DD (&bitchain, dd[i][1]);
+      if (result == dd[i][0] && code == (unsigned char)dd[i][2])
+        pass ("bit_write_DD %g/%g", dd[i][0], dd[i][1]);
+      else
+        fail ("bit_write_DD %g/%g: code %d, read %g", dd[i][0], dd[i][1],
+              code, result);
+      free (bitchain.chain);
+    }
+}
+
 int
 main (int argc, char const *argv[])
 {
@@ -296,6 +333,7 @@ main (int argc, char const *argv[])
   bit_write_RL_tests ();
   bit_read_RD_tests();
   bit_write_RD_tests();
+  bit_write_DD_tests();
   //bit_read_H_tests();
   //bit_write_H_tests();
 
@@ -0,0 +1,372 @@
+#include "../../src/common.h"
+#include "../../src/in_dxf.c"
+
+#include <sys/stat.h>
+#include <dejagnu.h>
+
+static void
+dxf_parse_double_tests (void)
+{
+  char buf[512];
+  unsigned int len, i;
+  double d;
+
+  if (dxf_parse_double ("12.5", 4, &d) == 4 && d == 12.5)
+    pass ("dxf_parse_double 12.5");
+  else
+    fail ("dxf_parse_double 12.5 => %g", d);
+
+  if (dxf_parse_double ("-1.25e-3", 8, &d) == 8 && d == -1.25e-3)
+    pass ("dxf_parse_double -1.25e-3");
+  else
+    fail ("dxf_parse_double -1.25e-3 => %g", d);
+
+  // longer than the stack copy
+  strcpy (buf, "0.");
+  for (i = 2; i < 300; i++)
+    buf[i] = '3';
+  buf[i] = '\0';
+  len = i;
+  if (dxf_parse_double (buf, len, &d) == len && d == strtod (buf, NULL))
+    pass ("dxf_parse_double %u digits", len);
+  else
+    fail ("dxf_parse_double %u digits => %.17g", len, d);
+
+  if (dxf_parse_double ("1.5x", 4, &d) < 4)
+    pass ("dxf_parse_double 1.5x invalid");
+  else
+    fail ("dxf_parse_double 1.5x valid");
+  if (dxf_parse_double ("-", 1, &d) < 1)
+    pass ("dxf_parse_double - invalid");
+  else
+    fail ("dxf_parse_double - valid");
+
+  // not NUL terminated
+  if (dxf_parse_double ("2.75\n10", 4, &d) == 4 && d == 2.75)
+    pass ("dxf_parse_double view");
+  else
+    fail ("dxf_parse_double view => %g", d);
+}
+
+static Bit_Chain
+dxf_chain (const char *s)
+{
+  Bit_Chain dat;
+  memset (&dat, 0, sizeof (Bit_Chain));
+  dat.chain = (unsigned char *)s;
+  dat.size = strlen (s);
+  return dat;
+}
+
+static void
+dxf_read_pair_tests (void)
+{
+  Dxf_Pair pair;
+  Bit_Chain dat;
+  char buf[512], *str = NULL;
+  unsigned int i;
+
+  // CRLF and LF give the same groups
+  dat = dxf_chain ("  0\r\nSECTION\r\n  2\nHEADER\n 10\r\n1.5\r\n");
+  if (!dxf_read_pair (&dat, &pair) && pair.code == 0
+      && dxf_is (&pair, "SECTION") && !dxf_read_pair (&dat, &pair)
+      && pair.code == 2 && dxf_is (&pair, "HEADER")
+      && !dxf_read_pair (&dat, &pair) && pair.code == 10
+      && pair.value.d == 1.5)
+    pass ("dxf_read_pair CRLF");
+  else
+    fail ("dxf_read_pair CRLF");
+  if (dxf_read_pair (&dat, &pair) == DWG_ERR_INVALIDDWG)
+    pass ("dxf_read_pair EOF");
+  else
+    fail ("dxf_read_pair EOF");
+
+  // the last line without newline, and a missing value at EOF
+  dat = dxf_chain ("  0\nEOF");
+  if (!dxf_read_pair (&dat, &pair) && dxf_is (&pair, "EOF"))
+    pass ("dxf_read_pair EOF without newline");
+  else
+    fail ("dxf_read_pair EOF without newline");
+  dat = dxf_chain ("  0\r\n");
+  if (dxf_read_pair (&dat, &pair) == DWG_ERR_INVALIDDWG)
+    pass ("dxf_read_pair missing value");
+  else
+    fail ("dxf_read_pair missing value");
+
+  // empty values
+  dat = dxf_chain ("  1\r\n\r\n 40\n\n");
+  if (!dxf_read_pair (&dat, &pair) && pair.code == 1 && !pair.len
+      && !dxf_read_pair (&dat, &pair) && pair.code == 40
+      && pair.value.d == 0.0)
+    pass ("dxf_read_pair empty values");
+  else
+    fail ("dxf_read_pair empty values");
+
+  // invalid group code and real
+  dat = dxf_chain ("AC1015\n  0\n");
+  if (dxf_read_pair (&dat, &pair) == DWG_ERR_INVALIDDWG)
+    pass ("dxf_read_pair invalid code");
+  else
+    fail ("dxf_read_pair invalid code");
+  dat = dxf_chain (" 40\n1.5.0\n");
+  if (dxf_read_pair (&dat, &pair) == DWG_ERR_INVALIDDWG)
+    pass ("dxf_read_pair invalid real");
+  else
+    fail ("dxf_read_pair invalid real");
+
+  // long real
+  strcpy (buf, " 40\r\n-12.");
+  for (i = strlen (buf); i < 400; i++)
+    buf[i] = '5';
+  strcpy (&buf[i], "\r\n");
+  dat = dxf_chain (buf);
+  if (!dxf_read_pair (&dat, &pair) && pair.value.d == strtod (&buf[5], NULL))
+    pass ("dxf_read_pair long real");
+  else
+    fail ("dxf_read_pair long real %.17g", pair.value.d);
+
+  // strings reuse the old buffer
+  dat = dxf_chain ("first\r\nsecond one\n");
+  if (!dxf_read_string (&dat, &str) && !strcmp (str, "first")
+      && !dxf_read_string (&dat, &str) && !strcmp (str, "second one")
+      && dxf_read_string (&dat, &str) == DWG_ERR_INVALIDDWG
+      && !strcmp (str, "second one"))
+    pass ("dxf_read_string");
+  else
+    fail ("dxf_read_string");
+  dwg_dealloc (str);
+}
+
+static void
+dxf_values_tests (void)
+{
+  Dwg_Data dwg;
+  Dwg_Object obj;
+  BITCODE_H *reactors = NULL;
+  BITCODE_BL num_reactors = 0;
+  BITCODE_TU wstr = NULL;
+  Bit_Chain dat;
+
+  dat = dxf_chain ("abc\r\nxy\n");
+  if (!dxf_read_wstring (&dat, &wstr) && wstr[0] == 'a' && wstr[2] == 'c'
+      && !wstr[3] && !dxf_read_wstring (&dat, &wstr) && wstr[0] == 'x'
+      && wstr[1] == 'y' && !wstr[2])
+    pass ("dxf_read_wstring");
+  else
+    fail ("dxf_read_wstring");
+  dwg_dealloc (wstr);
+
+  memset (&dwg, 0, sizeof (Dwg_Data));
+  memset (&obj, 0, sizeof (Dwg_Object));
+  obj.parent = &dwg;
+  if (!dxf_add_reactor (&obj, &reactors, &num_reactors, 0, 0x1F)
+      && !dxf_add_reactor (&obj, &reactors, &num_reactors, 1, 0x2A)
+      && !dxf_add_reactor (&obj, &reactors, &num_reactors, 1, 0x2B)
+      && num_reactors == 2 && reactors[0]->absolute_ref == 0x1F
+      && reactors[1]->absolute_ref == 0x2B && dwg.num_object_refs == 2
+      && dwg.object_ref[1] == reactors[1])
+    pass ("dxf_add_reactor");
+  else
+    fail ("dxf_add_reactor %u", (unsigned)num_reactors);
+  dwg_dealloc (reactors);
+  dwg_free (&dwg);
+}
+
+/* the fields of two objects and the header in one import */
+static void
+dxf_field_tests (void)
+{
+  Dxf_Import imp;
+  Dwg_Object objs[2];
+  Dxf_Field *f, *g;
+  char name[16];
+  unsigned int i, bad = 0;
+
+  memset (objs, 0, sizeof (objs));
+  objs[1].index = 1;
+  if (!dxf_search_field (&objs[0], "layer", "H", 8))
+    pass ("dxf_search_field without import");
+  else
+    fail ("dxf_search_field without import");
+
+  dxf_import_init (&imp);
+  dxf_import = &imp;
+  dxf_add_field (&objs[0], "layer", "H", 8);
+  dxf_add_field (&objs[0], "thickness", "BD", 39);
+  // more than the first fieldmap and fields hold
+  for (i = 0; i < 300; i++)
+    {
+      sprintf (name, "f%u", i);
+      dxf_add_field (&objs[0], name, "BL", 70 + i % 10);
+    }
+  dxf_add_field (&objs[1], "layer", "H", 8);
+  dxf_add_field (&objs[1], "layer", "T", 8);
+  dxf_add_field (&objs[1], "color", "CMC", 62);
+  dxf_add_field (NULL, "HANDSEED", "H", 5);
+
+  f = dxf_search_field (&objs[0], "layer", "H", 8);
+  g = dxf_search_field (&objs[1], "layer", "H", 8);
+  if (imp.num_fields == 305 && imp.num_objs == 3 && f && f == g
+      && !strcmp (f->name, "layer") && !strcmp (f->type, "H") && f->dxf == 8)
+    pass ("dxf_add_field interns %u fields", imp.num_fields);
+  else
+    fail ("dxf_add_field %u fields, %u objects", imp.num_fields,
+          imp.num_objs);
+
+  f = dxf_search_field (&objs[1], "layer", "T", 8);
+  if (f && !strcmp (f->type, "T") && f != g
+      && !dxf_search_field (&objs[0], "layer", "T", 8)
+      && dxf_search_field (&objs[0], "thickness", NULL, 39)
+      && !dxf_search_field (&objs[0], "thickness", "BL", 39)
+      && !dxf_search_field (&objs[0], "thickness", "BD", 40)
+      && !dxf_search_field (&objs[0], "color", "CMC", 62)
+      && !dxf_search_field (&objs[1], "thickness", "BD", 39)
+      && dxf_search_field (NULL, "HANDSEED", "H", 5)
+      && !dxf_search_field (&objs[0], "HANDSEED", "H", 5))
+    pass ("dxf_search_field by object, name, type and dxf");
+  else
+    fail ("dxf_search_field by object, name, type and dxf");
+
+  for (i = 0; i < 300; i++)
+    {
+      sprintf (name, "f%u", i);
+      f = dxf_search_field (&objs[0], name, "BL", 70 + i % 10);
+      if ((!f || strcmp (f->name, name)
+           || dxf_search_field (&objs[0], name, "BL", 70 + (i + 1) % 10))
+          && bad++ < 3)
+        fail ("dxf_search_field %s", name);
+    }
+  if (!bad)
+    pass ("dxf_search_field 300 fields after growing");
+
+  dxf_import = NULL;
+  dxf_import_free (&imp);
+  if (!imp.num_fields && !imp.fields && !imp.objmap)
+    pass ("dxf_import_free");
+  else
+    fail ("dxf_import_free");
+}
+
+static int
+same_string (const char *a, const char *b)
+{
+  return a == b || (a && b && !strcmp (a, b));
+}
+
+/* the import of dat into dwg, from its own cursor */
+static int
+import_dxf (const Bit_Chain *dat, Dwg_Data *dwg)
+{
+  Bit_Chain tdat = *dat;
+  memset (dwg, 0, sizeof (Dwg_Data));
+  return dwg_read_dxf (&tdat, dwg);
+}
+
+/* each thread has its own import, its fields not seen by the other */
+static void
+dxf_parallel_tests (void)
+{
+  const char *input = "../test-data/example_2000.dxf";
+  struct stat attrib;
+  Bit_Chain dat;
+  Dwg_Data dwg[3];
+  int error[3], t, bad = 0;
+  BITCODE_BL i;
+  FILE *fp;
+
+#pragma omp parallel for num_threads(2) reduction(+:bad)
+  for (t = 0; t < 2; t++)
+    {
+      Dxf_Import imp;
+      Dwg_Object objs[64];
+      char name[32];
+      unsigned int j;
+      memset (objs, 0, sizeof (objs));
+      dxf_import_init (&imp);
+      dxf_import = &imp;
+      for (j = 0; j < 64 * 16; j++)
+        {
+          objs[j % 64].index = j % 64;
+          sprintf (name, "t%d_f%u", t, j / 64);
+          dxf_add_field (&objs[j % 64], name, "BL", 8 + t);
+        }
+      for (j = 0; j < 64 * 16; j++)
+        {
+          sprintf (name, "t%d_f%u", t, j / 64);
+          if (!dxf_search_field (&objs[j % 64], name, "BL", 8 + t))
+            bad++;
+          sprintf (name, "t%d_f%u", 1 - t, j / 64);
+          if (dxf_search_field (&objs[j % 64], name, NULL, 9 - t))
+            bad++;
+        }
+      if (imp.num_fields != 16 || imp.num_objs != 64)
+        bad++;
+      dxf_import = NULL;
+      dxf_import_free (&imp);
+    }
+  if (!bad)
+    pass ("dxf_add_field in 2 imports in parallel");
+  else
+    fail ("dxf_add_field in 2 imports in parallel: %d wrong", bad);
+
+  // the same file, once serially and twice in parallel
+  if (stat (input, &attrib) || !(fp = fopen (input, "rb")))
+    {
+      fail ("%s not found", input);
+      return;
+    }
+  memset (&dat, 0, sizeof (Bit_Chain));
+  dat.size = attrib.st_size;
+  dat.chain = (unsigned char *)dwg_calloc (1, dat.size);
+  if (!dat.chain || fread (dat.chain, 1, dat.size, fp) != dat.size)
+    {
+      fail ("read %s", input);
+      fclose (fp);
+      dwg_dealloc (dat.chain);
+      return;
+    }
+  fclose (fp);
+
+  error[0] = import_dxf (&dat, &dwg[0]);
+#pragma omp parallel for num_threads(2)
+  for (t = 1; t < 3; t++)
+    error[t] = import_dxf (&dat, &dwg[t]);
+
+  for (t = 1; t < 3; t++)
+    {
+      bad = error[t] != error[0] || dwg[t].num_objects != dwg[0].num_objects
+            || dwg[t].num_classes != dwg[0].num_classes
+            || dwg[t].header.codepage != dwg[0].header.codepage;
+      for (i = 0; !bad && i < dwg[0].num_objects; i++)
+        bad = dwg[t].object[i].fixedtype != dwg[0].object[i].fixedtype
+              || dwg[t].object[i].handle.value
+                     != dwg[0].object[i].handle.value;
+      for (i = 0; !bad && i < dwg[0].num_classes; i++)
+        bad = dwg[t].dwg_class[i].number != dwg[0].dwg_class[i].number
+              || !same_string (dwg[t].dwg_class[i].dxfname,
+                               dwg[0].dwg_class[i].dxfname)
+              || !same_string (dwg[t].dwg_class[i].cppname,
+                               dwg[0].dwg_class[i].cppname);
+      if (!bad && dwg[0].num_classes)
+        pass ("dwg_read_dxf %d in parallel: %u classes, %u objects", t,
+              dwg[t].num_classes, dwg[t].num_objects);
+      else
+        fail ("dwg_read_dxf %d in parallel: error %d, %u classes, "
+              "serially %d, %u",
+              t, error[t], dwg[t].num_classes, error[0], dwg[0].num_classes);
+    }
+  for (t = 0; t < 3; t++)
+    dwg_free (&dwg[t]);
+  dwg_dealloc (dat.chain);
+}
+
+int
+main (int argc, char *argv[])
+{
+  dxf_parse_double_tests ();
+  dxf_read_pair_tests ();
+  dxf_values_tests ();
+  dxf_field_tests ();
+  dxf_parallel_tests ();
+  return 0;
+}
@@ -0,0 +1,398 @@
+#include "../../src/config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+
+#include <dejagnu.h>
+#include "dwg.h"
+#include "../../src/common.h"
+
+#ifndef M_PI
+# define M_PI 3.14159265358979323846
+#endif
+
+static Dwg_Data mem;
+static Dwg_Object obj;
+static Dwg_Object_Entity ent;
+
+/* obj as entity of type in mem, its fields in _obj */
+static void
+set_obj (int type, void *_obj)
+{
+  memset (&obj, 0, sizeof (obj));
+  memset (&ent, 0, sizeof (ent));
+  obj.parent = &mem;
+  obj.supertype = DWG_SUPERTYPE_ENTITY;
+  obj.type = obj.fixedtype = type;
+  obj.tio.entity = &ent;
+  ent.tio.ARC = (Dwg_Entity_ARC *)_obj;
+}
+
+static int
+near (double a, double b)
+{
+  return fabs (a - b) <= 1e-9 * (1.0 + fabs (b));
+}
+
+static int
+bbox_near (const Dwg_Bbox *a, const Dwg_Bbox *b)
+{
+  return near (a->min.x, b->min.x) && near (a->min.y, b->min.y)
+         && near (a->min.z, b->min.z) && near (a->max.x, b->max.x)
+         && near (a->max.y, b->max.y) && near (a->max.z, b->max.z);
+}
+
+static void
+extents_ok (const char *what, double x0, double y0, double z0, double x1,
+            double y1, double z1)
+{
+  const Dwg_Bbox expected = { { x0, y0, z0 }, { x1, y1, z1 } };
+  Dwg_Bbox bb;
+  int error;
+
+  ent.extents_state = DWG_EXTENTS_UNKNOWN;
+  error = dwg_entity_extents (&obj, &bb);
+  if (!error && bbox_near (&bb, &expected)
+      && ent.extents_state == DWG_EXTENTS_VALID)
+    pass ("%s extents", what);
+  else
+    fail ("%s extents: error %d, (%g, %g, %g) - (%g, %g, %g)", what, error,
+          bb.min.x, bb.min.y, bb.min.z, bb.max.x, bb.max.y, bb.max.z);
+}
+
+/* the exact boxes of the curves */
+static void
+entity_tests (void)
+{
+  Dwg_Entity_LINE line;
+  Dwg_Entity_CIRCLE circle;
+  Dwg_Entity_ARC arc;
+  Dwg_Entity_ELLIPSE ellipse;
+  Dwg_Entity_LWPOLYLINE pline;
+  Dwg_Entity_XLINE xline;
+  BITCODE_2RD points[2] = { { 0.0, 0.0 }, { 2.0, 0.0 } };
+  BITCODE_BD bulges[2] = { 1.0, 0.0 };
+  const double h = sqrt (0.5);
+
+  memset (&line, 0, sizeof (line));
+  line.start.x = 1.0;
+  line.start.y = 2.0;
+  line.start.z = 3.0;
+  line.end.x = 4.0;
+  line.end.y = -5.0;
+  line.end.z = 6.0;
+  set_obj (DWG_TYPE_LINE, &line);
+  extents_ok ("LINE", 1.0, -5.0, 3.0, 4.0, 2.0, 6.0);
+
+  memset (&circle, 0, sizeof (circle));
+  circle.center.x = 1.0;
+  circle.center.y = 2.0;
+  circle.radius = 3.0;
+  circle.extrusion.z = 1.0;
+  set_obj (DWG_TYPE_CIRCLE, &circle);
+  extents_ok ("CIRCLE", -2.0, -1.0, 0.0, 4.0, 5.0, 0.0);
+
+  memset (&arc, 0, sizeof (arc));
+  arc.radius = 1.0;
+  arc.start_angle = M_PI / 4;
+  arc.end_angle = 3 * M_PI / 4;
+  arc.extrusion.z = 1.0;
+  set_obj (DWG_TYPE_ARC, &arc);
+  extents_ok ("ARC over 90", -h, h, 0.0, h, 1.0, 0.0);
+  // over 0
+  arc.start_angle = 7 * M_PI / 4;
+  arc.end_angle = M_PI / 4;
+  extents_ok ("ARC over 0", h, -h, 0.0, 1.0, h, 0.0);
+  // in the OCS of (0, 0, -1), x and z mirrored
+  arc.center.x = 1.0;
+  arc.center.z = 2.0;
+  arc.radius = 1.0;
+  arc.start_angle = 0.0;
+  arc.end_angle = M_PI / 2;
+  arc.extrusion.z = -1.0;
+  extents_ok ("ARC in OCS", -2.0, 0.0, -2.0, -1.0, 1.0, -2.0);
+
+  memset (&ellipse, 0, sizeof (ellipse));
+  ellipse.center.x = 1.0;
+  ellipse.sm_axis.x = 3.0;
+  ellipse.extrusion.z = 1.0;
+  ellipse.axis_ratio = 0.5;
+  ellipse.end_angle = 2 * M_PI;
+  set_obj (DWG_TYPE_ELLIPSE, &ellipse);
+  extents_ok ("ELLIPSE", -2.0, -1.5, 0.0, 4.0, 1.5, 0.0);
+  ellipse.start_angle = 0.0;
+  ellipse.end_angle = M_PI / 2;
+  extents_ok ("ELLIPSE arc", 1.0, 0.0, 0.0, 4.0, 1.5, 0.0);
+
+  // the semicircle below (0, 0) - (2, 0)
+  memset (&pline, 0, sizeof (pline));
+  pline.elevation = 0.5;
+  pline.extrusion.z = 1.0;
+  pline.num_points = pline.num_bulges = 2;
+  pline.points = points;
+  pline.bulges = bulges;
+  set_obj (DWG_TYPE_LWPOLYLINE, &pline);
+  extents_ok ("LWPOLYLINE", 0.0, -1.0, 0.5, 2.0, 0.0, 0.5);
+
+  memset (&xline, 0, sizeof (xline));
+  xline.vector.x = 1.0;
+  set_obj (DWG_TYPE_XLINE, &xline);
+  {
+    Dwg_Bbox bb;
+    if (dwg_entity_extents (&obj, &bb) == DWG_ERR_INVALIDTYPE
+        && ent.extents_state == DWG_EXTENTS_NONE)
+      pass ("XLINE unbounded");
+    else
+      fail ("XLINE bounded");
+  }
+}
+
+/* cached until dwg_reset_extents */
+static void
+cache_tests (void)
+{
+  Dwg_Entity_LINE line;
+  Dwg_Bbox bb;
+
+  memset (&line, 0, sizeof (line));
+  line.end.x = 1.0;
+  set_obj (DWG_TYPE_LINE, &line);
+  dwg_entity_extents (&obj, &bb);
+  line.end.x = 2.0;
+  if (!dwg_entity_extents (&obj, &bb) && bb.max.x == 1.0)
+    pass ("extents cached");
+  else
+    fail ("extents not cached: %g", bb.max.x);
+  dwg_reset_extents (&obj);
+  if (ent.extents_state == DWG_EXTENTS_UNKNOWN
+      && !dwg_entity_extents (&obj, &bb) && bb.max.x == 2.0)
+    pass ("dwg_reset_extents");
+  else
+    fail ("dwg_reset_extents: %g", bb.max.x);
+}
+
+/* the box of the corners of b transformed as by the INSERT */
+static void
+insert_box (Dwg_Bbox *bb, const Dwg_Bbox *b,
+            const Dwg_Entity_INSERT *ins, const BITCODE_3BD *base)
+{
+  const double c = cos (ins->rotation), s = sin (ins->rotation);
+  double m[9];
+  int i;
+
+  dwg_ocs_matrix (&ins->extrusion, m);
+  bb->min.x = bb->min.y = bb->min.z = HUGE_VAL;
+  bb->max.x = bb->max.y = bb->max.z = -HUGE_VAL;
+  for (i = 0; i < 8; i++)
+    {
+      const double x = ((i & 1) ? b->max.x : b->min.x) - base->x;
+      const double y = ((i & 2) ? b->max.y : b->min.y) - base->y;
+      const double z = ((i & 4) ? b->max.z : b->min.z) - base->z;
+      // scaled and rotated in the OCS, then to the WCS
+      const double ox = c * x * ins->scale.x - s * y * ins->scale.y
+                        + ins->ins_pt.x;
+      const double oy = s * x * ins->scale.x + c * y * ins->scale.y
+                        + ins->ins_pt.y;
+      const double oz = z * ins->scale.z + ins->ins_pt.z;
+      const double p[3] = { m[0] * ox + m[3] * oy + m[6] * oz,
+                            m[1] * ox + m[4] * oy + m[7] * oz,
+                            m[2] * ox + m[5] * oy + m[8] * oz };
+      if (p[0] < bb->min.x) bb->min.x = p[0];
+      if (p[1] < bb->min.y) bb->min.y = p[1];
+      if (p[2] < bb->min.z) bb->min.z = p[2];
+      if (p[0] > bb->max.x) bb->max.x = p[0];
+      if (p[1] > bb->max.y) bb->max.y = p[1];
+      if (p[2] > bb->max.z) bb->max.z = p[2];
+    }
+}
+
+/* the union of the extents of the drawn entities of the block */
+static int
+block_box (Dwg_Bbox *bb, const Dwg_Object *hdr)
+{
+  Dwg_Owned_Iter it;
+  Dwg_Object *o;
+
+  bb->min.x = bb->min.y = bb->min.z = HUGE_VAL;
+  bb->max.x = bb->max.y = bb->max.z = -HUGE_VAL;
+  if (dwg_owned_iter_init (&it, hdr))
+    return 0;
+  while ((o = dwg_owned_iter_next (&it)))
+    {
+      Dwg_Bbox b;
+      if (o->fixedtype == DWG_TYPE_ATTDEF || o->fixedtype == DWG_TYPE_BLOCK
+          || o->fixedtype == DWG_TYPE_ENDBLK || dwg_entity_extents (o, &b))
+        continue;
+      if (b.min.x < bb->min.x) bb->min.x = b.min.x;
+      if (b.min.y < bb->min.y) bb->min.y = b.min.y;
+      if (b.min.z < bb->min.z) bb->min.z = b.min.z;
+      if (b.max.x > bb->max.x) bb->max.x = b.max.x;
+      if (b.max.y > bb->max.y) bb->max.y = b.max.y;
+      if (b.max.z > bb->max.z) bb->max.z = b.max.z;
+    }
+  return bb->min.x <= bb->max.x;
+}
+
+/* The INSERT's of dwg as they are, and rotated, scaled, mirrored and
+   in another OCS */
+static void
+insert_tests (Dwg_Data *dwg)
+{
+  static const double rotations[] = { 0.0, M_PI / 6, -2.0 };
+  static const double scales[][3]
+      = { { 1.0, 1.0, 1.0 }, { 2.0, 0.5, 3.0 }, { -1.5, 1.0, -1.0 } };
+  static const double normals[][3]
+      = { { 0.0, 0.0, 1.0 }, { 0.0, 0.0, -1.0 }, { 0.6, 0.0, 0.8 } };
+  BITCODE_BL i, num = 0, bad = 0;
+  int k;
+
+  for (i = 0; i < dwg->num_objects; i++)
+    {
+      Dwg_Object *o = &dwg->object[i];
+      Dwg_Entity_INSERT *ins, saved;
+      Dwg_Object *hdr;
+      Dwg_Bbox blk;
+      if (o->fixedtype != DWG_TYPE_INSERT || !o->tio.entity)
+        continue;
+      ins = o->tio.entity->tio.INSERT;
+      hdr = ins->block_header ? dwg_ref_object (dwg, ins->block_header)
+                              : NULL;
+      if (!hdr || hdr->fixedtype != DWG_TYPE_BLOCK_HEADER
+          || !block_box (&blk, hdr))
+        continue;
+      saved = *ins;
+      for (k = 0; k < 4; k++)
+        {
+          Dwg_Bbox bb, expected;
+          if (k)
+            {
+              ins->rotation = rotations[k - 1];
+              ins->scale.x = scales[k - 1][0];
+              ins->scale.y = scales[k - 1][1];
+              ins->scale.z = scales[k - 1][2];
+              ins->extrusion.x = normals[k - 1][0];
+              ins->extrusion.y = normals[k - 1][1];
+              ins->extrusion.z = normals[k - 1][2];
+              dwg_reset_extents (o);
+            }
+          insert_box (&expected, &blk, ins,
+                      &hdr->tio.object->tio.BLOCK_HEADER->base_pt);
+          num++;
+          if ((dwg_entity_extents (o, &bb) || !bbox_near (&bb, &expected))
+              && bad++ < 3)
+            fail ("INSERT %u, %d: (%g, %g, %g) - (%g, %g, %g)", i, k,
+                  bb.min.x, bb.min.y, bb.min.z, bb.max.x, bb.max.y,
+                  bb.max.z);
+        }
+      *ins = saved;
+      dwg_reset_extents (o);
+    }
+  if (!num)
+    untested ("no INSERT");
+  else if (!bad)
+    pass ("INSERT extents: %u", num);
+}
+
+/* the same as one at a time, and the model space box their union */
+static void
+compute_all_tests (Dwg_Data *dwg)
+{
+  Dwg_Bbox model, expected;
+  Dwg_Bbox *boxes;
+  int *errors;
+  BITCODE_BL i, num = 0, bad = 0;
+
+  boxes = (Dwg_Bbox *)calloc (dwg->num_objects, sizeof (Dwg_Bbox));
+  errors = (int *)calloc (dwg->num_objects, sizeof (int));
+  if (!boxes || !errors || dwg_compute_all_extents (dwg, &model))
+    {
+      fail ("dwg_compute_all_extents");
+      free (boxes);
+      free (errors);
+      return;
+    }
+  for (i = 0; i < dwg->num_objects; i++)
+    {
+      Dwg_Object *o = &dwg->object[i];
+      if (o->supertype == DWG_SUPERTYPE_ENTITY && o->tio.entity)
+        {
+          errors[i] = o->tio.entity->extents_state != DWG_EXTENTS_VALID;
+          boxes[i] = o->tio.entity->extents;
+          o->tio.entity->extents_state = DWG_EXTENTS_UNKNOWN;
+        }
+    }
+  expected.min.x = expected.min.y = expected.min.z = HUGE_VAL;
+  expected.max.x = expected.max.y = expected.max.z = -HUGE_VAL;
+  for (i = 0; i < dwg->num_objects; i++)
+    {
+      Dwg_Object *o = &dwg->object[i];
+      Dwg_Bbox bb;
+      int error;
+      if (o->supertype != DWG_SUPERTYPE_ENTITY || !o->tio.entity)
+        continue;
+      error = dwg_entity_extents (o, &bb) != 0;
+      if (error != errors[i] || (!error && !bbox_near (&bb, &boxes[i])))
+        {
+          if (bad++ < 3)
+            fail ("dwg_compute_all_extents %s %u differs",
+                  o->dxfname ? o->dxfname : "?", i);
+          continue;
+        }
+      if (error)
+        continue;
+      num++;
+      if (o->tio.entity->entity_mode != 2)
+        continue;
+      if (bb.min.x < expected.min.x) expected.min.x = bb.min.x;
+      if (bb.min.y < expected.min.y) expected.min.y = bb.min.y;
+      if (bb.min.z < expected.min.z) expected.min.z = bb.min.z;
+      if (bb.max.x > expected.max.x) expected.max.x = bb.max.x;
+      if (bb.max.y > expected.max.y) expected.max.y = bb.max.y;
+      if (bb.max.z > expected.max.z) expected.max.z = bb.max.z;
+    }
+  if (!bad)
+    pass ("dwg_compute_all_extents as dwg_entity_extents: %u", num);
+  if (num && bbox_near (&model, &expected))
+    pass ("dwg_compute_all_extents model (%g, %g) - (%g, %g)", model.min.x,
+          model.min.y, model.max.x, model.max.y);
+  else
+    fail ("dwg_compute_all_extents model (%g, %g) - (%g, %g)", model.min.x,
+          model.min.y, model.max.x, model.max.y);
+  free (boxes);
+  free (errors);
+}
+
+int
+main (int argc, char *argv[])
+{
+  char *input = getenv ("INPUT");
+  struct stat attrib;
+  Dwg_Data dwg;
+  int error;
+
+  memset (&mem, 0, sizeof (mem));
+  mem.header.version = R_2000;
+  entity_tests ();
+  cache_tests ();
+
+  if (!input)
+    input = (char *)"example_2000.dwg";
+  if (stat (input, &attrib))
+    {
+      fprintf (stderr, "Env var INPUT not defined, %s not found\n", input);
+      return EXIT_FAILURE;
+    }
+  memset (&dwg, 0, sizeof (Dwg_Data));
+  error = dwg_read_file (input, &dwg);
+  if (error >= DWG_ERR_CRITICAL)
+    {
+      fail ("dwg_read_file %s", input);
+      return 1;
+    }
+  compute_all_tests (&dwg);
+  insert_tests (&dwg);
+  dwg_free (&dwg);
+  return 0;
+}
@@ -0,0 +1,78 @@
+#include "../../src/config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <dejagnu.h>
+#include "dwg.h"
+
+/* Decodes the common entity handles of an R2004+ drawing: every entity
+   LAYER must resolve to a LAYER, every INSERT block_header to a
+   BLOCK_HEADER. */
+int
+main (int argc, char *argv[])
+{
+  char *input = getenv ("INPUT");
+  struct stat attrib;
+  Dwg_Data dwg;
+  BITCODE_BL i, layers = 0, inserts = 0, bad_layers = 0, bad_inserts = 0;
+  int error;
+
+  if (!input)
+    input = (char *)"../test-data/example_2004.dwg";
+  if (stat (input, &attrib))
+    {
+      fprintf (stderr, "Env var INPUT not defined, %s not found\n", input);
+      return EXIT_FAILURE;
+    }
+
+  memset (&dwg, 0, sizeof (Dwg_Data));
+  error = dwg_read_file (input, &dwg);
+  if (error >= DWG_ERR_CRITICAL)
+    {
+      fail ("dwg_read_file %s", input);
+      return 1;
+    }
+
+  for (i = 0; i < dwg.num_objects; i++)
+    {
+      const Dwg_Object *obj = &dwg.object[i];
+      const Dwg_Object_Entity *ent;
+      if (obj->supertype != DWG_SUPERTYPE_ENTITY || !obj->tio.entity)
+        continue;
+      // the ACIS data of R2004+ is not fully decoded yet, so the handle
+      // stream of these may be off
+      if (obj->fixedtype == DWG_TYPE_REGION || obj->fixedtype == DWG_TYPE__3DSOLID
+          || obj->fixedtype == DWG_TYPE_BODY)
+        continue;
+      ent = obj->tio.entity;
+      if (ent->layer && ent->layer->obj
+          && ent->layer->obj->fixedtype == DWG_TYPE_LAYER)
+        layers++;
+      else
+        bad_layers++;
+      if (obj->fixedtype == DWG_TYPE_INSERT)
+        {
+          const Dwg_Entity_INSERT *ins = ent->tio.INSERT;
+          if (ins->block_header && ins->block_header->obj
+              && ins->block_header->obj->fixedtype == DWG_TYPE_BLOCK_HEADER)
+            inserts++;
+          else
+            bad_inserts++;
+        }
+    }
+  if (layers && !bad_layers)
+    pass ("entity layer: %u resolved", (unsigned)layers);
+  else
+    fail ("entity layer: %u resolved, %u not a LAYER", (unsigned)layers,
+          (unsigned)bad_layers);
+  if (!bad_inserts)
+    pass ("INSERT block_header: %u resolved", (unsigned)inserts);
+  else
+    fail ("INSERT block_header: %u resolved, %u not a BLOCK_HEADER",
+          (unsigned)inserts, (unsigned)bad_inserts);
+
+  dwg_free (&dwg);
+  return 0;
+}
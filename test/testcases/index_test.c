@@ -0,0 +1,274 @@
+#include "../../src/config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <dejagnu.h>
+#include "dwg.h"
+#include "dwg_api.h"
+#include "../../src/common.h"
+
+/* The sum of the entities on all layers, each checked to be on it */
+static BITCODE_BL
+layer_entities (const Dwg_Data *dwg, const char *when)
+{
+  BITCODE_BL i, j, num, total = 0;
+
+  for (i = 0; i < dwg->num_objects; i++)
+    {
+      const Dwg_Object *obj = &dwg->object[i];
+      const BITCODE_BL *list;
+      if (obj->fixedtype != DWG_TYPE_LAYER)
+        continue;
+      list = dwg_get_entities_on_layer (dwg, obj->handle.value, &num);
+      if (num && !list)
+        fail ("%s: layer %lX has %u entities, but no list", when,
+              obj->handle.value, (unsigned)num);
+      for (j = 0; list && j < num; j++)
+        {
+          const Dwg_Object *ent = &dwg->object[list[j]];
+          if (ent->supertype != DWG_SUPERTYPE_ENTITY || !ent->tio.entity
+              || !ent->tio.entity->layer
+              || ent->tio.entity->layer->absolute_ref != obj->handle.value)
+            {
+              fail ("%s: object[%u] is not on layer %lX", when,
+                    (unsigned)list[j], obj->handle.value);
+              break;
+            }
+        }
+      total += num;
+    }
+  return total;
+}
+
+/* The views of the type index against a scan of object[] */
+static void
+type_views (Dwg_Data *dwg, const char *when)
+{
+  Dwg_Object_Entity **ents = dwg_get_entities (dwg);
+  Dwg_Object_Ref *mspace = dwg_model_space_ref (dwg);
+  const BITCODE_BL *list;
+  Dwg_Entity_LINE **lines;
+  BITCODE_BL i, num, entities = 0, n_lines = 0, m_lines = 0;
+  int ok = 1;
+
+  for (i = 0; i < dwg->num_objects; i++)
+    {
+      const Dwg_Object *obj = &dwg->object[i];
+      if (obj->supertype != DWG_SUPERTYPE_ENTITY || !obj->tio.entity)
+        continue;
+      entities++;
+      if (obj->fixedtype == DWG_TYPE_LINE)
+        {
+          n_lines++;
+          if (obj->tio.entity->entity_mode == 2)
+            m_lines++;
+        }
+    }
+
+  for (i = 0; ents && ents[i]; i++)
+    if (dwg->object[ents[i]->objid].tio.entity != ents[i])
+      ok = 0;
+  if (ents && ok && i == entities)
+    pass ("%s: dwg_get_entities: %u", when, (unsigned)i);
+  else
+    fail ("%s: dwg_get_entities: %u, expected %u", when, (unsigned)i,
+          (unsigned)entities);
+
+  list = dwg_get_objects_by_type (dwg, DWG_TYPE_LINE, &num);
+  for (i = 0; list && i < num; i++)
+    if (dwg->object[list[i]].fixedtype != DWG_TYPE_LINE)
+      ok = 0;
+  if (ok && n_lines && num == n_lines)
+    pass ("%s: dwg_get_objects_by_type LINE: %u", when, (unsigned)num);
+  else
+    fail ("%s: dwg_get_objects_by_type LINE: %u, expected %u", when,
+          (unsigned)num, (unsigned)n_lines);
+
+  lines = mspace ? dwg_get_LINE (mspace) : NULL;
+  if (!mspace
+      || (void **)lines
+             != dwg_get_block_entities_by_type (mspace->obj, DWG_TYPE_LINE))
+    ok = 0;
+  for (i = 0; lines && lines[i]; i++)
+    {
+      const Dwg_Object *obj = &dwg->object[lines[i]->parent->objid];
+      if (obj->fixedtype != DWG_TYPE_LINE
+          || obj->tio.entity->entity_mode != 2)
+        ok = 0;
+    }
+  if (ok && i == m_lines)
+    pass ("%s: dwg_get_LINE of the model space: %u", when, (unsigned)i);
+  else
+    fail ("%s: dwg_get_LINE of the model space: %u, expected %u", when,
+          (unsigned)i, (unsigned)m_lines);
+}
+
+/* Concurrent first calls share one build */
+static void
+concurrent_views (Dwg_Data *dwg)
+{
+  BITCODE_BL counts[8];
+  int i, ok = 1;
+
+  memset (counts, 0, sizeof (counts));
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(8)
+#endif
+  for (i = 0; i < 8; i++)
+    (void)dwg_get_objects_by_type (dwg, DWG_TYPE_LINE, &counts[i]);
+  for (i = 1; i < 8; i++)
+    if (counts[i] != counts[0])
+      ok = 0;
+  if (ok && counts[0])
+    pass ("concurrent dwg_get_objects_by_type: %u", (unsigned)counts[0]);
+  else
+    fail ("concurrent dwg_get_objects_by_type");
+}
+
+/* get_first_owned_object and get_next_owned_object walk the same
+   entities as Dwg_Owned_Iter, for each block */
+static void
+owned_walks (Dwg_Data *dwg)
+{
+  BITCODE_BL i, num = 0;
+  int ok = 1;
+
+  for (i = 0; i < dwg->num_objects; i++)
+    {
+      const Dwg_Object *hdr = &dwg->object[i];
+      Dwg_Owned_Iter it;
+      Dwg_Object *obj, *next;
+      if (hdr->fixedtype != DWG_TYPE_BLOCK_HEADER
+          || dwg_owned_iter_init (&it, hdr))
+        continue;
+      next = get_first_owned_object (hdr);
+      while ((obj = dwg_owned_iter_next (&it)))
+        {
+          if (next != obj)
+            {
+              ok = 0;
+              break;
+            }
+          num++;
+          next = get_next_owned_object (hdr, obj);
+        }
+      if (!obj && next)
+        ok = 0;
+    }
+  if (ok)
+    pass ("get_next_owned_object as dwg_owned_iter_next: %u", (unsigned)num);
+  else
+    fail ("get_next_owned_object differs from dwg_owned_iter_next");
+}
+
+/* preR13 has no owned index, but still the entities and types */
+static void
+preR13_views (Dwg_Data *dwg)
+{
+  const unsigned int version = dwg->header.version;
+  Dwg_Object_Entity **ents;
+  BITCODE_BL i, num, entities = 0, n_lines = 0;
+  int ok = 1;
+
+  dwg->header.version = R_11;
+  if (dwg_build_owned_index (dwg) || dwg->owned_start
+      || dwg_build_type_index (dwg))
+    ok = 0;
+  for (i = 0; i < dwg->num_objects; i++)
+    if (dwg->object[i].supertype == DWG_SUPERTYPE_ENTITY)
+      {
+        entities++;
+        if (dwg->object[i].fixedtype == DWG_TYPE_LINE)
+          n_lines++;
+      }
+  ents = dwg_get_entities (dwg);
+  for (i = 0; ents && ents[i]; i++)
+    if (dwg->object[ents[i]->objid].tio.entity != ents[i])
+      ok = 0;
+  if (ok && ents && i == entities)
+    pass ("preR13 dwg_get_entities: %u", (unsigned)i);
+  else
+    fail ("preR13 dwg_get_entities: %u, expected %u", (unsigned)i,
+          (unsigned)entities);
+  if (dwg_get_objects_by_type (dwg, DWG_TYPE_LINE, &num) && num == n_lines)
+    pass ("preR13 dwg_get_objects_by_type LINE: %u", (unsigned)num);
+  else
+    fail ("preR13 dwg_get_objects_by_type LINE: %u, expected %u",
+          (unsigned)num, (unsigned)n_lines);
+
+  dwg->header.version = version;
+  if (dwg_build_owned_index (dwg) || dwg_build_type_index (dwg))
+    fail ("dwg_build_type_index");
+}
+
+int
+main (int argc, char *argv[])
+{
+  char *input = getenv ("INPUT");
+  struct stat attrib;
+  Dwg_Data dwg;
+  BITCODE_BL i, num, total, expected = 0;
+  int error;
+
+  if (!input)
+    input = (char *)"example_2000.dwg";
+  if (stat (input, &attrib))
+    {
+      fprintf (stderr, "Env var INPUT not defined, %s not found\n", input);
+      return EXIT_FAILURE;
+    }
+
+  memset (&dwg, 0, sizeof (Dwg_Data));
+  error = dwg_read_file (input, &dwg);
+  if (error >= DWG_ERR_CRITICAL)
+    {
+      fail ("dwg_read_file %s", input);
+      return 1;
+    }
+
+  for (i = 0; i < dwg.num_objects; i++)
+    {
+      const Dwg_Object *obj = &dwg.object[i];
+      const Dwg_Object *layer;
+      if (obj->supertype != DWG_SUPERTYPE_ENTITY || !obj->tio.entity
+          || !obj->tio.entity->layer)
+        continue;
+      layer = dwg_ref_object (&dwg, obj->tio.entity->layer);
+      if (layer && layer->fixedtype == DWG_TYPE_LAYER)
+        expected++;
+    }
+  total = layer_entities (&dwg, "decoded");
+  if (total && total == expected)
+    pass ("dwg_get_entities_on_layer: %u entities", (unsigned)total);
+  else
+    fail ("dwg_get_entities_on_layer: %u entities, expected %u",
+          (unsigned)total, (unsigned)expected);
+  if (dwg_get_entities_on_layer (&dwg, 0xFFFFFFF, &num) || num)
+    fail ("dwg_get_entities_on_layer of an unknown handle");
+  else
+    pass ("dwg_get_entities_on_layer of an unknown handle");
+  type_views (&dwg, "decoded");
+
+  // adding an object drops the index, the getter rebuilds it
+  if (dwg_add_object (&dwg) > 0)
+    fail ("dwg_add_object");
+  if (dwg.layered_start)
+    fail ("the layer index was not dropped by dwg_add_object");
+  total = layer_entities (&dwg, "added");
+  if (total == expected && dwg.layered_start)
+    pass ("dwg_get_entities_on_layer after dwg_add_object");
+  else
+    fail ("dwg_get_entities_on_layer after dwg_add_object: %u, expected %u",
+          (unsigned)total, (unsigned)expected);
+  type_views (&dwg, "added");
+  if (dwg_add_object (&dwg) > 0)
+    fail ("dwg_add_object");
+  concurrent_views (&dwg);
+  owned_walks (&dwg);
+  preR13_views (&dwg);
+
+  dwg_free (&dwg);
+  return 0;
+}
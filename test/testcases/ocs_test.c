@@ -0,0 +1,197 @@
+#include "../../src/common.h"
+#include "../../src/ocs.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <dejagnu.h>
+
+static int
+near (double a, double b)
+{
+  return fabs (a - b) <= 1e-12;
+}
+
+static int
+vec_is (const double *v, double x, double y, double z)
+{
+  return near (v[0], x) && near (v[1], y) && near (v[2], z);
+}
+
+/* unit, orthogonal, right-handed rows, the last along n */
+static int
+ocs_valid (const double m[9], const BITCODE_3BD *n)
+{
+  const double len = sqrt (n->x * n->x + n->y * n->y + n->z * n->z);
+  int i, j;
+
+  for (i = 0; i < 3; i++)
+    for (j = 0; j < 3; j++)
+      if (!near (m[3 * i] * m[3 * j] + m[3 * i + 1] * m[3 * j + 1]
+                     + m[3 * i + 2] * m[3 * j + 2],
+                 i == j ? 1.0 : 0.0))
+        return 0;
+  return vec_is (&m[6], n->x / len, n->y / len, n->z / len)
+         && near (m[1] * m[5] - m[2] * m[4], m[6])
+         && near (m[2] * m[3] - m[0] * m[5], m[7])
+         && near (m[0] * m[4] - m[1] * m[3], m[8]);
+}
+
+/* the x axis of the OCS of n */
+static void
+axis_ok (const char *what, double x, double y, double z, double ax,
+         double ay, double az)
+{
+  const BITCODE_3BD n = { x, y, z };
+  double m[9];
+  int r = dwg_ocs_matrix (&n, m);
+
+  if (r && ocs_valid (m, &n) && vec_is (m, ax, ay, az))
+    pass ("%s: Ax (%g, %g, %g)", what, m[0], m[1], m[2]);
+  else
+    fail ("%s: %d, Ax (%g, %g, %g), expected (%g, %g, %g)", what, r, m[0],
+          m[1], m[2], ax, ay, az);
+}
+
+/* Wy x N below 1/64 of both Nx and Ny, else Wz x N */
+static void
+threshold_tests (void)
+{
+  const double below = OCS_ARBITRARY_AXIS * (1.0 - 1e-9);
+  const double above = OCS_ARBITRARY_AXIS * (1.0 + 1e-9);
+  const double zb = sqrt (1.0 - below * below);
+  const double za = sqrt (1.0 - above * above);
+  const double l = hypot (1.0, below);
+
+  axis_ok ("Nx below 1/64", below, 0.0, zb, zb, 0.0, -below);
+  axis_ok ("Nx above 1/64", above, 0.0, za, 0.0, 1.0, 0.0);
+  axis_ok ("Nx above -1/64", -above, 0.0, za, 0.0, -1.0, 0.0);
+  axis_ok ("Ny below 1/64", 0.0, below, zb, 1.0, 0.0, 0.0);
+  axis_ok ("Ny above 1/64", 0.0, above, za, -1.0, 0.0, 0.0);
+  axis_ok ("Ny above -1/64", 0.0, -above, za, 1.0, 0.0, 0.0);
+  // both below, each alone is
+  axis_ok ("Nx, Ny below 1/64", below, below, 1.0, 1.0 / l, 0.0, -below / l);
+  // not normalized, along x and y
+  axis_ok ("N (2, 0, 0)", 2.0, 0.0, 0.0, 0.0, 1.0, 0.0);
+  axis_ok ("N (0, -3, 0)", 0.0, -3.0, 0.0, 1.0, 0.0, 0.0);
+}
+
+/* the mirror image of the WCS, and no OCS */
+static void
+special_tests (void)
+{
+  const BITCODE_3BD down = { 0.0, 0.0, -1.0 };
+  const BITCODE_3BD up = { 0.0, 0.0, 1.0 };
+  const BITCODE_3BD up5 = { 0.0, 0.0, 5.0 };
+  const BITCODE_3BD zero = { 0.0, 0.0, 0.0 };
+  double m[9], x[1] = { 1.0 }, y[1] = { 2.0 }, z[1] = { 3.0 };
+
+  if (dwg_ocs_matrix (&down, m) && vec_is (m, -1.0, 0.0, 0.0)
+      && vec_is (&m[3], 0.0, 1.0, 0.0) && vec_is (&m[6], 0.0, 0.0, -1.0))
+    pass ("N (0, 0, -1): x and z mirrored");
+  else
+    fail ("N (0, 0, -1): (%g, %g, %g) (%g, %g, %g)", m[0], m[1], m[2], m[3],
+          m[4], m[5]);
+  dwg_ocs_to_wcs (m, 1, x, y, z);
+  if (x[0] == -1.0 && y[0] == 2.0 && z[0] == -3.0)
+    pass ("dwg_ocs_to_wcs N (0, 0, -1)");
+  else
+    fail ("dwg_ocs_to_wcs N (0, 0, -1): (%g, %g, %g)", x[0], y[0], z[0]);
+
+  if (!dwg_ocs_matrix (&up, m) && vec_is (m, 1.0, 0.0, 0.0)
+      && vec_is (&m[3], 0.0, 1.0, 0.0) && vec_is (&m[6], 0.0, 0.0, 1.0)
+      && !dwg_ocs_matrix (&up5, m) && vec_is (m, 1.0, 0.0, 0.0)
+      && !dwg_ocs_matrix (&zero, m) && vec_is (&m[6], 0.0, 0.0, 1.0)
+      && !dwg_ocs_matrix (NULL, m) && vec_is (&m[3], 0.0, 1.0, 0.0))
+    pass ("the WCS for N (0, 0, 1), (0, 0, 5), (0, 0, 0) and none");
+  else
+    fail ("the WCS for N (0, 0, 1), (0, 0, 5), (0, 0, 0) and none");
+}
+
+/* the same extrusion again from the cache, more than it holds again */
+static void
+cache_tests (void)
+{
+  BITCODE_3BD n[OCS_CACHE_SIZE + 2];
+  double m[9], first[9];
+  int i, used, ok = 1;
+
+  for (i = 0; i < OCS_CACHE_SIZE + 2; i++)
+    {
+      n[i].x = 0.5;
+      n[i].y = 0.1 * i;
+      n[i].z = 1.0;
+    }
+  ocs_cache_used = ocs_cache_next = 0;
+  dwg_ocs_matrix (&n[0], first);
+  used = ocs_cache_used;
+  for (i = 0; i < 3; i++)
+    {
+      dwg_ocs_matrix (&n[0], m);
+      if (memcmp (m, first, sizeof (m)))
+        ok = 0;
+    }
+  if (ok && used == 1 && ocs_cache_used == 1)
+    pass ("OCS cache reused");
+  else
+    fail ("OCS cache not reused: %d entries", ocs_cache_used);
+
+  // the oldest are replaced, all still right
+  for (i = 0; i < OCS_CACHE_SIZE + 2; i++)
+    {
+      dwg_ocs_matrix (&n[i], m);
+      if (!ocs_valid (m, &n[i]))
+        ok = 0;
+    }
+  if (ocs_cache_used != OCS_CACHE_SIZE)
+    ok = 0;
+  dwg_ocs_matrix (&n[0], m);
+  if (memcmp (m, first, sizeof (m)))
+    ok = 0;
+  for (i = 0; i < ocs_cache_used; i++)
+    if (!ocs_valid (ocs_cache[i].m, &ocs_cache[i].extrusion))
+      ok = 0;
+  if (ok)
+    pass ("OCS cache of %d replaced", OCS_CACHE_SIZE);
+  else
+    fail ("OCS cache replaced wrong");
+}
+
+/* all points, in and after whole vectors */
+static void
+transform_tests (void)
+{
+  const BITCODE_3BD n = { 0.3, -0.4, 0.5 };
+  double m[9], x[37], y[37], z[37];
+  int i, bad = 0;
+
+  dwg_ocs_matrix (&n, m);
+  for (i = 0; i < 37; i++)
+    {
+      x[i] = i;
+      y[i] = 1.0 - i * 0.5;
+      z[i] = i * i;
+    }
+  dwg_ocs_to_wcs (m, 37, x, y, z);
+  for (i = 0; i < 37; i++)
+    {
+      const double px = i, py = 1.0 - i * 0.5, pz = (double)i * i;
+      if (!near (x[i], px * m[0] + py * m[3] + pz * m[6])
+          || !near (y[i], px * m[1] + py * m[4] + pz * m[7])
+          || !near (z[i], px * m[2] + py * m[5] + pz * m[8]))
+        bad++;
+    }
+  if (!bad)
+    pass ("dwg_ocs_to_wcs of 37 points");
+  else
+    fail ("dwg_ocs_to_wcs: %d points wrong", bad);
+}
+
+int
+main (int argc, char *argv[])
+{
+  threshold_tests ();
+  special_tests ();
+  cache_tests ();
+  transform_tests ();
+  return 0;
+}
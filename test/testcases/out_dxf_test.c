@@ -0,0 +1,131 @@
+#include "../../src/common.h"
+#include "../../src/out_dxf.c"
+
+#include <math.h>
+#include <dejagnu.h>
+
+static void
+dxf_fixed14_tests (void)
+{
+  static const double values[] = {
+    0.0,       -0.0,          1.0,        -1.0,        0.5,
+    0.1,       0.3,           1.0 / 3.0,  2.0 / 3.0,   -123.456,
+    1e-14,     5e-15,         4.9e-15,    1.5e-14,     2.5e-14,
+    0.999999999999995,        0.9999999999999949,      99999.99999999999,
+    4.94065645841246544e-324, 2.2250738585072014e-308, 1e-300,
+    123456789012345.6,        -999999999999999.9,      3.14159265358979,
+  };
+  char s[512], t[512];
+  unsigned int i, bad = 0, num = 0;
+  uint64_t x = 88172645463325252ULL;
+  int len;
+
+  if (!dxf_fixed14 (s, 0.5))
+    {
+      // no 128 bit, dxf_double() falls back to snprintf
+      untested ("dxf_fixed14 without __int128");
+      return;
+    }
+  for (i = 0; i < sizeof (values) / sizeof (values[0]); i++, num++)
+    {
+      len = dxf_fixed14 (s, values[i]);
+      snprintf (t, sizeof (t), "%-16.14f", values[i]);
+      if (len != (int)strlen (t) || memcmp (s, t, len))
+        {
+          fail ("dxf_fixed14 %.17g: %.*s, expected %s", values[i], len, s, t);
+          bad++;
+        }
+    }
+  // random bits with an exponent below 2^50
+  for (i = 0; i < 100000; i++, num++)
+    {
+      double d;
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      d = (double)(x >> 11) / 9007199254740992.0;
+      d = ldexp (d, (int)(x % 100) - 50);
+      if (x & 1)
+        d = -d;
+      len = dxf_fixed14 (s, d);
+      snprintf (t, sizeof (t), "%-16.14f", d);
+      if (len != (int)strlen (t) || memcmp (s, t, len))
+        {
+          if (bad++ < 5)
+            fail ("dxf_fixed14 %.17g: %.*s, expected %s", d, len, s, t);
+        }
+    }
+  if (!bad)
+    pass ("dxf_fixed14 as %%-16.14f: %u values", num);
+
+  if (dxf_fixed14 (s, 1e15) || dxf_fixed14 (s, -1e15)
+      || dxf_fixed14 (s, NAN) || dxf_fixed14 (s, INFINITY))
+    fail ("dxf_fixed14 out of range");
+  else
+    pass ("dxf_fixed14 out of range");
+}
+
+static void
+dxf_kind_tests (void)
+{
+  static const struct
+  {
+    int code;
+    enum DXF_KIND kind;
+  } codes[] = {
+    { -5, DXF_HEX },      { -1, DXF_DOUBLE },    { 0, DXF_STRING },
+    { 5, DXF_HEX },       { 9, DXF_STRING },     { 10, DXF_DOUBLE },
+    { 59, DXF_DOUBLE },   { 60, DXF_INT16 },     { 90, DXF_INT32 },
+    { 100, DXF_STRING },  { 101, DXF_UNKNOWN },  { 105, DXF_HEX },
+    { 140, DXF_DOUBLE },  { 160, DXF_INT64 },    { 175, DXF_INT16 },
+    { 200, DXF_UNKNOWN }, { 210, DXF_DOUBLE },   { 280, DXF_INT16 },
+    { 310, DXF_STRING },  { 330, DXF_HEX },      { 370, DXF_INT16 },
+    { 390, DXF_HEX },     { 420, DXF_INT32 },    { 450, DXF_INT64 },
+    { 460, DXF_DOUBLE },  { 470, DXF_STRING },   { 481, DXF_HEX },
+    { 482, DXF_UNKNOWN }, { 999, DXF_STRING },   { 1005, DXF_STRING },
+    { 1040, DXF_DOUBLE }, { 1070, DXF_INT16 },   { 1071, DXF_INT32 },
+    { 1072, DXF_UNKNOWN },
+  };
+  unsigned int i;
+  int ok = 1;
+
+  for (i = 0; i < sizeof (codes) / sizeof (codes[0]); i++)
+    if (dxf_kind (codes[i].code) != codes[i].kind)
+      {
+        fail ("dxf_kind %d: %d, expected %d", codes[i].code,
+              (int)dxf_kind (codes[i].code), (int)codes[i].kind);
+        ok = 0;
+      }
+  if (ok)
+    pass ("dxf_kind");
+}
+
+/* handles keep all 64 bits */
+static void
+dxf_hex_tests (void)
+{
+  if (dxf_writer_init (NULL))
+    {
+      fail ("dxf_writer_init");
+      return;
+    }
+  dxf_hex (0);
+  dxf_write (" ", 1);
+  dxf_hex (0x2F);
+  dxf_write (" ", 1);
+  dxf_hex (0x123456789ABCDEF0ULL);
+  if (out.len == 21 && !memcmp (out.buf, "0 2F 123456789ABCDEF0", 21))
+    pass ("dxf_hex");
+  else
+    fail ("dxf_hex: %.*s", (int)out.len, out.buf);
+  dxf_writer_end ();
+}
+
+int
+main (int argc, char *argv[])
+{
+  dxf_fixed14_tests ();
+  dxf_kind_tests ();
+  dxf_hex_tests ();
+  return 0;
+}
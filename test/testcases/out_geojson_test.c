@@ -0,0 +1,244 @@
+#include "../../src/common.h"
+#include "../../src/out_geojson.c"
+
+#include <sys/stat.h>
+#include <dejagnu.h>
+
+#ifndef M_PI
+# define M_PI 3.14159265358979323846
+#endif
+
+/* tess from the parts of n points each, closed if closed[i] */
+static void
+set_tess (BITCODE_BL num_parts, const BITCODE_BL *n, BITCODE_B *closed)
+{
+  static double x[64], y[64], z[64];
+  static BITCODE_BL parts[8];
+  BITCODE_BL i, j, k = 0;
+
+  for (i = 0; i < num_parts; i++)
+    {
+      parts[i] = k;
+      for (j = 0; j < n[i]; j++, k++)
+        {
+          x[k] = cos (j * 2 * M_PI / n[i]);
+          y[k] = sin (j * 2 * M_PI / n[i]);
+          z[k] = 0.0;
+        }
+    }
+  memset (&tess, 0, sizeof (tess));
+  tess.x = x;
+  tess.y = y;
+  tess.z = z;
+  tess.num_points = k;
+  tess.parts = parts;
+  tess.closed = closed;
+  tess.num_parts = num_parts;
+}
+
+static void
+type_ok (BITCODE_BL num_parts, const BITCODE_BL *n, BITCODE_B *closed,
+         const char *expected)
+{
+  const char *type;
+  set_tess (num_parts, n, closed);
+  type = geojson_type ();
+  if (!strcmp (type, expected))
+    pass ("geojson_type %u parts of %u, %u points: %s", num_parts, n[0],
+          num_parts > 1 ? n[1] : 0, type);
+  else
+    fail ("geojson_type %u parts of %u, %u points: %s, expected %s",
+          num_parts, n[0], num_parts > 1 ? n[1] : 0, type, expected);
+}
+
+/* rings of at least 4 positions only */
+static void
+geojson_type_tests (void)
+{
+  static const BITCODE_BL n1[] = { 1 }, n3[] = { 3 }, n5[] = { 5 };
+  static const BITCODE_BL n55[] = { 5, 5 }, n53[] = { 5, 3 };
+  BITCODE_B open[] = { 0, 0 }, closed[] = { 1, 1 }, mixed[] = { 1, 0 };
+
+  type_ok (1, n1, open, "Point");
+  type_ok (1, n5, open, "LineString");
+  type_ok (1, n5, closed, "Polygon");
+  type_ok (1, n3, closed, "LineString");
+  type_ok (2, n55, closed, "MultiPolygon");
+  type_ok (2, n55, mixed, "MultiLineString");
+  type_ok (2, n53, closed, "MultiLineString");
+  memset (&tess, 0, sizeof (tess));
+}
+
+/* a closed LWPOLYLINE of 2 points has a ring of 3 */
+static void
+geojson_lwpolyline_tests (void)
+{
+  Dwg_Data dwg;
+  Dwg_Object obj;
+  Dwg_Object_Entity ent;
+  Dwg_Entity_LWPOLYLINE pline;
+  BITCODE_2RD points[2] = { { 0.0, 0.0 }, { 1.0, 2.0 } };
+  Geojson_Xform xf;
+  const char *type;
+  int error;
+
+  memset (&dwg, 0, sizeof (dwg));
+  memset (&obj, 0, sizeof (obj));
+  memset (&ent, 0, sizeof (ent));
+  memset (&pline, 0, sizeof (pline));
+  dwg.header.version = R_2000;
+  obj.parent = &dwg;
+  obj.supertype = DWG_SUPERTYPE_ENTITY;
+  obj.type = obj.fixedtype = DWG_TYPE_LWPOLYLINE;
+  obj.tio.entity = &ent;
+  ent.tio.LWPOLYLINE = &pline;
+  pline.flag = 512;
+  pline.extrusion.z = 1.0;
+  pline.num_points = 2;
+  pline.points = points;
+  xform_identity (&xf);
+
+  type = geojson_tessellate (&obj, &xf, 0.0, &error);
+  if (type && !error && !strcmp (type, "LineString") && tess.num_points == 3)
+    pass ("closed LWPOLYLINE of 2 points: LineString");
+  else
+    fail ("closed LWPOLYLINE of 2 points: %s, %u points",
+          type ? type : "none", tess.num_points);
+  dwg_free_tessellation (&tess);
+}
+
+/* The geometry of all entities of dwg is valid GeoJSON: a LineString
+   has 2 positions, a ring 4 and ends at its first */
+static void
+geojson_entities_tests (Dwg_Data *dwg)
+{
+  Geojson_Xform xf;
+  BITCODE_BL i, j, num = 0, bad = 0;
+
+  xform_identity (&xf);
+  for (i = 0; i < dwg->num_objects; i++)
+    {
+      const Dwg_Object *obj = &dwg->object[i];
+      const char *type;
+      int error, rings;
+      if (obj->supertype != DWG_SUPERTYPE_ENTITY || !obj->tio.entity)
+        continue;
+      type = geojson_tessellate (obj, &xf, dwg->tolerance, &error);
+      if (error)
+        {
+          fail ("geojson_tessellate %u: error %d", i, error);
+          bad++;
+          continue;
+        }
+      if (!type)
+        continue;
+      num++;
+      rings = !strcmp (type, "Polygon") || !strcmp (type, "MultiPolygon");
+      for (j = 0; j < tess.num_parts; j++)
+        {
+          const BITCODE_BL from = tess.parts[j];
+          const BITCODE_BL to
+              = j + 1 < tess.num_parts ? tess.parts[j + 1] : tess.num_points;
+          const int ok
+              = !strcmp (type, "Point")
+                    ? to - from == 1
+                    : rings ? to - from >= 4 && tess.x[from] == tess.x[to - 1]
+                                  && tess.y[from] == tess.y[to - 1]
+                                  && tess.z[from] == tess.z[to - 1]
+                            : to - from >= 2;
+          if (!ok && bad++ < 5)
+            fail ("%s of %s %u, part %u: %u positions", type,
+                  obj->dxfname ? obj->dxfname : "?", i, j, to - from);
+        }
+    }
+  dwg_free_tessellation (&tess);
+  if (!bad)
+    pass ("geojson geometry of %u entities valid", num);
+}
+
+/* dwg_write_geojson writes one balanced object */
+static void
+geojson_write_tests (Dwg_Data *dwg)
+{
+  Bit_Chain dat;
+  int c, in_string = 0, escaped = 0, depth = 0, min = 1, first = 0;
+  long size = 0;
+
+  memset (&dat, 0, sizeof (Bit_Chain));
+  dat.version = dat.from_version = dwg->header.version;
+  dat.fh = tmpfile ();
+  if (!dat.fh || dwg_write_geojson (&dat, dwg))
+    {
+      fail ("dwg_write_geojson");
+      if (dat.fh)
+        fclose (dat.fh);
+      return;
+    }
+  rewind (dat.fh);
+  while ((c = getc (dat.fh)) != EOF)
+    {
+      if (!size++)
+        first = c;
+      if (in_string)
+        {
+          if (escaped)
+            escaped = 0;
+          else if (c == '\\')
+            escaped = 1;
+          else if (c == '"')
+            in_string = 0;
+          else if (c < 0x20)
+            min = -1;
+          continue;
+        }
+      if (c == '"')
+        in_string = 1;
+      else if (c == '{' || c == '[')
+        depth++;
+      else if (c == '}' || c == ']')
+        {
+          if (--depth < 0)
+            min = -1;
+          else if (!depth && min > 0)
+            min = 0;
+        }
+      else if (!depth && !min && c != '\n')
+        min = -1; // after the end
+    }
+  fclose (dat.fh);
+  if (first == '{' && !depth && !in_string && !min)
+    pass ("dwg_write_geojson: %ld bytes", size);
+  else
+    fail ("dwg_write_geojson: unbalanced, depth %d", depth);
+}
+
+int
+main (int argc, char *argv[])
+{
+  char *input = getenv ("INPUT");
+  struct stat attrib;
+  Dwg_Data dwg;
+  int error;
+
+  geojson_type_tests ();
+  geojson_lwpolyline_tests ();
+
+  if (!input)
+    input = (char *)"example_2000.dwg";
+  if (stat (input, &attrib))
+    {
+      fprintf (stderr, "Env var INPUT not defined, %s not found\n", input);
+      return EXIT_FAILURE;
+    }
+  memset (&dwg, 0, sizeof (Dwg_Data));
+  error = dwg_read_file (input, &dwg);
+  if (error >= DWG_ERR_CRITICAL)
+    {
+      fail ("dwg_read_file %s", input);
+      return 1;
+    }
+  geojson_entities_tests (&dwg);
+  geojson_write_tests (&dwg);
+  dwg_free (&dwg);
+  return 0;
+}
@@ -0,0 +1,171 @@
+#include "../../src/common.h"
+#include "../../src/out_json.c"
+
+#include <sys/stat.h>
+#include <dejagnu.h>
+
+/* the fewest %g digits which read back as d */
+static int
+shortest_g (char *s, size_t size, double d)
+{
+  int prec, len = 0;
+  for (prec = 1; prec <= 17; prec++)
+    {
+      len = snprintf (s, size, "%.*g", prec, d);
+      if (strtod (s, NULL) == d)
+        break;
+    }
+  return len;
+}
+
+/* json_double into the buffer writer, read back with strtod */
+static int
+double_ok (double d, unsigned int *bad)
+{
+  char t[32];
+  char *end;
+  int len;
+
+  out.len = 0;
+  json_double (d);
+  json_write ("", 1);
+  if (out.error || strtod (out.buf, &end) != d || *end)
+    {
+      if ((*bad)++ < 5)
+        fail ("json_double %.17g: %s", d, out.buf);
+      return 0;
+    }
+  if (d == (double)(BITCODE_RLL)d)
+    return 1;
+  len = shortest_g (t, sizeof (t), d);
+  if (len < (int)strlen (out.buf))
+    {
+      if ((*bad)++ < 5)
+        fail ("json_double %.17g: %s, shorter %s", d, out.buf, t);
+      return 0;
+    }
+  return 1;
+}
+
+static void
+json_double_tests (void)
+{
+  static const double values[] = {
+    0.0,     -0.0,   1.0,     -42.0,        0.1,
+    0.3,     1e-5,   1e21,    1.0 / 3.0,    -123.456,
+    5e-324,  1e-310, DBL_MIN, DBL_MAX,      9007199254740993.0,
+    1e15,    0.1 + 0.2,       2.2250738585072009e-308,
+  };
+  unsigned int i, num = 0, bad = 0;
+  uint64_t x = 88172645463325252ULL;
+
+  if (json_writer_init (NULL, 0))
+    {
+      fail ("json_writer_init");
+      return;
+    }
+  for (i = 0; i < sizeof (values) / sizeof (values[0]); i++, num++)
+    double_ok (values[i], &bad);
+  // random bits, without NaN and Inf
+  for (i = 0; i < 100000; i++)
+    {
+      double d;
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      memcpy (&d, &x, sizeof (d));
+      if (d != d || d - d != 0.0)
+        continue;
+      double_ok (d, &bad);
+      num++;
+    }
+  if (!bad)
+    pass ("json_double round-trips shortest: %u values", num);
+
+  // no NaN and Infinity in JSON
+  out.len = 0;
+  json_double (NAN);
+  json_write (",", 1);
+  json_double (INFINITY);
+  json_write (",", 1);
+  json_double (-INFINITY);
+  if (out.len == 14 && !memcmp (out.buf, "null,null,null", 14))
+    pass ("json_double NaN and Infinity as null");
+  else
+    fail ("json_double NaN and Infinity: %.*s", (int)out.len, out.buf);
+  json_writer_end ();
+}
+
+/* dwg_write_json_buffer writes the same as dwg_write_json into a file */
+static void
+json_buffer_tests (Dwg_Data *dwg, const char *when)
+{
+  Bit_Chain dat, fdat;
+  char *text = NULL;
+  long size;
+  int ok = 0;
+
+  memset (&dat, 0, sizeof (Bit_Chain));
+  memset (&fdat, 0, sizeof (Bit_Chain));
+  dat.version = dat.from_version = dwg->header.version;
+  fdat.version = fdat.from_version = dwg->header.version;
+  if (dwg_write_json_buffer (&dat, dwg) || !dat.chain)
+    {
+      fail ("%s: dwg_write_json_buffer", when);
+      return;
+    }
+  if (dat.chain[dat.byte] || strlen ((char *)dat.chain) != dat.byte
+      || dat.byte >= dat.size)
+    fail ("%s: dwg_write_json_buffer not terminated at %lu", when,
+          (unsigned long)dat.byte);
+
+  fdat.fh = tmpfile ();
+  if (fdat.fh && !dwg_write_json (&fdat, dwg)
+      && (size = ftell (fdat.fh)) >= 0)
+    {
+      text = (char *)malloc (size + 1);
+      rewind (fdat.fh);
+      if (text && fread (text, 1, size, fdat.fh) == (size_t)size)
+        ok = (size_t)size == dat.byte && !memcmp (text, dat.chain, size);
+    }
+  if (ok)
+    pass ("%s: dwg_write_json_buffer as dwg_write_json: %lu bytes", when,
+          (unsigned long)dat.byte);
+  else
+    fail ("%s: dwg_write_json_buffer differs from dwg_write_json", when);
+  if (fdat.fh)
+    fclose (fdat.fh);
+  free (text);
+  dwg_free_mem (dat.chain);
+}
+
+int
+main (int argc, char *argv[])
+{
+  char *input = getenv ("INPUT");
+  struct stat attrib;
+  Dwg_Data dwg;
+  int error;
+
+  json_double_tests ();
+
+  if (!input)
+    input = (char *)"example_2000.dwg";
+  if (stat (input, &attrib))
+    {
+      fprintf (stderr, "Env var INPUT not defined, %s not found\n", input);
+      return EXIT_FAILURE;
+    }
+  memset (&dwg, 0, sizeof (Dwg_Data));
+  error = dwg_read_file (input, &dwg);
+  if (error >= DWG_ERR_CRITICAL)
+    {
+      fail ("dwg_read_file %s", input);
+      return 1;
+    }
+  json_buffer_tests (&dwg, "indented");
+  dwg.opts |= 0x80;
+  json_buffer_tests (&dwg, "compact");
+  dwg_free (&dwg);
+  return 0;
+}
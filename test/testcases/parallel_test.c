@@ -0,0 +1,195 @@
+#include "../../src/config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <dejagnu.h>
+#include "dwg.h"
+#include "../../src/common.h"
+#include "../../src/bits.h"
+#include "../../src/out_json.h"
+
+/* The warnings and errors of a decode, one line each */
+typedef struct
+{
+  char **lines;
+  unsigned int num;
+  unsigned int size;
+  char line[1024];
+  size_t len;
+} Log_Lines;
+
+/* from the warning on, the serial log may have more before it */
+static void
+log_line (Log_Lines *log)
+{
+  char *msg;
+  log->line[log->len] = '\0';
+  if ((msg = strstr (log->line, "Warning: "))
+      || (msg = strstr (log->line, "ERROR: ")))
+    {
+      if (log->num == log->size)
+        {
+          log->size = log->size ? 2 * log->size : 64;
+          log->lines
+              = (char **)realloc (log->lines, log->size * sizeof (char *));
+        }
+      log->lines[log->num++] = strdup (msg);
+    }
+  log->len = 0;
+}
+
+static void
+log_callback (void *data, const char *msg, size_t len)
+{
+  Log_Lines *log = (Log_Lines *)data;
+  size_t i;
+  for (i = 0; i < len; i++)
+    {
+      if (msg[i] == '\n')
+        log_line (log);
+      else if (log->len + 1 < sizeof (log->line))
+        log->line[log->len++] = msg[i];
+    }
+}
+
+static int
+cmp_lines (const void *a, const void *b)
+{
+  return strcmp (*(char *const *)a, *(char *const *)b);
+}
+
+static void
+free_lines (Log_Lines *log)
+{
+  unsigned int i;
+  for (i = 0; i < log->num; i++)
+    free (log->lines[i]);
+  free (log->lines);
+}
+
+/* The JSON of dwg, with the same options for both */
+static char *
+json (Dwg_Data *dwg, size_t *size)
+{
+  Bit_Chain dat;
+  const unsigned int opts = dwg->opts;
+
+  memset (&dat, 0, sizeof (Bit_Chain));
+  dat.version = dat.from_version = dwg->header.version;
+  dwg->opts = 0;
+  if (dwg_write_json_buffer (&dat, dwg))
+    dat.chain = NULL;
+  dwg->opts = opts;
+  *size = dat.byte;
+  return (char *)dat.chain;
+}
+
+/* Decodes input at loglevel INFO, which keeps the objects in their
+   order serially, and at ERROR, in parallel with OpenMP. Both must
+   give the same objects, JSON and warnings. */
+static void
+parallel_tests (const char *input)
+{
+  Dwg_Data serial, parallel;
+  Log_Lines slog, plog;
+  char *sjson, *pjson;
+  size_t ssize, psize;
+  BITCODE_BL i, bad = 0;
+  unsigned int j;
+
+  memset (&serial, 0, sizeof (Dwg_Data));
+  memset (&parallel, 0, sizeof (Dwg_Data));
+  memset (&slog, 0, sizeof (Log_Lines));
+  memset (&plog, 0, sizeof (Log_Lines));
+  serial.opts = 2;
+  parallel.opts = 1;
+  dwg_set_log_callback (&serial, log_callback, &slog);
+  dwg_set_log_callback (&parallel, log_callback, &plog);
+  if (dwg_read_file (input, &serial) >= DWG_ERR_CRITICAL
+      || dwg_read_file (input, &parallel) >= DWG_ERR_CRITICAL)
+    {
+      fail ("dwg_read_file %s", input);
+      dwg_free (&serial);
+      dwg_free (&parallel);
+      free_lines (&slog);
+      free_lines (&plog);
+      return;
+    }
+
+  if (serial.num_objects != parallel.num_objects)
+    {
+      fail ("%s: %u objects serially, %u in parallel", input,
+            serial.num_objects, parallel.num_objects);
+      bad++;
+    }
+  for (i = 0; i < serial.num_objects && i < parallel.num_objects; i++)
+    {
+      const Dwg_Object *s = &serial.object[i], *p = &parallel.object[i];
+      if ((s->type != p->type || s->fixedtype != p->fixedtype
+           || s->handle.value != p->handle.value || s->address != p->address
+           || s->size != p->size || s->bitsize != p->bitsize)
+          && bad++ < 3)
+        fail ("%s: object %u differs in parallel", input, i);
+    }
+  if (!bad)
+    pass ("%s: %u objects decoded in parallel as serially", input,
+          serial.num_objects);
+
+  sjson = json (&serial, &ssize);
+  pjson = json (&parallel, &psize);
+  if (sjson && pjson && ssize == psize && !memcmp (sjson, pjson, ssize))
+    pass ("%s: the same JSON in parallel, %lu bytes", input,
+          (unsigned long)ssize);
+  else
+    fail ("%s: other JSON in parallel", input);
+  dwg_free_mem (sjson);
+  dwg_free_mem (pjson);
+
+  // the same warnings, in any order
+  qsort (slog.lines, slog.num, sizeof (char *), cmp_lines);
+  qsort (plog.lines, plog.num, sizeof (char *), cmp_lines);
+  for (j = 0; j < slog.num && j < plog.num; j++)
+    if (strcmp (slog.lines[j], plog.lines[j]))
+      break;
+  if (slog.num == plog.num && j == slog.num)
+    pass ("%s: the same %u warnings in parallel", input, slog.num);
+  else
+    fail ("%s: %u warnings serially, %u in parallel, first other: %s",
+          input, slog.num, plog.num,
+          j < plog.num ? plog.lines[j] : j < slog.num ? slog.lines[j] : "");
+
+  dwg_free (&serial);
+  dwg_free (&parallel);
+  free_lines (&slog);
+  free_lines (&plog);
+}
+
+int
+main (int argc, char *argv[])
+{
+  static const char *inputs[] = {
+    "../test-data/example_2004.dwg",
+    "../test-data/example_2018.dwg",
+  };
+  char *input = getenv ("INPUT");
+  struct stat attrib;
+  unsigned int i;
+
+  if (input)
+    {
+      parallel_tests (input);
+      return 0;
+    }
+  for (i = 0; i < sizeof (inputs) / sizeof (inputs[0]); i++)
+    {
+      if (stat (inputs[i], &attrib))
+        {
+          fprintf (stderr, "%s not found\n", inputs[i]);
+          return EXIT_FAILURE;
+        }
+      parallel_tests (inputs[i]);
+    }
+  return 0;
+}
@@ -0,0 +1,142 @@
+#include "../../src/config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <dejagnu.h>
+#include "dwg.h"
+
+static int
+has_owner (const Dwg_Referrer *r, BITCODE_BL num, BITCODE_BL owner)
+{
+  BITCODE_BL j;
+  for (j = 0; j < num; j++)
+    if (r[j].owner == owner)
+      return 1;
+  return 0;
+}
+
+/* A referrer: the handle of its object, 0 for the header, and code */
+typedef struct
+{
+  unsigned long handle;
+  unsigned int code;
+} Expected_Referrer;
+
+/* exactly the expected referrers of handle, in any order */
+static void
+referrers_are (Dwg_Data *dwg, unsigned long handle,
+               const Expected_Referrer *expected, BITCODE_BL num_expected)
+{
+  const Dwg_Referrer *r;
+  unsigned char used[64];
+  BITCODE_BL i, j, num;
+
+  r = dwg_referrers (dwg, handle, &num);
+  if (num != num_expected || num > sizeof (used))
+    {
+      fail ("referrers of %lX: %u, expected %u", handle, (unsigned)num,
+            (unsigned)num_expected);
+      return;
+    }
+  memset (used, 0, sizeof (used));
+  for (i = 0; i < num_expected; i++)
+    {
+      for (j = 0; j < num; j++)
+        {
+          const unsigned long h = r[j].owner == DWG_REFERRER_HEADER
+                                      ? 0
+                                      : dwg->object[r[j].owner].handle.value;
+          if (!used[j] && h == expected[i].handle
+              && r[j].code == expected[i].code)
+            break;
+        }
+      if (j == num)
+        {
+          fail ("referrers of %lX: %lX code %u missing", handle,
+                expected[i].handle, expected[i].code);
+          return;
+        }
+      used[j] = 1;
+    }
+  pass ("referrers of %lX: %u", handle, (unsigned)num);
+}
+
+/* the known referrers in example_2000.dwg */
+static void
+known_referrers_tests (Dwg_Data *dwg)
+{
+  // the header and the block headers
+  static const Expected_Referrer block_control[]
+      = { { 0, 3 },     { 0x1F, 4 },  { 0x50, 4 },
+          { 0x55, 4 },  { 0x17D, 4 }, { 0x1B8, 4 } };
+  // *Model_Space: the header, its control and its layout
+  static const Expected_Referrer mspace[]
+      = { { 0, 5 }, { 0x1, 3 }, { 0x22, 4 } };
+  // ByLayer: LTYPE_BYLAYER and CELTYPE, and its control
+  static const Expected_Referrer bylayer[]
+      = { { 0, 5 }, { 0, 5 }, { 0x5, 3 } };
+  // the header and the layers
+  static const Expected_Referrer layer_control[]
+      = { { 0, 3 }, { 0x10, 4 }, { 0x89, 4 }, { 0x8A, 4 } };
+
+  referrers_are (dwg, 0x1, block_control, 6);
+  referrers_are (dwg, 0x1F, mspace, 3);
+  referrers_are (dwg, 0x15, bylayer, 3);
+  referrers_are (dwg, 0x2, layer_control, 4);
+}
+
+int
+main (int argc, char *argv[])
+{
+  char *input = getenv ("INPUT");
+  struct stat attrib;
+  Dwg_Data dwg;
+  BITCODE_BL i, num, bad = 0;
+  int error, known = !input;
+
+  if (!input)
+    input = (char *)"example_2000.dwg";
+  if (stat (input, &attrib))
+    {
+      fprintf (stderr, "Env var INPUT not defined, %s not found\n", input);
+      return EXIT_FAILURE;
+    }
+
+  memset (&dwg, 0, sizeof (Dwg_Data));
+  dwg.opts = DWG_OPTS_REFERRERS; // build the reverse index while decoding
+  error = dwg_read_file (input, &dwg);
+  if (error >= DWG_ERR_CRITICAL)
+    {
+      fail ("dwg_read_file %s", input);
+      return 1;
+    }
+  if (!dwg.referrers_start)
+    fail ("referrers index not built");
+
+  // every resolved handle is found from its target
+  for (i = 0; i < dwg.num_object_refs; i++)
+    {
+      const Dwg_Object_Ref *ref = dwg.object_ref[i];
+      const Dwg_Referrer *r;
+      if (!ref || !ref->obj)
+        continue;
+      r = dwg_referrers (&dwg, ref->obj->handle.value, &num);
+      if (!has_owner (r, num, dwg.object_ref_owner[i]) && bad++ < 5)
+        fail ("object_ref[%u] owner %u not in referrers of %lX", (unsigned)i,
+              (unsigned)dwg.object_ref_owner[i], ref->obj->handle.value);
+    }
+  if (!bad)
+    pass ("dwg_referrers of %u refs", (unsigned)dwg.num_object_refs);
+
+  if (known)
+    known_referrers_tests (&dwg);
+  if (!dwg_referrers (&dwg, 0xFFFFFF, &num) && !num)
+    pass ("no referrers of an unknown handle");
+  else
+    fail ("referrers of an unknown handle: %u", (unsigned)num);
+
+  dwg_free (&dwg);
+  return 0;
+}
@@ -0,0 +1,196 @@
+#include "../../src/config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+
+#include <dejagnu.h>
+#include "dwg.h"
+
+typedef struct
+{
+  char *found; // per object[] index
+  BITCODE_BL num;
+} Hits;
+
+static int
+collect (Dwg_Object *obj, void *data)
+{
+  Hits *hits = (Hits *)data;
+  hits->found[obj->index]++;
+  hits->num++;
+  return 0;
+}
+
+static int
+intersects (const Dwg_Bbox *a, const Dwg_Bbox *b)
+{
+  return a->min.x <= b->max.x && a->max.x >= b->min.x && a->min.y <= b->max.y
+         && a->max.y >= b->min.y && a->min.z <= b->max.z
+         && a->max.z >= b->min.z;
+}
+
+static double
+dist_to (const Dwg_Bbox *b, const BITCODE_2RD *pt)
+{
+  double dx = fmax (fmax (b->min.x - pt->x, pt->x - b->max.x), 0.0);
+  double dy = fmax (fmax (b->min.y - pt->y, pt->y - b->max.y), 0.0);
+  return sqrt (dx * dx + dy * dy);
+}
+
+/* Compare the queries of the tree against a scan of its leaves */
+static int
+check_queries (Dwg_Data *dwg, const Dwg_RTree *tree, const Dwg_Bbox *all)
+{
+  Hits hits;
+  BITCODE_BL i, q;
+  int errors = 0;
+
+  hits.found = (char *)calloc (dwg->num_objects, 1);
+  for (q = 0; q < 20; q++)
+    {
+      Dwg_Bbox bb;
+      BITCODE_2RD pt;
+      Dwg_Object *near[5];
+      double dist[5];
+      BITCODE_BL expect = 0, k;
+      const double w = all->max.x - all->min.x, h = all->max.y - all->min.y;
+      const double fx = (q * 37 % 20) / 20.0, fy = (q * 53 % 20) / 20.0;
+
+      bb.min.x = all->min.x + fx * w;
+      bb.min.y = all->min.y + fy * h;
+      bb.max.x = bb.min.x + w * 0.3;
+      bb.max.y = bb.min.y + h * 0.3;
+      bb.min.z = -HUGE_VAL;
+      bb.max.z = HUGE_VAL;
+      memset (hits.found, 0, dwg->num_objects);
+      hits.num = 0;
+      dwg_query_bbox (dwg, &dwg->object[tree->block], &bb, collect, &hits);
+      for (i = 0; i < tree->num_items; i++)
+        {
+          int in = intersects (&tree->boxes[i], &bb);
+          expect += in;
+          if (in && hits.found[tree->indices[i]] != 1)
+            errors++;
+        }
+      if (hits.num != expect)
+        errors++;
+
+      pt.x = bb.min.x;
+      pt.y = bb.max.y;
+      if (dwg_query_nearest (dwg, &dwg->object[tree->block], &pt, 5, near,
+                             dist, &k)
+          || k != (tree->num_items < 5 ? tree->num_items : 5))
+        errors++;
+      for (i = 0; i < k; i++)
+        {
+          BITCODE_BL j, closer = 0;
+          if (i && dist[i] < dist[i - 1])
+            errors++;
+          for (j = 0; j < tree->num_items; j++)
+            if (dist_to (&tree->boxes[j], &pt) < dist[i])
+              closer++;
+          if (closer > i)
+            errors++;
+        }
+    }
+  free (hits.found);
+  return errors;
+}
+
+int
+main (int argc, char *argv[])
+{
+  char *input = getenv ("INPUT");
+  struct stat attrib;
+  Dwg_Data dwg;
+  const Dwg_RTree *tree;
+  Dwg_Bbox model;
+  BITCODE_BL i, num = 0;
+  unsigned char *buf;
+  size_t size;
+  int error;
+
+  if (!input)
+    input = (char *)"example_2000.dwg";
+  if (stat (input, &attrib))
+    {
+      fprintf (stderr, "Env var INPUT not defined, %s not found\n", input);
+      return EXIT_FAILURE;
+    }
+
+  memset (&dwg, 0, sizeof (Dwg_Data));
+  error = dwg_read_file (input, &dwg);
+  if (error >= DWG_ERR_CRITICAL)
+    {
+      fail ("dwg_read_file %s", input);
+      return 1;
+    }
+  if (dwg_build_rtrees (&dwg))
+    fail ("dwg_build_rtrees");
+  tree = dwg_rtree (&dwg, NULL);
+  if (!tree)
+    {
+      fail ("no model space rtree");
+      return 1;
+    }
+  // the union of the model space entities in the tree
+  model.min.x = model.min.y = model.min.z = HUGE_VAL;
+  model.max.x = model.max.y = model.max.z = -HUGE_VAL;
+  for (i = 0; i < dwg.num_objects; i++)
+    {
+      const Dwg_Object *obj = &dwg.object[i];
+      const Dwg_Bbox *b;
+      if (obj->supertype != DWG_SUPERTYPE_ENTITY
+          || obj->fixedtype == DWG_TYPE_BLOCK
+          || obj->tio.entity->entity_mode != 2
+          || obj->tio.entity->extents_state != 1)
+        continue;
+      b = &obj->tio.entity->extents;
+      model.min.x = fmin (model.min.x, b->min.x);
+      model.min.y = fmin (model.min.y, b->min.y);
+      model.min.z = fmin (model.min.z, b->min.z);
+      model.max.x = fmax (model.max.x, b->max.x);
+      model.max.y = fmax (model.max.y, b->max.y);
+      model.max.z = fmax (model.max.z, b->max.z);
+      num++;
+    }
+  if (tree->num_items == num && num)
+    pass ("model space rtree: %u entities", (unsigned)num);
+  else
+    fail ("model space rtree: %u entities, expected %u",
+          (unsigned)tree->num_items, (unsigned)num);
+  if (tree->num_boxes
+      && !memcmp (&tree->boxes[tree->num_boxes - 1], &model, sizeof (model)))
+    pass ("rtree root is the model extents");
+  else
+    fail ("rtree root is not the model extents");
+
+  error = check_queries (&dwg, tree, &model);
+  if (error)
+    fail ("dwg_query_bbox, dwg_query_nearest: %d errors", error);
+  else
+    pass ("dwg_query_bbox, dwg_query_nearest");
+
+  size = dwg_rtree_serialize (tree, NULL, 0);
+  buf = (unsigned char *)malloc (size);
+  if (dwg_rtree_serialize (tree, buf, size) != size)
+    fail ("dwg_rtree_serialize");
+  dwg_free_rtrees (&dwg);
+  if (dwg_rtree_deserialize (&dwg, buf, size - 1) == 0)
+    fail ("dwg_rtree_deserialize accepted a short buffer");
+  error = dwg_rtree_deserialize (&dwg, buf, size);
+  tree = dwg_rtree (&dwg, NULL);
+  if (!error && tree && tree->num_items == num
+      && !memcmp (buf + size - tree->num_boxes * sizeof (BITCODE_BL),
+                  tree->indices, tree->num_boxes * sizeof (BITCODE_BL))
+      && !check_queries (&dwg, tree, &model))
+    pass ("dwg_rtree_deserialize");
+  else
+    fail ("dwg_rtree_deserialize");
+  free (buf);
+
+  dwg_free (&dwg);
+  return 0;
+}
@@ -0,0 +1,421 @@
+#include "../../src/config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <dejagnu.h>
+#include "dwg.h"
+#include "../../src/common.h"
+
+#ifndef M_PI
+# define M_PI 3.14159265358979323846
+#endif
+
+/* the chord tolerance of all tests */
+#define TOL 0.01
+/* the rounding error of the points on the curve */
+#define EPS 1e-9
+
+static Dwg_Data dwg;
+static Dwg_Object obj;
+static Dwg_Object_Entity ent;
+static Dwg_Tessellation tess;
+
+/* obj as entity of type, its fields in _obj */
+static void
+set_obj (int type, void *_obj)
+{
+  memset (&obj, 0, sizeof (obj));
+  memset (&ent, 0, sizeof (ent));
+  obj.parent = &dwg;
+  obj.supertype = DWG_SUPERTYPE_ENTITY;
+  obj.type = obj.fixedtype = type;
+  obj.tio.entity = &ent;
+  ent.tio.ARC = (Dwg_Entity_ARC *)_obj;
+}
+
+static int
+tessellate (const char *what)
+{
+  int error = dwg_tessellate (&obj, TOL, &tess);
+  if (error || !tess.num_points || tess.num_parts != 1)
+    {
+      fail ("%s: dwg_tessellate error %d, %u points, %u parts", what, error,
+            tess.num_points, tess.num_parts);
+      return 0;
+    }
+  return 1;
+}
+
+static int
+near (double a, double b, double eps)
+{
+  return fabs (a - b) <= eps * (1.0 + fabs (b));
+}
+
+static int
+point_is (BITCODE_BL i, double x, double y, double z)
+{
+  return near (tess.x[i], x, EPS) && near (tess.y[i], y, EPS)
+         && near (tess.z[i], z, EPS);
+}
+
+/* All points on the circle c, r in the z plane, at angles from a0 by
+   sweep, and the chords within TOL of the arc */
+static void
+circle_ok (const char *what, double cx, double cy, double cz, double r,
+           double a0, double sweep)
+{
+  BITCODE_BL i, bad = 0;
+  double prev = 0.0;
+
+  for (i = 0; i < tess.num_points; i++)
+    {
+      const double dx = tess.x[i] - cx, dy = tess.y[i] - cy;
+      // the angle from a0, counterclockwise for sweep > 0
+      double a = atan2 (dy, dx) - a0;
+      if (sweep < 0.0)
+        a = -a;
+      while (a < -EPS)
+        a += 2 * M_PI;
+      if (i && a < prev - EPS)
+        a += 2 * M_PI;
+      if (!near (hypot (dx, dy), r, EPS) || !near (tess.z[i], cz, EPS)
+          || a > fabs (sweep) + EPS || (i && a < prev - EPS))
+        {
+          if (bad++ < 3)
+            fail ("%s: point %u (%g, %g, %g) off the arc", what, i,
+                  tess.x[i], tess.y[i], tess.z[i]);
+        }
+      if (i)
+        {
+          const double mx = (tess.x[i - 1] + tess.x[i]) / 2.0 - cx;
+          const double my = (tess.y[i - 1] + tess.y[i]) / 2.0 - cy;
+          if (r - hypot (mx, my) > TOL * (1.0 + EPS) && bad++ < 3)
+            fail ("%s: chord %u off by %g", what, i, r - hypot (mx, my));
+        }
+      prev = a;
+    }
+  if (!near (prev, fabs (sweep), 1e-6) && bad++ < 3)
+    fail ("%s: ends at %g, not %g", what, prev, fabs (sweep));
+  if (!bad)
+    pass ("%s: %u points", what, tess.num_points);
+}
+
+static void
+arc_tests (void)
+{
+  Dwg_Entity_CIRCLE circle;
+  Dwg_Entity_ARC arc;
+
+  memset (&circle, 0, sizeof (circle));
+  circle.center.x = 1.0;
+  circle.center.y = 2.0;
+  circle.center.z = 3.0;
+  circle.radius = 5.0;
+  circle.extrusion.z = 1.0;
+  set_obj (DWG_TYPE_CIRCLE, &circle);
+  if (tessellate ("CIRCLE"))
+    {
+      if (!tess.closed[0] || !point_is (0, 6.0, 2.0, 3.0)
+          || !point_is (tess.num_points - 1, 6.0, 2.0, 3.0))
+        fail ("CIRCLE: not closed at (6, 2, 3)");
+      circle_ok ("CIRCLE", 1.0, 2.0, 3.0, 5.0, 0.0, 2 * M_PI);
+    }
+
+  memset (&arc, 0, sizeof (arc));
+  arc.radius = 2.0;
+  arc.start_angle = 0.0;
+  arc.end_angle = M_PI / 2;
+  arc.extrusion.z = 1.0;
+  set_obj (DWG_TYPE_ARC, &arc);
+  if (tessellate ("ARC"))
+    {
+      if (tess.closed[0] || !point_is (0, 2.0, 0.0, 0.0)
+          || !point_is (tess.num_points - 1, 0.0, 2.0, 0.0))
+        fail ("ARC: not from (2, 0) to (0, 2)");
+      circle_ok ("ARC", 0.0, 0.0, 0.0, 2.0, 0.0, M_PI / 2);
+    }
+
+  // over 0, counterclockwise from 270 to 45 degrees
+  arc.center.x = -1.0;
+  arc.radius = 100.0;
+  arc.start_angle = 3 * M_PI / 2;
+  arc.end_angle = M_PI / 4;
+  if (tessellate ("ARC over 0"))
+    circle_ok ("ARC over 0", -1.0, 0.0, 0.0, 100.0, 3 * M_PI / 2,
+               3 * M_PI / 4);
+}
+
+/* the semicircles of bulge 1 and -1 from (0, 0) to (2, 0) */
+static void
+bulge_tests (void)
+{
+  Dwg_Entity_LWPOLYLINE pline;
+  BITCODE_2RD points[3] = { { 0.0, 0.0 }, { 2.0, 0.0 }, { 2.0, 1.0 } };
+  BITCODE_BD bulges[3] = { 1.0, 0.0, 0.0 };
+
+  memset (&pline, 0, sizeof (pline));
+  pline.elevation = 0.5;
+  pline.extrusion.z = 1.0;
+  pline.num_points = 2;
+  pline.points = points;
+  pline.num_bulges = 2;
+  pline.bulges = bulges;
+  set_obj (DWG_TYPE_LWPOLYLINE, &pline);
+  // counterclockwise, below the chord
+  if (tessellate ("LWPOLYLINE bulge 1"))
+    circle_ok ("LWPOLYLINE bulge 1", 1.0, 0.0, 0.5, 1.0, M_PI, M_PI);
+  // clockwise, above
+  bulges[0] = -1.0;
+  if (tessellate ("LWPOLYLINE bulge -1"))
+    circle_ok ("LWPOLYLINE bulge -1", 1.0, 0.0, 0.5, 1.0, M_PI, -M_PI);
+
+  // a quarter circle, the tangent of 22.5 degrees, then straight
+  bulges[0] = tan (M_PI / 8);
+  pline.num_points = pline.num_bulges = 3;
+  if (tessellate ("LWPOLYLINE bulge"))
+    {
+      BITCODE_BL n = tess.num_points;
+      if (n < 4 || !point_is (n - 2, 2.0, 0.0, 0.5)
+          || !point_is (n - 1, 2.0, 1.0, 0.5))
+        fail ("LWPOLYLINE bulge: not straight to (2, 1)");
+      else
+        {
+          // the arc only
+          tess.num_points--;
+          circle_ok ("LWPOLYLINE bulge", 1.0, 1.0, 0.5, sqrt (2.0),
+                     5 * M_PI / 4, M_PI / 2);
+        }
+    }
+}
+
+/* the points on the ellipse x^2/9 + y^2/2.25 = 1, rotated by 90 degrees
+   around z, and the chords within TOL of it */
+static void
+ellipse_tests (void)
+{
+  Dwg_Entity_ELLIPSE ellipse;
+  BITCODE_BL i, bad = 0;
+
+  memset (&ellipse, 0, sizeof (ellipse));
+  ellipse.center.x = 10.0;
+  ellipse.center.z = 1.0;
+  ellipse.sm_axis.y = 3.0;
+  ellipse.extrusion.z = 1.0;
+  ellipse.axis_ratio = 0.5;
+  ellipse.start_angle = 0.0;
+  ellipse.end_angle = 2 * M_PI;
+  set_obj (DWG_TYPE_ELLIPSE, &ellipse);
+  if (!tessellate ("ELLIPSE"))
+    return;
+  if (!tess.closed[0] || !point_is (0, 10.0, 3.0, 1.0)
+      || !point_is (tess.num_points - 1, 10.0, 3.0, 1.0))
+    fail ("ELLIPSE: not closed at (10, 3, 1)");
+  for (i = 0; i < tess.num_points; i++)
+    {
+      // the major axis along y, the minor along -x
+      const double u = tess.y[i] / 3.0, v = -(tess.x[i] - 10.0) / 1.5;
+      if (!near (u * u + v * v, 1.0, EPS) || !near (tess.z[i], 1.0, EPS))
+        {
+          if (bad++ < 3)
+            fail ("ELLIPSE: point %u (%g, %g) off", i, tess.x[i], tess.y[i]);
+        }
+      else if (i)
+        {
+          // the chord midpoint, to the ellipse along its ray
+          const double mu = (tess.y[i - 1] + tess.y[i]) / 6.0;
+          const double mv = -((tess.x[i - 1] + tess.x[i]) / 2.0 - 10.0) / 1.5;
+          const double f = 1.0 / sqrt (mu * mu + mv * mv) - 1.0;
+          const double d = f * hypot (3.0 * mu, 1.5 * mv);
+          if (d > TOL * (1.0 + EPS) && bad++ < 3)
+            fail ("ELLIPSE: chord %u off by %g", i, d);
+        }
+    }
+  if (!bad)
+    pass ("ELLIPSE: %u points", tess.num_points);
+
+  // the arc from the minor axis to the negative major axis
+  ellipse.start_angle = M_PI / 2;
+  ellipse.end_angle = M_PI;
+  if (tessellate ("ELLIPSE arc"))
+    {
+      if (tess.closed[0] || !point_is (0, 8.5, 0.0, 1.0)
+          || !point_is (tess.num_points - 1, 10.0, -3.0, 1.0))
+        fail ("ELLIPSE arc: not from (8.5, 0) to (10, -3)");
+      else
+        pass ("ELLIPSE arc: %u points", tess.num_points);
+    }
+}
+
+/* The distance of the parabola y = x^2 at the middle of the chord from
+   x0 to x1 from it */
+static double
+parabola_chord (double x0, double x1)
+{
+  const double s = x0 + x1; // the slope of the chord
+  return (x1 - x0) * (x1 - x0) / 4.0 / sqrt (1.0 + s * s);
+}
+
+static void
+nurbs_tests (void)
+{
+  Dwg_Entity_SPLINE spline;
+  // the quarter circle, rational quadratic
+  Dwg_SPLINE_control_point quarter[3] = {
+    { NULL, 1.0, 0.0, 0.0, 1.0 },
+    { NULL, 1.0, 1.0, 0.0, 0.70710678118654752440 },
+    { NULL, 0.0, 1.0, 0.0, 1.0 },
+  };
+  double quarter_knots[6] = { 0.0, 0.0, 0.0, 1.0, 1.0, 1.0 };
+  // y = x^2 by a cubic B-spline of 3 spans, its control points at the
+  // Greville abscissae and the blossoms of x^2
+  Dwg_SPLINE_control_point parabola[6] = {
+    { NULL, 0.0, 0.0, 0.0, 1.0 },       { NULL, 1.0 / 3, 0.0, 0.0, 1.0 },
+    { NULL, 1.0, 2.0 / 3, 0.0, 1.0 },   { NULL, 2.0, 11.0 / 3, 0.0, 1.0 },
+    { NULL, 8.0 / 3, 7.0, 0.0, 1.0 },   { NULL, 3.0, 9.0, 0.0, 1.0 },
+  };
+  double parabola_knots[10] = { 0, 0, 0, 0, 1, 2, 3, 3, 3, 3 };
+  BITCODE_BL i, bad = 0;
+
+  memset (&spline, 0, sizeof (spline));
+  spline.degree = 2;
+  spline.weighted = 1;
+  spline.rational = 1;
+  spline.num_ctrl_pts = 3;
+  spline.ctrl_pts = quarter;
+  spline.num_knots = 6;
+  spline.knots = quarter_knots;
+  set_obj (DWG_TYPE_SPLINE, &spline);
+  if (tessellate ("SPLINE rational"))
+    {
+      if (!point_is (0, 1.0, 0.0, 0.0)
+          || !point_is (tess.num_points - 1, 0.0, 1.0, 0.0))
+        fail ("SPLINE rational: not from (1, 0) to (0, 1)");
+      circle_ok ("SPLINE rational", 0.0, 0.0, 0.0, 1.0, 0.0, M_PI / 2);
+    }
+
+  memset (&spline, 0, sizeof (spline));
+  spline.degree = 3;
+  spline.num_ctrl_pts = 6;
+  spline.ctrl_pts = parabola;
+  spline.num_knots = 10;
+  spline.knots = parabola_knots;
+  if (!tessellate ("SPLINE"))
+    return;
+  if (!point_is (0, 0.0, 0.0, 0.0)
+      || !point_is (tess.num_points - 1, 3.0, 9.0, 0.0))
+    fail ("SPLINE: not from (0, 0) to (3, 9)");
+  for (i = 0; i < tess.num_points; i++)
+    {
+      const double x = tess.x[i];
+      if (!near (tess.y[i], x * x, EPS) || (i && x <= tess.x[i - 1]))
+        {
+          if (bad++ < 3)
+            fail ("SPLINE: point %u (%g, %g) off", i, x, tess.y[i]);
+        }
+      else if (i && parabola_chord (tess.x[i - 1], x) > TOL * (1.0 + EPS)
+               && bad++ < 3)
+        fail ("SPLINE: chord %u off by %g", i,
+              parabola_chord (tess.x[i - 1], x));
+    }
+  if (!bad)
+    pass ("SPLINE: %u points", tess.num_points);
+}
+
+/* The interpolation error of 32 fit points on a circle of radius 10,
+   about the 4th power of their distance by the 4th derivative / 384 */
+#define FIT_ERROR 1e-4
+
+/* without control points, through the fit points */
+static void
+fit_tests (void)
+{
+  Dwg_Entity_SPLINE spline;
+  Dwg_SPLINE_point fit[32];
+  BITCODE_BL i, j, bad = 0;
+
+  // on a line, at uneven distances
+  memset (&spline, 0, sizeof (spline));
+  for (i = 0; i < 4; i++)
+    {
+      fit[i].parent = NULL;
+      fit[i].x = (double)(i * i);
+      fit[i].y = 2.0 * i * i;
+      fit[i].z = 1.0;
+    }
+  spline.degree = 3;
+  spline.num_fit_pts = 4;
+  spline.fit_pts = fit;
+  set_obj (DWG_TYPE_SPLINE, &spline);
+  if (tessellate ("SPLINE fit line"))
+    {
+      for (i = 0; i < tess.num_points; i++)
+        if ((!near (tess.y[i], 2.0 * tess.x[i], EPS)
+             || !near (tess.z[i], 1.0, EPS)
+             || (i && tess.x[i] <= tess.x[i - 1]))
+            && bad++ < 3)
+          fail ("SPLINE fit line: point %u (%g, %g, %g) off", i, tess.x[i],
+                tess.y[i], tess.z[i]);
+      if (!point_is (tess.num_points - 1, 9.0, 18.0, 1.0) && bad++ < 3)
+        fail ("SPLINE fit line: not to (9, 18, 1)");
+      if (!bad)
+        pass ("SPLINE fit line: %u points", tess.num_points);
+    }
+
+  // closed, on a circle
+  bad = 0;
+  for (i = 0; i < 32; i++)
+    {
+      fit[i].x = 10.0 * cos (i * M_PI / 16);
+      fit[i].y = 10.0 * sin (i * M_PI / 16);
+      fit[i].z = 0.0;
+    }
+  spline.num_fit_pts = 32;
+  spline.closed_b = 1;
+  if (!tessellate ("SPLINE fit circle"))
+    return;
+  if (!tess.closed[0] || !point_is (tess.num_points - 1, 10.0, 0.0, 0.0))
+    fail ("SPLINE fit circle: not closed at (10, 0)");
+  // through all fit points, in order
+  for (i = j = 0; i < tess.num_points && j < 32; i++)
+    if (point_is (i, fit[j].x, fit[j].y, fit[j].z))
+      j++;
+  if (j < 32)
+    {
+      fail ("SPLINE fit circle: not through fit point %u", j);
+      bad++;
+    }
+  for (i = 0; i < tess.num_points; i++)
+    {
+      if (fabs (hypot (tess.x[i], tess.y[i]) - 10.0) > FIT_ERROR
+          && bad++ < 3)
+        fail ("SPLINE fit circle: point %u off by %g", i,
+              hypot (tess.x[i], tess.y[i]) - 10.0);
+      if (i)
+        {
+          const double mx = (tess.x[i - 1] + tess.x[i]) / 2.0;
+          const double my = (tess.y[i - 1] + tess.y[i]) / 2.0;
+          if (10.0 - hypot (mx, my) > TOL + FIT_ERROR && bad++ < 3)
+            fail ("SPLINE fit circle: chord %u off by %g", i,
+                  10.0 - hypot (mx, my));
+        }
+    }
+  if (!bad)
+    pass ("SPLINE fit circle: %u points", tess.num_points);
+}
+
+int
+main (int argc, char *argv[])
+{
+  memset (&dwg, 0, sizeof (dwg));
+  dwg.header.version = R_2000;
+  arc_tests ();
+  bulge_tests ();
+  ellipse_tests ();
+  nurbs_tests ();
+  fit_tests ();
+  dwg_free_tessellation (&tess);
+  return 0;
+}
@@ -95,6 +95,7 @@ api_process(dwg_object *obj)
    {
      for ( i = 0; i < lwpline->num_bulges; i++ )
        printf("bulge[%d] of lwpline : %f\n", (int)i, bulges[i]);
+     dwg_free_mem(bulges);
    }
   else
    {
@@ -108,6 +109,7 @@ api_process(dwg_object *obj)
      for ( i = 0; i < lwpline->num_points ; i++ )
        printf("point[%d] of lwpline : x = %f\ty = %f\n",
               (int)i, points[i].x, points[i].y);
+     dwg_free_mem(points);
    }
   else
    {
@@ -121,6 +123,7 @@ api_process(dwg_object *obj)
      for ( i = 0; i < lwpline->num_widths ; i++ )
        printf("widths[%d] of lwpline : x = %f\ty = %f\n",
               (int)i, width[i].start, width[i].end);
+     dwg_free_mem(width);
    }
   else
    {